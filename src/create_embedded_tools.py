@@ -42,6 +42,10 @@ output_paths = [
     ('*def_parser.exe', lambda x: 'tools/def_parser/def_parser.exe'),
     ('*zipper.exe', lambda x: 'tools/zip/zipper/zipper.exe'),
     ('*zipper', lambda x: 'tools/zip/zipper/zipper'),
+    ('*src/tools/grep-includes/grep-includes',
+     lambda x: 'tools/cpp/grep_includes/grep-includes'),
+    ('*src/tools/build_interface_so/build_interface_so',
+     lambda x: 'tools/cpp/interface_so/build_interface_so'),
     ('*third_party/jarjar/BUILD.tools', lambda x: 'third_party/jarjar/BUILD'),
     ('*third_party/jarjar/LICENSE', lambda x: 'third_party/jarjar/LICENSE'),
     ('*src/objc_tools/*',
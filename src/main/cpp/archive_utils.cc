@@ -13,6 +13,9 @@
 // limitations under the License.
 #include "src/main/cpp/archive_utils.h"
 
+#include <algorithm>
+#include <set>
+#include <utility>
 #include <vector>
 
 #include "src/main/cpp/blaze_util_platform.h"
@@ -20,6 +23,7 @@
 #include "src/main/cpp/util/file.h"
 #include "src/main/cpp/util/exit_code.h"
 #include "src/main/cpp/util/logging.h"
+#include "src/main/cpp/util/md5.h"
 #include "src/main/cpp/util/path.h"
 #include "src/main/cpp/util/strings.h"
 #include "third_party/ijar/zip.h"
@@ -165,6 +169,141 @@ class ExtractBlazeZipProcessor : public PureZipExtractorProcessor {
   blaze::embedded_binaries::Dumper *dumper_;
 };
 
+// A PureZipExtractorProcessor to extract the files from the blaze zip into a
+// content-addressed store. Files whose contents are not in the store yet are
+// written to temporary files in it; `Finish` moves them into place and
+// creates the files under `output_dir` from the store.
+class StoreBlazeZipProcessor : public PureZipExtractorProcessor {
+ public:
+  StoreBlazeZipProcessor(const string &output_dir, const string &store_dir,
+                         blaze::embedded_binaries::Dumper *dumper)
+      : output_dir_(output_dir),
+        store_dir_(store_dir),
+        temp_suffix_(".tmp." + GetProcessIdAsString()),
+        dumper_(dumper) {}
+
+  bool AcceptPure(const char *filename,
+                  const devtools_ijar::u4 attr) const override {
+    return !devtools_ijar::zipattr_is_dir(attr);
+  }
+
+  bool Accept(const char *filename, const devtools_ijar::u4 attr) override {
+    return AcceptPure(filename, attr);
+  }
+
+  void Process(const char *filename,
+               const devtools_ijar::u4 attr,
+               const devtools_ijar::u1 *data,
+               const size_t size) override {
+    string key = Md5Of(data, size);
+    files_.push_back(std::make_pair(string(filename), key));
+    if (seen_keys_.insert(key).second && !IsIntactInStore(key, size)) {
+      dumper_->Dump(data, size,
+                    blaze_util::JoinPath(store_dir_, key + temp_suffix_));
+      new_keys_.push_back(key);
+    }
+  }
+
+  // Moves the new files into the store and creates the files in `output_dir`.
+  // Must be called once the dumper has finished writing.
+  void Finish() {
+    for (const string &key : new_keys_) {
+      string temp = blaze_util::JoinPath(store_dir_, key + temp_suffix_);
+      string path = blaze_util::JoinPath(store_dir_, key);
+      // Make sure no other installation can find the file in the store before
+      // it is complete, also after a crash.
+      blaze_util::SyncFile(temp);
+      // Install bases share the file, so none of them must be able to change
+      // it for the others.
+      if (!blaze_util::MakeReadOnly(temp)) {
+        BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+            << "couldn't make '" << temp
+            << "' read-only: " << blaze_util::GetLastErrorString();
+      }
+      int result = blaze_util::RenameDirectory(temp, path);
+      if (result == blaze_util::kRenameDirectoryFailureNotEmpty) {
+        // A concurrent installation stored the same contents first.
+        blaze_util::UnlinkPath(temp);
+      } else if (result != blaze_util::kRenameDirectorySuccess) {
+        BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+            << "couldn't move '" << temp << "' into the install store: "
+            << blaze_util::GetLastErrorString();
+      }
+    }
+    BAZEL_LOG(INFO) << "Extracted " << new_keys_.size() << " of "
+                    << files_.size() << " files into the install store at "
+                    << store_dir_;
+
+    std::set<string> created_dirs;
+    for (const auto &file : files_) {
+      string source = blaze_util::JoinPath(store_dir_, file.second);
+      string target = blaze_util::JoinPath(output_dir_, file.first);
+      string dirname = blaze_util::Dirname(target);
+      if (created_dirs.insert(dirname).second &&
+          !blaze_util::MakeDirectories(dirname, 0777)) {
+        BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+            << "couldn't create '" << dirname
+            << "': " << blaze_util::GetLastErrorString();
+      }
+      if (!blaze_util::CloneOrLinkFile(source, target)) {
+        // E.g. the install base is on a different file system than the store.
+        string contents;
+        if (!blaze_util::ReadFile(source, &contents) ||
+            !blaze_util::WriteFile(contents, target, 0755)) {
+          BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+              << "couldn't copy '" << source << "' to '" << target
+              << "': " << blaze_util::GetLastErrorString();
+        }
+      }
+    }
+  }
+
+ private:
+  static string Md5Of(const void *data, const size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    blaze_util::Md5Digest digest;
+    for (size_t offset = 0; offset < size;) {
+      unsigned int length =
+          static_cast<unsigned int>(std::min<size_t>(size - offset, 1 << 30));
+      digest.Update(bytes + offset, length);
+      offset += length;
+    }
+    unsigned char md5[blaze_util::Md5Digest::kDigestLength];
+    digest.Finish(md5);
+    return digest.String();
+  }
+
+  // Returns whether the store has a file with the contents of the given key.
+  // A file that was changed after it was stored is removed, so that the
+  // contents are stored again.
+  bool IsIntactInStore(const string &key, const size_t size) const {
+    string path = blaze_util::JoinPath(store_dir_, key);
+    if (!blaze_util::PathExists(path)) {
+      return false;
+    }
+    string contents;
+    if (blaze_util::ReadFile(path, &contents) &&
+        contents.size() == size &&
+        Md5Of(contents.data(), contents.size()) == key) {
+      return true;
+    }
+    BAZEL_LOG(WARNING) << "Replacing the modified file '" << path
+                       << "' in the install store";
+    blaze_util::UnlinkPath(path);
+    return false;
+  }
+
+  const string output_dir_;
+  const string store_dir_;
+  const string temp_suffix_;
+  blaze::embedded_binaries::Dumper *dumper_;
+  // The names of the files in the archive and the keys of their contents.
+  vector<std::pair<string, string>> files_;
+  std::set<string> seen_keys_;
+  // The keys of the contents that are written to the store.
+  vector<string> new_keys_;
+};
+
 // A ZipExtractorProcessor that reads the contents of the build-label.txt file
 // from the archive.
 class GetBuildLabelFileProcessor
@@ -230,7 +369,8 @@ void DetermineArchiveContents(
 void ExtractArchiveOrDie(const string &archive_path,
                          const string &product_name,
                          const string &expected_install_md5,
-                         const string &output_dir) {
+                         const string &output_dir,
+                         const string &store_dir) {
   std::string install_md5;
   GetInstallKeyFileProcessor install_key_processor(&install_md5);
 
@@ -242,14 +382,24 @@ void ExtractArchiveOrDie(const string &archive_path,
   }
   ExtractBlazeZipProcessor extract_blaze_processor(output_dir,
                                                    dumper.get());
-
-  CompoundZipProcessor processor({&extract_blaze_processor,
-                                  &install_key_processor});
+  StoreBlazeZipProcessor store_blaze_processor(output_dir, store_dir,
+                                               dumper.get());
+
+  CompoundZipProcessor processor(
+      {store_dir.empty()
+           ? static_cast<PureZipExtractorProcessor *>(&extract_blaze_processor)
+           : &store_blaze_processor,
+       &install_key_processor});
   if (!blaze_util::MakeDirectories(output_dir, 0777)) {
     BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
         << "couldn't create '" << output_dir
         << "': " << blaze_util::GetLastErrorString();
   }
+  if (!store_dir.empty() && !blaze_util::MakeDirectories(store_dir, 0777)) {
+    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+        << "couldn't create '" << store_dir
+        << "': " << blaze_util::GetLastErrorString();
+  }
 
   BAZEL_LOG(USER) << "Extracting " << product_name
                   << " installation...";
@@ -260,6 +410,9 @@ void ExtractArchiveOrDie(const string &archive_path,
     BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
         << "Failed to extract embedded binaries: " << error;
   }
+  if (!store_dir.empty()) {
+    store_blaze_processor.Finish();
+  }
 
   if (install_md5 != expected_install_md5) {
     BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
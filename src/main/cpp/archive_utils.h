@@ -30,10 +30,17 @@ void DetermineArchiveContents(const std::string &archive_path,
 // Extracts the embedded data files in `archive_path` into `output_dir`.
 // Fails if `expected_install_md5` doesn't match that contained in the archive,
 // as this could indicate that the contents has unexpectedly changed.
+//
+// If `store_dir` is not empty, the contents of the files are written to the
+// content-addressed store in that directory instead, named by their MD5, and
+// the files in `output_dir` are clones of or hard links to the files in the
+// store. Files that are in the store already are not extracted again, so
+// installations of different versions share their identical files.
 void ExtractArchiveOrDie(const std::string &archive_path,
                          const std::string &product_name,
                          const std::string &expected_install_md5,
-                         const std::string &output_dir);
+                         const std::string &output_dir,
+                         const std::string &store_dir);
 
 // Retrieves the build label (version string) from `archive_path` into
 // `build_label`.
@@ -794,6 +794,102 @@ static void EnsurePreviousServerProcessTerminated(
   }
 }
 
+// Splits the server command line into the arguments to start a server zygote
+// with, which must not depend on the output base or the workspace, and the
+// JVM flags and server arguments that are only passed to the zygote when it is
+// claimed for an output base. Returns false if the JVM flags depend on the
+// output base in a way a zygote cannot apply once it is running.
+static bool GetServerZygoteArgs(const vector<string> &server_exe_args,
+                                const StartupOptions &startup_options,
+                                vector<string> *zygote_args,
+                                vector<string> *claim_jvm_args,
+                                vector<string> *claim_server_args) {
+  // JVM flags end with "-jar <server jar>", see AddJVMArgumentSuffix().
+  auto jar = std::find(server_exe_args.begin(), server_exe_args.end(), "-jar");
+  if (server_exe_args.empty() || jar == server_exe_args.end() ||
+      jar + 1 == server_exe_args.end()) {
+    return false;
+  }
+
+  const string output_base =
+      blaze_util::PathAsJvmFlag(startup_options.output_base);
+  zygote_args->push_back(startup_options.GetLowercaseProductName() +
+                         "(zygote)");
+  for (auto it = server_exe_args.begin() + 1; it != jar; ++it) {
+    const string &arg = *it;
+    if (arg.find(output_base + "/") == string::npos &&
+        !blaze_util::ends_with(arg, output_base)) {
+      zygote_args->push_back(arg);
+    } else if ((blaze_util::starts_with(arg, "-D") &&
+                arg.find('=') != string::npos) ||
+               blaze_util::starts_with(arg, "-XX:HeapDumpPath=")) {
+      // System properties and manageable VM options, which the zygote can
+      // apply once it is running, e.g. the logging configuration.
+      claim_jvm_args->push_back(arg);
+    } else {
+      BAZEL_LOG(INFO) << "Not using a server zygote because of JVM flag "
+                      << arg;
+      return false;
+    }
+  }
+  zygote_args->insert(zygote_args->end(), jar, jar + 2);
+  claim_server_args->assign(jar + 2, server_exe_args.end());
+  return true;
+}
+
+// Returns a string that identifies the environment a server is started with.
+// Leaves out the variables that the shell sets for its working directory, so
+// that the servers of different workspaces can share a zygote.
+static string GetServerZygoteEnvironmentKey(
+    const map<string, EnvVarValue> &env) {
+  string result;
+  for (const auto &var : env) {
+    if (var.first == "PWD" || var.first == "OLDPWD" || var.first == "_") {
+      continue;
+    }
+    result.append(var.first);
+    if (var.second.action == EnvVarAction::SET) {
+      result.append("=").append(var.second.value);
+    }
+    result.push_back('\0');
+  }
+  return result;
+}
+
+// Starts a server zygote in zygote_base in the background, unless one is
+// already parked there or still starting up.
+static void StartServerZygoteIfMissing(const string &server_exe,
+                                       const vector<string> &zygote_args,
+                                       const map<string, EnvVarValue> &env,
+                                       const string &zygote_base,
+                                       const StartupOptions &startup_options) {
+  const string zygote_dir = blaze_util::JoinPath(zygote_base, "server");
+  if (!blaze_util::MakeDirectories(zygote_dir, 0700)) {
+    BAZEL_LOG(WARNING) << "server zygote directory '" << zygote_dir
+                       << "' could not be created: " << GetLastErrorString();
+    return;
+  }
+
+  // The PID file of a zygote is removed when it is claimed.
+  const int zygote_pid = GetServerPid(zygote_dir);
+  if (zygote_pid > 0 && VerifyServerProcess(zygote_pid, zygote_base)) {
+    return;
+  }
+
+  vector<string> args = zygote_args;
+  args.push_back("--zygote_base=" + blaze_util::ConvertPath(zygote_base));
+  args.push_back("--max_idle_secs=" + ToString(startup_options.max_idle_secs));
+
+  BAZEL_LOG(INFO) << "Starting server zygote in " << zygote_base;
+  BlazeServerStartup *zygote_startup;
+  ExecuteDaemon(server_exe, args, env,
+                blaze_util::JoinPath(zygote_dir, "jvm.out"),
+                /* daemon_output_append= */ false,
+                GetEmbeddedBinariesRoot(startup_options.install_base),
+                zygote_dir, startup_options, &zygote_startup);
+  delete zygote_startup;
+}
+
 // Starts up a new server and connects to it. Exits if it didn't work out.
 static void StartServerAndConnect(
     const string &server_exe,
@@ -839,20 +935,59 @@ static void StartServerAndConnect(
   SetScheduling(startup_options.batch_cpu_scheduling,
                 startup_options.io_nice_level);
 
-  BAZEL_LOG(USER) << "Starting local " << startup_options.product_name
-                  << " server and connecting to it...";
+  const map<string, EnvVarValue> jvm_env = PrepareEnvironmentForJvm();
+
+  // Zygotes are shared by all output bases that start their server with the
+  // same JVM, install base, JVM flags, environment and scheduling.
+  vector<string> zygote_args, claim_jvm_args, claim_server_args;
+  const bool use_zygote =
+      startup_options.server_zygote &&
+      GetServerZygoteArgs(server_exe_args, startup_options, &zygote_args,
+                          &claim_jvm_args, &claim_server_args);
+  string zygote_base;
+  if (use_zygote) {
+    zygote_base = GetHashedBaseDir(
+        blaze_util::JoinPath(startup_options.output_user_root, "zygote"),
+        server_exe + "\n" + GetArgumentString(zygote_args) + "\n" +
+            ToString(startup_options.batch_cpu_scheduling) + " " +
+            ToString(startup_options.io_nice_level) + "\n" +
+            GetServerZygoteEnvironmentKey(jvm_env));
+  }
+
   BlazeServerStartup *server_startup;
-  const int server_pid = ExecuteDaemon(
-      server_exe, server_exe_args, PrepareEnvironmentForJvm(),
-      server->ProcessInfo().jvm_log_file_,
-      server->ProcessInfo().jvm_log_file_append_,
-      GetEmbeddedBinariesRoot(startup_options.install_base), server_dir,
-      startup_options, &server_startup);
+  int server_pid = -1;
+  if (use_zygote) {
+    server_pid = ClaimServerZygote(
+        zygote_base, claim_jvm_args, claim_server_args, workspace,
+        server->ProcessInfo().jvm_log_file_,
+        server->ProcessInfo().jvm_log_file_append_, server_dir,
+        &server_startup);
+  }
+  if (server_pid > 0) {
+    BAZEL_LOG(USER) << "Connecting to pre-started local "
+                    << startup_options.product_name << " server...";
+  } else {
+    BAZEL_LOG(USER) << "Starting local " << startup_options.product_name
+                    << " server and connecting to it...";
+    server_pid = ExecuteDaemon(
+        server_exe, server_exe_args, jvm_env,
+        server->ProcessInfo().jvm_log_file_,
+        server->ProcessInfo().jvm_log_file_append_,
+        GetEmbeddedBinariesRoot(startup_options.install_base), server_dir,
+        startup_options, &server_startup);
+  }
 
   ConnectOrDie(
       option_processor, startup_options, server_pid, server_startup, server);
 
   delete server_startup;
+
+  // Only now, so that the replacement does not compete with the server we
+  // are waiting for.
+  if (use_zygote) {
+    StartServerZygoteIfMissing(server_exe, zygote_args, jvm_env, zygote_base,
+                               startup_options);
+  }
 }
 
 static void MoveFiles(const string &embedded_binaries) {
@@ -926,11 +1061,20 @@ static void ExtractData(
                          blaze::GetProcessIdAsString();
     string tmp_binaries =
         blaze_util::JoinPath(tmp_install, "_embedded_binaries");
+    // The store is shared by the installations of all versions; its files are
+    // named by their contents and never change once they are in place.
+    string store_dir;
+    if (startup_options.shared_install_store) {
+      store_dir = blaze_util::JoinPath(
+          blaze_util::JoinPath(startup_options.output_user_root, "install"),
+          "store");
+    }
     ExtractArchiveOrDie(
         self_path,
         startup_options.product_name,
         expected_install_md5,
-        tmp_binaries);
+        tmp_binaries,
+        store_dir);
     MoveFiles(tmp_binaries);
 
     uint64_t et = GetMillisecondsMonotonic();
@@ -201,8 +201,9 @@ int ConfigureDaemonProcess(posix_spawnattr_t *attrp,
   return posix_spawnattr_set_qos_class_np(attrp, options.macos_qos_class);
 }
 
-void WriteSystemSpecificProcessIdentifier(
+bool WriteSystemSpecificProcessIdentifier(
     const string& server_dir, pid_t server_pid) {
+  return true;
 }
 
 bool VerifyServerProcess(int pid, const string &output_base) {
@@ -161,8 +161,9 @@ int ConfigureDaemonProcess(posix_spawnattr_t *attrp,
   return 0;
 }
 
-void WriteSystemSpecificProcessIdentifier(
+bool WriteSystemSpecificProcessIdentifier(
     const string& server_dir, pid_t server_pid) {
+  return true;
 }
 
 bool VerifyServerProcess(int pid, const string &output_base) {
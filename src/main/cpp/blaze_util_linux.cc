@@ -210,15 +210,13 @@ int ConfigureDaemonProcess(posix_spawnattr_t* attrp,
   return 0;
 }
 
-void WriteSystemSpecificProcessIdentifier(
+bool WriteSystemSpecificProcessIdentifier(
     const string& server_dir, pid_t server_pid) {
   string pid_string = ToString(server_pid);
 
   string start_time;
   if (!GetStartTime(pid_string, &start_time)) {
-    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
-        << "Cannot get start time of process " << pid_string << ": "
-        << GetLastErrorString();
+    return false;
   }
 
   string start_time_file = blaze_util::JoinPath(server_dir, "server.starttime");
@@ -227,6 +225,7 @@ void WriteSystemSpecificProcessIdentifier(
         << "Cannot write start time in server dir " << server_dir << ": "
         << GetLastErrorString();
   }
+  return true;
 }
 
 // On Linux we use a combination of PID and start time to identify the server
@@ -169,6 +169,22 @@ int ExecuteDaemon(const std::string& exe,
                   const StartupOptions &options,
                   BlazeServerStartup** server_startup);
 
+// Claims the server zygote parked in zygote_base, if there is one, and turns
+// it into the server for server_dir: the zygote changes its working directory
+// to "workspace", redirects (and conditionally appends) its output to
+// "daemon_output", applies the JVM flags in jvm_args and runs as a server with
+// the arguments server_args. Like ExecuteDaemon, sets server_startup, writes
+// the PID of the server into server_dir and returns it. Returns -1 if no
+// zygote could be claimed, in which case the caller should start a server.
+int ClaimServerZygote(const std::string& zygote_base,
+                      const std::vector<std::string>& jvm_args,
+                      const std::vector<std::string>& server_args,
+                      const std::string& workspace,
+                      const std::string& daemon_output,
+                      const bool daemon_output_append,
+                      const std::string& server_dir,
+                      BlazeServerStartup** server_startup);
+
 // A character used to separate paths in a list.
 extern const char kListSeparator;
 
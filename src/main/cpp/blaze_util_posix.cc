@@ -19,6 +19,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>  // PATH_MAX
+#include <netinet/in.h>
 #include <poll.h>
 #include <pwd.h>
 #include <signal.h>
@@ -41,6 +42,7 @@
 #include <fstream>
 #include <iterator>
 #include <set>
+#include <sstream>
 #include <string>
 
 #include "src/main/cpp/blaze_util.h"
@@ -341,7 +343,9 @@ bool SocketBlazeServerStartup::IsStillAlive() {
 int ConfigureDaemonProcess(posix_spawnattr_t* attrp,
                            const StartupOptions &options);
 
-void WriteSystemSpecificProcessIdentifier(
+// Records what identifies the server process besides its PID in server_dir.
+// Returns false if the process does not exist anymore.
+bool WriteSystemSpecificProcessIdentifier(
     const string& server_dir, pid_t server_pid);
 
 int ExecuteDaemon(const string& exe,
@@ -424,12 +428,193 @@ int ExecuteDaemon(const string& exe,
   pid_t server_pid;
   pid_reader >> server_pid;
 
-  WriteSystemSpecificProcessIdentifier(server_dir, server_pid);
+  if (!WriteSystemSpecificProcessIdentifier(server_dir, server_pid)) {
+    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+        << "Cannot get start time of process " << server_pid << ": "
+        << GetLastErrorString();
+  }
 
   *server_startup = new SocketBlazeServerStartup(fds[0]);
   return server_pid;
 }
 
+// Written by a server zygote into its server directory once it is ready to be
+// claimed. Contains the PID of the zygote, the port it accepts claims on and
+// the cookie a claim must start with.
+static const char kServerZygoteReadyFile[] = "zygote.ready";
+
+// How long to wait for a claimed zygote to acknowledge the claim.
+static const int kServerZygoteClaimTimeoutMillis = 10000;
+
+// Writes all of "data" to the socket fd. Returns false on error.
+static bool SendAll(int fd, const string& data) {
+#if defined(MSG_NOSIGNAL)
+  const int flags = MSG_NOSIGNAL;
+#else
+  const int flags = 0;
+#endif
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t result = send(fd, data.data() + sent, data.size() - sent, flags);
+    if (result == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    sent += result;
+  }
+  return true;
+}
+
+// Reads a newline-terminated line from the socket fd, without the newline.
+// Reads byte by byte so that nothing after the line is consumed. Returns false
+// on error, on end of file or if no complete line arrives within the timeout.
+static bool ReceiveLine(int fd, int timeout_millis, string* line) {
+  line->clear();
+  while (true) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    int result;
+    do {
+      result = poll(&pfd, 1, timeout_millis);
+    } while (result < 0 && errno == EINTR);
+    if (result <= 0) {
+      return false;
+    }
+    char c;
+    ssize_t bytes_read;
+    do {
+      bytes_read = read(fd, &c, 1);
+    } while (bytes_read < 0 && errno == EINTR);
+    if (bytes_read <= 0) {
+      return false;
+    }
+    if (c == '\n') {
+      return true;
+    }
+    line->push_back(c);
+  }
+}
+
+int ClaimServerZygote(const string& zygote_base,
+                      const std::vector<string>& jvm_args,
+                      const std::vector<string>& server_args,
+                      const string& workspace,
+                      const string& daemon_output,
+                      const bool daemon_output_append,
+                      const string& server_dir,
+                      BlazeServerStartup** server_startup) {
+  const string zygote_dir = blaze_util::JoinPath(zygote_base, "server");
+  const string ready_file =
+      blaze_util::JoinPath(zygote_dir, kServerZygoteReadyFile);
+  const string claimed_file = ready_file + ".claimed." + ToString(getpid());
+
+  // Only one client can move the ready file away, so this is what claims the
+  // zygote. From here on, the zygote is ours: if the claim fails, it is killed.
+  if (rename(ready_file.c_str(), claimed_file.c_str()) == -1) {
+    return -1;
+  }
+  string ready;
+  const bool ready_read = blaze_util::ReadFile(claimed_file, &ready);
+  (void)blaze_util::UnlinkPath(claimed_file);
+  // Let the next client start a replacement.
+  (void)blaze_util::UnlinkPath(
+      blaze_util::JoinPath(zygote_dir, kServerPidFile));
+
+  int zygote_pid = -1;
+  int port = -1;
+  string cookie;
+  std::istringstream ready_reader(ready);
+  ready_reader >> zygote_pid >> port >> cookie;
+  if (!ready_read || ready_reader.fail() || zygote_pid <= 0) {
+    BAZEL_LOG(WARNING) << "Ignoring malformed server zygote file "
+                       << ready_file;
+    return -1;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) {
+    BAZEL_LOG(WARNING) << "socket creation failed: " << GetLastErrorString();
+    return -1;
+  }
+#if defined(SO_NOSIGPIPE)
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) ==
+      -1) {
+    // The zygote died after it became ready.
+    BAZEL_LOG(INFO) << "Could not connect to server zygote (pid=" << zygote_pid
+                    << "): " << GetLastErrorString();
+    close(fd);
+    return -1;
+  }
+
+  // The server reads its PID file on startup, so it has to be in place before
+  // the zygote turns into the server.
+  const string pid_file = blaze_util::JoinPath(server_dir, kServerPidFile);
+  if (!blaze_util::WriteFile(ToString(zygote_pid), pid_file)) {
+    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+        << "Failed to write " << pid_file << ": " << GetLastErrorString();
+  }
+  if (!WriteSystemSpecificProcessIdentifier(server_dir, zygote_pid)) {
+    // The zygote exited after it accepted the connection, e.g. because it was
+    // idle for too long.
+    BAZEL_LOG(INFO) << "Server zygote (pid=" << zygote_pid
+                    << ") exited before it was claimed";
+    close(fd);
+    (void)blaze_util::UnlinkPath(pid_file);
+    return -1;
+  }
+
+  // The claim is a sequence of NUL-terminated strings: the cookie, the working
+  // directory, the output file and whether to append to it, then the JVM flags
+  // and the server arguments, each list terminated by an empty string.
+  string claim;
+  for (const string& field :
+       {cookie, blaze_util::ConvertPath(workspace), daemon_output,
+        string(daemon_output_append ? "1" : "0")}) {
+    claim.append(field).push_back('\0');
+  }
+  for (const string& arg : jvm_args) {
+    claim.append(arg).push_back('\0');
+  }
+  claim.push_back('\0');
+  for (const string& arg : server_args) {
+    claim.append(arg).push_back('\0');
+  }
+  claim.push_back('\0');
+
+  string response;
+  if (!SendAll(fd, claim) ||
+      !ReceiveLine(fd, kServerZygoteClaimTimeoutMillis, &response) ||
+      response != "ok") {
+    BAZEL_LOG(WARNING) << "Server zygote (pid=" << zygote_pid
+                       << ") did not accept the claim"
+                       << (response.empty() ? "" : ": " + response);
+    close(fd);
+    // A replacement zygote may have overwritten the start time file in
+    // zygote_base already, so identify the zygote by the one in server_dir.
+    const string output_base = blaze_util::Dirname(server_dir);
+    if (VerifyServerProcess(zygote_pid, output_base)) {
+      KillServerProcess(zygote_pid, output_base);
+    }
+    (void)blaze_util::UnlinkPath(pid_file);
+    return -1;
+  }
+
+  // The zygote keeps the connection open for as long as it lives.
+  *server_startup = new SocketBlazeServerStartup(fd);
+  return zygote_pid;
+}
+
 string GetHashedBaseDir(const string& root, const string& hashable) {
   unsigned char buf[blaze_util::Md5Digest::kDigestLength];
   blaze_util::Md5Digest digest;
@@ -768,6 +768,19 @@ int ExecuteDaemon(const string& exe,
   return processInfo.dwProcessId;
 }
 
+// Not supported: server zygotes rely on the Unix JNI to redirect their output
+// and change their working directory once claimed.
+int ClaimServerZygote(const string& zygote_base,
+                      const std::vector<string>& jvm_args,
+                      const std::vector<string>& server_args,
+                      const string& workspace,
+                      const string& daemon_output,
+                      const bool daemon_output_append,
+                      const string& server_dir,
+                      BlazeServerStartup** server_startup) {
+  return -1;
+}
+
 // Run the given program in the current working directory, using the given
 // argument vector, wait for it to finish, then exit ourselves with the exitcode
 // of that program.
@@ -101,6 +101,8 @@ StartupOptions::StartupOptions(const string &product_name,
       macos_qos_class(QOS_CLASS_DEFAULT),
 #endif
       unlimit_coredumps(false),
+      shared_install_store(false),
+      server_zygote(false),
       incompatible_enable_execution_transition(false) {
   if (blaze::IsRunningWithinTest()) {
     output_root = blaze_util::MakeAbsolute(blaze::GetPathEnv("TEST_TMPDIR"));
@@ -138,6 +140,8 @@ StartupOptions::StartupOptions(const string &product_name,
   RegisterNullaryStartupFlag("deep_execroot");
   RegisterNullaryStartupFlag("expand_configs_in_place");
   RegisterNullaryStartupFlag("experimental_oom_more_eagerly");
+  RegisterNullaryStartupFlag("experimental_server_zygote");
+  RegisterNullaryStartupFlag("experimental_shared_install_store");
   RegisterNullaryStartupFlag("fatal_event_bus_exceptions");
   RegisterNullaryStartupFlag("host_jvm_debug");
   RegisterNullaryStartupFlag("idle_server_tasks");
@@ -431,6 +435,22 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(
   } else if (GetNullaryOption(arg, "--nounlimit_coredumps")) {
     unlimit_coredumps = false;
     option_sources["unlimit_coredumps"] = rcfile;
+  } else if (GetNullaryOption(arg, "--experimental_server_zygote")) {
+    // We parse this flag on all platforms to ensure that rc files mentioning it
+    // are valid, but server zygotes are only supported on Unix.
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+    server_zygote = true;
+#endif
+    option_sources["experimental_server_zygote"] = rcfile;
+  } else if (GetNullaryOption(arg, "--noexperimental_server_zygote")) {
+    server_zygote = false;
+    option_sources["experimental_server_zygote"] = rcfile;
+  } else if (GetNullaryOption(arg, "--experimental_shared_install_store")) {
+    shared_install_store = true;
+    option_sources["experimental_shared_install_store"] = rcfile;
+  } else if (GetNullaryOption(arg, "--noexperimental_shared_install_store")) {
+    shared_install_store = false;
+    option_sources["experimental_shared_install_store"] = rcfile;
   } else if (GetNullaryOption(arg,
                               "--incompatible_enable_execution_transition")) {
     incompatible_enable_execution_transition = true;
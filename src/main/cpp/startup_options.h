@@ -267,6 +267,16 @@ class StartupOptions {
   // Whether to raise the soft coredump limit to the hard one or not.
   bool unlimit_coredumps;
 
+  // Whether to extract the embedded binaries into a content-addressed store
+  // under output_user_root that installations of all versions share, and to
+  // create the install base from it.
+  bool shared_install_store;
+
+  // Whether to keep a pre-started server process, a zygote, parked per install
+  // base, JVM configuration and environment, and to turn it into the server of
+  // a new output base instead of starting a new JVM for it.
+  bool server_zygote;
+
   // Whether the execution transition is enabled, or behaves like a host
   // transition. This must be set before rule classes are constructed.
   // See https://github.com/bazelbuild/bazel/issues/7935
@@ -142,6 +142,16 @@ bool ReadDirectorySymlink(const std::string &symlink, std::string *result);
 // Returns true on success. In case of failure sets errno.
 bool UnlinkPath(const std::string &file_path);
 
+// Creates `target` as a file with the same contents as the existing file
+// `source` without copying them: as a copy-on-write clone if the file system
+// supports that, as a hard link otherwise. Returns false if neither is
+// possible, e.g. because the paths are on different file systems.
+bool CloneOrLinkFile(const std::string &source, const std::string &target);
+
+// Removes all write permissions of the file `path`. Returns true on success.
+// Has no effect on Windows, where read-only files cannot be deleted.
+bool MakeReadOnly(const std::string &path);
+
 // Returns true if this path exists, following symlinks.
 bool PathExists(const std::string& path);
 
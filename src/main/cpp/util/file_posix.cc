@@ -20,9 +20,17 @@
 #include <limits.h>  // PATH_MAX
 #include <stdlib.h>  // getenv
 #include <string.h>  // strncmp
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <unistd.h>  // access, open, close, fsync
 #include <utime.h>   // utime
+#if defined(__linux__)
+#include <linux/fs.h>  // FICLONE
+#elif defined(__APPLE__) && defined(__has_include)
+#if __has_include(<sys/clonefile.h>)
+#include <sys/clonefile.h>  // clonefile, macOS 10.12 and later
+#endif
+#endif
 
 #include <string>
 #include <vector>
@@ -264,6 +272,40 @@ bool UnlinkPath(const string &file_path) {
   return unlink(file_path.c_str()) == 0;
 }
 
+bool CloneOrLinkFile(const string &source, const string &target) {
+#if defined(CLONE_NOFOLLOW)
+  if (clonefile(source.c_str(), target.c_str(), 0) == 0) {
+    return true;
+  }
+#elif defined(FICLONE)
+  int source_fd = open(source.c_str(), O_RDONLY);
+  struct stat st;
+  if (source_fd != -1 && fstat(source_fd, &st) == 0) {
+    int target_fd = open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL,
+                         st.st_mode & 07777);
+    if (target_fd != -1) {
+      bool cloned = ioctl(target_fd, FICLONE, source_fd) == 0;
+      close(target_fd);
+      if (cloned) {
+        close(source_fd);
+        return true;
+      }
+      unlink(target.c_str());
+    }
+  }
+  if (source_fd != -1) {
+    close(source_fd);
+  }
+#endif
+  return link(source.c_str(), target.c_str()) == 0;
+}
+
+bool MakeReadOnly(const string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 &&
+         chmod(path.c_str(), st.st_mode & 07555) == 0;
+}
+
 bool PathExists(const string& path) {
   return access(path.c_str(), F_OK) == 0;
 }
@@ -432,6 +432,22 @@ bool UnlinkPath(const string& file_path) {
   return UnlinkPathW(wpath);
 }
 
+bool CloneOrLinkFile(const string& source, const string& target) {
+  wstring wsource;
+  wstring wtarget;
+  string error;
+  if (!AsAbsoluteWindowsPath(source, &wsource, &error) ||
+      !AsAbsoluteWindowsPath(target, &wtarget, &error)) {
+    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+        << "CloneOrLinkFile(" << source << ", " << target
+        << "): AsAbsoluteWindowsPath failed: " << error;
+    return false;
+  }
+  return ::CreateHardLinkW(wtarget.c_str(), wsource.c_str(), NULL) == TRUE;
+}
+
+bool MakeReadOnly(const string& path) { return true; }
+
 static bool RealPath(const WCHAR* path, unique_ptr<WCHAR[]>* result = nullptr) {
   // Attempt opening the path, which may be anything -- a file, a directory, a
   // symlink, even a dangling symlink is fine.
@@ -0,0 +1,378 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Derived from the RSA Data Security, Inc. MD5 Message-Digest Algorithm, see
+// md5.cc.
+
+#include "src/main/cpp/util/md5_multi.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+namespace blaze_util {
+
+namespace {
+
+#if defined(__AVX512F__)
+typedef uint32_t Vec __attribute__((vector_size(64)));
+#else
+typedef uint32_t Vec __attribute__((vector_size(32)));
+#endif
+
+const int kLaneCount = sizeof(Vec) / sizeof(uint32_t);
+const size_t kBlockSize = 64;
+// Bytes read from a file at once.
+const size_t kReadSize = 64 * 1024;
+
+const unsigned char kZeroBlock[kBlockSize] = {0};
+
+inline uint32_t LoadLittleEndian32(const unsigned char *p) {
+  return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+         static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+inline void StoreLittleEndian32(uint32_t v, unsigned char *p) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+// The MD5 state of all the lanes.
+struct State {
+  Vec a, b, c, d;
+
+  void Reset(int lane) {
+    a[lane] = 0x67452301;
+    b[lane] = 0xefcdab89;
+    c[lane] = 0x98badcfe;
+    d[lane] = 0x10325476;
+  }
+
+  void Get(int lane, unsigned char digest[16]) const {
+    StoreLittleEndian32(a[lane], digest);
+    StoreLittleEndian32(b[lane], digest + 4);
+    StoreLittleEndian32(c[lane], digest + 8);
+    StoreLittleEndian32(d[lane], digest + 12);
+  }
+
+  // Runs the MD5 transform of one 64-byte block in every lane.
+  void Transform(const unsigned char *const blocks[kLaneCount]);
+};
+
+// The four basic MD5 functions, F as optimized in md5.cc.
+#define F(x, y, z) (z ^ (x & (y ^ z)))
+#define G(x, y, z) F(z, x, y)
+#define H(x, y, z) (x ^ y ^ z)
+#define I(x, y, z) (y ^ (x | ~z))
+
+#define ROTATE_LEFT(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define STEP(f, a, b, c, d, k, s, t) \
+  a += f(b, c, d) + m[k] + t;        \
+  a = ROTATE_LEFT(a, s) + b;
+
+void State::Transform(const unsigned char *const blocks[kLaneCount]) {
+  Vec m[16];
+  for (int i = 0; i < 16; ++i) {
+    for (int lane = 0; lane < kLaneCount; ++lane) {
+      m[i][lane] = LoadLittleEndian32(blocks[lane] + 4 * i);
+    }
+  }
+
+  Vec aa = a, bb = b, cc = c, dd = d;
+
+  STEP(F, aa, bb, cc, dd, 0, 7, 0xd76aa478);
+  STEP(F, dd, aa, bb, cc, 1, 12, 0xe8c7b756);
+  STEP(F, cc, dd, aa, bb, 2, 17, 0x242070db);
+  STEP(F, bb, cc, dd, aa, 3, 22, 0xc1bdceee);
+  STEP(F, aa, bb, cc, dd, 4, 7, 0xf57c0faf);
+  STEP(F, dd, aa, bb, cc, 5, 12, 0x4787c62a);
+  STEP(F, cc, dd, aa, bb, 6, 17, 0xa8304613);
+  STEP(F, bb, cc, dd, aa, 7, 22, 0xfd469501);
+  STEP(F, aa, bb, cc, dd, 8, 7, 0x698098d8);
+  STEP(F, dd, aa, bb, cc, 9, 12, 0x8b44f7af);
+  STEP(F, cc, dd, aa, bb, 10, 17, 0xffff5bb1);
+  STEP(F, bb, cc, dd, aa, 11, 22, 0x895cd7be);
+  STEP(F, aa, bb, cc, dd, 12, 7, 0x6b901122);
+  STEP(F, dd, aa, bb, cc, 13, 12, 0xfd987193);
+  STEP(F, cc, dd, aa, bb, 14, 17, 0xa679438e);
+  STEP(F, bb, cc, dd, aa, 15, 22, 0x49b40821);
+
+  STEP(G, aa, bb, cc, dd, 1, 5, 0xf61e2562);
+  STEP(G, dd, aa, bb, cc, 6, 9, 0xc040b340);
+  STEP(G, cc, dd, aa, bb, 11, 14, 0x265e5a51);
+  STEP(G, bb, cc, dd, aa, 0, 20, 0xe9b6c7aa);
+  STEP(G, aa, bb, cc, dd, 5, 5, 0xd62f105d);
+  STEP(G, dd, aa, bb, cc, 10, 9, 0x02441453);
+  STEP(G, cc, dd, aa, bb, 15, 14, 0xd8a1e681);
+  STEP(G, bb, cc, dd, aa, 4, 20, 0xe7d3fbc8);
+  STEP(G, aa, bb, cc, dd, 9, 5, 0x21e1cde6);
+  STEP(G, dd, aa, bb, cc, 14, 9, 0xc33707d6);
+  STEP(G, cc, dd, aa, bb, 3, 14, 0xf4d50d87);
+  STEP(G, bb, cc, dd, aa, 8, 20, 0x455a14ed);
+  STEP(G, aa, bb, cc, dd, 13, 5, 0xa9e3e905);
+  STEP(G, dd, aa, bb, cc, 2, 9, 0xfcefa3f8);
+  STEP(G, cc, dd, aa, bb, 7, 14, 0x676f02d9);
+  STEP(G, bb, cc, dd, aa, 12, 20, 0x8d2a4c8a);
+
+  STEP(H, aa, bb, cc, dd, 5, 4, 0xfffa3942);
+  STEP(H, dd, aa, bb, cc, 8, 11, 0x8771f681);
+  STEP(H, cc, dd, aa, bb, 11, 16, 0x6d9d6122);
+  STEP(H, bb, cc, dd, aa, 14, 23, 0xfde5380c);
+  STEP(H, aa, bb, cc, dd, 1, 4, 0xa4beea44);
+  STEP(H, dd, aa, bb, cc, 4, 11, 0x4bdecfa9);
+  STEP(H, cc, dd, aa, bb, 7, 16, 0xf6bb4b60);
+  STEP(H, bb, cc, dd, aa, 10, 23, 0xbebfbc70);
+  STEP(H, aa, bb, cc, dd, 13, 4, 0x289b7ec6);
+  STEP(H, dd, aa, bb, cc, 0, 11, 0xeaa127fa);
+  STEP(H, cc, dd, aa, bb, 3, 16, 0xd4ef3085);
+  STEP(H, bb, cc, dd, aa, 6, 23, 0x04881d05);
+  STEP(H, aa, bb, cc, dd, 9, 4, 0xd9d4d039);
+  STEP(H, dd, aa, bb, cc, 12, 11, 0xe6db99e5);
+  STEP(H, cc, dd, aa, bb, 15, 16, 0x1fa27cf8);
+  STEP(H, bb, cc, dd, aa, 2, 23, 0xc4ac5665);
+
+  STEP(I, aa, bb, cc, dd, 0, 6, 0xf4292244);
+  STEP(I, dd, aa, bb, cc, 7, 10, 0x432aff97);
+  STEP(I, cc, dd, aa, bb, 14, 15, 0xab9423a7);
+  STEP(I, bb, cc, dd, aa, 5, 21, 0xfc93a039);
+  STEP(I, aa, bb, cc, dd, 12, 6, 0x655b59c3);
+  STEP(I, dd, aa, bb, cc, 3, 10, 0x8f0ccc92);
+  STEP(I, cc, dd, aa, bb, 10, 15, 0xffeff47d);
+  STEP(I, bb, cc, dd, aa, 1, 21, 0x85845dd1);
+  STEP(I, aa, bb, cc, dd, 8, 6, 0x6fa87e4f);
+  STEP(I, dd, aa, bb, cc, 15, 10, 0xfe2ce6e0);
+  STEP(I, cc, dd, aa, bb, 6, 15, 0xa3014314);
+  STEP(I, bb, cc, dd, aa, 13, 21, 0x4e0811a1);
+  STEP(I, aa, bb, cc, dd, 4, 6, 0xf7537e82);
+  STEP(I, dd, aa, bb, cc, 11, 10, 0xbd3af235);
+  STEP(I, cc, dd, aa, bb, 2, 15, 0x2ad7d2bb);
+  STEP(I, bb, cc, dd, aa, 9, 21, 0xeb86d391);
+
+  a += aa;
+  b += bb;
+  c += cc;
+  d += dd;
+}
+
+#undef F
+#undef G
+#undef H
+#undef I
+#undef ROTATE_LEFT
+#undef STEP
+
+// A message being hashed in a lane, either in memory or read from a file.
+struct Message {
+  size_t index;
+  int fd;                     // -1 for in-memory messages
+  const unsigned char *data;  // the bytes not hashed yet
+  size_t available;           // the number of bytes at data
+  uint64_t length;            // the number of bytes hashed so far
+  bool eof;
+  int error;
+  // The final one or two padded blocks, once the input is exhausted.
+  unsigned char tail[2 * kBlockSize];
+  int tail_blocks;
+  int tail_next;
+  std::vector<unsigned char> buffer;
+};
+
+// Feeds messages to the lanes, one after the other, in the order of their
+// indexes.
+class Scheduler {
+ public:
+  Scheduler(size_t count, const void *const *data, const size_t *lengths,
+            const char *const *paths)
+      : count_(count), next_(0), data_(data), lengths_(lengths),
+        paths_(paths) {}
+
+  // Hashes all the messages, storing their digests and errors.
+  void Run(unsigned char *digests, int *errors);
+
+ private:
+  // Starts the next message in "message", returns false if there is none.
+  bool Start(Message *message);
+
+  // Returns the next block of "message", or NULL if it is complete.
+  const unsigned char *NextBlock(Message *message);
+
+  // Reads from the file until a block is available or the end is reached.
+  void Fill(Message *message);
+
+  size_t count_;
+  size_t next_;
+  const void *const *data_;
+  const size_t *lengths_;
+  const char *const *paths_;
+};
+
+bool Scheduler::Start(Message *message) {
+  if (next_ == count_) {
+    return false;
+  }
+  message->index = next_++;
+  message->fd = -1;
+  message->length = 0;
+  message->eof = true;
+  message->error = 0;
+  message->tail_blocks = 0;
+  message->tail_next = 0;
+  if (paths_ == NULL) {
+    message->data = static_cast<const unsigned char *>(data_[message->index]);
+    message->available = lengths_[message->index];
+    return true;
+  }
+
+  message->data = NULL;
+  message->available = 0;
+  int fd;
+  while ((fd = open(paths_[message->index], O_RDONLY)) == -1 &&
+         errno == EINTR) {
+  }
+  if (fd == -1) {
+    message->error = errno;
+    return true;
+  }
+  message->fd = fd;
+  message->eof = false;
+  message->buffer.resize(kReadSize);
+  return true;
+}
+
+void Scheduler::Fill(Message *message) {
+  unsigned char *buffer = &message->buffer[0];
+  memmove(buffer, message->data, message->available);
+  message->data = buffer;
+  while (!message->eof && message->available < kBlockSize) {
+    ssize_t len = read(message->fd, buffer + message->available,
+                       kReadSize - message->available);
+    if (len == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      message->error = errno;
+      message->eof = true;
+    } else if (len == 0) {
+      message->eof = true;
+    } else {
+      message->available += len;
+    }
+  }
+  if (message->eof) {
+    close(message->fd);
+    message->fd = -1;
+  }
+}
+
+const unsigned char *Scheduler::NextBlock(Message *message) {
+  if (message->error != 0) {
+    return NULL;
+  }
+  if (message->available < kBlockSize && !message->eof) {
+    Fill(message);
+    if (message->error != 0) {
+      return NULL;
+    }
+  }
+  if (message->available >= kBlockSize) {
+    const unsigned char *block = message->data;
+    message->data += kBlockSize;
+    message->available -= kBlockSize;
+    message->length += kBlockSize;
+    return block;
+  }
+
+  if (message->tail_blocks == 0) {
+    // Pad the rest of the message with a 1 bit, zeros and its length in bits.
+    size_t rest = message->available;
+    message->length += rest;
+    message->tail_blocks = rest < kBlockSize - 8 ? 1 : 2;
+    size_t tail_size = message->tail_blocks * kBlockSize;
+    memcpy(message->tail, message->data, rest);
+    message->tail[rest] = 0x80;
+    memset(message->tail + rest + 1, 0, tail_size - rest - 1);
+    uint64_t bits = message->length << 3;
+    StoreLittleEndian32(bits, message->tail + tail_size - 8);
+    StoreLittleEndian32(bits >> 32, message->tail + tail_size - 4);
+    message->available = 0;
+  }
+  if (message->tail_next == message->tail_blocks) {
+    return NULL;
+  }
+  return message->tail + kBlockSize * message->tail_next++;
+}
+
+void Scheduler::Run(unsigned char *digests, int *errors) {
+  Message messages[kLaneCount];
+  bool active[kLaneCount];
+  State state;
+  for (int lane = 0; lane < kLaneCount; ++lane) {
+    active[lane] = Start(&messages[lane]);
+    state.Reset(lane);
+  }
+
+  const unsigned char *blocks[kLaneCount];
+  while (true) {
+    bool any_active = false;
+    for (int lane = 0; lane < kLaneCount; ++lane) {
+      blocks[lane] = kZeroBlock;
+      while (active[lane]) {
+        Message *message = &messages[lane];
+        const unsigned char *block = NextBlock(message);
+        if (block != NULL) {
+          blocks[lane] = block;
+          any_active = true;
+          break;
+        }
+        // The message is complete: the state holds its digest.
+        state.Get(lane, digests + 16 * message->index);
+        if (errors != NULL) {
+          errors[message->index] = message->error;
+        }
+        if (message->fd != -1) {
+          close(message->fd);
+        }
+        state.Reset(lane);
+        active[lane] = Start(message);
+      }
+    }
+    if (!any_active) {
+      break;
+    }
+    state.Transform(blocks);
+  }
+}
+
+}  // namespace
+
+const int Md5MultiDigest::kLanes = kLaneCount;
+
+void Md5MultiDigest::Digest(const void *const *data, const size_t *lengths,
+                            size_t count, unsigned char *digests) {
+  Scheduler(count, data, lengths, NULL).Run(digests, NULL);
+}
+
+void Md5MultiDigest::DigestFiles(const char *const *paths, size_t count,
+                                 unsigned char *digests, int *errors) {
+  Scheduler(count, NULL, NULL, paths).Run(digests, errors);
+}
+
+}  // namespace blaze_util
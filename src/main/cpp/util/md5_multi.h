@@ -0,0 +1,50 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_UTIL_MD5_MULTI_H_
+#define BAZEL_SRC_MAIN_CPP_UTIL_MD5_MULTI_H_
+
+#include <stddef.h>
+
+namespace blaze_util {
+
+// Computes the MD5 digests of many independent messages at once, each one in
+// its own lane of the SIMD registers. The 64 steps of an MD5 block depend on
+// each other, so this is the only way to use the vector units when hashing
+// lots of small files; a single message is better hashed by Md5Digest.
+//
+// The lane count follows the vector width the code is compiled for: 16 with
+// AVX-512, 8 otherwise (one AVX2 register, or two SSE2 or NEON registers).
+// Requires the GCC vector extensions, which Clang supports too.
+class Md5MultiDigest {
+ public:
+  // The number of messages hashed in parallel.
+  static const int kLanes;
+
+  // Computes the digests of the "count" messages data[i] of lengths[i] bytes
+  // into the 16 bytes at digests + 16 * i.
+  static void Digest(const void *const *data, const size_t *lengths,
+                     size_t count, unsigned char *digests);
+
+  // Computes the digests of the "count" files at paths[i], following symbolic
+  // links, into the 16 bytes at digests + 16 * i. Files are read in chunks, so
+  // they can be of any size. Sets errors[i] to zero on success, or to the
+  // errno of the failed open(2) or read(2) call.
+  static void DigestFiles(const char *const *paths, size_t count,
+                          unsigned char *digests, int *errors);
+};
+
+}  // namespace blaze_util
+
+#endif  // BAZEL_SRC_MAIN_CPP_UTIL_MD5_MULTI_H_
@@ -12,8 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_ZIP_HEADERS_H_
-#define BAZEL_SRC_TOOLS_SINGLEJAR_ZIP_HEADERS_H_
+#ifndef BAZEL_SRC_MAIN_CPP_UTIL_ZIP_HEADERS_H_
+#define BAZEL_SRC_MAIN_CPP_UTIL_ZIP_HEADERS_H_
 
 /*
  * Zip file headers, as described in .ZIP File Format Specification
@@ -659,4 +659,197 @@ static_assert(56 == sizeof(ECD64), "ECD64 class fields layout is incorrect.");
 
 #undef attr_packed
 
-#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_ZIP_HEADERS_H_
+/* Central Directory of a Zip file mapped into memory. This is how all Zip
+ * readers in the tree (singlejar, ijar, zipper and the client) locate the
+ * entries of an archive:
+ *   CentralDirectory cen;
+ *   const char *error = cen.locate(start, end);
+ *   if (error) { fail... }
+ *   for (const CDH *cdh = cen.first(); cdh->is(); cdh = cen.next(cdh)) {
+ *     const LH *lh = cen.local_header(cdh);
+ *     ...
+ *   }
+ *
+ * We want to handle the case where a Jar/Zip file contains a preamble (an
+ * arbitrary data before the first entry) and 'zip -A' was not called to adjust
+ * the offsets, so all the offsets are off by the preamble size. In the 32-bit
+ * case (that is, there is no ECD64Locator+ECD64), ECD immediately follows the
+ * last CDH and contains the size of the Central Directory, so the Central
+ * Directory can be found reliably. We then use its stated location, which ECD
+ * contains, too, to calculate the preamble size. In the 64-bit case, there
+ * are ECD64 and ECD64Locator records between the end of the Central Directory
+ * and the ECD, the calculation is similar, with the exception of the logic to
+ * find the actual start of the ECD64. ECD64Locator contains only its position
+ * in the file, which is off by preamble size, but does not contain the actual
+ * size of ECD64, which in theory is variable (the fixed fields may be followed
+ * by some custom data, with the total size saved in ECD64::remaining_size).
+ * We first assume that the custom data is missing, and if there is no ECD64
+ * there, we trust the position in the locator.
+ */
+class CentralDirectory {
+ public:
+  CentralDirectory()
+      : start_(nullptr),
+        end_(nullptr),
+        first_(nullptr),
+        cen_end_(nullptr),
+        preamble_size_(0) {}
+
+  // Locates the Central Directory of the Zip file occupying [start, end).
+  // Returns nullptr on success, or the description of the problem.
+  const char *locate(const uint8_t *start, const uint8_t *end) {
+    if (end < start + sizeof(ECD)) {
+      return "file is too short to be a Zip file";
+    }
+
+    // ECD is followed by at most 64K of comment which runs till the end of
+    // the file.
+    const uint8_t *ecd_min = end - sizeof(ECD) - 0xFFFF;
+    if (ecd_min < start) {
+      ecd_min = start;
+    }
+    for (const uint8_t *ecd_ptr = end - sizeof(ECD); ecd_ptr >= ecd_min;
+         --ecd_ptr) {
+      const ECD *candidate = reinterpret_cast<const ECD *>(ecd_ptr);
+      if (candidate->is() &&
+          candidate->comment() + candidate->comment_length() == end) {
+        return parse(start, end, candidate);
+      }
+    }
+
+    // Some tools append data after the archive without updating the ECD
+    // comment length. Accept the last ECD in the same range whose comment
+    // fits in the file and which describes a consistent Central Directory.
+    for (const uint8_t *ecd_ptr = end - sizeof(ECD); ecd_ptr >= ecd_min;
+         --ecd_ptr) {
+      const ECD *candidate = reinterpret_cast<const ECD *>(ecd_ptr);
+      if (candidate->is() &&
+          candidate->comment_length() <=
+              static_cast<size_t>(end - candidate->comment()) &&
+          parse(start, end, candidate) == nullptr) {
+        return nullptr;
+      }
+    }
+    return "file is invalid or corrupted (missing end of central directory "
+           "record)";
+  }
+
+  // The first Central Directory Header. Like next(), returns a header whose
+  // is() is false once the Central Directory is exhausted.
+  const CDH *first() const { return bounded(ziph::byte_ptr(first_)); }
+
+  // The Central Directory Header following given one. Never points past the
+  // end of the Central Directory, even if the headers are corrupted.
+  const CDH *next(const CDH *cdh) const {
+    return bounded(ziph::byte_ptr(cdh) + cdh->size());
+  }
+
+  // The Local Header of the entry, or nullptr if the Central Directory Header
+  // points outside of the file.
+  const LH *local_header(const CDH *cdh) const {
+    uint64_t offset = cdh->local_header_offset() + preamble_size_;
+    if (offset > static_cast<uint64_t>(end_ - start_) ||
+        end_ - start_ - offset < sizeof(LH)) {
+      return nullptr;
+    }
+    return reinterpret_cast<const LH *>(start_ + offset);
+  }
+
+  // Bytes before the Zip proper.
+  uint64_t preamble_size() const { return preamble_size_; }
+
+ private:
+  // Validates the Central Directory described by given ECD and, if it is
+  // consistent, makes it the current one.
+  const char *parse(const uint8_t *start, const uint8_t *end,
+                    const ECD *ecd) {
+    if (ecd->this_disk_nr() != 0 || ecd->cen_disk_nr() != 0 ||
+        ecd->this_disk_entries16() != ecd->total_entries16()) {
+      return "multi-disk Zip files are not supported";
+    }
+
+    uint64_t cen_size = ecd->cen_size32();
+    uint64_t cen_offset = ecd->cen_offset32();
+    const uint8_t *cen_end = ziph::byte_ptr(ecd);
+    const ECD64Locator *locator = reinterpret_cast<const ECD64Locator *>(
+        ziph::byte_ptr(ecd) - sizeof(ECD64Locator));
+    if (ziph::byte_ptr(locator) >= start && locator->is()) {
+      if (locator->ecd64_disk_nr() != 0 || locator->total_disks() != 1) {
+        return "multi-disk Zip files are not supported";
+      }
+      const ECD64 *ecd64 = reinterpret_cast<const ECD64 *>(
+          ziph::byte_ptr(locator) - sizeof(ECD64));
+      if (ziph::byte_ptr(ecd64) < start || !ecd64->is()) {
+        if (locator->ecd64_offset() > static_cast<uint64_t>(end - start) ||
+            end - start - locator->ecd64_offset() < sizeof(ECD64)) {
+          return "zip64 end of central directory record is missing";
+        }
+        ecd64 = reinterpret_cast<const ECD64 *>(start +
+                                                locator->ecd64_offset());
+        if (!ecd64->is()) {
+          return "zip64 end of central directory record is missing";
+        }
+      }
+      if (ecd64->this_disk_nr() != 0 || ecd64->cen_disk_nr() != 0 ||
+          ecd64->this_disk_entries() != ecd64->total_entries()) {
+        return "multi-disk Zip files are not supported";
+      }
+      cen_size = ecd64->cen_size();
+      cen_offset = ecd64->cen_offset();
+      cen_end = ziph::byte_ptr(ecd64);
+    } else if (ziph::zfield_has_ext64(ecd->cen_size32()) ||
+               ziph::zfield_has_ext64(ecd->cen_offset32())) {
+      return "zip64 end of central directory locator is missing";
+    }
+
+    if (cen_size > static_cast<uint64_t>(cen_end - start)) {
+      return "central directory size is too large";
+    }
+    const uint8_t *cen = cen_end - cen_size;
+    if (cen_offset > static_cast<uint64_t>(cen - start)) {
+      return "central directory location is invalid";
+    }
+    // If the archive is empty, the Central Directory is followed by the
+    // ECD64 or ECD record right away.
+    if (cen_size != 0 && !reinterpret_cast<const CDH *>(cen)->is()) {
+      return "central directory does not start with a central file header";
+    }
+    // Every header has to fit in the Central Directory, so that the readers
+    // can iterate over it without checking the bounds themselves.
+    const uint8_t *p = cen;
+    while (static_cast<size_t>(cen_end - p) >= sizeof(CDH) &&
+           reinterpret_cast<const CDH *>(p)->is()) {
+      size_t size = reinterpret_cast<const CDH *>(p)->size();
+      if (size > static_cast<size_t>(cen_end - p)) {
+        return "central directory header runs past the central directory";
+      }
+      p += size;
+    }
+    start_ = start;
+    end_ = end;
+    first_ = reinterpret_cast<const CDH *>(cen);
+    cen_end_ = cen_end;
+    preamble_size_ = (cen - start) - cen_offset;
+    return nullptr;
+  }
+
+  // The header at given position if it lies within the Central Directory,
+  // otherwise the ECD64 or ECD record following it, which is not a CDH.
+  const CDH *bounded(const uint8_t *p) const {
+    const CDH *cdh = reinterpret_cast<const CDH *>(p);
+    if (p > cen_end_ || static_cast<size_t>(cen_end_ - p) < sizeof(CDH) ||
+        !cdh->is() || cdh->size() > static_cast<size_t>(cen_end_ - p)) {
+      return reinterpret_cast<const CDH *>(cen_end_);
+    }
+    return cdh;
+  }
+
+  const uint8_t *start_;
+  const uint8_t *end_;
+  const CDH *first_;
+  // The ECD64 or ECD record right after the last Central Directory Header.
+  const uint8_t *cen_end_;
+  uint64_t preamble_size_;
+};
+
+#endif  // BAZEL_SRC_MAIN_CPP_UTIL_ZIP_HEADERS_H_
@@ -194,12 +194,12 @@ public final class TestActionBuilder {
     // initialization.
     final boolean isExecutedOnWindows = OS.getCurrent() == OS.WINDOWS;
 
+    final TestConfiguration testConfiguration =
+        ruleContext.getConfiguration().getFragment(TestConfiguration.class);
     final boolean isUsingTestWrapperInsteadOfTestSetupScript =
         isExecutedOnWindows
-            && ruleContext
-                .getConfiguration()
-                .getFragment(TestConfiguration.class)
-                .isUsingWindowsNativeTestWrapper();
+            ? testConfiguration.isUsingWindowsNativeTestWrapper()
+            : testConfiguration.isUsingPosixNativeTestWrapper();
 
     NestedSetBuilder<Artifact> inputsBuilder = NestedSetBuilder.stableOrder();
     inputsBuilder.addTransitive(
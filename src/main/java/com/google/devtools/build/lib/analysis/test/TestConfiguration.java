@@ -231,6 +231,23 @@ public class TestConfiguration extends Fragment {
                 + "tools/test/test-setup.sh as on other platforms. On other platforms: no-op.")
     public boolean windowsNativeTestWrapper;
 
+    @Option(
+        name = "experimental_posix_native_test_wrapper",
+        documentationCategory = OptionDocumentationCategory.TESTING,
+        // Affects loading and analysis: this flag affects which target Bazel loads and creates test
+        // actions with on platforms other than Windows.
+        effectTags = {
+          OptionEffectTag.LOADING_AND_ANALYSIS,
+          OptionEffectTag.TEST_RUNNER,
+        },
+        metadataTags = {OptionMetadataTag.EXPERIMENTAL},
+        defaultValue = "false",
+        help =
+            "On platforms other than Windows: if true, uses the C++ test wrapper "
+                + "(//tools/test:tw) to run tests instead of tools/test/test-setup.sh, and the C++ "
+                + "XML writer instead of tools/test/generate-xml.sh. On Windows: no-op, see "
+                + "--incompatible_windows_native_test_wrapper.")
+    public boolean posixNativeTestWrapper;
 
     @Override
     public FragmentOptions getHost() {
@@ -306,6 +323,10 @@ public class TestConfiguration extends Fragment {
     return options.windowsNativeTestWrapper;
   }
 
+  public boolean isUsingPosixNativeTestWrapper() {
+    return options.posixNativeTestWrapper;
+  }
+
   /**
    * @return number of times the given test should run. If the test doesn't match any of the
    *     filters, runs it once.
@@ -331,6 +331,19 @@ public class BuildRequestOptions extends OptionsBase {
               + "with caution.")
   public boolean useAsyncExecution;
 
+  @Option(
+      name = "experimental_enable_fs_verity_on_outputs",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+      metadataTags = OptionMetadataTag.EXPERIMENTAL,
+      effectTags = {OptionEffectTag.EXECUTION},
+      help =
+          "If set to true, Bazel enables fs-verity on regular output files when it makes them "
+              + "read-only after the action completes, if the file system supports it. The kernel "
+              + "then verifies the contents of outputs on every read, and their fs-verity digests "
+              + "can be queried without reading them.")
+  public boolean enableFsVerityOnOutputs;
+
   @Option(
       name = "incompatible_skip_genfiles_symlink",
       defaultValue = "false",
@@ -487,6 +487,19 @@ public class ExecutionOptions extends OptionsBase {
               + "test log. Otherwise, Bazel generates a test.xml as part of the test action.")
   public boolean splitXmlGeneration;
 
+  @Option(
+      name = "experimental_collapse_runfiles_directories",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.EXECUTION_STRATEGY,
+      effectTags = {OptionEffectTag.EXECUTION},
+      metadataTags = {OptionMetadataTag.EXPERIMENTAL},
+      help =
+          "If set, a directory of a runfiles tree that contains exactly the files of one source "
+              + "directory, e.g. of an external repository, is created as a single symlink to that "
+              + "directory instead of one symlink per file. Files that are added to the source "
+              + "directory afterwards are visible in the runfiles tree until it is rebuilt.")
+  public boolean collapseRunfilesDirectories;
+
   /** Converter for the --flaky_test_attempts option. */
   public static class TestAttemptsConverter extends PerLabelOptions.PerLabelOptionsConverter {
     private static final int MIN_VALUE = 1;
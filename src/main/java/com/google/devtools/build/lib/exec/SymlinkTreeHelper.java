@@ -42,6 +42,7 @@ public final class SymlinkTreeHelper {
   private final Path inputManifest;
   private final Path symlinkTreeRoot;
   private final boolean filesetTree;
+  private final boolean collapseDirectories;
 
   /**
    * Creates SymlinkTreeHelper instance. Can be used independently of SymlinkTreeAction.
@@ -52,9 +53,25 @@ public final class SymlinkTreeHelper {
    *     tree.
    */
   public SymlinkTreeHelper(Path inputManifest, Path symlinkTreeRoot, boolean filesetTree) {
+    this(inputManifest, symlinkTreeRoot, filesetTree, /*collapseDirectories=*/ false);
+  }
+
+  /**
+   * Creates SymlinkTreeHelper instance. Can be used independently of SymlinkTreeAction.
+   *
+   * @param inputManifest exec path to the input runfiles manifest
+   * @param symlinkTreeRoot the root of the symlink tree to be created
+   * @param filesetTree true if this is fileset symlink tree, false if this is a runfiles symlink
+   *     tree.
+   * @param collapseDirectories true if directories that mirror a source directory should be
+   *     created as a single symlink to it. Only applies to runfiles symlink trees.
+   */
+  public SymlinkTreeHelper(
+      Path inputManifest, Path symlinkTreeRoot, boolean filesetTree, boolean collapseDirectories) {
     this.inputManifest = inputManifest;
     this.symlinkTreeRoot = symlinkTreeRoot;
     this.filesetTree = filesetTree;
+    this.collapseDirectories = collapseDirectories;
   }
 
   public Path getOutputManifest() {
@@ -130,6 +147,8 @@ public final class SymlinkTreeHelper {
     if (filesetTree) {
       args.add("--allow_relative");
       args.add("--use_metadata");
+    } else if (collapseDirectories) {
+      args.add("--collapse_directories");
     }
     args.add(inputManifest.relativeTo(execRoot).getPathString());
     args.add(symlinkTreeRoot.relativeTo(execRoot).getPathString());
@@ -66,7 +66,11 @@ public final class SymlinkTreeStrategy implements SymlinkTreeActionContext {
                   actionExecutionContext
                       .getInputPath(action.getOutputManifest())
                       .getParentDirectory(),
-                  action.isFilesetTree());
+                  action.isFilesetTree(),
+                  actionExecutionContext
+                      .getOptions()
+                      .getOptions(ExecutionOptions.class)
+                      .collapseRunfilesDirectories);
           helper.createSymlinks(actionExecutionContext, binTools, shellEnvironment, enableRunfiles);
         }
       } catch (ExecException e) {
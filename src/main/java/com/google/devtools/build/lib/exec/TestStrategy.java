@@ -480,7 +480,8 @@ public abstract class TestStrategy implements TestActionContext {
     new SymlinkTreeHelper(
             actionExecutionContext.getInputPath(execSettings.getInputManifest()),
             runfilesDir,
-            false)
+            false,
+            executionOptions.collapseRunfilesDirectories)
         .createSymlinks(actionExecutionContext, binTools, shellEnvironment, enableRunfiles);
 
     actionExecutionContext.getEventHandler()
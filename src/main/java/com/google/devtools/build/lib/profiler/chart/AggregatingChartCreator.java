@@ -63,7 +63,8 @@ public class AggregatingChartCreator implements ChartCreator {
           ProfilerTask.VFS_READ,
           ProfilerTask.VFS_WRITE,
           ProfilerTask.VFS_GLOB,
-          ProfilerTask.VFS_XATTR);
+          ProfilerTask.VFS_XATTR,
+          ProfilerTask.VFS_VERITY);
 
   /** The data of the profiled build. */
   private final ProfileInfo info;
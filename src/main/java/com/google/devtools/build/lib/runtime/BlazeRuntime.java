@@ -801,6 +801,19 @@ public final class BlazeRuntime implements BugReport.BlazeRuntimeInterface {
   public static void main(Iterable<Class<? extends BlazeModule>> moduleClasses, String[] args) {
     setupUncaughtHandler(args);
     List<BlazeModule> modules = createModules(moduleClasses);
+    // blaze.cc will put --zygote_base first to start a server zygote.
+    if (args.length >= 1 && args[0].startsWith(ServerZygote.ZYGOTE_BASE_FLAG)) {
+      try {
+        args = ServerZygote.awaitClaim(moduleClasses, args);
+      } catch (IOException e) {
+        logger.log(Level.SEVERE, "Server zygote failed", e);
+        System.exit(ExitCode.LOCAL_ENVIRONMENTAL_ERROR.getNumericExitCode());
+      }
+      if (args == null) {
+        System.exit(ExitCode.SUCCESS.getNumericExitCode());
+      }
+      setupUncaughtHandler(args);
+    }
     // blaze.cc will put --batch first if the user set it.
     if (args.length >= 1 && args[0].equals("--batch")) {
       // Run Blaze in batch mode.
@@ -465,6 +465,32 @@ public class BlazeServerStartupOptions extends OptionsBase {
           + " actually encounter a condition that triggers them.")
   public boolean unlimitCoredumps;
 
+  @Option(
+      name = "experimental_server_zygote",
+      defaultValue = "false", // NOTE: only for documentation, value is set and used by the client.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.BAZEL_INTERNAL_CONFIGURATION},
+      metadataTags = {OptionMetadataTag.EXPERIMENTAL},
+      help =
+          "If true, the client keeps a pre-started server process parked per install base, "
+              + "JVM configuration and environment. When a server needs to be started for an "
+              + "output base, the client claims the parked process instead of starting a new JVM, "
+              + "and starts a replacement in the background. Only supported on Unix.")
+  public boolean serverZygote;
+
+  @Option(
+      name = "experimental_shared_install_store",
+      defaultValue = "false", // NOTE: only for documentation, value is set and used by the client.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.BAZEL_INTERNAL_CONFIGURATION},
+      metadataTags = {OptionMetadataTag.EXPERIMENTAL},
+      help =
+          "If true, the client extracts the files of a new install base into a content-addressed "
+              + "store in the output user root, and creates the install base from clones of or "
+              + "hard links to the files in the store. Files that are the same in different "
+              + "versions are then extracted and stored only once.")
+  public boolean sharedInstallStore;
+
   @Option(
       name = "macos_qos_class",
       defaultValue = "default", // Only for documentation; value is set and used by the client.
@@ -57,6 +57,8 @@ public final class ProcessWrapperUtil {
     private Duration timeout;
     private Duration killDelay;
     private Path statisticsPath;
+    private Path outputsPath;
+    private Path outputManifestPath;
 
     private CommandLineBuilder(String processWrapperPath, List<String> commandArguments) {
       this.processWrapperPath = processWrapperPath;
@@ -96,6 +98,16 @@ public final class ProcessWrapperUtil {
       return this;
     }
 
+    /**
+     * Sets the file listing the outputs to digest after the command exits, and the path for writing
+     * the resulting {@code OutputManifest}. Directories are listed recursively.
+     */
+    public CommandLineBuilder setOutputManifest(Path outputsPath, Path outputManifestPath) {
+      this.outputsPath = outputsPath;
+      this.outputManifestPath = outputManifestPath;
+      return this;
+    }
+
     /** Build the command line to invoke a specific command using the process wrapper tool. */
     public List<String> build() {
       List<String> fullCommandLine = new ArrayList<>();
@@ -116,6 +128,10 @@ public final class ProcessWrapperUtil {
       if (statisticsPath != null) {
         fullCommandLine.add("--stats=" + statisticsPath);
       }
+      if (outputsPath != null) {
+        fullCommandLine.add("--outputs=" + outputsPath);
+        fullCommandLine.add("--output_manifest=" + outputManifestPath);
+      }
 
       fullCommandLine.addAll(commandArguments);
 
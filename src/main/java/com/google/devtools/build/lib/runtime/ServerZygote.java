@@ -0,0 +1,295 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.runtime;
+
+import static java.nio.charset.StandardCharsets.ISO_8859_1;
+
+import com.google.common.base.Preconditions;
+import com.google.common.collect.ImmutableList;
+import com.google.common.primitives.Ints;
+import com.google.devtools.build.lib.analysis.ConfiguredRuleClassProvider;
+import com.google.devtools.build.lib.unix.ProcessUtils;
+import com.google.devtools.common.options.OptionsParser;
+import com.sun.management.HotSpotDiagnosticMXBean;
+import java.io.BufferedInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.EOFException;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.lang.management.ManagementFactory;
+import java.net.InetAddress;
+import java.net.ServerSocket;
+import java.net.Socket;
+import java.net.SocketTimeoutException;
+import java.nio.file.FileAlreadyExistsException;
+import java.nio.file.Files;
+import java.nio.file.NoSuchFileException;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.security.SecureRandom;
+import java.util.List;
+import java.util.concurrent.TimeUnit;
+import java.util.logging.Level;
+import java.util.logging.LogManager;
+import java.util.logging.Logger;
+import javax.annotation.Nullable;
+
+/**
+ * A server process that is started before it is known which output base it will serve, so that
+ * starting the server of a new output base costs a handshake instead of a JVM startup.
+ *
+ * <p>The client starts a zygote with the JVM flags of a server that do not depend on the output
+ * base, and only {@code --zygote_base} and {@code --max_idle_secs} as arguments. The zygote warms
+ * up by running the output base independent part of the server initialization, then publishes
+ * the loopback port it accepts a claim on in {@code zygote.ready} in its server directory. A
+ * client claims the zygote by moving that file away and sending the working directory, the output
+ * file, the remaining JVM flags and the arguments of the server the zygote turns into, see
+ * ClaimServerZygote() in blaze_util_posix.cc.
+ */
+final class ServerZygote {
+  private static final Logger logger = Logger.getLogger(ServerZygote.class.getName());
+
+  /** The flag the client passes first to start a zygote instead of a server. */
+  static final String ZYGOTE_BASE_FLAG = "--zygote_base=";
+
+  private static final String MAX_IDLE_SECS_FLAG = "--max_idle_secs=";
+  private static final String READY_FILE = "zygote.ready";
+  private static final int CLAIM_TIMEOUT_MILLIS = 10000;
+
+  /**
+   * The connection of the client that claimed this zygote. It stays open for as long as the
+   * server lives, so that the client can tell if the server dies while it starts up.
+   */
+  @SuppressWarnings("unused")
+  private static Socket claim;
+
+  private ServerZygote() {}
+
+  /**
+   * Warms up, waits until a client claims this zygote and applies the claim.
+   *
+   * @return the arguments of the server to run, or null if the zygote should exit because it was
+   *     idle for too long or another zygote is parked already
+   */
+  @Nullable
+  static String[] awaitClaim(Iterable<Class<? extends BlazeModule>> moduleClasses, String[] args)
+      throws IOException {
+    Path zygoteBase = null;
+    long maxIdleSeconds = 0;
+    for (String arg : args) {
+      if (arg.startsWith(ZYGOTE_BASE_FLAG)) {
+        zygoteBase = Paths.get(arg.substring(ZYGOTE_BASE_FLAG.length()));
+      } else if (arg.startsWith(MAX_IDLE_SECS_FLAG)) {
+        maxIdleSeconds = Long.parseLong(arg.substring(MAX_IDLE_SECS_FLAG.length()));
+      } else {
+        throw new IllegalArgumentException("Unexpected server zygote argument: " + arg);
+      }
+    }
+    Preconditions.checkArgument(zygoteBase != null, "%s is required", ZYGOTE_BASE_FLAG);
+    Path readyFile = zygoteBase.resolve("server").resolve(READY_FILE);
+    int pid = ProcessUtils.getpid(); // Also fails early if JNI is not available.
+
+    long startTime = System.nanoTime();
+    warmUp(moduleClasses);
+    logger.info(
+        "Server zygote warmed up in "
+            + TimeUnit.NANOSECONDS.toMillis(System.nanoTime() - startTime)
+            + " ms");
+
+    try (ServerSocket serverSocket = new ServerSocket(0, 1, InetAddress.getLoopbackAddress())) {
+      serverSocket.setSoTimeout(Ints.saturatedCast(TimeUnit.SECONDS.toMillis(maxIdleSeconds)));
+      String cookie = generateCookie();
+      String ready = pid + " " + serverSocket.getLocalPort() + " " + cookie;
+      if (!publish(readyFile, ready, pid)) {
+        logger.info("Another server zygote is parked in " + zygoteBase);
+        return null;
+      }
+      while (true) {
+        Socket socket;
+        try {
+          socket = serverSocket.accept();
+        } catch (SocketTimeoutException e) {
+          logger.info("Server zygote was idle for " + maxIdleSeconds + " seconds");
+          unpublish(readyFile, ready, pid);
+          return null;
+        }
+        String[] serverArgs = readClaim(socket, cookie);
+        if (serverArgs != null) {
+          claim = socket;
+          return serverArgs;
+        }
+        socket.close();
+      }
+    }
+  }
+
+  /**
+   * Runs the part of the server initialization that does not depend on the output base on
+   * throwaway modules, which loads and initializes most of the classes the server needs. Rule
+   * classes are built again for the real server, just like tests build them many times in a JVM.
+   */
+  private static void warmUp(Iterable<Class<? extends BlazeModule>> moduleClasses) {
+    try {
+      List<BlazeModule> modules = BlazeRuntime.createModules(moduleClasses);
+      OptionsParser.builder()
+          .optionsClasses(BlazeCommandUtils.getStartupOptions(modules))
+          .allowResidue(false)
+          .build();
+      ConfiguredRuleClassProvider.Builder ruleClassBuilder =
+          new ConfiguredRuleClassProvider.Builder();
+      for (BlazeModule module : modules) {
+        module.initializeRuleClasses(ruleClassBuilder);
+      }
+      ruleClassBuilder.build();
+    } catch (RuntimeException e) {
+      // The warm-up is an optimization only; the server initialization reports any real problem.
+      logger.log(Level.WARNING, "Server zygote warm-up failed", e);
+    }
+  }
+
+  /**
+   * Atomically creates the ready file, unless another zygote has created it already.
+   *
+   * @return whether the ready file was created
+   */
+  private static boolean publish(Path readyFile, String ready, int pid) throws IOException {
+    Path tmpFile = readyFile.resolveSibling(READY_FILE + ".tmp." + pid);
+    Files.write(tmpFile, ready.getBytes(ISO_8859_1));
+    try {
+      Files.createLink(readyFile, tmpFile);
+      return true;
+    } catch (FileAlreadyExistsException e) {
+      return false;
+    } finally {
+      Files.delete(tmpFile);
+    }
+  }
+
+  /**
+   * Removes the ready file of this zygote, unless a client has claimed it already. Moving the file
+   * away first makes sure that no client can claim the zygote anymore.
+   */
+  private static void unpublish(Path readyFile, String ready, int pid) throws IOException {
+    Path expiredFile = readyFile.resolveSibling(READY_FILE + ".expired." + pid);
+    try {
+      Files.move(readyFile, expiredFile);
+    } catch (NoSuchFileException e) {
+      return;
+    }
+    try {
+      if (!new String(Files.readAllBytes(expiredFile), ISO_8859_1).equals(ready)) {
+        // This zygote was claimed, but the client gave up, and a replacement is parked now.
+        Files.createLink(readyFile, expiredFile);
+      }
+    } catch (FileAlreadyExistsException e) {
+      // Yet another zygote is parked already.
+    } finally {
+      Files.delete(expiredFile);
+    }
+  }
+
+  /**
+   * Reads a claim and turns this process into the server the claim asks for.
+   *
+   * @return the arguments of the server, or null if the claim does not have the right cookie
+   */
+  @Nullable
+  private static String[] readClaim(Socket socket, String cookie) throws IOException {
+    socket.setSoTimeout(CLAIM_TIMEOUT_MILLIS);
+    InputStream in = new BufferedInputStream(socket.getInputStream());
+    OutputStream out = socket.getOutputStream();
+    try {
+      if (!cookie.equals(readField(in))) {
+        logger.warning("Ignoring server zygote claim with the wrong cookie");
+        return null;
+      }
+    } catch (IOException e) {
+      logger.log(Level.WARNING, "Ignoring incomplete server zygote claim", e);
+      return null;
+    }
+    try {
+      String workingDirectory = readField(in);
+      String outputFile = readField(in);
+      boolean append = readField(in).equals("1");
+      ImmutableList<String> jvmFlags = readList(in);
+      ImmutableList<String> serverArgs = readList(in);
+
+      ProcessUtils.redirectOutput(outputFile, append);
+      ProcessUtils.chdir(workingDirectory);
+      System.setProperty("user.dir", workingDirectory);
+      for (String flag : jvmFlags) {
+        applyJvmFlag(flag);
+      }
+      // Picks up the logging configuration of the output base.
+      LogManager.getLogManager().readConfiguration();
+
+      socket.setSoTimeout(0);
+      out.write("ok\n".getBytes(ISO_8859_1));
+      out.flush();
+      logger.info("Server zygote claimed with args " + serverArgs);
+      return serverArgs.toArray(new String[0]);
+    } catch (IOException | RuntimeException e) {
+      out.write(("error: " + e.getMessage() + "\n").getBytes(ISO_8859_1));
+      out.flush();
+      throw new IOException("Could not apply server zygote claim", e);
+    }
+  }
+
+  /** Applies a system property or a manageable VM option given as a JVM flag. */
+  private static void applyJvmFlag(String flag) {
+    int eq = flag.indexOf('=');
+    if (flag.startsWith("-D") && eq > 2) {
+      System.setProperty(flag.substring(2, eq), flag.substring(eq + 1));
+    } else if (flag.startsWith("-XX:") && eq > 4) {
+      ManagementFactory.getPlatformMXBean(HotSpotDiagnosticMXBean.class)
+          .setVMOption(flag.substring(4, eq), flag.substring(eq + 1));
+    } else {
+      throw new IllegalArgumentException("Cannot apply JVM flag " + flag);
+    }
+  }
+
+  /** Reads a NUL-terminated string. */
+  private static String readField(InputStream in) throws IOException {
+    ByteArrayOutputStream field = new ByteArrayOutputStream();
+    int b;
+    while ((b = in.read()) != 0) {
+      if (b == -1) {
+        throw new EOFException("Incomplete server zygote claim");
+      }
+      field.write(b);
+    }
+    return new String(field.toByteArray(), ISO_8859_1);
+  }
+
+  /** Reads NUL-terminated strings up to an empty one. */
+  private static ImmutableList<String> readList(InputStream in) throws IOException {
+    ImmutableList.Builder<String> result = ImmutableList.builder();
+    for (String field = readField(in); !field.isEmpty(); field = readField(in)) {
+      result.add(field);
+    }
+    return result.build();
+  }
+
+  private static String generateCookie() {
+    byte[] bytes = new byte[16];
+    new SecureRandom().nextBytes(bytes);
+    StringBuilder result = new StringBuilder();
+    for (byte b : bytes) {
+      result.append(String.format("%02x", b & 0xff));
+    }
+    return result.toString();
+  }
+}
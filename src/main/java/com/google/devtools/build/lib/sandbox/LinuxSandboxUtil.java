@@ -65,8 +65,12 @@ public final class LinuxSandboxUtil {
     private Set<Path> tmpfsDirectories = ImmutableSet.of();
     private Map<Path, Path> bindMounts = ImmutableMap.of();
     private Path statisticsPath;
+    private Path inputTracePath;
+    private Path outputsPath;
+    private Path outputManifestPath;
     private boolean useFakeHostname = false;
     private boolean createNetworkNamespace = false;
+    private Path networkNamespacePath;
     private boolean useFakeRoot = false;
     private boolean useFakeUsername = false;
     private boolean useDebugMode = false;
@@ -143,6 +147,25 @@ public final class LinuxSandboxUtil {
       return this;
     }
 
+    /**
+     * Sets the path for writing which files in the working directory the command opened, as one
+     * {@code accessed} or {@code unused} line per file.
+     */
+    public CommandLineBuilder setInputTracePath(Path inputTracePath) {
+      this.inputTracePath = inputTracePath;
+      return this;
+    }
+
+    /**
+     * Sets the file listing the outputs to digest after the command exits, and the path for writing
+     * the resulting {@code OutputManifest}. Directories are listed recursively.
+     */
+    public CommandLineBuilder setOutputManifest(Path outputsPath, Path outputManifestPath) {
+      this.outputsPath = outputsPath;
+      this.outputManifestPath = outputManifestPath;
+      return this;
+    }
+
     /** Sets whether to use a fake 'localhost' hostname inside the sandbox. */
     public CommandLineBuilder setUseFakeHostname(boolean useFakeHostname) {
       this.useFakeHostname = useFakeHostname;
@@ -155,6 +178,15 @@ public final class LinuxSandboxUtil {
       return this;
     }
 
+    /**
+     * Sets the network namespace to join instead of creating one, e.g. one that is shared by many
+     * sandboxes and was created with {@code linux-sandbox -C}.
+     */
+    public CommandLineBuilder setNetworkNamespacePath(Path networkNamespacePath) {
+      this.networkNamespacePath = networkNamespacePath;
+      return this;
+    }
+
     /** Sets whether to pretend to be 'root' inside the namespace. */
     public CommandLineBuilder setUseFakeRoot(boolean useFakeRoot) {
       this.useFakeRoot = useFakeRoot;
@@ -188,6 +220,9 @@ public final class LinuxSandboxUtil {
       Preconditions.checkState(
           !(this.useFakeUsername && this.useFakeRoot),
           "useFakeUsername and useFakeRoot are exclusive");
+      Preconditions.checkState(
+          !(this.createNetworkNamespace && this.networkNamespacePath != null),
+          "createNetworkNamespace and networkNamespacePath are exclusive");
 
       ImmutableList.Builder<String> commandLineBuilder = ImmutableList.builder();
 
@@ -224,12 +259,22 @@ public final class LinuxSandboxUtil {
       if (statisticsPath != null) {
         commandLineBuilder.add("-S", statisticsPath.getPathString());
       }
+      if (inputTracePath != null) {
+        commandLineBuilder.add("-I", inputTracePath.getPathString());
+      }
+      if (outputsPath != null) {
+        commandLineBuilder.add("-O", outputsPath.getPathString());
+        commandLineBuilder.add("-o", outputManifestPath.getPathString());
+      }
       if (useFakeHostname) {
         commandLineBuilder.add("-H");
       }
       if (createNetworkNamespace) {
         commandLineBuilder.add("-N");
       }
+      if (networkNamespacePath != null) {
+        commandLineBuilder.add("-n", networkNamespacePath.getPathString());
+      }
       if (useFakeRoot) {
         commandLineBuilder.add("-R");
       }
@@ -622,7 +622,8 @@ public class ActionExecutionFunction implements SkyFunction {
             action.getOutputs(),
             tsgm.get(),
             pathResolver,
-            newOutputStore(state));
+            newOutputStore(state),
+            skyframeActionExecutor.enableFsVerityOnOutputs());
     // We only need to check the action cache if we haven't done it on a previous run.
     if (!state.hasCheckedActionCache()) {
       state.token =
@@ -705,7 +706,8 @@ public class ActionExecutionFunction implements SkyFunction {
                   action.getOutputs(),
                   tsgm.get(),
                   pathResolver,
-                  newOutputStore(state));
+                  newOutputStore(state),
+                  skyframeActionExecutor.enableFsVerityOnOutputs());
           // Set the MetadataHandler to accept output information.
           metadataHandler.discardOutputMetadata();
       }
@@ -819,7 +821,8 @@ public class ActionExecutionFunction implements SkyFunction {
                     action.getOutputs(),
                     tsgm.get(),
                     metadataHandler.getArtifactPathResolver(),
-                    metadataHandler.getOutputStore());
+                    metadataHandler.getOutputStore(),
+                    skyframeActionExecutor.enableFsVerityOnOutputs());
         }
       }
       Preconditions.checkState(!env.valuesMissing(), action);
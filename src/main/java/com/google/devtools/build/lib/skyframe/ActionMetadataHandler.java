@@ -52,6 +52,8 @@ import java.util.Collection;
 import java.util.Map;
 import java.util.Set;
 import java.util.concurrent.atomic.AtomicBoolean;
+import java.util.logging.Level;
+import java.util.logging.Logger;
 import javax.annotation.Nullable;
 
 /**
@@ -75,6 +77,7 @@ import javax.annotation.Nullable;
  */
 @VisibleForTesting
 public final class ActionMetadataHandler implements MetadataHandler {
+  private static final Logger logger = Logger.getLogger(ActionMetadataHandler.class.getName());
 
   /**
    * Data for input artifacts. Immutable.
@@ -105,6 +108,9 @@ public final class ActionMetadataHandler implements MetadataHandler {
 
   private final OutputStore store;
 
+  /** Whether to enable fs-verity on output files when they are made read-only. */
+  private final boolean enableFsVerityOnOutputs;
+
   @VisibleForTesting
   public ActionMetadataHandler(
       ActionInputMap inputArtifactData,
@@ -113,12 +119,31 @@ public final class ActionMetadataHandler implements MetadataHandler {
       @Nullable TimestampGranularityMonitor tsgm,
       ArtifactPathResolver artifactPathResolver,
       OutputStore store)  {
+    this(
+        inputArtifactData,
+        missingArtifactsAllowed,
+        outputs,
+        tsgm,
+        artifactPathResolver,
+        store,
+        /*enableFsVerityOnOutputs=*/ false);
+  }
+
+  ActionMetadataHandler(
+      ActionInputMap inputArtifactData,
+      boolean missingArtifactsAllowed,
+      Iterable<Artifact> outputs,
+      @Nullable TimestampGranularityMonitor tsgm,
+      ArtifactPathResolver artifactPathResolver,
+      OutputStore store,
+      boolean enableFsVerityOnOutputs) {
     this.inputArtifactData = Preconditions.checkNotNull(inputArtifactData);
     this.missingArtifactsAllowed = missingArtifactsAllowed;
     this.outputs = ImmutableSet.copyOf(outputs);
     this.tsgm = tsgm;
     this.artifactPathResolver = artifactPathResolver;
     this.store = store;
+    this.enableFsVerityOnOutputs = enableFsVerityOnOutputs;
   }
 
   /**
@@ -658,6 +683,16 @@ public final class ActionMetadataHandler implements MetadataHandler {
     if (path.isFile(Symlinks.NOFOLLOW)) { // i.e. regular files only.
       // We trust the files created by the execution engine to be non symlinks with expected
       // chmod() settings already applied.
+      if (enableFsVerityOnOutputs) {
+        // Needs write permission, so do it before the chmod(). A no-op if the file system does not
+        // support fs-verity. Only an optimization, so a failure, e.g. because the file is still
+        // open for writing, must not fail the action.
+        try {
+          path.enableFsVerity();
+        } catch (IOException e) {
+          logger.log(Level.FINE, "Could not enable fs-verity on " + path, e);
+        }
+      }
       path.chmod(0555);  // Sets the file read-only and executable.
     }
   }
@@ -202,6 +202,7 @@ public final class SkyframeActionExecutor {
   private final AtomicReference<ActionExecutionStatusReporter> statusReporterRef;
   private OutputService outputService;
   private boolean finalizeActions;
+  private boolean enableFsVerityOnOutputs;
   private final Supplier<ImmutableList<Root>> sourceRootSupplier;
   private final Function<PathFragment, SourceArtifact> sourceArtifactFactory;
 
@@ -421,6 +422,8 @@ public final class SkyframeActionExecutor {
     // Cache some option values for performance, since we consult them on every action.
     this.useAsyncExecution = options.getOptions(BuildRequestOptions.class).useAsyncExecution;
     this.finalizeActions = options.getOptions(BuildRequestOptions.class).finalizeActions;
+    this.enableFsVerityOnOutputs =
+        options.getOptions(BuildRequestOptions.class).enableFsVerityOnOutputs;
     this.outputService = outputService;
     RemoteOptions remoteOptions = options.getOptions(RemoteOptions.class);
     this.bazelRemoteExecutionEnabled = remoteOptions != null && remoteOptions.isRemoteEnabled();
@@ -767,6 +770,11 @@ public final class SkyframeActionExecutor {
     }
   }
 
+  /** Whether fs-verity should be enabled on outputs when they are made read-only. */
+  boolean enableFsVerityOnOutputs() {
+    return enableFsVerityOnOutputs;
+  }
+
   boolean isBazelRemoteExecutionEnabled() {
     return bazelRemoteExecutionEnabled;
   }
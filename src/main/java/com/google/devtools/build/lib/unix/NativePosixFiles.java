@@ -347,6 +347,34 @@ public final class NativePosixFiles {
   public static native byte[] lgetxattr(String path, String name)
       throws IOException;
 
+  /**
+   * Returns the fs-verity digest of a file, as computed by the kernel when
+   * verity was enabled on it. This is the root of a Merkle tree over the
+   * contents, not a plain hash of them, and costs no I/O to obtain.
+   *
+   * @param path the file whose digest is to be returned; symbolic links are
+   *   followed.
+   * @return the digest, whose length identifies the hash algorithm (32 bytes
+   *   for SHA-256, 64 for SHA-512), or null if verity is not enabled on the
+   *   file or not supported by the file system (ENODATA, ENOTSUP).
+   * @throws IOException if the call failed for any other reason.
+   */
+  public static native byte[] getFsVerityDigest(String path)
+      throws IOException;
+
+  /**
+   * Enables fs-verity on a file with SHA-256 and page sized blocks. This
+   * makes the file immutable and reads verify its contents. The file must not
+   * be open for writing and the caller needs write permission on it.
+   *
+   * @param path the file to enable verity on; symbolic links are followed.
+   * @return true if verity is now enabled on the file, including if it was
+   *   enabled already, or false if the file system does not support it.
+   * @throws IOException if the call failed for any other reason.
+   */
+  public static native boolean enableFsVerity(String path)
+      throws IOException;
+
   /**
    * Returns the MD5 digest of the specified file, following symbolic links.
    *
@@ -367,6 +395,61 @@ public final class NativePosixFiles {
     return HashCode.fromBytes(md5sumAsBytes(path));
   }
 
+  /**
+   * Returns the MD5 digests of the specified files, following symbolic links. The files are hashed
+   * several at a time in the lanes of the SIMD registers, which is much faster than calling {@link
+   * #md5sum} for each of many small files.
+   *
+   * @param paths the files whose MD5 digests are required.
+   * @return the MD5 digests, as 16 bytes per file in the order of {@code paths}.
+   * @throws IOException if any file cannot be read; the exception names the first such file.
+   */
+  public static native byte[] md5sumsAsBytes(String[] paths) throws IOException;
+
+  /**
+   * Builds the remote execution Merkle tree of an input root, using MD5 digests. Files are hashed in
+   * parallel and the canonical {@code build.bazel.remote.execution.v2.Directory} messages are
+   * serialized bottom-up, with all files marked executable like {@code MerkleTree} does.
+   *
+   * @param entries the inputs as NUL-terminated, Latin-1 encoded pairs of a path relative to the
+   *     input root and a source path; a source directory is added with all its contents (following
+   *     symbolic links), an empty input path denotes the root and an empty source an empty file
+   * @param threads the number of threads hashing files, or 0 for one per CPU
+   * @return the 16-byte MD5 digest of the root {@code Directory}, followed by a serialized {@code
+   *     Tree} message whose children are the distinct subdirectories, each after its own children
+   * @throws IOException if an entry is malformed, conflicts with another one or cannot be read
+   */
+  public static native byte[] md5MerkleTree(byte[] entries, int threads) throws IOException;
+
+  /**
+   * Evaluates a {@code glob()} below {@code base} natively: the tree is walked by a pool of threads
+   * that read each directory once for all include patterns, and the patterns are matched like
+   * {@link com.google.devtools.build.lib.vfs.UnixGlob} and {@code UnixGlob.removeExcludes} do.
+   * Symbolic links are followed, except for directory links to one of their ancestors. The patterns
+   * must be valid according to {@code UnixGlob.checkPatternForError}.
+   *
+   * @param base the directory the patterns are relative to; if it does not exist, nothing matches
+   * @param includes the patterns to expand
+   * @param excludes the patterns whose matches are removed from the result
+   * @param excludeDirectories whether to leave out directories that match
+   * @param buildFileNames the names of build files; subdirectories that contain a regular file with
+   *     one of these names are packages of their own, so they are neither entered nor matched
+   * @param threads the number of threads walking the tree, or 0 for one per CPU
+   * @return one entry per matching path and per subpackage that was not entered, in sorted order
+   *     and matches first. An entry is the kind, {@code 'M'} for a match and {@code 'P'} for a
+   *     subpackage, followed by the Latin-1 encoded path relative to {@code base} and a NUL
+   * @throws IOException if a directory cannot be read, or a path named by a pattern without
+   *     wildcards cannot be stat'ed for another reason than its absence
+   */
+  public static native byte[] glob(
+      String base,
+      String[] includes,
+      String[] excludes,
+      boolean excludeDirectories,
+      String[] buildFileNames,
+      int threads)
+      throws IOException;
+
   /**
    * Deletes all directory trees recursively beneath the given path, which is expected to be a
    * directory. Does not remove the top directory.
@@ -377,6 +460,21 @@ public final class NativePosixFiles {
    */
   public static native void deleteTreesBelow(String dir) throws IOException;
 
+  /**
+   * Creates or updates the runfiles tree in the given directory in-process, the same way the
+   * build-runfiles tool does for a runfiles manifest: extraneous files are removed, missing ones
+   * are created and the entries are written to {@code runfilesDir/MANIFEST}. Different trees may be
+   * created concurrently.
+   *
+   * @param runfilesDir the root of the runfiles tree, which is created if it does not exist
+   * @param entries the manifest entries as NUL-terminated, Latin-1 encoded pairs of link and
+   *     target paths; an empty target denotes an empty file
+   * @param allowRelative whether targets may be relative paths
+   * @throws IOException if an entry is malformed or the tree cannot be created
+   */
+  public static native void createRunfilesTree(
+      String runfilesDir, byte[] entries, boolean allowRelative) throws IOException;
+
   /**
    * Open a file descriptor for writing.
    *
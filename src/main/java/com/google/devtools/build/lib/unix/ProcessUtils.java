@@ -14,6 +14,7 @@
 package com.google.devtools.build.lib.unix;
 
 import com.google.devtools.build.lib.UnixJniLoader;
+import java.io.IOException;
 
 
 /**
@@ -49,4 +50,20 @@ public final class ProcessUtils {
    * @return the real user ID of the current process.
    */
   public static native int getuid();
+
+  /**
+   * Native wrapper around POSIX chdir(2). Note that this does not update the {@code user.dir}
+   * system property.
+   *
+   * @throws IOException if the working directory could not be changed.
+   */
+  public static native void chdir(String path) throws IOException;
+
+  /**
+   * Redirects the standard output and standard error of this process to the file at {@code path},
+   * which is created if it does not exist and truncated unless {@code append} is true.
+   *
+   * @throws IOException if the file could not be opened or the output could not be redirected.
+   */
+  public static native void redirectOutput(String path, boolean append) throws IOException;
 }
@@ -0,0 +1,125 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.unix;
+
+import com.google.common.base.Preconditions;
+import com.google.devtools.build.lib.UnixJniLoader;
+import com.google.devtools.build.lib.util.OS;
+import java.time.Duration;
+import java.util.Arrays;
+
+/**
+ * Samples how loaded the machine is, so that local work can be throttled before the machine starts
+ * thrashing: pressure stall information from /proc/pressure, MemAvailable from /proc/meminfo and
+ * the memory usage and limit of the cgroup Bazel runs in.
+ *
+ * <p>A sample is a {@code long[]} of {@link #NUM_VALUES} values, indexed by the constants below.
+ * Values that are not available, e.g. because the kernel is older than 4.20 or not Linux, are -1.
+ * Sampling reads a few files that are kept open, so it is cheap; with {@link #startSampler}, a
+ * native thread samples in the background and {@link #sample} only copies its latest sample.
+ */
+public final class SystemLoad {
+
+  /** Share of time some runnable task waited for a CPU in the last 10s, in 1/100 of a percent. */
+  public static final int CPU_SOME_AVG10 = 0;
+  /** Total time some runnable task waited for a CPU, in microseconds. */
+  public static final int CPU_SOME_TOTAL = 1;
+  /** Share of time some task stalled on memory in the last 10s, in 1/100 of a percent. */
+  public static final int MEMORY_SOME_AVG10 = 2;
+  /** Share of time all non-idle tasks stalled on memory in the last 10s, in 1/100 of a percent. */
+  public static final int MEMORY_FULL_AVG10 = 3;
+  /** Total time some task stalled on memory, in microseconds. */
+  public static final int MEMORY_SOME_TOTAL = 4;
+  /** Total time all non-idle tasks stalled on memory, in microseconds. */
+  public static final int MEMORY_FULL_TOTAL = 5;
+  /** Share of time some task stalled on I/O in the last 10s, in 1/100 of a percent. */
+  public static final int IO_SOME_AVG10 = 6;
+  /** Share of time all non-idle tasks stalled on I/O in the last 10s, in 1/100 of a percent. */
+  public static final int IO_FULL_AVG10 = 7;
+  /** Total time some task stalled on I/O, in microseconds. */
+  public static final int IO_SOME_TOTAL = 8;
+  /** Total time all non-idle tasks stalled on I/O, in microseconds. */
+  public static final int IO_FULL_TOTAL = 9;
+  /** Memory available for new work without swapping, in bytes. */
+  public static final int MEM_AVAILABLE = 10;
+  /** Memory used by the cgroup of this process, in bytes. */
+  public static final int CGROUP_MEMORY_CURRENT = 11;
+  /** Memory limit of the cgroup of this process in bytes, {@link Long#MAX_VALUE} if unlimited. */
+  public static final int CGROUP_MEMORY_MAX = 12;
+  /** When the sample was taken, in {@link System#nanoTime} compatible monotonic nanoseconds. */
+  public static final int SAMPLE_TIME = 13;
+
+  /** The number of values in a sample. */
+  public static final int NUM_VALUES = 14;
+
+  private static final boolean SUPPORTED = OS.getCurrent() == OS.LINUX;
+
+  private SystemLoad() {}
+
+  static {
+    if (SUPPORTED && !"0".equals(System.getProperty("io.bazel.EnableJni"))) {
+      UnixJniLoader.loadJni();
+    }
+  }
+
+  /** Returns whether samples can contain any values on this platform. */
+  public static boolean isSupported() {
+    return SUPPORTED;
+  }
+
+  /** Returns a new array for {@link #sample}. */
+  public static long[] newSample() {
+    long[] values = new long[NUM_VALUES];
+    Arrays.fill(values, -1);
+    return values;
+  }
+
+  /**
+   * Stores the latest sample of the background sampler in {@code values}, or takes a new sample if
+   * it is not running. Does not allocate, so it can be polled frequently.
+   */
+  public static void sample(long[] values) {
+    Preconditions.checkArgument(values.length >= NUM_VALUES);
+    if (SUPPORTED) {
+      nativeSample(values);
+    } else {
+      Arrays.fill(values, 0, NUM_VALUES, -1);
+    }
+  }
+
+  /**
+   * Starts sampling every {@code interval} in a native thread, or changes the interval if it is
+   * running already.
+   */
+  public static void startSampler(Duration interval) {
+    Preconditions.checkArgument(!interval.isNegative() && !interval.isZero());
+    if (SUPPORTED) {
+      nativeStartSampler(Math.max(1, interval.toMillis()));
+    }
+  }
+
+  /** Stops the background sampler, if it is running. */
+  public static void stopSampler() {
+    if (SUPPORTED) {
+      nativeStopSampler();
+    }
+  }
+
+  private static native void nativeSample(long[] values);
+
+  private static native void nativeStartSampler(long intervalMillis);
+
+  private static native void nativeStopSampler();
+}
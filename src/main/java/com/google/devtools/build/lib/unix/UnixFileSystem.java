@@ -403,6 +403,28 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
     }
   }
 
+  @Override
+  public byte[] getFsVerityDigest(Path path) throws IOException {
+    String pathName = path.toString();
+    long startTime = Profiler.nanoTimeMaybe();
+    try {
+      return NativePosixFiles.getFsVerityDigest(pathName);
+    } finally {
+      profiler.logSimpleTask(startTime, ProfilerTask.VFS_VERITY, pathName);
+    }
+  }
+
+  @Override
+  public boolean enableFsVerity(Path path) throws IOException {
+    String pathName = path.toString();
+    long startTime = Profiler.nanoTimeMaybe();
+    try {
+      return NativePosixFiles.enableFsVerity(pathName);
+    } finally {
+      profiler.logSimpleTask(startTime, ProfilerTask.VFS_VERITY, pathName);
+    }
+  }
+
   @Override
   protected byte[] getDigest(Path path) throws IOException {
     String name = path.toString();
@@ -207,6 +207,16 @@ public abstract class DelegateFileSystem extends FileSystem {
     return delegateFs.getxattr(toDelegatePath(path), name, followSymlinks);
   }
 
+  @Override
+  public byte[] getFsVerityDigest(Path path) throws IOException {
+    return delegateFs.getFsVerityDigest(toDelegatePath(path));
+  }
+
+  @Override
+  public boolean enableFsVerity(Path path) throws IOException {
+    return delegateFs.enableFsVerity(toDelegatePath(path));
+  }
+
   @Override
   protected byte[] getFastDigest(Path path) throws IOException {
     return delegateFs.getFastDigest(toDelegatePath(path));
@@ -296,6 +296,33 @@ public abstract class FileSystem {
     return null;
   }
 
+  /**
+   * Returns the fs-verity digest of the file, or null if verity is not enabled on it or the file
+   * system does not support fs-verity. Follows symlinks.
+   *
+   * <p>The digest is computed by the kernel when verity is enabled, so this is cheap, but it is the
+   * root of a Merkle tree over the contents and not a digest of the configured {@link
+   * DigestHashFunction}. Its length identifies the hash algorithm.
+   *
+   * <p>Default implementation assumes that the file system does not support fs-verity.
+   */
+  public byte[] getFsVerityDigest(Path path) throws IOException {
+    return null;
+  }
+
+  /**
+   * Enables fs-verity on the file, which makes it immutable. Follows symlinks.
+   *
+   * <p>Default implementation assumes that the file system does not support fs-verity.
+   *
+   * @return true if verity is enabled on the file afterwards, false if the file system does not
+   *     support it.
+   * @throws IOException if the file is open for writing or the call failed for any other reason.
+   */
+  public boolean enableFsVerity(Path path) throws IOException {
+    return false;
+  }
+
   /**
    * Gets a fast digest for the given path, or {@code null} if there isn't one available or the
    * filesystem doesn't support them. This digest should be suitable for detecting changes to the
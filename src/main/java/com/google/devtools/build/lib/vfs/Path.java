@@ -767,6 +767,22 @@ public class Path
     return fileSystem.getxattr(this, name, followSymlinks.toBoolean());
   }
 
+  /**
+   * Returns the fs-verity digest of the file, or null if verity is not enabled on it or the file
+   * system does not support fs-verity. Follows symlinks.
+   */
+  public byte[] getFsVerityDigest() throws IOException {
+    return fileSystem.getFsVerityDigest(this);
+  }
+
+  /**
+   * Enables fs-verity on the file, which makes it immutable. Returns false if the file system does
+   * not support fs-verity. Follows symlinks.
+   */
+  public boolean enableFsVerity() throws IOException {
+    return fileSystem.enableFsVerity(this);
+  }
+
   /**
    * Gets a fast digest for the given path, or {@code null} if there isn't one available. The digest
    * should be suitable for detecting changes to the file.
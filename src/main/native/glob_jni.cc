@@ -0,0 +1,699 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Evaluates the glob() of a package natively: the directory tree below the
+// package is walked by a pool of threads, each directory being read once for
+// all include patterns, and the patterns are matched with the semantics of
+// UnixGlob.matches() and UnixGlob.removeExcludes().
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <jni.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "src/main/native/latin1_jni_path.h"
+#include "src/main/native/unix_jni.h"
+
+namespace {
+
+bool StartsWith(const std::string &s, const std::string &prefix) {
+  return s.size() >= prefix.size() && s.compare(0, prefix.size(), prefix) == 0;
+}
+
+bool EndsWith(const std::string &s, const std::string &suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool IsWildcardFree(const std::string &pattern) {
+  return pattern.find_first_of("*?") == std::string::npos;
+}
+
+// Matches `name` against a pattern in which "*" matches any sequence of
+// characters and "?" any single character.
+bool WildcardMatches(const std::string &pattern, const std::string &name) {
+  size_t p = 0, n = 0;
+  size_t star = std::string::npos, star_n = 0;
+  while (n < name.size()) {
+    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+      p++;
+      n++;
+    } else if (p < pattern.size() && pattern[p] == '*') {
+      star = p++;
+      star_n = n;
+    } else if (star != std::string::npos) {
+      p = star + 1;
+      n = ++star_n;
+    } else {
+      return false;
+    }
+  }
+  while (p < pattern.size() && pattern[p] == '*') {
+    p++;
+  }
+  return p == pattern.size();
+}
+
+// One segment of a pattern, classified like UnixGlob.matches() does, which
+// also keeps its quirks: "*" and "**" match names starting with a dot, and a
+// "?" in a prefix or suffix pattern like "*.?" is matched literally.
+class Segment {
+ public:
+  explicit Segment(const std::string &pattern) : pattern_(pattern) {
+    size_t first_star = pattern.find('*');
+    size_t last_star = pattern.rfind('*');
+    if (pattern == "**") {
+      kind_ = kRecursive;
+    } else if (pattern == "*") {
+      kind_ = kAny;
+    } else if (first_star == 0 && last_star == 0) {
+      kind_ = kSuffix;
+      affix_ = pattern.substr(1);
+    } else if (last_star == pattern.size() - 1 && first_star == last_star) {
+      kind_ = kPrefix;
+      affix_ = pattern.substr(0, pattern.size() - 1);
+    } else if (IsWildcardFree(pattern)) {
+      kind_ = kLiteral;
+    } else {
+      kind_ = kWildcard;
+    }
+  }
+
+  bool IsRecursive() const { return kind_ == kRecursive; }
+
+  // Whether the segment can only match its own text, in which case the
+  // directory need not be read.
+  bool IsLiteral() const { return kind_ == kLiteral; }
+
+  const std::string &pattern() const { return pattern_; }
+
+  bool Matches(const std::string &name) const {
+    if (name.empty()) {
+      return false;
+    }
+    if (kind_ == kRecursive || kind_ == kAny) {
+      return true;
+    }
+    // A name starting with '.' must be matched explicitly.
+    if (name[0] == '.' && pattern_[0] != '.') {
+      return false;
+    }
+    switch (kind_) {
+      case kSuffix:
+        return EndsWith(name, affix_);
+      case kPrefix:
+        return StartsWith(name, affix_);
+      case kLiteral:
+        return name == pattern_;
+      default:
+        return WildcardMatches(pattern_, name);
+    }
+  }
+
+ private:
+  enum Kind { kRecursive, kAny, kSuffix, kPrefix, kLiteral, kWildcard };
+
+  std::string pattern_;
+  Kind kind_;
+  std::string affix_;
+};
+
+typedef std::vector<Segment> Pattern;
+
+Pattern CompilePattern(const std::string &pattern) {
+  Pattern segments;
+  size_t start = 0;
+  while (true) {
+    size_t slash = pattern.find('/', start);
+    segments.emplace_back(pattern.substr(start, slash - start));
+    if (slash == std::string::npos) {
+      return segments;
+    }
+    start = slash + 1;
+  }
+}
+
+// Whether `path`, split into segments, matches `pattern` from the given
+// segments on. Like UnixGlob.matchesPattern().
+bool PatternMatches(const Pattern &pattern, size_t i,
+                    const std::vector<std::string> &path, size_t j) {
+  if (i == pattern.size()) {
+    return j == path.size();
+  }
+  if (pattern[i].IsRecursive()) {
+    return PatternMatches(pattern, i + 1, path, j) ||
+           (j < path.size() && PatternMatches(pattern, i, path, j + 1));
+  }
+  return j < path.size() && pattern[i].Matches(path[j]) &&
+         PatternMatches(pattern, i + 1, path, j + 1);
+}
+
+// Removes the paths matching any of `excludes`, with the same fast paths as
+// UnixGlob.removeExcludes(), whose results differ slightly from those of the
+// general matcher.
+void RemoveExcludes(const std::vector<std::string> &excludes,
+                    std::vector<std::string> *paths) {
+  std::set<std::string> literals;
+  std::vector<std::pair<std::string, std::string>> heads_and_tails;
+  std::vector<Pattern> patterns;
+  for (const std::string &exclude : excludes) {
+    if (IsWildcardFree(exclude)) {
+      literals.insert(exclude);
+      continue;
+    }
+    size_t pos = exclude.find("**/*");
+    if (pos != std::string::npos) {
+      std::string head = exclude.substr(0, pos);
+      std::string tail = exclude.substr(pos + 4);
+      if (IsWildcardFree(head) && IsWildcardFree(tail)) {
+        heads_and_tails.emplace_back(head, tail);
+        continue;
+      }
+    }
+    patterns.push_back(CompilePattern(exclude));
+  }
+
+  auto excluded = [&](const std::string &path) {
+    if (literals.count(path) > 0) {
+      return true;
+    }
+    for (const auto &head_and_tail : heads_and_tails) {
+      if (StartsWith(path, head_and_tail.first) &&
+          EndsWith(path, head_and_tail.second)) {
+        return true;
+      }
+    }
+    if (patterns.empty()) {
+      return false;
+    }
+    std::vector<std::string> segments;
+    size_t start = 0;
+    while (true) {
+      size_t slash = path.find('/', start);
+      segments.push_back(path.substr(start, slash - start));
+      if (slash == std::string::npos) {
+        break;
+      }
+      start = slash + 1;
+    }
+    for (const Pattern &pattern : patterns) {
+      if (PatternMatches(pattern, 0, segments, 0)) {
+        return true;
+      }
+    }
+    return false;
+  };
+  paths->erase(std::remove_if(paths->begin(), paths->end(), excluded),
+               paths->end());
+}
+
+// A position in the include patterns: (pattern, segment).
+typedef std::pair<int, int> State;
+
+// A directory to visit: its path relative to the base directory, the
+// patterns positions it is to be matched against and the identities of the
+// directories on the way there, to detect symlink cycles.
+struct DirectoryTask {
+  std::string path;
+  std::vector<State> states;
+  std::vector<std::pair<dev_t, ino_t>> ancestors;
+};
+
+// The names and d_type values of directory entries.
+typedef std::vector<std::pair<std::string, unsigned char>> Dirents;
+
+// Reads the entries of the directory `fd`, without "." and "..". Returns false
+// and sets errno on error.
+bool ReadDirectory(int fd, Dirents *dirents) {
+#if defined(__linux__)
+  // getdents64 on the descriptor we have open anyway, with a buffer large
+  // enough for most directories in one call.
+  struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;  // NOLINT
+    unsigned char d_type;
+    char d_name[];
+  };
+  std::vector<char> buf(32768);
+  while (true) {
+    long n = syscall(SYS_getdents64, fd, buf.data(), buf.size());  // NOLINT
+    if (n < 0) {
+      return false;
+    }
+    if (n == 0) {
+      return true;
+    }
+    for (long pos = 0; pos < n;) {  // NOLINT
+      auto *dent = reinterpret_cast<linux_dirent64 *>(&buf[pos]);
+      pos += dent->d_reclen;
+      if (strcmp(dent->d_name, ".") != 0 && strcmp(dent->d_name, "..") != 0) {
+        dirents->emplace_back(dent->d_name, dent->d_type);
+      }
+    }
+  }
+#else
+  int dup_fd = dup(fd);
+  DIR *dir = dup_fd < 0 ? nullptr : fdopendir(dup_fd);
+  if (dir == nullptr) {
+    if (dup_fd >= 0) {
+      close(dup_fd);
+    }
+    return false;
+  }
+  errno = 0;
+  struct dirent *dent;
+  while ((dent = readdir(dir)) != nullptr) {
+    if (strcmp(dent->d_name, ".") != 0 && strcmp(dent->d_name, "..") != 0) {
+      dirents->emplace_back(dent->d_name, dent->d_type);
+    }
+  }
+  int error = errno;
+  closedir(dir);
+  errno = error;
+  return error == 0;
+#endif
+}
+
+class Globber {
+ public:
+  Globber(int base_fd, const std::vector<std::string> &includes,
+          bool exclude_directories,
+          const std::vector<std::string> &build_file_names)
+      : base_fd_(base_fd),
+        exclude_directories_(exclude_directories),
+        build_file_names_(build_file_names),
+        max_threads_(1),
+        idle_(0),
+        pending_(0),
+        error_number_(0) {
+    for (const std::string &include : includes) {
+      patterns_.push_back(CompilePattern(include));
+    }
+  }
+
+  // Walks the tree with up to `threads` threads. Returns false on error.
+  bool Run(int threads, const std::pair<dev_t, ino_t> &base_id);
+
+  // The matching paths relative to the base directory, and the
+  // subdirectories that were not entered because they contain a build file.
+  std::vector<std::string> &matches() { return matches_; }
+  std::vector<std::string> &subpackages() { return subpackages_; }
+
+  int error_number() const { return error_number_; }
+  const std::string &error() const { return error_; }
+
+ private:
+  struct Output {
+    std::vector<std::string> matches;
+    std::vector<std::string> subpackages;
+  };
+
+  void Worker();
+  bool Visit(DirectoryTask *task, Output *out);
+  // Queues the subdirectory `name` of the directory `fd` visited by `task`
+  // to be matched against `states`, unless it is a subpackage.
+  bool AddSubdirectory(int fd, const DirectoryTask &task,
+                       const std::string &name, std::vector<State> states,
+                       Output *out);
+  bool Fail(int error_number, const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error_number_ == 0) {
+      error_number_ = error_number;
+      error_ = path;
+    }
+    work_available_.notify_all();
+    return false;
+  }
+
+  static std::string Child(const std::string &dir, const std::string &name) {
+    return dir.empty() ? name : dir + "/" + name;
+  }
+
+  const int base_fd_;
+  const bool exclude_directories_;
+  const std::vector<std::string> build_file_names_;
+  std::vector<Pattern> patterns_;
+
+  // mutex_ guards the members below.
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::vector<DirectoryTask> queue_;
+  // Threads are only started while there is more work queued than there are
+  // idle threads, so that a small glob does not start one per core.
+  int max_threads_;
+  std::vector<std::thread> pool_;
+  int idle_;
+  // Queued and running tasks.
+  int pending_;
+  int error_number_;
+  std::string error_;
+  std::vector<std::string> matches_;
+  std::vector<std::string> subpackages_;
+};
+
+bool Globber::Run(int threads, const std::pair<dev_t, ino_t> &base_id) {
+  DirectoryTask root;
+  for (size_t i = 0; i < patterns_.size(); ++i) {
+    root.states.emplace_back(i, 0);
+  }
+  root.ancestors.push_back(base_id);
+  queue_.push_back(std::move(root));
+  pending_ = 1;
+
+  if (threads <= 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+  max_threads_ = threads;
+  Worker();
+  // No more threads are started once the walk has finished or failed.
+  for (std::thread &thread : pool_) {
+    thread.join();
+  }
+  return error_number_ == 0;
+}
+
+void Globber::Worker() {
+  Output out;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    idle_++;
+    work_available_.wait(lock, [this] {
+      return !queue_.empty() || pending_ == 0 || error_number_ != 0;
+    });
+    idle_--;
+    if (queue_.empty() || error_number_ != 0) {
+      break;
+    }
+    // Depth first, which keeps the queue short.
+    DirectoryTask task = std::move(queue_.back());
+    queue_.pop_back();
+    lock.unlock();
+    Visit(&task, &out);
+    lock.lock();
+    if (--pending_ == 0) {
+      work_available_.notify_all();
+    }
+  }
+  matches_.insert(matches_.end(), out.matches.begin(), out.matches.end());
+  subpackages_.insert(subpackages_.end(), out.subpackages.begin(),
+                      out.subpackages.end());
+}
+
+bool Globber::Visit(DirectoryTask *task, Output *out) {
+  // "**" can match nothing at all: x/** matches x, **/y matches y and x/**/y
+  // matches x/y.
+  std::vector<State> &states = task->states;
+  for (size_t i = 0; i < states.size(); ++i) {
+    const Pattern &pattern = patterns_[states[i].first];
+    if (states[i].second < static_cast<int>(pattern.size()) &&
+        pattern[states[i].second].IsRecursive()) {
+      State next(states[i].first, states[i].second + 1);
+      if (std::find(states.begin(), states.end(), next) == states.end()) {
+        states.push_back(next);
+      }
+    }
+  }
+
+  bool read_directory = false;
+  bool matched = false;
+  for (const State &state : states) {
+    const Pattern &pattern = patterns_[state.first];
+    if (state.second == static_cast<int>(pattern.size())) {
+      matched = true;
+    } else if (!pattern[state.second].IsLiteral()) {
+      read_directory = true;
+    }
+  }
+  // The base directory itself is never reported.
+  if (matched && !exclude_directories_ && !task->path.empty()) {
+    out->matches.push_back(task->path);
+  }
+  if (std::all_of(states.begin(), states.end(), [this](const State &state) {
+        return state.second == static_cast<int>(patterns_[state.first].size());
+      })) {
+    return true;
+  }
+
+  int fd = openat(base_fd_, task->path.empty() ? "." : task->path.c_str(),
+                  O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return Fail(errno, task->path);
+  }
+
+  // The subdirectories to visit, with the pattern positions below them.
+  std::map<std::string, std::vector<State>> subdirectories;
+  bool ok = true;
+
+  // Literal segments only need a stat, like in UnixGlob.
+  for (const State &state : states) {
+    const Pattern &pattern = patterns_[state.first];
+    if (state.second == static_cast<int>(pattern.size()) ||
+        !pattern[state.second].IsLiteral()) {
+      continue;
+    }
+    const std::string &name = pattern[state.second].pattern();
+    struct stat statbuf;
+    if (fstatat(fd, name.c_str(), &statbuf, 0) < 0) {
+      if (errno != ENOENT && errno != ENOTDIR) {
+        ok = Fail(errno, Child(task->path, name));
+        break;
+      }
+      continue;
+    }
+    if (S_ISDIR(statbuf.st_mode)) {
+      subdirectories[name].emplace_back(state.first, state.second + 1);
+    } else if (S_ISREG(statbuf.st_mode) &&
+               state.second + 1 == static_cast<int>(pattern.size())) {
+      out->matches.push_back(Child(task->path, name));
+    }
+  }
+
+  Dirents dirents;
+  if (ok && read_directory && !ReadDirectory(fd, &dirents)) {
+    ok = Fail(errno, task->path);
+  }
+  for (size_t d = 0; ok && d < dirents.size(); ++d) {
+    const std::string &name = dirents[d].first;
+    std::vector<State> matched_states;
+    for (const State &state : states) {
+      const Pattern &pattern = patterns_[state.first];
+      if (state.second < static_cast<int>(pattern.size()) &&
+          !pattern[state.second].IsLiteral() &&
+          pattern[state.second].Matches(name)) {
+        matched_states.push_back(state);
+      }
+    }
+    if (matched_states.empty()) {
+      continue;
+    }
+
+    bool is_dir;
+    unsigned char type = dirents[d].second;
+    struct stat statbuf;
+    if (type == DT_UNKNOWN) {
+      if (fstatat(fd, name.c_str(), &statbuf, AT_SYMLINK_NOFOLLOW) < 0) {
+        continue;
+      }
+      type = S_ISDIR(statbuf.st_mode)
+                 ? DT_DIR
+                 : S_ISREG(statbuf.st_mode)
+                       ? DT_REG
+                       : S_ISLNK(statbuf.st_mode) ? DT_LNK : DT_UNKNOWN;
+    }
+    if (type == DT_DIR) {
+      is_dir = true;
+    } else if (type == DT_REG) {
+      is_dir = false;
+    } else if (type == DT_LNK) {
+      // Symlinks are followed; dangling ones are ignored, and anything but a
+      // directory counts as a file, like in UnixGlob.
+      if (fstatat(fd, name.c_str(), &statbuf, 0) < 0) {
+        continue;
+      }
+      is_dir = S_ISDIR(statbuf.st_mode);
+    } else {
+      // A special file (fifo, etc.).
+      continue;
+    }
+    for (const State &state : matched_states) {
+      const Pattern &pattern = patterns_[state.first];
+      if (is_dir) {
+        // A directory stays at a "**": the next segment is matched below it.
+        subdirectories[name].emplace_back(
+            state.first,
+            state.second + (pattern[state.second].IsRecursive() ? 0 : 1));
+      } else if (state.second + 1 == static_cast<int>(pattern.size())) {
+        out->matches.push_back(Child(task->path, name));
+        break;
+      }
+    }
+  }
+
+  for (auto it = subdirectories.begin(); ok && it != subdirectories.end();
+       ++it) {
+    ok = AddSubdirectory(fd, *task, it->first, std::move(it->second), out);
+  }
+  close(fd);
+  return ok;
+}
+
+bool Globber::AddSubdirectory(int fd, const DirectoryTask &task,
+                              const std::string &name,
+                              std::vector<State> states, Output *out) {
+  std::string path = Child(task.path, name);
+  // Subpackages are not entered, nor matched themselves.
+  for (const std::string &build_file_name : build_file_names_) {
+    struct stat statbuf;
+    std::string build_file = name + "/" + build_file_name;
+    if (fstatat(fd, build_file.c_str(), &statbuf, 0) == 0 &&
+        S_ISREG(statbuf.st_mode)) {
+      out->subpackages.push_back(path);
+      return true;
+    }
+  }
+
+  struct stat statbuf;
+  if (fstatat(fd, name.c_str(), &statbuf, 0) < 0) {
+    return Fail(errno, path);
+  }
+  std::pair<dev_t, ino_t> id(statbuf.st_dev, statbuf.st_ino);
+  if (std::find(task.ancestors.begin(), task.ancestors.end(), id) !=
+      task.ancestors.end()) {
+    // A symlink to an ancestor, which would be expanded forever.
+    return true;
+  }
+
+  DirectoryTask child;
+  child.path = path;
+  child.states = std::move(states);
+  std::sort(child.states.begin(), child.states.end());
+  child.states.erase(std::unique(child.states.begin(), child.states.end()),
+                     child.states.end());
+  child.ancestors = task.ancestors;
+  child.ancestors.push_back(id);
+  std::lock_guard<std::mutex> lock(mutex_);
+  queue_.push_back(std::move(child));
+  pending_++;
+  if (queue_.size() > static_cast<size_t>(idle_) && error_number_ == 0 &&
+      static_cast<int>(pool_.size()) + 1 < max_threads_) {
+    pool_.emplace_back(&Globber::Worker, this);
+  }
+  work_available_.notify_one();
+  return true;
+}
+
+std::vector<std::string> GetStrings(JNIEnv *env, jobjectArray array) {
+  std::vector<std::string> strings;
+  jsize count = array == NULL ? 0 : env->GetArrayLength(array);
+  for (jsize i = 0; i < count; ++i) {
+    jstring string = (jstring)env->GetObjectArrayElement(array, i);
+    const char *chars = GetStringLatin1Chars(env, string);
+    strings.push_back(chars);
+    ReleaseStringLatin1Chars(chars);
+    env->DeleteLocalRef(string);
+  }
+  return strings;
+}
+
+}  // namespace
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    glob
+ * Signature: (Ljava/lang/String;[Ljava/lang/String;[Ljava/lang/String;Z
+ *             [Ljava/lang/String;I)[B
+ *
+ * Expands the include patterns below `base` and removes the paths matching
+ * the exclude patterns; see NativePosixFiles.glob() for the result format.
+ */
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_glob(
+    JNIEnv *env, jclass clazz, jstring base, jobjectArray includes,
+    jobjectArray excludes, jboolean exclude_directories,
+    jobjectArray build_file_names, jint threads) {
+  const char *base_chars = GetStringLatin1Chars(env, base);
+  std::string base_path(base_chars);
+  ReleaseStringLatin1Chars(base_chars);
+
+  std::string result;
+  int base_fd = open(base_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  struct stat statbuf;
+  if (base_fd < 0 || fstat(base_fd, &statbuf) < 0) {
+    int error = errno;
+    if (base_fd >= 0) {
+      close(base_fd);
+    }
+    // A missing base matches nothing, like in UnixGlob.
+    if (error != ENOENT && error != ENOTDIR) {
+      ::PostFileException(env, error, base_path.c_str());
+      return NULL;
+    }
+  } else {
+    Globber globber(base_fd, GetStrings(env, includes), exclude_directories,
+                    GetStrings(env, build_file_names));
+    bool ok = globber.Run(
+        threads, std::make_pair(statbuf.st_dev, statbuf.st_ino));
+    close(base_fd);
+    if (!ok) {
+      std::string path = globber.error().empty()
+                             ? base_path
+                             : base_path + "/" + globber.error();
+      ::PostFileException(env, globber.error_number(), path.c_str());
+      return NULL;
+    }
+
+    std::vector<std::string> &matches = globber.matches();
+    std::sort(matches.begin(), matches.end());
+    matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+    RemoveExcludes(GetStrings(env, excludes), &matches);
+    std::vector<std::string> &subpackages = globber.subpackages();
+    std::sort(subpackages.begin(), subpackages.end());
+    subpackages.erase(std::unique(subpackages.begin(), subpackages.end()),
+                      subpackages.end());
+    for (const std::string &match : matches) {
+      result.push_back('M');
+      result.append(match);
+      result.push_back('\0');
+    }
+    for (const std::string &subpackage : subpackages) {
+      result.push_back('P');
+      result.append(subpackage);
+      result.push_back('\0');
+    }
+  }
+
+  jbyteArray array = env->NewByteArray(result.size());
+  if (array != NULL) {
+    env->SetByteArrayRegion(array, 0, result.size(),
+                            reinterpret_cast<const jbyte *>(result.data()));
+  }
+  return array;
+}
@@ -0,0 +1,424 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Builds the Merkle tree of a remote execution input root: the files are
+// hashed in parallel with Md5MultiDigest, then the canonical
+// build.bazel.remote.execution.v2 Directory messages are serialized bottom-up.
+
+#include <dirent.h>
+#include <errno.h>
+#include <jni.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/main/cpp/util/md5.h"
+#include "src/main/cpp/util/md5_multi.h"
+#include "src/main/native/unix_jni.h"
+
+using blaze_util::Md5Digest;
+using blaze_util::Md5MultiDigest;
+
+namespace {
+
+struct File {
+  // Path to read the contents from, empty for an empty file.
+  std::string path;
+  uint64_t size;
+  unsigned char digest[Md5Digest::kDigestLength];
+};
+
+struct Directory {
+  // Children by name: std::map keeps them in the canonical order.
+  std::map<std::string, size_t> files;  // index in MerkleTreeBuilder::files_
+  std::map<std::string, std::unique_ptr<Directory>> directories;
+};
+
+void PutVarint(uint64_t value, std::string *out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+// Appends a length-delimited field (string or message).
+void PutBytes(int field, const std::string &value, std::string *out) {
+  PutVarint(field << 3 | 2, out);
+  PutVarint(value.size(), out);
+  out->append(value);
+}
+
+// Returns a serialized Digest message. Fields holding their default value are
+// omitted, as the canonical encoding requires.
+std::string DigestMessage(const unsigned char *digest, uint64_t size) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  std::string hash;
+  for (int i = 0; i < Md5Digest::kDigestLength; ++i) {
+    hash.push_back(kHexDigits[digest[i] >> 4]);
+    hash.push_back(kHexDigits[digest[i] & 0xf]);
+  }
+  std::string result;
+  PutBytes(1, hash, &result);
+  if (size != 0) {
+    PutVarint(2 << 3, &result);
+    PutVarint(size, &result);
+  }
+  return result;
+}
+
+class MerkleTreeBuilder {
+ public:
+  MerkleTreeBuilder() : error_number_(0) {}
+
+  // Adds "source" to the input root at "input_path", which is relative to the
+  // root and empty for the root itself. A directory source is added with all
+  // its contents, following symlinks; an empty source stands for an empty
+  // file. Returns false on error.
+  bool AddInput(const std::string &input_path, const std::string &source);
+
+  // Hashes all the files using "threads" threads. Returns false on error.
+  bool HashFiles(int threads);
+
+  // Returns the digest of the root Directory followed by a serialized Tree
+  // message holding the root and its distinct subdirectories.
+  std::string Serialize() const;
+
+  int error_number() const { return error_number_; }
+  const std::string &error() const { return error_; }
+
+ private:
+  bool Fail(int error_number, const std::string &path) {
+    error_number_ = error_number;
+    error_ = path;
+    return false;
+  }
+
+  // Returns the directory at "path" below the root, creating it if needed, or
+  // NULL if a file is in the way.
+  Directory *MakeDirectory(const std::string &path);
+
+  bool AddFile(Directory *dir, const std::string &name, std::string path,
+               const portable_stat_struct &statbuf);
+  bool AddDirectoryContents(Directory *dir, const std::string &path);
+
+  // Serializes "dir" into "message", after adding its subdirectories that are
+  // not in "digests" yet to "tree".
+  void SerializeDirectory(const Directory &dir, std::string *message,
+                          std::set<std::string> *digests,
+                          std::string *tree) const;
+
+  Directory root_;
+  std::vector<File> files_;
+  int error_number_;
+  std::string error_;
+};
+
+Directory *MerkleTreeBuilder::MakeDirectory(const std::string &path) {
+  Directory *dir = &root_;
+  size_t start = 0;
+  while (start < path.size()) {
+    size_t end = path.find('/', start);
+    if (end == std::string::npos) {
+      end = path.size();
+    }
+    if (end > start) {
+      std::string name = path.substr(start, end - start);
+      if (dir->files.count(name) != 0) {
+        return NULL;
+      }
+      std::unique_ptr<Directory> &child = dir->directories[name];
+      if (child == NULL) {
+        child.reset(new Directory());
+      }
+      dir = child.get();
+    }
+    start = end + 1;
+  }
+  return dir;
+}
+
+bool MerkleTreeBuilder::AddFile(Directory *dir, const std::string &name,
+                                std::string path,
+                                const portable_stat_struct &statbuf) {
+  if (dir->directories.count(name) != 0 || dir->files.count(name) != 0) {
+    return Fail(EEXIST, path);
+  }
+  dir->files[name] = files_.size();
+  files_.push_back(File());
+  File &file = files_.back();
+  file.path.swap(path);
+  file.size = statbuf.st_size;
+  return true;
+}
+
+bool MerkleTreeBuilder::AddDirectoryContents(Directory *dir,
+                                             const std::string &path) {
+  DIR *d = opendir(path.c_str());
+  if (d == NULL) {
+    return Fail(errno, path);
+  }
+  std::vector<std::string> names;
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL) {
+    if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0) {
+      names.push_back(e->d_name);
+    }
+  }
+  closedir(d);
+
+  for (const std::string &name : names) {
+    std::string child_path = path + "/" + name;
+    portable_stat_struct statbuf;
+    if (portable_stat(child_path.c_str(), &statbuf) == -1) {
+      return Fail(errno, child_path);
+    }
+    if (S_ISDIR(statbuf.st_mode)) {
+      if (dir->files.count(name) != 0) {
+        return Fail(EEXIST, child_path);
+      }
+      std::unique_ptr<Directory> &child = dir->directories[name];
+      if (child == NULL) {
+        child.reset(new Directory());
+      }
+      if (!AddDirectoryContents(child.get(), child_path)) {
+        return false;
+      }
+    } else if (S_ISREG(statbuf.st_mode)) {
+      if (!AddFile(dir, name, child_path, statbuf)) {
+        return false;
+      }
+    } else {
+      return Fail(EINVAL, child_path);
+    }
+  }
+  return true;
+}
+
+bool MerkleTreeBuilder::AddInput(const std::string &input_path,
+                                 const std::string &source) {
+  portable_stat_struct statbuf;
+  if (source.empty()) {
+    memset(&statbuf, 0, sizeof(statbuf));
+    statbuf.st_mode = S_IFREG;
+  } else if (portable_stat(source.c_str(), &statbuf) == -1) {
+    return Fail(errno, source);
+  }
+
+  if (S_ISDIR(statbuf.st_mode)) {
+    Directory *dir = MakeDirectory(input_path);
+    if (dir == NULL) {
+      return Fail(EEXIST, input_path);
+    }
+    return AddDirectoryContents(dir, source);
+  }
+  if (!S_ISREG(statbuf.st_mode)) {
+    return Fail(EINVAL, source);
+  }
+  size_t slash = input_path.rfind('/');
+  std::string name = slash == std::string::npos
+                         ? input_path
+                         : input_path.substr(slash + 1);
+  if (name.empty()) {
+    return Fail(EINVAL, input_path);
+  }
+  Directory *dir = MakeDirectory(
+      slash == std::string::npos ? "" : input_path.substr(0, slash));
+  if (dir == NULL) {
+    return Fail(EEXIST, input_path);
+  }
+  return AddFile(dir, name, source, statbuf);
+}
+
+bool MerkleTreeBuilder::HashFiles(int threads) {
+  // Each worker takes a few files per lane at a time, so that the lanes of
+  // Md5MultiDigest stay busy while the pool still balances uneven sizes.
+  const size_t chunk = 4 * Md5MultiDigest::kLanes;
+  std::atomic<size_t> next(0);
+  std::atomic<bool> failed(false);
+  std::mutex error_mutex;
+  auto worker = [this, chunk, &next, &failed, &error_mutex]() {
+    std::vector<const char *> paths;
+    std::vector<size_t> indices;
+    std::vector<unsigned char> digests;
+    std::vector<int> errors;
+    for (size_t start = next.fetch_add(chunk);
+         start < files_.size() && !failed; start = next.fetch_add(chunk)) {
+      size_t end = std::min(start + chunk, files_.size());
+      paths.clear();
+      indices.clear();
+      for (size_t i = start; i < end; ++i) {
+        File &file = files_[i];
+        if (file.path.empty()) {
+          Md5Digest digest;
+          digest.Finish(file.digest);
+        } else {
+          paths.push_back(file.path.c_str());
+          indices.push_back(i);
+        }
+      }
+      digests.resize(Md5Digest::kDigestLength * paths.size());
+      errors.resize(paths.size());
+      Md5MultiDigest::DigestFiles(paths.data(), paths.size(), digests.data(),
+                                  errors.data());
+      for (size_t j = 0; j < paths.size(); ++j) {
+        File &file = files_[indices[j]];
+        if (errors[j] != 0) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (!failed) {
+            Fail(errors[j], file.path);
+            failed = true;
+          }
+          break;
+        }
+        memcpy(file.digest, &digests[Md5Digest::kDigestLength * j],
+               Md5Digest::kDigestLength);
+      }
+    }
+  };
+
+  if (threads <= 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+  std::vector<std::thread> pool;
+  for (int i = 1; i < threads && i * chunk < files_.size(); ++i) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : pool) {
+    thread.join();
+  }
+  return !failed;
+}
+
+void MerkleTreeBuilder::SerializeDirectory(const Directory &dir,
+                                           std::string *message,
+                                           std::set<std::string> *digests,
+                                           std::string *tree) const {
+  for (const auto &entry : dir.files) {
+    const File &file = files_[entry.second];
+    std::string node;
+    PutBytes(1, entry.first, &node);
+    PutBytes(2, DigestMessage(file.digest, file.size), &node);
+    // Like MerkleTree.java, all the input files are executable.
+    PutVarint(4 << 3, &node);
+    PutVarint(1, &node);
+    PutBytes(1, node, message);
+  }
+  for (const auto &entry : dir.directories) {
+    std::string child;
+    SerializeDirectory(*entry.second, &child, digests, tree);
+    unsigned char child_digest[Md5Digest::kDigestLength];
+    Md5Digest md5;
+    md5.Update(child.data(), child.size());
+    md5.Finish(child_digest);
+    std::string digest = DigestMessage(child_digest, child.size());
+    if (digests->insert(digest).second) {
+      PutBytes(2, child, tree);
+    }
+    std::string node;
+    PutBytes(1, entry.first, &node);
+    PutBytes(2, digest, &node);
+    PutBytes(2, node, message);
+  }
+}
+
+std::string MerkleTreeBuilder::Serialize() const {
+  std::set<std::string> digests;
+  std::string children;
+  std::string root;
+  SerializeDirectory(root_, &root, &digests, &children);
+
+  unsigned char root_digest[Md5Digest::kDigestLength];
+  Md5Digest md5;
+  md5.Update(root.data(), root.size());
+  md5.Finish(root_digest);
+  std::string result(reinterpret_cast<char *>(root_digest),
+                     Md5Digest::kDigestLength);
+  PutBytes(1, root, &result);
+  result.append(children);
+  return result;
+}
+
+}  // namespace
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    md5MerkleTree
+ * Signature: ([BI)[B
+ *
+ * Builds the Merkle tree of an input root with MD5 digests. `entries` holds
+ * NUL-terminated pairs of input path and source path, see
+ * MerkleTreeBuilder::AddInput().
+ */
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_md5MerkleTree(
+    JNIEnv *env, jclass clazz, jbyteArray entries, jint threads) {
+  jsize entries_len = env->GetArrayLength(entries);
+  std::vector<char> buf(entries_len);
+  if (entries_len > 0) {
+    env->GetByteArrayRegion(entries, 0, entries_len,
+                            reinterpret_cast<jbyte *>(&buf[0]));
+    if (env->ExceptionOccurred()) {
+      return NULL;
+    }
+  }
+
+  MerkleTreeBuilder builder;
+  bool ok = true;
+  size_t pos = 0;
+  while (ok && pos < buf.size()) {
+    const char *input_path = &buf[pos];
+    size_t input_path_len = strnlen(input_path, buf.size() - pos);
+    if (pos + input_path_len == buf.size()) {
+      ::PostException(env, EINVAL, "unterminated input entry");
+      return NULL;
+    }
+    pos += input_path_len + 1;
+    const char *source = &buf[pos];
+    size_t source_len = strnlen(source, buf.size() - pos);
+    if (pos + source_len == buf.size()) {
+      ::PostException(env, EINVAL, "unterminated input entry");
+      return NULL;
+    }
+    pos += source_len + 1;
+    ok = builder.AddInput(std::string(input_path, input_path_len),
+                          std::string(source, source_len));
+  }
+  if (ok) {
+    ok = builder.HashFiles(threads);
+  }
+  if (!ok) {
+    ::PostFileException(env, builder.error_number(), builder.error().c_str());
+    return NULL;
+  }
+
+  std::string tree = builder.Serialize();
+  jbyteArray result = env->NewByteArray(tree.size());
+  if (result != NULL) {
+    env->SetByteArrayRegion(result, 0, tree.size(),
+                            reinterpret_cast<const jbyte *>(tree.data()));
+  }
+  return result;
+}
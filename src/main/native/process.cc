@@ -12,10 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <errno.h>
+#include <fcntl.h>
 #include <jni.h>
-
 #include <unistd.h>
 
+#include "src/main/native/latin1_jni_path.h"
+#include "src/main/native/unix_jni.h"
+
 /*
  * Class:     com.google.devtools.build.lib.unix.ProcessUtils
  * Method:    getgid
@@ -45,3 +49,44 @@ extern "C" JNIEXPORT jint JNICALL
 Java_com_google_devtools_build_lib_unix_ProcessUtils_getuid(JNIEnv *env, jclass clazz) {
   return getuid();
 }
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.ProcessUtils
+ * Method:    chdir
+ * Signature: (Ljava/lang/String;)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_ProcessUtils_chdir(JNIEnv *env,
+                                                           jclass clazz,
+                                                           jstring path) {
+  const char *path_chars = GetStringLatin1Chars(env, path);
+  if (chdir(path_chars) == -1) {
+    ::PostFileException(env, errno, path_chars);
+  }
+  ReleaseStringLatin1Chars(path_chars);
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.ProcessUtils
+ * Method:    redirectOutput
+ * Signature: (Ljava/lang/String;Z)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_ProcessUtils_redirectOutput(
+    JNIEnv *env, jclass clazz, jstring path, jboolean append) {
+  const char *path_chars = GetStringLatin1Chars(env, path);
+  int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+  int fd = open(path_chars, flags, 0666);
+  if (fd == -1) {
+    ::PostFileException(env, errno, path_chars);
+  } else {
+    // dup2 clears O_CLOEXEC on the new descriptors, as they should be.
+    if (dup2(fd, STDOUT_FILENO) == -1 || dup2(fd, STDERR_FILENO) == -1) {
+      ::PostFileException(env, errno, path_chars);
+    }
+    close(fd);
+  }
+  ReleaseStringLatin1Chars(path_chars);
+}
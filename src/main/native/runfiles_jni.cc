@@ -0,0 +1,82 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <jni.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "src/main/native/latin1_jni_path.h"
+#include "src/main/native/unix_jni.h"
+#include "src/main/tools/runfiles-creator.h"
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    createRunfilesTree
+ * Signature: (Ljava/lang/String;[BZ)V
+ *
+ * Creates or updates the runfiles tree in `runfiles_dir` in-process, the same
+ * way build-runfiles does. `entries` holds the manifest entries as
+ * NUL-terminated pairs of link and target paths; an empty target stands for
+ * an empty file.
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_createRunfilesTree(
+    JNIEnv *env, jclass clazz, jstring runfiles_dir, jbyteArray entries,
+    jboolean allow_relative) {
+  jsize entries_len = env->GetArrayLength(entries);
+  std::vector<char> buf(entries_len);
+  if (entries_len > 0) {
+    env->GetByteArrayRegion(entries, 0, entries_len,
+                            reinterpret_cast<jbyte *>(&buf[0]));
+    if (env->ExceptionOccurred()) {
+      return;
+    }
+  }
+
+  const char *runfiles_dir_chars = GetStringLatin1Chars(env, runfiles_dir);
+  RunfilesCreator creator(runfiles_dir_chars);
+  bool ok = true;
+  size_t pos = 0;
+  while (ok && pos < buf.size()) {
+    const char *link = &buf[pos];
+    size_t link_len = strnlen(link, buf.size() - pos);
+    if (pos + link_len == buf.size()) {
+      ::PostException(env, EINVAL, "unterminated runfiles entry");
+      ReleaseStringLatin1Chars(runfiles_dir_chars);
+      return;
+    }
+    pos += link_len + 1;
+    const char *target = &buf[pos];
+    size_t target_len = strnlen(target, buf.size() - pos);
+    if (pos + target_len == buf.size()) {
+      ::PostException(env, EINVAL, "unterminated runfiles entry");
+      ReleaseStringLatin1Chars(runfiles_dir_chars);
+      return;
+    }
+    pos += target_len + 1;
+    ok = creator.AddEntry(link, target, allow_relative);
+  }
+  if (ok) {
+    ok = creator.CreateRunfiles();
+  }
+  if (!ok) {
+    ::PostException(env,
+                    creator.error_number() ? creator.error_number() : EIO,
+                    std::string(runfiles_dir_chars) + ": " + creator.error());
+  }
+  ReleaseStringLatin1Chars(runfiles_dir_chars);
+}
@@ -0,0 +1,359 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Samples Linux load signals for com.google.devtools.build.lib.unix.SystemLoad:
+// pressure stall information, MemAvailable and the memory usage and limit of
+// the cgroup the server runs in.
+//
+// The files are opened once and re-read with pread(2), which makes a sample a
+// handful of syscalls and lets any number of threads sample concurrently. The
+// optional sampler thread publishes its samples through a sequence lock, so
+// polling it from Java is a few atomic loads.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <jni.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace {
+
+// The indices of the values in a sample. Keep in sync with SystemLoad.java.
+enum LoadValue {
+  kCpuSomeAvg10,
+  kCpuSomeTotal,
+  kMemorySomeAvg10,
+  kMemoryFullAvg10,
+  kMemorySomeTotal,
+  kMemoryFullTotal,
+  kIoSomeAvg10,
+  kIoFullAvg10,
+  kIoSomeTotal,
+  kIoFullTotal,
+  kMemAvailable,
+  kCgroupMemoryCurrent,
+  kCgroupMemoryMax,
+  kSampleTime,
+  kNumLoadValues,
+};
+
+// File descriptors of the files a sample is read from, or -1 for the files
+// this kernel does not provide.
+struct LoadFiles {
+  int cpu_pressure;
+  int memory_pressure;
+  int io_pressure;
+  int meminfo;
+  int cgroup_memory_current;
+  int cgroup_memory_max;
+};
+
+int OpenReadOnly(const std::string &path) {
+  return open(path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+// Returns the path of the cgroup of this process in the hierarchy with the
+// given controller, e.g. "memory", or in the unified hierarchy if the
+// controller is empty. Returns false if there is no such hierarchy.
+bool GetCgroupPath(const std::string &controller, std::string *path) {
+  FILE *f = fopen("/proc/self/cgroup", "re");
+  if (f == nullptr) {
+    return false;
+  }
+  // Lines look like "4:memory:/user.slice" or "0::/user.slice".
+  bool found = false;
+  char *line = nullptr;
+  size_t line_size = 0;
+  ssize_t len;
+  while (!found && (len = getline(&line, &line_size, f)) > 0) {
+    if (line[len - 1] == '\n') {
+      line[--len] = '\0';
+    }
+    char *controllers = strchr(line, ':');
+    char *cgroup = controllers ? strchr(controllers + 1, ':') : nullptr;
+    if (cgroup == nullptr) {
+      continue;
+    }
+    std::string names(controllers + 1, cgroup - controllers - 1);
+    if (controller.empty() ? names.empty()
+                           : (names == controller ||
+                              names.find(controller + ",") == 0 ||
+                              names.find("," + controller) !=
+                                  std::string::npos)) {
+      *path = cgroup + 1;
+      found = true;
+    }
+  }
+  free(line);
+  fclose(f);
+  return found;
+}
+
+LoadFiles OpenLoadFiles() {
+  LoadFiles files;
+  files.cpu_pressure = OpenReadOnly("/proc/pressure/cpu");
+  files.memory_pressure = OpenReadOnly("/proc/pressure/memory");
+  files.io_pressure = OpenReadOnly("/proc/pressure/io");
+  files.meminfo = OpenReadOnly("/proc/meminfo");
+  files.cgroup_memory_current = -1;
+  files.cgroup_memory_max = -1;
+
+  // Prefer the unified hierarchy (cgroup v2) and fall back to the memory
+  // controller of cgroup v1.
+  std::string cgroup;
+  if (GetCgroupPath("", &cgroup)) {
+    std::string dir = "/sys/fs/cgroup" + cgroup;
+    files.cgroup_memory_current = OpenReadOnly(dir + "/memory.current");
+    files.cgroup_memory_max = OpenReadOnly(dir + "/memory.max");
+  }
+  if (files.cgroup_memory_current < 0 && GetCgroupPath("memory", &cgroup)) {
+    std::string dir = "/sys/fs/cgroup/memory" + cgroup;
+    files.cgroup_memory_current = OpenReadOnly(dir + "/memory.usage_in_bytes");
+    files.cgroup_memory_max = OpenReadOnly(dir + "/memory.limit_in_bytes");
+  }
+  return files;
+}
+
+const LoadFiles &GetLoadFiles() {
+  static const LoadFiles files = OpenLoadFiles();
+  return files;
+}
+
+// Reads the whole (small) file behind fd into the NUL-terminated buf. Returns
+// false if the file is not available.
+bool ReadLoadFile(int fd, char *buf, size_t size) {
+  if (fd < 0) {
+    return false;
+  }
+  ssize_t len;
+  do {
+    len = pread(fd, buf, size - 1, 0);
+  } while (len < 0 && errno == EINTR);
+  if (len < 0) {
+    return false;
+  }
+  buf[len] = '\0';
+  return true;
+}
+
+// Parses the line of a /proc/pressure file that starts with `kind` ("some" or
+// "full"), e.g. "some avg10=1.53 avg60=0.87 avg300=0.33 total=12345". The
+// average is stored in hundredths of a percent, the total in microseconds.
+void ParsePressure(const char *contents, const char *kind, int64_t *avg10,
+                   int64_t *total) {
+  const char *line = contents;
+  size_t kind_len = strlen(kind);
+  while (line != nullptr && strncmp(line, kind, kind_len) != 0) {
+    line = strchr(line, '\n');
+    line = line ? line + 1 : nullptr;
+  }
+  double avg;
+  long long total_us;  // NOLINT
+  if (line == nullptr ||
+      sscanf(line + kind_len, " avg10=%lf avg60=%*f avg300=%*f total=%lld",
+             &avg, &total_us) != 2) {
+    return;
+  }
+  *avg10 = static_cast<int64_t>(avg * 100 + 0.5);
+  *total = total_us;
+}
+
+void SamplePressure(int fd, LoadValue some_avg10, LoadValue full_avg10,
+                    LoadValue some_total, LoadValue full_total,
+                    int64_t *values) {
+  char buf[256];
+  if (!ReadLoadFile(fd, buf, sizeof(buf))) {
+    return;
+  }
+  ParsePressure(buf, "some", &values[some_avg10], &values[some_total]);
+  if (full_avg10 != kNumLoadValues) {
+    ParsePressure(buf, "full", &values[full_avg10], &values[full_total]);
+  }
+}
+
+// Takes a sample. Values that are not available are -1.
+void SampleLoad(int64_t *values) {
+  const LoadFiles &files = GetLoadFiles();
+  for (int i = 0; i < kNumLoadValues; i++) {
+    values[i] = -1;
+  }
+
+  // The "full" line of /proc/pressure/cpu is always zero, if it is present.
+  SamplePressure(files.cpu_pressure, kCpuSomeAvg10, kNumLoadValues,
+                 kCpuSomeTotal, kNumLoadValues, values);
+  SamplePressure(files.memory_pressure, kMemorySomeAvg10, kMemoryFullAvg10,
+                 kMemorySomeTotal, kMemoryFullTotal, values);
+  SamplePressure(files.io_pressure, kIoSomeAvg10, kIoFullAvg10, kIoSomeTotal,
+                 kIoFullTotal, values);
+
+  char buf[8192];
+  if (ReadLoadFile(files.meminfo, buf, sizeof(buf))) {
+    const char *mem_available = strstr(buf, "MemAvailable:");
+    if (mem_available != nullptr) {
+      values[kMemAvailable] =
+          strtoll(mem_available + strlen("MemAvailable:"), nullptr, 10) * 1024;
+    }
+  }
+  if (ReadLoadFile(files.cgroup_memory_current, buf, sizeof(buf))) {
+    values[kCgroupMemoryCurrent] = strtoll(buf, nullptr, 10);
+  }
+  if (ReadLoadFile(files.cgroup_memory_max, buf, sizeof(buf))) {
+    // cgroup v2 writes "max" if there is no limit, v1 the largest multiple of
+    // the page size.
+    static const int64_t unlimited = INT64_MAX & ~(sysconf(_SC_PAGESIZE) - 1);
+    int64_t max =
+        strncmp(buf, "max", 3) == 0 ? INT64_MAX : strtoll(buf, nullptr, 10);
+    values[kCgroupMemoryMax] = max >= unlimited ? INT64_MAX : max;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  values[kSampleTime] = now.tv_sec * INT64_C(1000000000) + now.tv_nsec;
+}
+
+// The latest sample of the sampler thread. The sequence number is odd while
+// the sample is being written and zero until the first sample is published.
+std::atomic<uint64_t> snapshot_sequence(0);
+std::atomic<int64_t> snapshot[kNumLoadValues];
+
+// Callers must hold sampler_mutex, so that there is only one writer.
+void PublishSnapshot(const int64_t *values) {
+  uint64_t sequence = snapshot_sequence.load(std::memory_order_relaxed);
+  snapshot_sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (int i = 0; i < kNumLoadValues; i++) {
+    snapshot[i].store(values[i], std::memory_order_relaxed);
+  }
+  snapshot_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// Copies the latest published sample to values. Returns false if there is
+// none.
+bool ReadSnapshot(int64_t *values) {
+  while (true) {
+    uint64_t before = snapshot_sequence.load(std::memory_order_acquire);
+    if (before == 0) {
+      return false;
+    }
+    if (before & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+    for (int i = 0; i < kNumLoadValues; i++) {
+      values[i] = snapshot[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (snapshot_sequence.load(std::memory_order_relaxed) == before) {
+      return true;
+    }
+  }
+}
+
+struct Sampler {
+  std::thread thread;
+  bool stopping = false;
+};
+
+// sampler_mutex guards everything below but sampler_running, which every poll
+// reads without it. Each sampler thread has its own stop flag, so that a
+// sampler started right after stopping another one is not confused with it.
+std::mutex sampler_mutex;
+std::condition_variable sampler_wakeup;
+Sampler *sampler = nullptr;
+std::chrono::milliseconds sampler_interval;
+std::atomic<bool> sampler_running(false);
+
+void RunSampler(Sampler *self) {
+  std::unique_lock<std::mutex> lock(sampler_mutex);
+  while (!self->stopping) {
+    int64_t values[kNumLoadValues];
+    lock.unlock();
+    SampleLoad(values);
+    lock.lock();
+    if (self->stopping) {
+      // A sampler started after this one was stopped may be publishing.
+      break;
+    }
+    PublishSnapshot(values);
+    sampler_wakeup.wait_for(lock, sampler_interval,
+                            [self] { return self->stopping; });
+  }
+}
+
+}  // namespace
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_SystemLoad_nativeSample(
+    JNIEnv *env, jclass clazz, jlongArray values) {
+  int64_t sample[kNumLoadValues];
+  if (!sampler_running.load(std::memory_order_acquire) ||
+      !ReadSnapshot(sample)) {
+    SampleLoad(sample);
+  }
+  jlong result[kNumLoadValues];
+  for (int i = 0; i < kNumLoadValues; i++) {
+    result[i] = sample[i];
+  }
+  env->SetLongArrayRegion(values, 0, kNumLoadValues, result);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_SystemLoad_nativeStartSampler(
+    JNIEnv *env, jclass clazz, jlong interval_millis) {
+  std::lock_guard<std::mutex> lock(sampler_mutex);
+  sampler_interval = std::chrono::milliseconds(interval_millis);
+  if (sampler != nullptr) {
+    // Already running: only the interval changes.
+    sampler_wakeup.notify_all();
+    return;
+  }
+  // Take the first sample synchronously, so that polls right after this call
+  // already see a snapshot.
+  int64_t values[kNumLoadValues];
+  SampleLoad(values);
+  PublishSnapshot(values);
+  sampler = new Sampler();
+  sampler->thread = std::thread(RunSampler, sampler);
+  sampler_running.store(true, std::memory_order_release);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_SystemLoad_nativeStopSampler(
+    JNIEnv *env, jclass clazz) {
+  Sampler *stopped;
+  {
+    std::lock_guard<std::mutex> lock(sampler_mutex);
+    if (sampler == nullptr) {
+      return;
+    }
+    sampler_running.store(false, std::memory_order_release);
+    sampler->stopping = true;
+    stopped = sampler;
+    sampler = nullptr;
+    sampler_wakeup.notify_all();
+  }
+  stopped->thread.join();
+  delete stopped;
+}
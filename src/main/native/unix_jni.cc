@@ -34,6 +34,7 @@
 #include <vector>
 
 #include "src/main/cpp/util/md5.h"
+#include "src/main/cpp/util/md5_multi.h"
 #include "src/main/cpp/util/port.h"
 #include "src/main/native/latin1_jni_path.h"
 #include "src/main/native/macros.h"
@@ -45,6 +46,7 @@
 #endif
 
 using blaze_util::Md5Digest;
+using blaze_util::Md5MultiDigest;
 
 // See unix_jni.h.
 void PostException(JNIEnv *env, int error_number, const std::string& message) {
@@ -1011,6 +1013,60 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_lgetxattr(JNIEnv *env,
   return ::getxattr_common(env, path, name, ::portable_lgetxattr);
 }
 
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    getFsVerityDigest
+ * Signature: (Ljava/lang/String;)[B
+ */
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_getFsVerityDigest(
+    JNIEnv *env, jclass clazz, jstring path) {
+  const char *path_chars = GetStringLatin1Chars(env, path);
+  jbyteArray result = NULL;
+  int fd = open(path_chars, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    ::PostFileException(env, errno, path_chars);
+  } else {
+    unsigned char digest[64];
+    size_t digest_size = sizeof(digest);
+    if (portable_measure_verity(fd, digest, &digest_size) == 0) {
+      result = env->NewByteArray(digest_size);
+      env->SetByteArrayRegion(result, 0, digest_size,
+                              reinterpret_cast<jbyte *>(digest));
+    } else if (errno != ENODATA && errno != ENOTSUP) {
+      ::PostFileException(env, errno, path_chars);
+    }
+    close(fd);
+  }
+  ReleaseStringLatin1Chars(path_chars);
+  return result;
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    enableFsVerity
+ * Signature: (Ljava/lang/String;)Z
+ */
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_enableFsVerity(
+    JNIEnv *env, jclass clazz, jstring path) {
+  const char *path_chars = GetStringLatin1Chars(env, path);
+  jboolean result = false;
+  int fd = open(path_chars, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    ::PostFileException(env, errno, path_chars);
+  } else {
+    if (portable_enable_verity(fd) == 0 || errno == EEXIST) {
+      result = true;
+    } else if (errno != ENOTSUP) {
+      ::PostFileException(env, errno, path_chars);
+    }
+    close(fd);
+  }
+  ReleaseStringLatin1Chars(path_chars);
+  return result;
+}
+
 extern "C" JNIEXPORT jint JNICALL
 Java_com_google_devtools_build_lib_unix_NativePosixFiles_openWrite(
     JNIEnv *env, jclass clazz, jstring path, jboolean append) {
@@ -1129,6 +1185,42 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_md5sumAsBytes(
   return result;
 }
 
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_md5sumsAsBytes(
+    JNIEnv *env, jclass clazz, jobjectArray paths) {
+  jsize count = env->GetArrayLength(paths);
+  std::vector<std::string> path_strings;
+  for (jsize i = 0; i < count; ++i) {
+    jstring path = (jstring)env->GetObjectArrayElement(paths, i);
+    const char *path_chars = GetStringLatin1Chars(env, path);
+    path_strings.push_back(path_chars);
+    ReleaseStringLatin1Chars(path_chars);
+    env->DeleteLocalRef(path);
+  }
+  std::vector<const char *> path_ptrs;
+  for (const std::string &path : path_strings) {
+    path_ptrs.push_back(path.c_str());
+  }
+
+  std::vector<jbyte> digests(Md5Digest::kDigestLength * count);
+  std::vector<int> errors(count);
+  Md5MultiDigest::DigestFiles(
+      path_ptrs.data(), count,
+      reinterpret_cast<unsigned char *>(digests.data()), errors.data());
+  for (jsize i = 0; i < count; ++i) {
+    if (errors[i] != 0) {
+      ::PostFileException(env, errors[i], path_ptrs[i]);
+      return NULL;
+    }
+  }
+  jbyteArray result = env->NewByteArray(digests.size());
+  if (result == NULL) {
+    return NULL;  // async exception!
+  }
+  env->SetByteArrayRegion(result, 0, digests.size(), digests.data());
+  return result;
+}
+
 extern "C" JNIEXPORT jlong JNICALL
 Java_com_google_devtools_build_lib_unix_NativePosixSystem_sysctlbynameGetLong(
     JNIEnv *env, jclass clazz, jstring name) {
@@ -98,4 +98,17 @@ ssize_t portable_lgetxattr(const char *path, const char *name, void *value,
 // Run sysctlbyname(3), only available on darwin
 int portable_sysctlbyname(const char *name_chars, long *mibp, size_t *sizep);
 
+// Stores the fs-verity digest of the open file fd in digest, which has room
+// for *digest_size bytes, and sets *digest_size to its length. Returns -1 and
+// sets errno on error: ENODATA if fs-verity is not enabled on the file, and
+// ENOTSUP if the platform or the file system does not support it.
+int portable_measure_verity(int fd, unsigned char *digest,
+                            size_t *digest_size);
+
+// Enables fs-verity with SHA-256 on the file fd, which must be open read-only
+// and not open for writing anywhere. Returns -1 and sets errno on error:
+// EEXIST if fs-verity is already enabled, and ENOTSUP if the platform or the
+// file system does not support it.
+int portable_enable_verity(int fd);
+
 #endif  // BAZEL_SRC_MAIN_NATIVE_UNIX_JNI_H__
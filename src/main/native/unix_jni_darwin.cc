@@ -120,3 +120,14 @@ ssize_t portable_lgetxattr(const char *path, const char *name, void *value,
 int portable_sysctlbyname(const char *name_chars, long *mibp, size_t *sizep) {
   return sysctlbyname(name_chars, mibp, sizep, NULL, 0);
 }
+
+int portable_measure_verity(int fd, unsigned char *digest,
+                            size_t *digest_size) {
+  errno = ENOTSUP;
+  return -1;
+}
+
+int portable_enable_verity(int fd) {
+  errno = ENOTSUP;
+  return -1;
+}
@@ -17,8 +17,15 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/xattr.h>
+#include <unistd.h>
+#if defined(__has_include)
+#if __has_include(<linux/fsverity.h>)
+#include <linux/fsverity.h>
+#endif
+#endif
 
 #include <string>
 
@@ -91,3 +98,56 @@ int portable_sysctlbyname(const char *name_chars, long *mibp, size_t *sizep) {
   errno = ENOSYS;
   return -1;
 }
+
+#if defined(FS_IOC_MEASURE_VERITY)
+// File systems without fs-verity support reject its ioctls with ENOTTY or
+// EOPNOTSUPP, depending on the kernel version.
+static int VerityError() {
+  if (errno == ENOTTY || errno == EOPNOTSUPP) {
+    errno = ENOTSUP;
+  }
+  return -1;
+}
+
+int portable_measure_verity(int fd, unsigned char *digest,
+                            size_t *digest_size) {
+  // Room for the largest digest, SHA-512.
+  const int kMaxDigestSize = 64;
+  alignas(struct fsverity_digest) char
+      buf[sizeof(struct fsverity_digest) + kMaxDigestSize];
+  struct fsverity_digest *measurement =
+      reinterpret_cast<struct fsverity_digest *>(buf);
+  measurement->digest_size = kMaxDigestSize;
+  if (ioctl(fd, FS_IOC_MEASURE_VERITY, measurement) < 0) {
+    return VerityError();
+  }
+  if (measurement->digest_size > *digest_size) {
+    errno = EOVERFLOW;
+    return -1;
+  }
+  memcpy(digest, measurement->digest, measurement->digest_size);
+  *digest_size = measurement->digest_size;
+  return 0;
+}
+
+int portable_enable_verity(int fd) {
+  struct fsverity_enable_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  arg.version = 1;
+  arg.hash_algorithm = FS_VERITY_HASH_ALG_SHA256;
+  // The page size is the one block size that all kernels support.
+  arg.block_size = sysconf(_SC_PAGESIZE);
+  return ioctl(fd, FS_IOC_ENABLE_VERITY, &arg) < 0 ? VerityError() : 0;
+}
+#else
+int portable_measure_verity(int fd, unsigned char *digest,
+                            size_t *digest_size) {
+  errno = ENOTSUP;
+  return -1;
+}
+
+int portable_enable_verity(int fd) {
+  errno = ENOTSUP;
+  return -1;
+}
+#endif
@@ -0,0 +1,222 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Creating a network namespace for every sandboxed action is expensive: the
+ * kernel tears network namespaces down asynchronously and serializes the
+ * cleanup, which limits how many sandboxed actions can run per second. The
+ * functions below let many sandboxes share one loopback-only namespace
+ * instead.
+ */
+
+#include "src/main/tools/linux-sandbox-netns.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+
+#include "src/main/tools/logging.h"
+
+#ifndef NS_GET_USERNS
+// From linux/nsfs.h, which older systems do not have.
+#define NS_GET_USERNS _IO(0xb7, 0x1)
+#endif
+
+void EnableLoopback() {
+  int fd;
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    DIE("socket");
+  }
+
+  struct ifreq ifr = {};
+  strncpy(ifr.ifr_name, "lo", IF_NAMESIZE);
+
+  // Verify that name is valid.
+  if (if_nametoindex(ifr.ifr_name) == 0) {
+    DIE("if_nametoindex");
+  }
+
+  // Enable the interface.
+  ifr.ifr_flags |= IFF_UP;
+  if (ioctl(fd, SIOCSIFFLAGS, &ifr) < 0) {
+    DIE("ioctl");
+  }
+
+  if (close(fd) < 0) {
+    DIE("close");
+  }
+}
+
+// Returns whether the given namespace file descriptor refers to the same
+// namespace as the file at `own_ns`.
+static bool IsSameNamespace(int ns_fd, const char *own_ns) {
+  struct stat ns_st, own_st;
+  if (fstat(ns_fd, &ns_st) < 0) {
+    DIE("fstat");
+  }
+  if (stat(own_ns, &own_st) < 0) {
+    DIE("stat(%s)", own_ns);
+  }
+  return ns_st.st_dev == own_st.st_dev && ns_st.st_ino == own_st.st_ino;
+}
+
+void JoinNetworkNamespace(const std::string &path) {
+  int netns_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (netns_fd < 0) {
+    DIE("open(%s)", path.c_str());
+  }
+
+  // Joining a network namespace requires CAP_SYS_ADMIN in the user namespace
+  // that owns it. An unprivileged user gets that by joining the owner, which
+  // it may do if it created it.
+  int userns_fd = ioctl(netns_fd, NS_GET_USERNS);
+  if (userns_fd >= 0) {
+    if (!IsSameNamespace(userns_fd, "/proc/self/ns/user")) {
+      PRINT_DEBUG("joining the user namespace of %s", path.c_str());
+      if (setns(userns_fd, CLONE_NEWUSER) < 0) {
+        DIE("setns(user namespace of %s)", path.c_str());
+      }
+    }
+    if (close(userns_fd) < 0) {
+      DIE("close");
+    }
+  } else if (errno != ENOTTY && errno != EPERM) {
+    // ENOTTY: the kernel is too old to tell, EPERM: the owner is an ancestor
+    // of our user namespace. Either way, all we can do is try to join.
+    DIE("ioctl(%s, NS_GET_USERNS)", path.c_str());
+  }
+
+  PRINT_DEBUG("joining the network namespace %s", path.c_str());
+  if (setns(netns_fd, CLONE_NEWNET) < 0) {
+    DIE("setns(%s)", path.c_str());
+  }
+  if (close(netns_fd) < 0) {
+    DIE("close");
+  }
+}
+
+static void WriteProcFile(const char *filename, const std::string &contents) {
+  int fd = open(filename, O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    DIE("open(%s)", filename);
+  }
+  if (write(fd, contents.data(), contents.size()) !=
+      static_cast<ssize_t>(contents.size())) {
+    DIE("write(%s)", filename);
+  }
+  if (close(fd) < 0) {
+    DIE("close(%s)", filename);
+  }
+}
+
+// Makes the namespace of a process running as root available at `path`.
+static int BindMountNetworkNamespace(const std::string &path) {
+  // The target of a bind mount must exist.
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    DIE("open(%s)", path.c_str());
+  }
+  if (close(fd) < 0) {
+    DIE("close");
+  }
+  if (mount("/proc/self/ns/net", path.c_str(), nullptr, MS_BIND, nullptr) <
+      0) {
+    DIE("mount(/proc/self/ns/net, %s, nullptr, MS_BIND, nullptr)",
+        path.c_str());
+  }
+  return EXIT_SUCCESS;
+}
+
+// Makes the namespace of an unprivileged process available at `path` for as
+// long as the process lives.
+static int LinkNetworkNamespace(const std::string &path) {
+  // Block the signals that end our life before publishing the namespace, so
+  // that they cannot get lost. Our parent dying must also end it.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGHUP);
+  if (sigprocmask(SIG_BLOCK, &signals, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+  if (prctl(PR_SET_PDEATHSIG, SIGTERM) < 0) {
+    DIE("prctl");
+  }
+
+  // Create the symlink under a temporary name and rename it into place, so
+  // that whoever waits for `path` never sees an incomplete state.
+  const std::string target =
+      "/proc/" + std::to_string(getpid()) + "/ns/net";
+  const std::string tmp_path = path + ".tmp";
+  unlink(tmp_path.c_str());
+  if (symlink(target.c_str(), tmp_path.c_str()) < 0) {
+    DIE("symlink(%s, %s)", target.c_str(), tmp_path.c_str());
+  }
+  if (rename(tmp_path.c_str(), path.c_str()) < 0) {
+    DIE("rename(%s, %s)", tmp_path.c_str(), path.c_str());
+  }
+  PRINT_DEBUG("network namespace available at %s -> %s", path.c_str(),
+              target.c_str());
+
+  int signum;
+  while (sigwait(&signals, &signum) != 0) {
+  }
+  PRINT_DEBUG("got signal %d, removing %s", signum, path.c_str());
+  if (unlink(path.c_str()) < 0) {
+    DIE("unlink(%s)", path.c_str());
+  }
+  return EXIT_SUCCESS;
+}
+
+int CreateNetworkNamespace(const std::string &path) {
+  bool privileged = geteuid() == 0;
+  int uid = getuid();
+  int gid = getgid();
+
+  if (unshare(privileged ? CLONE_NEWNET : CLONE_NEWUSER | CLONE_NEWNET) < 0) {
+    DIE("unshare");
+  }
+  if (!privileged) {
+    // Map our own user and group, so that the sandboxes that join this user
+    // namespace see the same ids as outside of it and can map them again.
+    struct stat sb;
+    if (stat("/proc/self/setgroups", &sb) == 0) {
+      WriteProcFile("/proc/self/setgroups", "deny");
+    } else if (errno != ENOENT) {
+      DIE("stat(/proc/self/setgroups)");
+    }
+    WriteProcFile("/proc/self/uid_map",
+                  std::to_string(uid) + " " + std::to_string(uid) + " 1\n");
+    WriteProcFile("/proc/self/gid_map",
+                  std::to_string(gid) + " " + std::to_string(gid) + " 1\n");
+  }
+  EnableLoopback();
+
+  return privileged ? BindMountNetworkNamespace(path)
+                    : LinkNetworkNamespace(path);
+}
@@ -0,0 +1,42 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_TOOLS_LINUX_SANDBOX_NETNS_H_
+#define SRC_MAIN_TOOLS_LINUX_SANDBOX_NETNS_H_
+
+#include <string>
+
+// Brings up the loopback interface of the current network namespace.
+void EnableLoopback();
+
+// Moves the current process into the network namespace referenced by `path`
+// (an nsfs file such as /proc/PID/ns/net or a bind mount of one), so that the
+// sandbox inherits it instead of creating a new one. If the namespace is owned
+// by another user namespace, that one is joined first, which is what allows
+// unprivileged users to share a namespace created by CreateNetworkNamespace.
+void JoinNetworkNamespace(const std::string &path);
+
+// Creates a network namespace with only the loopback interface up and makes
+// it available at `path` for use with JoinNetworkNamespace.
+//
+// When running as root, the namespace is bind-mounted onto `path` and
+// persists until `path` is unmounted; the function returns right away.
+// Otherwise the namespace is owned by a new user namespace, `path` becomes a
+// symlink to /proc/PID/ns/net and the process stays alive until it receives
+// SIGTERM, SIGINT or SIGHUP, or its parent dies. The symlink is then removed.
+//
+// Returns the exit code for the process.
+int CreateNetworkNamespace(const std::string &path);
+
+#endif  // SRC_MAIN_TOOLS_LINUX_SANDBOX_NETNS_H_
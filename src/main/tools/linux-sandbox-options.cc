@@ -66,8 +66,24 @@ static void Usage(char *program_name, const char *fmt, ...) {
           "    The -M option specifies which directory to mount, the -m option "
           "specifies where to\n"
           "  -S <file>  if set, write stats in protobuf format to a file\n"
+          "  -I <file>  if set, write which files in the working directory "
+          "were opened\n"
+          "    to a file, one \"accessed\" or \"unused\" line per file; "
+          "the file is left\n"
+          "    empty if the sandbox has to be killed with SIGKILL\n"
+          "  -O/-o <file/file>  digest the outputs listed in the first file, "
+          "one per line,\n"
+          "    after the command exits and write their metadata in protobuf "
+          "format to\n"
+          "    the second file\n"
           "  -H  if set, make hostname in the sandbox equal to 'localhost'\n"
           "  -N  if set, a new network namespace will be created\n"
+          "  -n <file>  join the network namespace at the given file instead "
+          "of creating one\n"
+          "  -C <file>  instead of running a command, create a loopback-only "
+          "network\n"
+          "    namespace and make it available at the given file for use "
+          "with -n\n"
           "  -R  if set, make the uid/gid be root\n"
           "  -U  if set, make the uid/gid be nobody\n"
           "  -D  if set, debug info will be printed\n"
@@ -92,7 +108,7 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
   bool source_specified = false;
 
   while ((c = getopt(args->size(), args->data(),
-                     ":W:T:t:l:L:w:e:M:m:S:HNRUD")) != -1) {
+                     ":W:T:t:l:L:w:e:M:m:S:I:O:o:HNn:C:RUD")) != -1) {
     if (c != 'M' && c != 'm') source_specified = false;
     switch (c) {
       case 'W':
@@ -165,12 +181,60 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
                 "Cannot write stats to more than one destination.");
         }
         break;
+      case 'I':
+        if (opt.input_trace_path.empty()) {
+          opt.input_trace_path.assign(optarg);
+        } else {
+          Usage(args->front(),
+                "Cannot write the input trace to more than one destination.");
+        }
+        break;
+      case 'O':
+        if (opt.outputs_path.empty()) {
+          opt.outputs_path.assign(optarg);
+        } else {
+          Usage(args->front(), "Multiple output lists (-O) specified.");
+        }
+        break;
+      case 'o':
+        if (opt.output_manifest_path.empty()) {
+          opt.output_manifest_path.assign(optarg);
+        } else {
+          Usage(args->front(),
+                "Cannot write the output manifest to more than one "
+                "destination.");
+        }
+        break;
       case 'H':
         opt.fake_hostname = true;
         break;
       case 'N':
+        if (!opt.netns_path.empty()) {
+          Usage(args->front(),
+                "The -N option cannot be used at the same time as the -n "
+                "option.");
+        }
         opt.create_netns = true;
         break;
+      case 'n':
+        if (opt.create_netns) {
+          Usage(args->front(),
+                "The -n option cannot be used at the same time as the -N "
+                "option.");
+        }
+        if (!opt.netns_path.empty()) {
+          Usage(args->front(),
+                "Multiple network namespaces (-n) specified, expected one.");
+        }
+        opt.netns_path.assign(optarg);
+        break;
+      case 'C':
+        if (!opt.create_netns_path.empty()) {
+          Usage(args->front(),
+                "Multiple network namespaces (-C) specified, expected one.");
+        }
+        opt.create_netns_path.assign(optarg);
+        break;
       case 'R':
         if (opt.fake_username) {
           Usage(args->front(),
@@ -257,10 +321,18 @@ void ParseOptions(int argc, char *argv[]) {
   vector<char *> args(argv, argv + argc);
   ParseCommandLine(ExpandArguments(args));
 
-  if (opt.args.empty()) {
+  if (!opt.create_netns_path.empty()) {
+    if (!opt.args.empty()) {
+      Usage(args.front(), "No command may be specified with -C.");
+    }
+  } else if (opt.args.empty()) {
     Usage(args.front(), "No command specified.");
   }
 
+  if (opt.outputs_path.empty() != opt.output_manifest_path.empty()) {
+    Usage(args.front(), "The -O and -o options must be used together.");
+  }
+
   if (opt.working_dir.empty()) {
     opt.working_dir = getcwd(nullptr, 0);
   }
@@ -42,10 +42,21 @@ struct Options {
   std::vector<std::string> bind_mount_targets;
   // Where to write stats, in protobuf format (-S)
   std::string stats_path;
+  // Where to write which inputs the command opened (-I)
+  std::string input_trace_path;
+  // File listing the declared outputs, one per line (-O)
+  std::string outputs_path;
+  // Where to write the metadata and digests of the outputs (-o)
+  std::string output_manifest_path;
   // Set the hostname inside the sandbox to 'localhost' (-H)
   bool fake_hostname;
   // Create a new network namespace (-N)
   bool create_netns;
+  // Join the network namespace at this path instead of creating one (-n)
+  std::string netns_path;
+  // Create a loopback-only network namespace at this path for use with -n,
+  // instead of running a command (-C)
+  std::string create_netns_path;
   // Pretend to be root inside the namespace (-R)
   bool fake_root;
   // Set the username inside the sandbox to 'nobody' (-U)
@@ -24,7 +24,6 @@
 #include <libgen.h>
 #include <math.h>
 #include <mntent.h>
-#include <net/if.h>
 #include <pwd.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -32,7 +31,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include <sys/mount.h>
 #include <sys/prctl.h>
 #include <sys/stat.h>
@@ -48,7 +46,9 @@
 #include <linux/fs.h>
 #endif
 
+#include "src/main/tools/linux-sandbox-netns.h"
 #include "src/main/tools/linux-sandbox-options.h"
+#include "src/main/tools/linux-sandbox-trace.h"
 #include "src/main/tools/linux-sandbox.h"
 #include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
@@ -297,31 +297,10 @@ static void MountProc() {
 
 static void SetupNetworking() {
   // When running in a separate network namespace, enable the loopback interface
-  // because some application may want to use it.
+  // because some application may want to use it. A shared namespace joined
+  // through -n has it enabled already.
   if (opt.create_netns) {
-    int fd;
-    fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (fd < 0) {
-      DIE("socket");
-    }
-
-    struct ifreq ifr = {};
-    strncpy(ifr.ifr_name, "lo", IF_NAMESIZE);
-
-    // Verify that name is valid.
-    if (if_nametoindex(ifr.ifr_name) == 0) {
-      DIE("if_nametoindex");
-    }
-
-    // Enable the interface.
-    ifr.ifr_flags |= IFF_UP;
-    if (ioctl(fd, SIOCSIFFLAGS, &ifr) < 0) {
-      DIE("ioctl");
-    }
-
-    if (close(fd) < 0) {
-      DIE("close");
-    }
+    EnableLoopback();
   }
 }
 
@@ -420,20 +399,32 @@ static void SpawnChild() {
     // permissions predictable.
     umask(022);
 
+    if (!opt.input_trace_path.empty()) {
+      TraceInputsOfChild();
+    }
+
     // argv[] passed to execve() must be a null-terminated array.
     opt.args.push_back(nullptr);
 
     if (execvp(opt.args[0], opt.args.data()) < 0) {
       DIE("execvp(%s, %p)", opt.args[0], opt.args.data());
     }
+  } else if (!opt.input_trace_path.empty()) {
+    TraceInputsOfChildInParent();
   }
 }
 
 static void WaitForChild() {
+  bool trace_inputs = !opt.input_trace_path.empty();
   while (1) {
-    // Check for zombies to be reaped and exit, if our own child exited.
+    // Check for zombies to be reaped and exit, if our own child exited. When
+    // tracing inputs, we handle the accesses while there is nothing to reap.
     int status;
-    pid_t killed_pid = waitpid(-1, &status, 0);
+    pid_t killed_pid = waitpid(-1, &status, trace_inputs ? WNOHANG : 0);
+    if (killed_pid == 0) {
+      WaitForInputAccesses();
+      continue;
+    }
     PRINT_DEBUG("waitpid returned %d", killed_pid);
 
     if (killed_pid < 0) {
@@ -450,6 +441,9 @@ static void WaitForChild() {
         // terminate. We can simply _exit() here, because the Linux kernel will
         // kindly SIGKILL all remaining processes in our PID namespace once we
         // exit.
+        if (trace_inputs) {
+          FinishInputTracing(global_input_trace_fd);
+        }
         if (WIFSIGNALED(status)) {
           PRINT_DEBUG("child died due to signal %d", WTERMSIG(status));
           _exit(128 + WTERMSIG(status));
@@ -479,6 +473,9 @@ int Pid1Main(void *sync_pipe_param) {
   SetupNetworking();
   EnterSandbox();
   SetupSignalHandlers();
+  if (!opt.input_trace_path.empty()) {
+    StartInputTracing();
+  }
   SpawnChild();
   WaitForChild();
   _exit(EXIT_FAILURE);
@@ -0,0 +1,589 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/tools/linux-sandbox-trace.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/fanotify.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#include "src/main/tools/linux-sandbox-options.h"
+#include "src/main/tools/logging.h"
+#include "src/main/tools/process-tools.h"
+
+// The seccomp filter only handles the native system call ABI.
+#if defined(SECCOMP_USER_NOTIF_FLAG_CONTINUE) && defined(__NR_seccomp)
+#if defined(__x86_64__)
+#define TRACE_SECCOMP_ARCH AUDIT_ARCH_X86_64
+#elif defined(__aarch64__)
+#define TRACE_SECCOMP_ARCH AUDIT_ARCH_AARCH64
+#endif
+#endif
+
+// The paths of the inputs relative to the working directory.
+static std::vector<std::string> inputs;
+static std::vector<bool> input_accessed;
+// Indices into `inputs` by canonical path: symlinks to the same file are
+// separate inputs.
+static std::map<std::string, std::vector<size_t>> inputs_by_real_path;
+// Whether accesses may have gone unnoticed.
+static bool trace_incomplete = false;
+
+// Carries the seccomp listener from the child to PID 1.
+static int trace_socket[2] = {-1, -1};
+static int seccomp_listener = -1;
+static size_t seccomp_notif_size;
+static size_t seccomp_notif_resp_size;
+
+static int fanotify_fd = -1;
+// The marked directories by file system ID and file handle.
+static std::map<std::string, std::string> dirs_by_handle;
+
+// The signal mask of PID 1, minus SIGCHLD, which is blocked except while
+// waiting for accesses.
+static sigset_t wait_mask;
+
+static void OnSigchld(int) {}
+
+static std::string JoinPath(const std::string &dir, const char *name) {
+  return dir == "/" ? dir + name : dir + "/" + name;
+}
+
+// Adds the files below `dir`, which is `prefix` relative to the working
+// directory, to the inputs. Follows symlinks, but not into a directory that
+// is being walked already.
+static void CollectInputs(const std::string &dir, const std::string &prefix,
+                          std::set<std::pair<dev_t, ino_t>> *ancestors) {
+  DIR *entries = opendir(dir.c_str());
+  if (entries == nullptr) {
+    PRINT_DEBUG("opendir(%s): %s", dir.c_str(), strerror(errno));
+    return;
+  }
+  struct dirent *ent;
+  while ((ent = readdir(entries)) != nullptr) {
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+      continue;
+    }
+    std::string path = JoinPath(dir, ent->d_name);
+    struct stat sb;
+    if (stat(path.c_str(), &sb) < 0) {
+      continue;  // A dangling symlink cannot be opened anyway.
+    }
+    if (S_ISDIR(sb.st_mode)) {
+      std::pair<dev_t, ino_t> id(sb.st_dev, sb.st_ino);
+      if (ancestors->insert(id).second) {
+        CollectInputs(path, prefix + ent->d_name + "/", ancestors);
+        ancestors->erase(id);
+      }
+      continue;
+    }
+    char *real_path = realpath(path.c_str(), nullptr);
+    if (real_path != nullptr) {
+      inputs_by_real_path[real_path].push_back(inputs.size());
+      inputs.push_back(prefix + ent->d_name);
+      free(real_path);
+    }
+  }
+  closedir(entries);
+}
+
+static void RecordAccess(const std::string &real_path) {
+  auto it = inputs_by_real_path.find(real_path);
+  if (it != inputs_by_real_path.end()) {
+    for (size_t input : it->second) {
+      input_accessed[input] = true;
+    }
+  }
+}
+
+static std::string HandleKey(const void *fsid,
+                             const struct file_handle *handle) {
+  std::string key(reinterpret_cast<const char *>(fsid), sizeof(fsid_t));
+  key.append(reinterpret_cast<const char *>(&handle->handle_type),
+             sizeof(handle->handle_type));
+  key.append(reinterpret_cast<const char *>(handle->f_handle),
+             handle->handle_bytes);
+  return key;
+}
+
+static bool GetDirectoryHandleKey(const std::string &dir, std::string *key) {
+  struct statfs sfs;
+  if (statfs(dir.c_str(), &sfs) < 0) {
+    return false;
+  }
+  alignas(struct file_handle) char buf[sizeof(struct file_handle) +
+                                       MAX_HANDLE_SZ];
+  struct file_handle *handle = reinterpret_cast<struct file_handle *>(buf);
+  handle->handle_bytes = MAX_HANDLE_SZ;
+  int mount_id;
+  if (name_to_handle_at(AT_FDCWD, dir.c_str(), handle, &mount_id, 0) < 0) {
+    return false;
+  }
+  *key = HandleKey(&sfs.f_fsid, handle);
+  return true;
+}
+
+// Marks the directories of all inputs in a new fanotify group that reports
+// the directory and name of each opened file. Returns false if this is not
+// supported by the kernel or by one of the file systems.
+static bool StartFanotify() {
+#ifdef FAN_REPORT_DFID_NAME
+  fanotify_fd = fanotify_init(
+      FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME,
+      O_RDONLY | O_CLOEXEC);
+  if (fanotify_fd < 0) {
+    PRINT_DEBUG("fanotify_init: %s", strerror(errno));
+    return false;
+  }
+  std::set<std::string> dirs;
+  for (const auto &entry : inputs_by_real_path) {
+    size_t slash = entry.first.rfind('/');
+    dirs.insert(slash == 0 ? "/" : entry.first.substr(0, slash));
+  }
+  for (const std::string &dir : dirs) {
+    std::string key;
+    if (!GetDirectoryHandleKey(dir, &key) ||
+        fanotify_mark(fanotify_fd, FAN_MARK_ADD, FAN_OPEN | FAN_EVENT_ON_CHILD,
+                      AT_FDCWD, dir.c_str()) < 0) {
+      PRINT_DEBUG("cannot watch %s with fanotify: %s", dir.c_str(),
+                  strerror(errno));
+      close(fanotify_fd);
+      fanotify_fd = -1;
+      dirs_by_handle.clear();
+      return false;
+    }
+    dirs_by_handle[key] = dir;
+  }
+  PRINT_DEBUG("tracing inputs with fanotify in %zu directories", dirs.size());
+  return true;
+#else
+  return false;
+#endif
+}
+
+static void ReadFanotifyEvents() {
+#ifdef FAN_REPORT_DFID_NAME
+  alignas(struct fanotify_event_metadata) char buf[65536];
+  while (1) {
+    ssize_t len = read(fanotify_fd, buf, sizeof(buf));
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      } else if (errno == EAGAIN) {
+        return;
+      }
+      DIE("read(fanotify)");
+    }
+    struct fanotify_event_metadata *event =
+        reinterpret_cast<struct fanotify_event_metadata *>(buf);
+    for (; FAN_EVENT_OK(event, len); event = FAN_EVENT_NEXT(event, len)) {
+      if (event->vers != FANOTIFY_METADATA_VERSION ||
+          (event->mask & FAN_Q_OVERFLOW) != 0) {
+        PRINT_DEBUG("lost fanotify events");
+        trace_incomplete = true;
+        continue;
+      }
+      const char *info = reinterpret_cast<const char *>(event);
+      const char *end = info + event->event_len;
+      for (info += event->metadata_len;
+           info + sizeof(struct fanotify_event_info_header) <= end;) {
+        const struct fanotify_event_info_header *header =
+            reinterpret_cast<const struct fanotify_event_info_header *>(info);
+        if (header->len == 0) {
+          break;
+        }
+        if (header->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+          const struct fanotify_event_info_fid *fid =
+              reinterpret_cast<const struct fanotify_event_info_fid *>(info);
+          const struct file_handle *handle =
+              reinterpret_cast<const struct file_handle *>(fid->handle);
+          const char *name = reinterpret_cast<const char *>(
+              handle->f_handle + handle->handle_bytes);
+          auto dir = dirs_by_handle.find(HandleKey(&fid->fsid, handle));
+          if (dir != dirs_by_handle.end()) {
+            RecordAccess(JoinPath(dir->second, name));
+          }
+        }
+        info += header->len;
+      }
+    }
+  }
+#endif
+}
+
+#ifdef TRACE_SECCOMP_ARCH
+// Makes open(2), openat(2), openat2(2), execve(2) and execveat(2) wait for
+// PID 1. Returns the listener, or -1 if the filter cannot be installed.
+static int InstallSeccompListener() {
+  static const uint32_t kTracedSyscalls[] = {
+#ifdef __NR_open
+      __NR_open,
+#endif
+      __NR_openat,
+#ifdef __NR_openat2
+      __NR_openat2,
+#endif
+      __NR_execve,
+      __NR_execveat,
+  };
+  const size_t count = sizeof(kTracedSyscalls) / sizeof(kTracedSyscalls[0]);
+
+  std::vector<struct sock_filter> filter;
+  filter.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                            offsetof(struct seccomp_data, arch)));
+  filter.push_back(
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, TRACE_SECCOMP_ARCH, 1, 0));
+  filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+  filter.push_back(
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)));
+  for (size_t i = 0; i < count; ++i) {
+    // On a match, skip the remaining comparisons and the "allow".
+    filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, kTracedSyscalls[i],
+                              static_cast<uint8_t>(count - i), 0));
+  }
+  filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+  filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_USER_NOTIF));
+
+  struct sock_fprog program = {};
+  program.len = static_cast<unsigned short>(filter.size());
+  program.filter = filter.data();
+  int listener = syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER,
+                         SECCOMP_FILTER_FLAG_NEW_LISTENER, &program);
+  if (listener < 0 && errno == EACCES) {
+    // We lack CAP_SYS_ADMIN in the namespace (e.g. because it is shared).
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+      DIE("prctl(PR_SET_NO_NEW_PRIVS)");
+    }
+    listener = syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER,
+                       SECCOMP_FILTER_FLAG_NEW_LISTENER, &program);
+  }
+  return listener;
+}
+
+// Reads the NUL-terminated string at `address` in the memory of `pid`.
+static bool ReadString(pid_t pid, uint64_t address, std::string *result) {
+  std::string mem_path = "/proc/" + std::to_string(pid) + "/mem";
+  int fd = open(mem_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  const uint64_t kPageSize = sysconf(_SC_PAGESIZE);
+  result->clear();
+  bool terminated = false;
+  while (!terminated && result->size() < PATH_MAX) {
+    // Do not read across a page boundary: the next page may be unmapped.
+    char buf[PATH_MAX];
+    size_t size = std::min<uint64_t>(sizeof(buf),
+                                     kPageSize - address % kPageSize);
+    ssize_t len = pread(fd, buf, size, address);
+    if (len <= 0) {
+      break;
+    }
+    size_t string_len = strnlen(buf, len);
+    result->append(buf, string_len);
+    terminated = string_len < static_cast<size_t>(len);
+    address += len;
+  }
+  close(fd);
+  return terminated;
+}
+
+// Returns the canonical path of the file that the intercepted system call
+// opens, or an empty string if it does not exist. Returns false if the path
+// cannot be determined.
+static bool GetOpenedPath(const struct seccomp_notif &request,
+                          std::string *result) {
+  int dirfd = AT_FDCWD;
+  uint64_t address;
+  switch (request.data.nr) {
+#ifdef __NR_open
+    case __NR_open:
+#endif
+    case __NR_execve:
+      address = request.data.args[0];
+      break;
+    default:
+      dirfd = static_cast<int>(request.data.args[0]);
+      address = request.data.args[1];
+      break;
+  }
+
+  std::string name;
+  if (!ReadString(request.pid, address, &name)) {
+    return false;
+  }
+  // Let the kernel resolve relative paths through the magic links in /proc.
+  if (name.empty() || name[0] != '/') {
+    std::string base = "/proc/" + std::to_string(request.pid);
+    base += dirfd == AT_FDCWD ? "/cwd" : "/fd/" + std::to_string(dirfd);
+    name = name.empty() ? base : base + "/" + name;
+  }
+  char *real_path = realpath(name.c_str(), nullptr);
+  if (real_path == nullptr) {
+    result->clear();
+  } else {
+    result->assign(real_path);
+    free(real_path);
+  }
+  return true;
+}
+
+static void HandleSeccompNotification() {
+  std::vector<char> request_buf(seccomp_notif_size);
+  std::vector<char> response_buf(seccomp_notif_resp_size);
+  struct seccomp_notif *request =
+      reinterpret_cast<struct seccomp_notif *>(request_buf.data());
+  struct seccomp_notif_resp *response =
+      reinterpret_cast<struct seccomp_notif_resp *>(response_buf.data());
+
+  if (ioctl(seccomp_listener, SECCOMP_IOCTL_NOTIF_RECV, request) < 0) {
+    // ENOENT means that the process died before we got to its request.
+    if (errno == EINTR || errno == ENOENT) {
+      return;
+    }
+    DIE("ioctl(SECCOMP_IOCTL_NOTIF_RECV)");
+  }
+
+  std::string path;
+  bool resolved = GetOpenedPath(*request, &path);
+  // The memory we read belongs to the request only if it is still pending.
+  if (ioctl(seccomp_listener, SECCOMP_IOCTL_NOTIF_ID_VALID, &request->id) ==
+      0) {
+    if (!resolved) {
+      PRINT_DEBUG("cannot tell which file process %d opens", request->pid);
+      trace_incomplete = true;
+    } else if (!path.empty()) {
+      RecordAccess(path);
+    }
+  }
+
+  response->id = request->id;
+  response->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+  if (ioctl(seccomp_listener, SECCOMP_IOCTL_NOTIF_SEND, response) < 0 &&
+      errno != ENOENT) {
+    DIE("ioctl(SECCOMP_IOCTL_NOTIF_SEND)");
+  }
+}
+#endif  // TRACE_SECCOMP_ARCH
+
+void StartInputTracing() {
+  std::set<std::pair<dev_t, ino_t>> ancestors;
+  struct stat sb;
+  if (stat(opt.working_dir.c_str(), &sb) < 0) {
+    DIE("stat(%s)", opt.working_dir.c_str());
+  }
+  ancestors.insert(std::make_pair(sb.st_dev, sb.st_ino));
+  CollectInputs(opt.working_dir, "", &ancestors);
+  input_accessed.assign(inputs.size(), false);
+  PRINT_DEBUG("tracing %zu inputs", inputs.size());
+
+  // WaitForInputAccesses() must not miss the death of the child between
+  // checking for it and waiting, so SIGCHLD only gets through while waiting.
+  sigset_t sigchld;
+  if (sigemptyset(&sigchld) < 0 || sigaddset(&sigchld, SIGCHLD) < 0) {
+    DIE("sigaddset");
+  }
+  if (sigprocmask(SIG_BLOCK, &sigchld, &wait_mask) < 0) {
+    DIE("sigprocmask");
+  }
+  if (sigdelset(&wait_mask, SIGCHLD) < 0) {
+    DIE("sigdelset");
+  }
+  InstallSignalHandler(SIGCHLD, OnSigchld);
+
+#ifdef TRACE_SECCOMP_ARCH
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, trace_socket) < 0) {
+    DIE("socketpair");
+  }
+#else
+  StartFanotify();
+#endif
+}
+
+void TraceInputsOfChild() {
+#ifdef TRACE_SECCOMP_ARCH
+  if (close(trace_socket[0]) < 0) {
+    DIE("close");
+  }
+  int listener = InstallSeccompListener();
+  if (listener < 0) {
+    PRINT_DEBUG("seccomp(SECCOMP_SET_MODE_FILTER): %s", strerror(errno));
+  }
+
+  char byte = 0;
+  struct iovec iov = {&byte, 1};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  union {
+    struct cmsghdr header;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  if (listener >= 0) {
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &listener, sizeof(int));
+  }
+  if (sendmsg(trace_socket[1], &msg, 0) < 0) {
+    DIE("sendmsg");
+  }
+  if (listener >= 0 && close(listener) < 0) {
+    DIE("close");
+  }
+
+  // Wait until PID 1 handles our opens, or has set up fanotify instead.
+  if (read(trace_socket[1], &byte, 1) != 1) {
+    DIE("read");
+  }
+  if (close(trace_socket[1]) < 0) {
+    DIE("close");
+  }
+#endif
+}
+
+void TraceInputsOfChildInParent() {
+#ifdef TRACE_SECCOMP_ARCH
+  if (close(trace_socket[1]) < 0) {
+    DIE("close");
+  }
+
+  char byte;
+  struct iovec iov = {&byte, 1};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  union {
+    struct cmsghdr header;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  ssize_t len;
+  while ((len = recvmsg(trace_socket[0], &msg, MSG_CMSG_CLOEXEC)) < 0 &&
+         errno == EINTR) {
+  }
+  struct cmsghdr *cmsg = len > 0 ? CMSG_FIRSTHDR(&msg) : nullptr;
+  if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET &&
+      cmsg->cmsg_type == SCM_RIGHTS) {
+    memcpy(&seccomp_listener, CMSG_DATA(cmsg), sizeof(int));
+    struct seccomp_notif_sizes sizes = {};
+    if (syscall(__NR_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) < 0) {
+      DIE("seccomp(SECCOMP_GET_NOTIF_SIZES)");
+    }
+    seccomp_notif_size =
+        std::max<size_t>(sizes.seccomp_notif, sizeof(struct seccomp_notif));
+    seccomp_notif_resp_size = std::max<size_t>(
+        sizes.seccomp_notif_resp, sizeof(struct seccomp_notif_resp));
+    PRINT_DEBUG("tracing inputs with seccomp");
+  } else if (len > 0) {
+    StartFanotify();
+  }
+
+  // The child may have died already, so ignore errors.
+  send(trace_socket[0], &byte, 1, MSG_NOSIGNAL);
+  if (close(trace_socket[0]) < 0) {
+    DIE("close");
+  }
+#endif
+}
+
+void WaitForInputAccesses() {
+  int fd = seccomp_listener >= 0 ? seccomp_listener : fanotify_fd;
+  if (fd < 0) {
+    sigsuspend(&wait_mask);
+    return;
+  }
+
+  struct pollfd pfd = {fd, POLLIN, 0};
+  if (ppoll(&pfd, 1, nullptr, &wait_mask) < 0) {
+    if (errno == EINTR) {
+      return;
+    }
+    DIE("ppoll");
+  }
+  if ((pfd.revents & POLLIN) == 0) {
+    return;
+  }
+#ifdef TRACE_SECCOMP_ARCH
+  if (seccomp_listener >= 0) {
+    HandleSeccompNotification();
+    return;
+  }
+#endif
+  ReadFanotifyEvents();
+}
+
+void FinishInputTracing(int fd) {
+  if (fanotify_fd >= 0) {
+    ReadFanotifyEvents();
+  } else if (seccomp_listener < 0) {
+    PRINT_DEBUG("input tracing is not available");
+    trace_incomplete = true;
+  }
+
+  std::vector<std::pair<std::string, bool>> result;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    result.push_back(
+        std::make_pair(inputs[i], trace_incomplete || input_accessed[i]));
+  }
+  std::sort(result.begin(), result.end());
+  std::string contents;
+  for (const auto &entry : result) {
+    contents += entry.second ? "accessed\t" : "unused\t";
+    contents += entry.first;
+    contents += '\n';
+  }
+
+  for (size_t written = 0; written < contents.size();) {
+    ssize_t len =
+        write(fd, contents.data() + written, contents.size() - written);
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("write(%s)", opt.input_trace_path.c_str());
+    }
+    written += len;
+  }
+}
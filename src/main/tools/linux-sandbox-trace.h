@@ -0,0 +1,55 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_TOOLS_LINUX_SANDBOX_TRACE_H_
+#define SRC_MAIN_TOOLS_LINUX_SANDBOX_TRACE_H_
+
+// Input tracing (-I) records which of the files present in the working
+// directory when the command starts are opened by the sandboxed process tree,
+// so that the caller can find declared inputs that an action does not need.
+//
+// Opens are intercepted with a seccomp user notification filter when the
+// kernel supports it (Linux 5.5), which attributes every open to a process in
+// the sandbox. Otherwise directory marks of an unprivileged fanotify group
+// (Linux 5.13) are used; those also report opens by processes outside of the
+// sandbox, which errs on the side of reporting inputs as accessed.
+//
+// Only opening a file counts as an access: an input that is merely stat()ed
+// is reported as unused. If no tracing mechanism is available, or events were
+// lost, all inputs are reported as accessed.
+
+// Collects the inputs and, if possible, starts watching them with fanotify.
+// Called by PID 1 before it spawns the child, with the signal handlers set up.
+void StartInputTracing();
+
+// Installs the seccomp filter that reports opens to PID 1, if fanotify is not
+// in use. Called in the child right before it runs the command.
+void TraceInputsOfChild();
+
+// Receives the seccomp listener from the child. Called by PID 1 right after
+// spawning the child.
+void TraceInputsOfChildInParent();
+
+// Waits until input accesses were reported or a signal arrived, and records
+// the accesses. PID 1 calls this whenever it has no child to reap.
+void WaitForInputAccesses();
+
+// Records the remaining accesses and writes the result to `fd`: one line per
+// input, "accessed" or "unused", a tab and the path relative to the working
+// directory. Called by PID 1 once the child has exited, including after a
+// timeout signal was forwarded to it; if PID 1 itself is killed with SIGKILL
+// the trace is not written.
+void FinishInputTracing(int fd);
+
+#endif  // SRC_MAIN_TOOLS_LINUX_SANDBOX_TRACE_H_
@@ -31,7 +31,12 @@
  *    will be killed.
  *  - If linux-sandbox's parent dies, it will kill itself, the process and all
  *    the children.
+ *  - The files in the working directory that the process opens can be
+ *    recorded (-I).
+ *  - The declared outputs can be digested after the process exits (-O/-o).
  *  - Network access is allowed, but can be disabled via -N.
+ *  - Alternatively, the process can share a loopback-only network namespace
+ *    with other sandboxes via -n. Such a namespace is created with -C.
  *  - The hostname and domainname will be set to "sandbox".
  *  - The process runs in its own PID namespace, so other processes on the
  *    system are invisible.
@@ -60,6 +65,7 @@
 #include <string>
 #include <vector>
 
+#include "src/main/tools/linux-sandbox-netns.h"
 #include "src/main/tools/linux-sandbox-options.h"
 #include "src/main/tools/linux-sandbox-pid1.h"
 #include "src/main/tools/logging.h"
@@ -67,6 +73,7 @@
 
 int global_outer_uid;
 int global_outer_gid;
+int global_input_trace_fd = -1;
 
 static int global_child_pid;
 
@@ -189,6 +196,15 @@ static int WaitForPid1() {
     }
   }
 
+  if (global_input_trace_fd >= 0 && WIFSIGNALED(status)) {
+    // PID 1 writes the trace once the command has exited, which it could not
+    // do if it was killed, e.g. with SIGKILL after the kill delay.
+    fprintf(stderr,
+            "linux-sandbox: the sandbox was killed before it could write the "
+            "input trace, %s is empty\n",
+            opt.input_trace_path.c_str());
+  }
+
   if (global_signal > 0) {
     // The child exited because we killed it due to receiving a signal
     // ourselves. Do not trust the exitcode in this case, just calculate it from
@@ -218,10 +234,30 @@ int main(int argc, char *argv[]) {
   Redirect(opt.stdout_path, STDOUT_FILENO);
   Redirect(opt.stderr_path, STDERR_FILENO);
 
+  CloseFds();
+
+  if (!opt.create_netns_path.empty()) {
+    return CreateNetworkNamespace(opt.create_netns_path);
+  }
+  if (!opt.netns_path.empty()) {
+    // This must happen before reading our ids, which change if we have to join
+    // another user namespace as well.
+    JoinNetworkNamespace(opt.netns_path);
+  }
+
   global_outer_uid = getuid();
   global_outer_gid = getgid();
 
-  CloseFds();
+  if (!opt.input_trace_path.empty()) {
+    // Opened here because PID 1 writes the trace once the file system has been
+    // made read-only.
+    global_input_trace_fd =
+        open(opt.input_trace_path.c_str(),
+             O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (global_input_trace_fd < 0) {
+      DIE("open(%s)", opt.input_trace_path.c_str());
+    }
+  }
 
   if (opt.timeout_secs > 0) {
     InstallSignalHandler(SIGALRM, OnTimeout);
@@ -229,5 +265,10 @@ int main(int argc, char *argv[]) {
   }
 
   SpawnPid1();
-  return WaitForPid1();
+  int exitcode = WaitForPid1();
+  if (!opt.outputs_path.empty()) {
+    WriteOutputManifest(opt.outputs_path, opt.working_dir,
+                        opt.output_manifest_path);
+  }
+  return exitcode;
 }
@@ -17,5 +17,7 @@
 
 extern int global_outer_uid;
 extern int global_outer_gid;
+// Where PID 1 writes the input trace (-I), or -1.
+extern int global_input_trace_fd;
 
 #endif
@@ -14,6 +14,7 @@
 
 #include "src/main/tools/process-tools.h"
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
@@ -28,11 +29,19 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
 #include <memory>
+#include <thread>
+#include <vector>
 
+#include "src/main/cpp/util/md5_multi.h"
 #include "src/main/protobuf/execution_statistics.pb.h"
 #include "src/main/tools/logging.h"
 
+using blaze_util::Md5MultiDigest;
+
 int SwitchToEuid() {
   int uid = getuid();
   int euid = geteuid();
@@ -233,13 +242,33 @@ CreateExecutionStatisticsProto(struct rusage *rusage) {
 }
 
 // Write execution statistics (e.g. resource usage) to a file.
-void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path) {
+static void WriteToFile(const std::string &contents, const std::string &path) {
   const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_APPEND;
-  int fd_out = open(stats_path.c_str(), flags, 0666);
+  int fd_out = open(path.c_str(), flags, 0666);
   if (fd_out < 0) {
-    DIE("open(%s)", stats_path.c_str());
+    DIE("open(%s)", path.c_str());
+  }
+
+  const char *remaining = contents.c_str();
+  ssize_t remaining_size = contents.size();
+
+  while (remaining_size > 0) {
+    ssize_t written = write(fd_out, remaining, remaining_size);
+    if (written < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      DIE("could not write to file '%s': %s", path.c_str(), strerror(errno));
+    }
+
+    remaining_size -= written;
+    remaining += written;
   }
 
+  close(fd_out);
+}
+
+void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path) {
   std::unique_ptr<tools::protos::ExecutionStatistics> execution_statistics =
       CreateExecutionStatisticsProto(rusage);
   std::string serialized = execution_statistics->SerializeAsString();
@@ -248,19 +277,141 @@ void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path) {
     DIE("invalid execution statistics message");
   }
 
-  const char *remaining = serialized.c_str();
-  ssize_t remaining_size = serialized.size();
+  WriteToFile(serialized, stats_path);
+}
 
-  while (remaining_size > 0) {
-    ssize_t written = write(fd_out, remaining, remaining_size);
-    if (written < 0 && errno != EINTR && errno != EAGAIN) {
-      DIE("could not write resource usage to file '%s': %s",
-          stats_path.c_str(), strerror(errno));
+// Adds an entry for "path", which is found at "real_path", to "manifest",
+// followed by entries for the contents of a directory. Appends the indices and
+// real paths of regular files to "files" and "file_paths".
+static void AddOutput(const std::string &path, const std::string &real_path,
+                      tools::protos::OutputManifest *manifest,
+                      std::vector<int> *files,
+                      std::vector<std::string> *file_paths) {
+  struct stat sb;
+  if (lstat(real_path.c_str(), &sb) < 0) {
+    if (errno != ENOENT && errno != ENOTDIR) {
+      PRINT_DEBUG("lstat(%s): %s", real_path.c_str(), strerror(errno));
     }
+    return;
+  }
 
-    remaining_size -= written;
-    remaining += written;
+  // The manifest is written once the command has finished, whether it
+  // succeeded, failed, timed out or was killed. An output that cannot be read
+  // is left out of it like a missing one rather than overriding that outcome.
+  std::vector<char> target;
+  ssize_t target_len = 0;
+  DIR *dir = nullptr;
+  if (S_ISLNK(sb.st_mode)) {
+    target.resize(sb.st_size + 1);
+    target_len = readlink(real_path.c_str(), target.data(), target.size());
+    if (target_len < 0) {
+      PRINT_DEBUG("readlink(%s): %s", real_path.c_str(), strerror(errno));
+      return;
+    }
+  } else if (S_ISDIR(sb.st_mode)) {
+    dir = opendir(real_path.c_str());
+    if (dir == nullptr) {
+      PRINT_DEBUG("opendir(%s): %s", real_path.c_str(), strerror(errno));
+      return;
+    }
   }
 
-  close(fd_out);
+  tools::protos::OutputManifest::Entry *entry = manifest->add_entries();
+  entry->set_path(path);
+  entry->set_mode(sb.st_mode);
+  entry->set_size(sb.st_size);
+  if (S_ISREG(sb.st_mode)) {
+    files->push_back(manifest->entries_size() - 1);
+    file_paths->push_back(real_path);
+  } else if (S_ISLNK(sb.st_mode)) {
+    entry->set_symlink_target(target.data(), target_len);
+  } else if (dir != nullptr) {
+    std::vector<std::string> names;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != nullptr) {
+      if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) {
+        names.push_back(ent->d_name);
+      }
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    for (const std::string &name : names) {
+      AddOutput(path + "/" + name, real_path + "/" + name, manifest, files,
+                file_paths);
+    }
+  }
+}
+
+// Sets the digests of the given regular files in "manifest". Each thread
+// hashes a few files per SIMD lane at a time.
+static void DigestOutputs(const std::vector<int> &files,
+                          const std::vector<std::string> &file_paths,
+                          tools::protos::OutputManifest *manifest) {
+  const size_t count = files.size();
+  const size_t chunk = 4 * Md5MultiDigest::kLanes;
+  std::vector<const char *> paths(count);
+  for (size_t i = 0; i < count; ++i) {
+    paths[i] = file_paths[i].c_str();
+  }
+  std::vector<unsigned char> digests(16 * count);
+  std::vector<int> errors(count);
+
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t start = next.fetch_add(chunk); start < count;
+         start = next.fetch_add(chunk)) {
+      Md5MultiDigest::DigestFiles(&paths[start], std::min(chunk, count - start),
+                                  &digests[16 * start], &errors[start]);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < std::thread::hardware_concurrency() &&
+                     i * chunk < count;
+       ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    if (errors[i] == 0) {
+      manifest->mutable_entries(files[i])->set_digest(&digests[16 * i], 16);
+    } else {
+      PRINT_DEBUG("cannot digest %s: %s", paths[i], strerror(errors[i]));
+    }
+  }
+}
+
+void WriteOutputManifest(const std::string &outputs_path,
+                         const std::string &base_dir,
+                         const std::string &manifest_path) {
+  std::ifstream outputs(outputs_path);
+  if (!outputs.is_open()) {
+    DIE("opening output list %s failed", outputs_path.c_str());
+  }
+
+  tools::protos::OutputManifest manifest;
+  manifest.set_digest_function("MD5");
+  std::vector<int> files;
+  std::vector<std::string> file_paths;
+  for (std::string path; std::getline(outputs, path);) {
+    while (path.size() > 1 && path.back() == '/') {
+      path.pop_back();
+    }
+    if (path.empty()) {
+      continue;
+    }
+    AddOutput(path,
+              base_dir.empty() || path[0] == '/' ? path : base_dir + "/" + path,
+              &manifest, &files, &file_paths);
+  }
+  if (outputs.bad()) {
+    DIE("error while reading from output list %s", outputs_path.c_str());
+  }
+
+  DigestOutputs(files, file_paths, &manifest);
+
+  WriteToFile(manifest.SerializeAsString(), manifest_path);
 }
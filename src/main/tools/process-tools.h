@@ -65,4 +65,13 @@ int WaitChildWithRusage(pid_t pid, struct rusage *rusage);
 // Write execution statistics to a file.
 void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path);
 
+// Write the metadata and MD5 digests of the outputs listed in the file
+// "outputs_path", one per line, to "manifest_path" as an OutputManifest
+// message. Relative output paths are resolved against "base_dir", if not
+// empty. Files are hashed in parallel right after the command exited, while
+// their contents are likely still in the page cache.
+void WriteOutputManifest(const std::string &outputs_path,
+                         const std::string &base_dir,
+                         const std::string &manifest_path);
+
 #endif  // PROCESS_TOOLS_H__
@@ -83,6 +83,10 @@ void LegacyProcessWrapper::WaitForChild() {
   // kill.
   kill(-child_pid, SIGKILL);
 
+  if (!opt.outputs_path.empty()) {
+    WriteOutputManifest(opt.outputs_path, "", opt.output_manifest_path);
+  }
+
   if (last_signal > 0) {
     // Don't trust the exit code if we got a timeout or signal.
     InstallDefaultSignalHandler(last_signal);
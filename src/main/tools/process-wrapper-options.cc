@@ -46,6 +46,12 @@ static void Usage(char *program_name, const char *fmt, ...) {
       "  -o/--stdout <file>  redirect stdout to a file\n"
       "  -e/--stderr <file>  redirect stderr to a file\n"
       "  -s/--stats <file>  if set, write stats in protobuf format to a file\n"
+      "  -O/--outputs <file>  digest the outputs listed in the file, one per "
+      "line,\n"
+      "    after the command exits\n"
+      "  -M/--output_manifest <file>  where to write the metadata of the "
+      "outputs\n"
+      "    listed with -O, in protobuf format\n"
       "  -d/--debug  if set, debug info will be printed\n"
       "  --  command to run inside sandbox, followed by arguments\n");
   exit(EXIT_FAILURE);
@@ -60,13 +66,15 @@ static void ParseCommandLine(const std::vector<char *> &args) {
       {"stdout", required_argument, 0, 'o'},
       {"stderr", required_argument, 0, 'e'},
       {"stats", required_argument, 0, 's'},
+      {"outputs", required_argument, 0, 'O'},
+      {"output_manifest", required_argument, 0, 'M'},
       {"debug", no_argument, 0, 'd'},
       {0, 0, 0, 0}};
   extern char *optarg;
   extern int optind, optopt;
   int c;
 
-  while ((c = getopt_long(args.size(), args.data(), "+:t:k:o:e:s:d",
+  while ((c = getopt_long(args.size(), args.data(), "+:t:k:o:e:s:O:M:d",
                           long_options, nullptr)) != -1) {
     switch (c) {
       case 't':
@@ -103,6 +111,22 @@ static void ParseCommandLine(const std::vector<char *> &args) {
                 "Cannot write stats (-s) to more than one destination.");
         }
         break;
+      case 'O':
+        if (opt.outputs_path.empty()) {
+          opt.outputs_path.assign(optarg);
+        } else {
+          Usage(args.front(), "Multiple output lists (-O) specified.");
+        }
+        break;
+      case 'M':
+        if (opt.output_manifest_path.empty()) {
+          opt.output_manifest_path.assign(optarg);
+        } else {
+          Usage(args.front(),
+                "Cannot write the output manifest (-M) to more than one "
+                "destination.");
+        }
+        break;
       case 'd':
         opt.debug = true;
         break;
@@ -129,6 +153,10 @@ void ParseOptions(int argc, char *argv[]) {
     Usage(args.front(), "No command specified.");
   }
 
+  if (opt.outputs_path.empty() != opt.output_manifest_path.empty()) {
+    Usage(args.front(), "The -O and -M options must be used together.");
+  }
+
   // argv[] passed to execve() must be a null-terminated array.
   opt.args.push_back(nullptr);
 }
@@ -32,6 +32,10 @@ struct Options {
   bool debug;
   // Where to write stats, in protobuf format (-s)
   std::string stats_path;
+  // File listing the declared outputs, one per line (-O)
+  std::string outputs_path;
+  // Where to write the metadata and digests of the outputs (-M)
+  std::string output_manifest_path;
   // Command to run (--)
   std::vector<char *> args;
 };
@@ -0,0 +1,573 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#define _FILE_OFFSET_BITS 64
+
+#include "src/main/tools/runfiles-creator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utility>
+
+#if defined(O_DIRECTORY)
+#define PORTABLE_O_DIRECTORY O_DIRECTORY
+#else
+#define PORTABLE_O_DIRECTORY 0
+#endif
+
+#if defined(O_CLOEXEC)
+#define PORTABLE_O_CLOEXEC O_CLOEXEC
+#else
+#define PORTABLE_O_CLOEXEC 0
+#endif
+
+RunfilesCreator::RunfilesCreator(const std::string &output_base)
+    : output_base_(output_base),
+      output_filename_("MANIFEST"),
+      temp_filename_(output_filename_ + ".tmp"),
+      output_base_fd_(-1),
+      added_entries_(0),
+      collapse_directories_(false),
+      error_number_(0) {}
+
+RunfilesCreator::~RunfilesCreator() {
+  if (output_base_fd_ >= 0) {
+    close(output_base_fd_);
+  }
+}
+
+bool RunfilesCreator::ReadManifest(const std::string &manifest_file,
+                                   bool allow_relative, bool use_metadata) {
+  FILE *infile = fopen(manifest_file.c_str(), "r");
+  if (!infile) {
+    return PFail("opening '%s' for reading", manifest_file.c_str());
+  }
+
+  // read input manifest
+  int lineno = 0;
+  char buf[3 * PATH_MAX];
+  bool ok = true;
+  while (ok && fgets(buf, sizeof buf, infile)) {
+    // copy line to output manifest
+    manifest_contents_ += buf;
+
+    // parse line
+    ++lineno;
+    // Skip metadata lines. They are used solely for
+    // dependency checking.
+    if (use_metadata && lineno % 2 == 0) continue;
+
+    int n = strlen(buf) - 1;
+    if (!n || buf[n] != '\n') {
+      ok = Fail("missing terminator at line %d: '%s'", lineno, buf);
+      break;
+    }
+    buf[n] = '\0';
+    ok = ParseLine(buf, lineno, allow_relative);
+  }
+  if (ok && ferror(infile)) {
+    ok = PFail("reading '%s'", manifest_file.c_str());
+  }
+  fclose(infile);
+  return ok;
+}
+
+bool RunfilesCreator::AddEntry(const std::string &link,
+                               const std::string &target,
+                               bool allow_relative) {
+  std::string line = link + ' ' + target;
+  if (line.find('\n') != std::string::npos) {
+    return Fail("link or target filename contains newline: '%s'",
+                line.c_str());
+  }
+  manifest_contents_ += line;
+  manifest_contents_ += '\n';
+  return ParseLine(line.c_str(), ++added_entries_, allow_relative);
+}
+
+bool RunfilesCreator::ParseLine(const char *buf, int lineno,
+                                bool allow_relative) {
+  if (buf[0] == '/') {
+    return Fail("paths must not be absolute: line %d: '%s'", lineno, buf);
+  }
+  const char *s = strchr(buf, ' ');
+  if (!s) {
+    return Fail("missing field delimiter at line %d: '%s'", lineno, buf);
+  } else if (strchr(s + 1, ' ')) {
+    return Fail("link or target filename contains space on line %d: '%s'",
+                lineno, buf);
+  }
+  std::string link(buf, s - buf);
+  const char *target = s + 1;
+  if (!allow_relative && target[0] != '\0' && target[0] != '/' &&
+      target[1] != ':') {  // Match Windows paths, e.g. C:\foo or C:/foo.
+    return Fail("expected absolute path at line %d: '%s'", lineno, buf);
+  }
+
+  FileInfo *info = &manifest_[link];
+  if (target[0] == '\0') {
+    // No target means an empty file.
+    info->type = FILE_TYPE_REGULAR;
+  } else {
+    info->type = FILE_TYPE_SYMLINK;
+    info->symlink_target = target;
+  }
+
+  FileInfo parent_info;
+  parent_info.type = FILE_TYPE_DIRECTORY;
+
+  while (true) {
+    int k = link.rfind('/');
+    if (k < 0) break;
+    link.erase(k, std::string::npos);
+    if (!manifest_.insert(std::make_pair(link, parent_info)).second) break;
+  }
+  return true;
+}
+
+void RunfilesCreator::CollapseDirectories() {
+  struct DirInfo {
+    // The source directory that all entries point into so far.
+    std::string source;
+    std::set<std::string> names;
+    bool collapsible = true;
+  };
+  std::map<std::string, DirInfo> dirs;
+  // The directories that can be collapsed, and their source directories.
+  std::map<std::string, std::string> collapsed;
+
+  // In reverse order, the entries below a directory come before it.
+  for (FileInfoMap::const_reverse_iterator it = manifest_.rbegin();
+       it != manifest_.rend(); ++it) {
+    const std::string &path = it->first;
+    // Where the entry points to, if that can be expressed by a symlink of
+    // its parent. Relative targets are relative to the entry's directory.
+    std::string source;
+    if (it->second.type == FILE_TYPE_SYMLINK &&
+        it->second.symlink_target[0] == '/') {
+      source = it->second.symlink_target;
+    } else if (it->second.type == FILE_TYPE_DIRECTORY) {
+      std::map<std::string, DirInfo>::iterator dir = dirs.find(path);
+      if (dir != dirs.end() && dir->second.collapsible &&
+          DirContainsExactly(dir->second.source, dir->second.names)) {
+        source = dir->second.source;
+        collapsed[path] = source;
+      }
+      if (dir != dirs.end()) {
+        dirs.erase(dir);
+      }
+    }
+
+    // The output directory itself is never collapsed.
+    std::string::size_type k = path.rfind('/');
+    if (k == std::string::npos) {
+      continue;
+    }
+    DirInfo *parent = &dirs[path.substr(0, k)];
+    if (!parent->collapsible) {
+      continue;
+    }
+    // The entry "parent/name" must point to "<source of parent>/name".
+    const std::string name = path.substr(k + 1);
+    parent->names.insert(name);
+    if (source.size() <= name.size() + 1 ||
+        source.compare(source.size() - name.size() - 1, std::string::npos,
+                       '/' + name) != 0) {
+      parent->collapsible = false;
+      continue;
+    }
+    source.resize(source.size() - name.size() - 1);
+    if (parent->names.size() == 1) {
+      parent->source = source;
+    } else if (parent->source != source) {
+      parent->collapsible = false;
+    }
+  }
+
+  for (std::map<std::string, std::string>::const_iterator it =
+           collapsed.begin();
+       it != collapsed.end(); ++it) {
+    const std::string &path = it->first;
+    // Siblings like "a-b" sort between "a" and "a/b", so look up every
+    // ancestor rather than only the last collapsed directory.
+    bool below_collapsed = false;
+    for (std::string::size_type k = path.rfind('/');
+         k != std::string::npos && k > 0 && !below_collapsed;
+         k = path.rfind('/', k - 1)) {
+      below_collapsed = collapsed.count(path.substr(0, k)) > 0;
+    }
+    if (below_collapsed) {
+      continue;  // Removed with the outer directory already.
+    }
+    // The entries below "path" are the ones in ["path/", "path0").
+    manifest_.erase(manifest_.lower_bound(path + '/'),
+                    manifest_.lower_bound(path + static_cast<char>('/' + 1)));
+    FileInfo *info = &manifest_[path];
+    info->type = FILE_TYPE_SYMLINK;
+    info->symlink_target = it->second;
+  }
+}
+
+bool RunfilesCreator::DirContainsExactly(const std::string &dir,
+                                         const std::set<std::string> &names) {
+  DIR *dh = opendir(dir.c_str());
+  if (!dh) {
+    return false;
+  }
+  size_t found = 0;
+  bool ok = true;
+  struct dirent *entry;
+  while (ok && (entry = readdir(dh)) != nullptr) {
+    if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+    ok = names.count(entry->d_name) > 0;
+    found++;
+  }
+  closedir(dh);
+  return ok && found == names.size();
+}
+
+bool RunfilesCreator::CreateRunfiles() {
+  if (collapse_directories_) {
+    CollapseDirectories();
+  }
+  if (!SetupOutputBase() || !WriteManifest()) {
+    return false;
+  }
+  // Don't delete the temp manifest file.
+  manifest_[temp_filename_].type = FILE_TYPE_REGULAR;
+
+  if (unlinkat(output_base_fd_, output_filename_.c_str(), 0) != 0 &&
+      errno != ENOENT) {
+    return PFail("removing previous file at '%s/%s'", output_base_.c_str(),
+                 output_filename_.c_str());
+  }
+
+  if (!ScanTreeAndPrune(".") || !CreateFiles()) {
+    return false;
+  }
+
+  // rename output file into place
+  if (renameat(output_base_fd_, temp_filename_.c_str(), output_base_fd_,
+               output_filename_.c_str()) != 0) {
+    return PFail("renaming '%s/%s' to '%s/%s'", output_base_.c_str(),
+                 temp_filename_.c_str(), output_base_.c_str(),
+                 output_filename_.c_str());
+  }
+  return true;
+}
+
+bool RunfilesCreator::SetupOutputBase() {
+  if (output_base_fd_ >= 0) {
+    return true;
+  }
+  struct stat st;
+  if (stat(output_base_.c_str(), &st) != 0) {
+    // Technically, this will cause problems if the user's umask contains
+    // 0200, but we don't care. Anyone who does that deserves what's coming.
+    if (mkdir(output_base_.c_str(), 0777) != 0) {
+      return PFail("creating directory '%s'", output_base_.c_str());
+    }
+  }
+  output_base_fd_ =
+      open(output_base_.c_str(),
+           O_RDONLY | PORTABLE_O_DIRECTORY | PORTABLE_O_CLOEXEC);
+  if (output_base_fd_ < 0) {
+    return PFail("opening directory '%s'", output_base_.c_str());
+  }
+  return EnsureDirReadAndWritePerms(".");
+}
+
+bool RunfilesCreator::WriteManifest() {
+  int fd = openat(output_base_fd_, temp_filename_.c_str(),
+                  O_WRONLY | O_CREAT | O_TRUNC | PORTABLE_O_CLOEXEC, 0666);
+  if (fd < 0) {
+    return PFail("opening '%s/%s' for writing", output_base_.c_str(),
+                 temp_filename_.c_str());
+  }
+  const char *data = manifest_contents_.data();
+  size_t remaining = manifest_contents_.size();
+  while (remaining > 0) {
+    ssize_t written = write(fd, data, remaining);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      int saved_errno = errno;
+      close(fd);
+      errno = saved_errno;
+      return PFail("writing to '%s/%s'", output_base_.c_str(),
+                   temp_filename_.c_str());
+    }
+    data += written;
+    remaining -= written;
+  }
+  if (close(fd) != 0) {
+    return PFail("writing to '%s/%s'", output_base_.c_str(),
+                 temp_filename_.c_str());
+  }
+  return true;
+}
+
+bool RunfilesCreator::ScanTreeAndPrune(const std::string &path) {
+  // A note on non-empty files:
+  // We don't distinguish between empty and non-empty files. That is, if
+  // there's a file that has contents, we don't truncate it here, even though
+  // the manifest supports creation of empty files, only. Given that
+  // .runfiles are *supposed* to be immutable, this shouldn't be a problem.
+  if (!EnsureDirReadAndWritePerms(path)) {
+    return false;
+  }
+
+  struct dirent *entry;
+  DIR *dh = OpenDir(path);
+  if (!dh) {
+    return PFail("opendir '%s'", path.c_str());
+  }
+
+  errno = 0;
+  const std::string prefix = (path == "." ? "" : path + "/");
+  while ((entry = readdir(dh)) != nullptr) {
+    if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+
+    std::string entry_path = prefix + entry->d_name;
+    FileInfo actual_info;
+    if (!DentryToFileType(entry_path, entry, &actual_info.type) ||
+        (actual_info.type == FILE_TYPE_SYMLINK &&
+         !ReadLink(entry_path, &actual_info.symlink_target))) {
+      closedir(dh);
+      return false;
+    }
+
+    FileInfoMap::iterator expected_it = manifest_.find(entry_path);
+    if (expected_it == manifest_.end() ||
+        expected_it->second != actual_info) {
+#if !defined(__CYGWIN__)
+      if (!DelTree(entry_path, actual_info.type)) {
+        closedir(dh);
+        return false;
+      }
+#else
+      // On Windows, if deleting failed, lamely assume that
+      // the link points to the right place.
+      if (!DelTree(entry_path, actual_info.type)) {
+        manifest_.erase(expected_it);
+      }
+#endif
+    } else {
+      manifest_.erase(expected_it);
+      if (actual_info.type == FILE_TYPE_DIRECTORY &&
+          !ScanTreeAndPrune(entry_path)) {
+        closedir(dh);
+        return false;
+      }
+    }
+
+    errno = 0;
+  }
+  if (errno != 0) {
+    int saved_errno = errno;
+    closedir(dh);
+    errno = saved_errno;
+    return PFail("reading directory '%s'", path.c_str());
+  }
+  closedir(dh);
+  return true;
+}
+
+bool RunfilesCreator::CreateFiles() {
+  for (FileInfoMap::const_iterator it = manifest_.begin();
+       it != manifest_.end(); ++it) {
+    const std::string &path = it->first;
+    switch (it->second.type) {
+      case FILE_TYPE_DIRECTORY:
+        if (mkdirat(output_base_fd_, path.c_str(), 0777) != 0) {
+          return PFail("mkdir '%s'", path.c_str());
+        }
+        break;
+      case FILE_TYPE_REGULAR:
+        {
+          int fd = openat(output_base_fd_, path.c_str(),
+                          O_CREAT | O_EXCL | O_WRONLY | PORTABLE_O_CLOEXEC,
+                          0555);
+          if (fd < 0) {
+            return PFail("creating empty file '%s'", path.c_str());
+          }
+          close(fd);
+        }
+        break;
+      case FILE_TYPE_SYMLINK:
+        {
+          const std::string &target = it->second.symlink_target;
+          if (symlinkat(target.c_str(), output_base_fd_, path.c_str()) != 0) {
+            return PFail("symlinking '%s' -> '%s'", path.c_str(),
+                         target.c_str());
+          }
+        }
+        break;
+    }
+  }
+  return true;
+}
+
+bool RunfilesCreator::DentryToFileType(const std::string &path,
+                                       struct dirent *ent, FileType *type) {
+#ifdef _DIRENT_HAVE_D_TYPE
+  if (ent->d_type != DT_UNKNOWN) {
+    if (ent->d_type == DT_DIR) {
+      *type = FILE_TYPE_DIRECTORY;
+    } else if (ent->d_type == DT_LNK) {
+      *type = FILE_TYPE_SYMLINK;
+    } else {
+      *type = FILE_TYPE_REGULAR;
+    }
+    return true;
+  }
+#endif
+  struct stat st;
+  if (!LStat(path, &st)) {
+    return false;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    *type = FILE_TYPE_DIRECTORY;
+  } else if (S_ISLNK(st.st_mode)) {
+    *type = FILE_TYPE_SYMLINK;
+  } else {
+    *type = FILE_TYPE_REGULAR;
+  }
+  return true;
+}
+
+bool RunfilesCreator::LStat(const std::string &path, struct stat *st) {
+  if (fstatat(output_base_fd_, path.c_str(), st, AT_SYMLINK_NOFOLLOW) != 0) {
+    return PFail("lstating file '%s'", path.c_str());
+  }
+  return true;
+}
+
+bool RunfilesCreator::ReadLink(const std::string &path, std::string *output) {
+  char readlink_buffer[PATH_MAX];
+  ssize_t sz = readlinkat(output_base_fd_, path.c_str(), readlink_buffer,
+                          sizeof(readlink_buffer));
+  if (sz < 0) {
+    return PFail("reading symlink '%s'", path.c_str());
+  }
+  // readlink returns a non-null terminated string.
+  std::string(readlink_buffer, sz).swap(*output);
+  return true;
+}
+
+bool RunfilesCreator::EnsureDirReadAndWritePerms(const std::string &path) {
+  const int kMode = 0700;
+  struct stat st;
+  if (!LStat(path, &st)) {
+    return false;
+  }
+  if ((st.st_mode & kMode) != kMode) {
+    int new_mode = st.st_mode | kMode;
+    if (fchmodat(output_base_fd_, path.c_str(), new_mode, 0) != 0) {
+      return PFail("chmod '%s'", path.c_str());
+    }
+  }
+  return true;
+}
+
+bool RunfilesCreator::DelTree(const std::string &path, FileType file_type) {
+  if (file_type != FILE_TYPE_DIRECTORY) {
+    if (unlinkat(output_base_fd_, path.c_str(), 0) != 0) {
+      return PFail("unlinking '%s'", path.c_str());
+    }
+    return true;
+  }
+
+  if (!EnsureDirReadAndWritePerms(path)) {
+    return false;
+  }
+
+  struct dirent *entry;
+  DIR *dh = OpenDir(path);
+  if (!dh) {
+    return PFail("opendir '%s'", path.c_str());
+  }
+  errno = 0;
+  while ((entry = readdir(dh)) != nullptr) {
+    if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+    const std::string entry_path = path + '/' + entry->d_name;
+    FileType entry_file_type;
+    if (!DentryToFileType(entry_path, entry, &entry_file_type) ||
+        !DelTree(entry_path, entry_file_type)) {
+      closedir(dh);
+      return false;
+    }
+    errno = 0;
+  }
+  if (errno != 0) {
+    int saved_errno = errno;
+    closedir(dh);
+    errno = saved_errno;
+    return PFail("readdir '%s'", path.c_str());
+  }
+  closedir(dh);
+  if (unlinkat(output_base_fd_, path.c_str(), AT_REMOVEDIR) != 0) {
+    return PFail("rmdir '%s'", path.c_str());
+  }
+  return true;
+}
+
+DIR *RunfilesCreator::OpenDir(const std::string &path) {
+  int fd = openat(output_base_fd_, path.c_str(),
+                  O_RDONLY | PORTABLE_O_DIRECTORY | PORTABLE_O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  DIR *dh = fdopendir(fd);
+  if (!dh) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+  }
+  return dh;
+}
+
+bool RunfilesCreator::Fail(const char *fmt, ...) {
+  char buf[4 * PATH_MAX];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  error_ = buf;
+  error_number_ = 0;
+  return false;
+}
+
+bool RunfilesCreator::PFail(const char *fmt, ...) {
+  int saved_errno = errno;
+  char buf[4 * PATH_MAX];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  error_ = buf;
+  error_ += ": ";
+  error_ += strerror(saved_errno);
+  error_ += " [" + std::to_string(saved_errno) + "]";
+  error_number_ = saved_errno;
+  return false;
+}
@@ -0,0 +1,131 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_TOOLS_RUNFILES_CREATOR_H_
+#define SRC_MAIN_TOOLS_RUNFILES_CREATOR_H_
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <set>
+#include <string>
+
+// Creates a "runfiles tree" from the entries of a "runfiles manifest", see
+// build-runfiles.cc for the details. The files in the output directory are
+// scanned and any extraneous ones are removed, then any missing files are
+// created, and finally the manifest is written to RUNFILES/MANIFEST.
+//
+// All the file system operations are relative to a descriptor of the output
+// directory and the methods report errors rather than exiting, so that
+// several instances can update different trees concurrently in one process.
+class RunfilesCreator {
+ public:
+  explicit RunfilesCreator(const std::string &output_base);
+  ~RunfilesCreator();
+
+  // Adds the entries of the given manifest file, whose contents are copied to
+  // RUNFILES/MANIFEST. If `use_metadata` is set, every other line is treated
+  // as opaque metadata and is ignored. Returns false on error.
+  bool ReadManifest(const std::string &manifest_file, bool allow_relative,
+                    bool use_metadata);
+
+  // Adds a single manifest entry: a symlink from `link` to `target`, or an
+  // empty file if `target` is empty. The line "<link> <target>" is added to
+  // RUNFILES/MANIFEST. Returns false on error.
+  bool AddEntry(const std::string &link, const std::string &target,
+                bool allow_relative);
+
+  // If set, a directory of the tree whose entries are all symlinks to the
+  // files of one source directory, with the same names and nothing else, is
+  // created as a single symlink to that directory rather than one symlink per
+  // file. This applies recursively, so e.g. the runfiles of an external
+  // repository become a single symlink. Note that files added to the source
+  // directory later show up in the tree until it is rebuilt.
+  void set_collapse_directories(bool collapse) {
+    collapse_directories_ = collapse;
+  }
+
+  // Creates the output directory if needed, brings its contents in line with
+  // the entries added so far and writes RUNFILES/MANIFEST. Returns false on
+  // error.
+  bool CreateRunfiles();
+
+  // The description of the last error.
+  const std::string &error() const { return error_; }
+
+  // The errno value of the last error, or 0 if it was not caused by a
+  // failing system call.
+  int error_number() const { return error_number_; }
+
+ private:
+  enum FileType { FILE_TYPE_REGULAR, FILE_TYPE_DIRECTORY, FILE_TYPE_SYMLINK };
+
+  struct FileInfo {
+    FileType type;
+    std::string symlink_target;
+
+    bool operator==(const FileInfo &other) const {
+      return type == other.type && symlink_target == other.symlink_target;
+    }
+
+    bool operator!=(const FileInfo &other) const { return !(*this == other); }
+  };
+
+  typedef std::map<std::string, FileInfo> FileInfoMap;
+
+  // Parses one line of the manifest, without the terminator.
+  bool ParseLine(const char *line, int lineno, bool allow_relative);
+  // Replaces the entries of directories that can be collapsed by a symlink.
+  void CollapseDirectories();
+  // Whether the directory at the absolute path `dir` contains exactly the
+  // given names.
+  bool DirContainsExactly(const std::string &dir,
+                          const std::set<std::string> &names);
+  bool SetupOutputBase();
+  bool WriteManifest();
+  bool ScanTreeAndPrune(const std::string &path);
+  bool CreateFiles();
+  bool DentryToFileType(const std::string &path, struct dirent *ent,
+                        FileType *type);
+  bool LStat(const std::string &path, struct stat *st);
+  bool ReadLink(const std::string &path, std::string *output);
+  bool EnsureDirReadAndWritePerms(const std::string &path);
+  bool DelTree(const std::string &path, FileType file_type);
+  // Opens the given directory, relative to the output directory.
+  DIR *OpenDir(const std::string &path);
+
+  // Sets the error message and returns false.
+  bool Fail(const char *fmt, ...)
+      __attribute__((format(printf, 2, 3)));
+  // Same, but appends the error message for errno.
+  bool PFail(const char *fmt, ...)
+      __attribute__((format(printf, 2, 3)));
+
+  std::string output_base_;
+  std::string output_filename_;
+  std::string temp_filename_;
+  // The descriptor of output_base_, or -1 before it is set up.
+  int output_base_fd_;
+
+  FileInfoMap manifest_;
+  std::string manifest_contents_;
+  // The number of entries added through AddEntry, for error messages.
+  int added_entries_;
+  bool collapse_directories_;
+  std::string error_;
+  int error_number_;
+};
+
+#endif  // SRC_MAIN_TOOLS_RUNFILES_CREATOR_H_
@@ -0,0 +1,141 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/archive_utils.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/path.h"
+#include "googletest/include/gtest/gtest.h"
+#include "third_party/ijar/zip.h"
+
+namespace blaze {
+
+using blaze_util::JoinPath;
+using std::string;
+
+static const char kInstallKey[] = "0123456789abcdef0123456789abcdef";
+static const char kHelloMd5[] = "5d41402abc4b2a76b9719d911017c592";
+
+class ArchiveUtilsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const char* tmp_dir = getenv("TEST_TMPDIR");
+    ASSERT_NE(nullptr, tmp_dir);
+    test_dir_ = JoinPath(tmp_dir, ::testing::UnitTest::GetInstance()
+                                      ->current_test_info()
+                                      ->name());
+    ASSERT_TRUE(blaze_util::MakeDirectories(test_dir_, 0755));
+    archive_ = JoinPath(test_dir_, "archive.zip");
+    store_ = JoinPath(test_dir_, "store");
+    WriteArchive({{"A", "hello"}, {"dir/B", "hello"}, {"C", "world"},
+                  {"install_base_key", kInstallKey}});
+  }
+
+  void WriteArchive(const std::vector<std::pair<string, string>>& files) {
+    std::unique_ptr<devtools_ijar::ZipBuilder> zip(
+        devtools_ijar::ZipBuilder::Create(archive_.c_str(), 1 << 20));
+    ASSERT_NE(nullptr, zip.get());
+    for (const auto& file : files) {
+      devtools_ijar::u1* data = zip->NewFile(file.first.c_str(), 0755 << 16);
+      ASSERT_NE(nullptr, data);
+      memcpy(data, file.second.data(), file.second.size());
+      ASSERT_EQ(0, zip->FinishFile(file.second.size()));
+    }
+    ASSERT_EQ(0, zip->Finish());
+  }
+
+  void Extract(const string& install_base) {
+    ExtractArchiveOrDie(archive_, "bazel", kInstallKey, install_base, store_);
+  }
+
+  static string ReadOrEmpty(const string& path) {
+    string contents;
+    return blaze_util::ReadFile(path, &contents) ? contents : "";
+  }
+
+  string test_dir_;
+  string archive_;
+  string store_;
+};
+
+TEST_F(ArchiveUtilsTest, ExtractsIntoStore) {
+  string install_base = JoinPath(test_dir_, "install");
+  Extract(install_base);
+
+  EXPECT_EQ("hello", ReadOrEmpty(JoinPath(install_base, "A")));
+  EXPECT_EQ("hello", ReadOrEmpty(JoinPath(install_base, "dir/B")));
+  EXPECT_EQ("world", ReadOrEmpty(JoinPath(install_base, "C")));
+  EXPECT_EQ(kInstallKey, ReadOrEmpty(JoinPath(install_base,
+                                              "install_base_key")));
+
+  // Identical contents are stored once, and no temporary files are left.
+  std::vector<string> stored;
+  blaze_util::GetAllFilesUnder(store_, &stored);
+  EXPECT_EQ(3u, stored.size());
+  string stored_hello = JoinPath(store_, kHelloMd5);
+  EXPECT_EQ("hello", ReadOrEmpty(stored_hello));
+
+  // Install bases share the stored files, which must not be writable.
+  struct stat st;
+  ASSERT_EQ(0, stat(stored_hello.c_str(), &st));
+  EXPECT_EQ(0, st.st_mode & 0222);
+  EXPECT_NE(0, st.st_mode & 0111);
+}
+
+TEST_F(ArchiveUtilsTest, ReusesStoredFiles) {
+  Extract(JoinPath(test_dir_, "install1"));
+  string stored_hello = JoinPath(store_, kHelloMd5);
+  struct stat before;
+  ASSERT_EQ(0, stat(stored_hello.c_str(), &before));
+
+  string install_base = JoinPath(test_dir_, "install2");
+  Extract(install_base);
+
+  struct stat after;
+  ASSERT_EQ(0, stat(stored_hello.c_str(), &after));
+  EXPECT_EQ(before.st_ino, after.st_ino);
+  EXPECT_EQ("hello", ReadOrEmpty(JoinPath(install_base, "A")));
+}
+
+TEST_F(ArchiveUtilsTest, ReplacesModifiedStoredFiles) {
+  Extract(JoinPath(test_dir_, "install1"));
+
+  // Change a stored file in place, as a write through a hard link from an
+  // install base would, once without and once with changing its size.
+  string stored_hello = JoinPath(store_, kHelloMd5);
+  ASSERT_EQ(0, chmod(stored_hello.c_str(), 0755));
+  ASSERT_TRUE(blaze_util::WriteFile("HELLO", stored_hello, 0755));
+  string install_base = JoinPath(test_dir_, "install2");
+  Extract(install_base);
+  EXPECT_EQ("hello", ReadOrEmpty(JoinPath(install_base, "A")));
+  EXPECT_EQ("hello", ReadOrEmpty(stored_hello));
+
+  ASSERT_EQ(0, chmod(stored_hello.c_str(), 0755));
+  ASSERT_TRUE(blaze_util::WriteFile("hello, world", stored_hello, 0755));
+  install_base = JoinPath(test_dir_, "install3");
+  Extract(install_base);
+  EXPECT_EQ("hello", ReadOrEmpty(JoinPath(install_base, "dir/B")));
+  EXPECT_EQ("hello", ReadOrEmpty(stored_hello));
+}
+
+}  // namespace blaze
@@ -162,6 +162,27 @@ TEST(FilePosixTest, PathExists) {
   ASSERT_TRUE(PathExists("/usr/bin/yes"));
 }
 
+TEST(FilePosixTest, CloneOrLinkFile) {
+  const char* tmp_dir = getenv("TEST_TMPDIR");
+  ASSERT_NE(tmp_dir, nullptr);
+  string source = JoinPath(tmp_dir, "clone_source");
+  string target = JoinPath(tmp_dir, "clone_target");
+  UnlinkPath(target);
+  ASSERT_TRUE(WriteFile("hello", source, 0755));
+
+  ASSERT_TRUE(CloneOrLinkFile(source, target));
+  string contents;
+  ASSERT_TRUE(ReadFile(target, &contents));
+  ASSERT_EQ("hello", contents);
+  ASSERT_TRUE(CanExecuteFile(target));
+
+  // The target must not exist yet.
+  ASSERT_FALSE(CloneOrLinkFile(source, target));
+  ASSERT_FALSE(CloneOrLinkFile(JoinPath(tmp_dir, "non.existent"),
+                               JoinPath(tmp_dir, "clone_target2")));
+  ASSERT_FALSE(PathExists(JoinPath(tmp_dir, "clone_target2")));
+}
+
 TEST(FilePosixTest, CanAccess) {
   ASSERT_FALSE(CanReadFile("/this/should/not/exist/mkay"));
   ASSERT_FALSE(CanExecuteFile("/this/should/not/exist/mkay"));
@@ -0,0 +1,192 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares the multi-buffer Md5MultiDigest with the one-stream Md5Digest,
+// both on messages in memory and on files read the way md5sumAsBytes in
+// unix_jni.cc does.
+//
+// Usage: md5_benchmark [--files=N] [--sizes=S1,S2,...] [--rounds=N]
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/util/md5.h"
+#include "src/main/cpp/util/md5_multi.h"
+
+using blaze_util::Md5Digest;
+using blaze_util::Md5MultiDigest;
+
+namespace {
+
+double Now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Hashes a file like md5sumAsBytes does.
+bool Md5File(const char *path, unsigned char digest[16]) {
+  Md5Digest md5;
+  char buf[8192];
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  ssize_t len;
+  while ((len = read(fd, buf, sizeof(buf))) > 0) {
+    md5.Update(buf, len);
+  }
+  close(fd);
+  md5.Finish(digest);
+  return len == 0;
+}
+
+void Report(const char *name, size_t count, size_t size, int rounds,
+            double seconds) {
+  double total = static_cast<double>(count) * rounds;
+  printf("  %-22s %10.0f messages/s %9.1f MB/s\n", name, total / seconds,
+         total * size / seconds / 1e6);
+}
+
+void Die(const char *what, const std::string &path) {
+  fprintf(stderr, "%s %s: %s\n", what, path.c_str(), strerror(errno));
+  exit(1);
+}
+
+void Benchmark(const std::string &dir, size_t count, size_t size,
+               int rounds) {
+  printf("%zu messages of %zu bytes:\n", count, size);
+  std::vector<std::string> contents(count);
+  std::vector<std::string> paths(count);
+  for (size_t i = 0; i < count; ++i) {
+    contents[i].resize(size);
+    for (size_t j = 0; j < size; ++j) {
+      contents[i][j] = static_cast<char>(rand());
+    }
+    paths[i] = dir + "/" + std::to_string(size) + "_" + std::to_string(i);
+    FILE *f = fopen(paths[i].c_str(), "w");
+    if (f == NULL || fwrite(contents[i].data(), 1, size, f) != size ||
+        fclose(f) != 0) {
+      Die("Cannot write", paths[i]);
+    }
+  }
+
+  std::vector<const void *> data(count);
+  std::vector<size_t> lengths(count);
+  std::vector<const char *> path_ptrs(count);
+  for (size_t i = 0; i < count; ++i) {
+    data[i] = contents[i].data();
+    lengths[i] = size;
+    path_ptrs[i] = paths[i].c_str();
+  }
+  std::vector<unsigned char> expected(16 * count);
+  std::vector<unsigned char> actual(16 * count);
+  std::vector<int> errors(count);
+
+  double start = Now();
+  for (int r = 0; r < rounds; ++r) {
+    for (size_t i = 0; i < count; ++i) {
+      Md5Digest md5;
+      md5.Update(data[i], size);
+      md5.Finish(&expected[16 * i]);
+    }
+  }
+  Report("Md5Digest (memory)", count, size, rounds, Now() - start);
+
+  start = Now();
+  for (int r = 0; r < rounds; ++r) {
+    Md5MultiDigest::Digest(&data[0], &lengths[0], count, &actual[0]);
+  }
+  Report("Md5MultiDigest (memory)", count, size, rounds, Now() - start);
+  if (expected != actual) {
+    fprintf(stderr, "Md5MultiDigest::Digest computed wrong digests\n");
+    exit(1);
+  }
+
+  start = Now();
+  for (int r = 0; r < rounds; ++r) {
+    for (size_t i = 0; i < count; ++i) {
+      if (!Md5File(path_ptrs[i], &expected[16 * i])) {
+        Die("Cannot read", paths[i]);
+      }
+    }
+  }
+  Report("Md5Digest (files)", count, size, rounds, Now() - start);
+
+  start = Now();
+  for (int r = 0; r < rounds; ++r) {
+    Md5MultiDigest::DigestFiles(&path_ptrs[0], count, &actual[0],
+                                &errors[0]);
+  }
+  Report("Md5MultiDigest (files)", count, size, rounds, Now() - start);
+  if (expected != actual) {
+    fprintf(stderr, "Md5MultiDigest::DigestFiles computed wrong digests\n");
+    exit(1);
+  }
+
+  for (const std::string &path : paths) {
+    unlink(path.c_str());
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  size_t count = 10000;
+  int rounds = 3;
+  std::vector<size_t> sizes = {100, 1000, 10000, 100000};
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--files=", 8) == 0) {
+      count = strtoul(argv[i] + 8, NULL, 10);
+    } else if (strncmp(argv[i], "--rounds=", 9) == 0) {
+      rounds = atoi(argv[i] + 9);
+    } else if (strncmp(argv[i], "--sizes=", 8) == 0) {
+      sizes.clear();
+      for (char *p = argv[i] + 8; *p != 0;) {
+        sizes.push_back(strtoul(p, &p, 10));
+        if (*p == ',') {
+          ++p;
+        }
+      }
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--files=N] [--sizes=S1,S2,...] [--rounds=N]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  const char *tmpdir = getenv("TEST_TMPDIR");
+  std::string dir = std::string(tmpdir != NULL ? tmpdir : "/tmp") +
+                    "/md5_benchmark.XXXXXX";
+  if (mkdtemp(&dir[0]) == NULL) {
+    Die("Cannot create", dir);
+  }
+  printf("Md5MultiDigest hashes %d messages at once.\n",
+         Md5MultiDigest::kLanes);
+  for (size_t size : sizes) {
+    Benchmark(dir, count, size, rounds);
+  }
+  rmdir(dir.c_str());
+  return 0;
+}
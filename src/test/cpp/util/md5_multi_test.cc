@@ -0,0 +1,131 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/util/md5.h"
+#include "src/main/cpp/util/md5_multi.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace blaze_util {
+
+static std::string Hex(const unsigned char *digest) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  std::string result;
+  for (int i = 0; i < 16; ++i) {
+    result.push_back(kHexDigits[digest[i] >> 4]);
+    result.push_back(kHexDigits[digest[i] & 0xf]);
+  }
+  return result;
+}
+
+// Hashes the messages with Md5MultiDigest::Digest and Md5Digest, and checks
+// that the results agree.
+static void ExpectSameDigests(const std::vector<std::string> &messages) {
+  std::vector<const void *> data;
+  std::vector<size_t> lengths;
+  for (const std::string &message : messages) {
+    data.push_back(message.data());
+    lengths.push_back(message.size());
+  }
+  std::vector<unsigned char> digests(16 * messages.size());
+  Md5MultiDigest::Digest(data.data(), lengths.data(), messages.size(),
+                         digests.data());
+
+  for (size_t i = 0; i < messages.size(); ++i) {
+    Md5Digest md5;
+    md5.Update(messages[i].data(), messages[i].size());
+    unsigned char expected[16];
+    md5.Finish(expected);
+    EXPECT_EQ(Hex(expected), Hex(&digests[16 * i])) << "message " << i;
+  }
+}
+
+TEST(Md5MultiDigestTest, TestVectors) {
+  const void *data[] = {"", "abc", "message digest"};
+  size_t lengths[] = {0, 3, 14};
+  unsigned char digests[16 * 3];
+  Md5MultiDigest::Digest(data, lengths, 3, digests);
+  EXPECT_EQ("d41d8cd98f00b204e9800998ecf8427e", Hex(digests));
+  EXPECT_EQ("900150983cd24fb0d6963f7d28e17f72", Hex(digests + 16));
+  EXPECT_EQ("f96b697d7cb7938d525a2f31aaf161d0", Hex(digests + 32));
+}
+
+TEST(Md5MultiDigestTest, AllPaddingLengths) {
+  // Covers messages ending at every offset of a block, with more messages
+  // than lanes so that lanes get reused.
+  std::vector<std::string> messages;
+  for (int length = 0; length < 200; ++length) {
+    std::string message;
+    for (int i = 0; i < length; ++i) {
+      message.push_back(static_cast<char>(length * 31 + i));
+    }
+    messages.push_back(message);
+  }
+  ExpectSameDigests(messages);
+}
+
+TEST(Md5MultiDigestTest, MixedSizes) {
+  std::vector<std::string> messages;
+  for (int i = 0; i < 3 * Md5MultiDigest::kLanes; ++i) {
+    messages.push_back(std::string(i % 5 == 0 ? 300000 : 10 * i, 'a' + i));
+  }
+  ExpectSameDigests(messages);
+}
+
+TEST(Md5MultiDigestTest, Files) {
+  std::string dir = getenv("TEST_TMPDIR");
+  std::vector<std::string> contents = {
+      "", "abc", std::string(200000, 'x'), "missing", "message digest"};
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < contents.size(); ++i) {
+    paths.push_back(dir + "/md5_multi_" + std::to_string(i));
+    if (contents[i] != "missing") {
+      FILE *f = fopen(paths[i].c_str(), "w");
+      ASSERT_NE(nullptr, f);
+      fwrite(contents[i].data(), 1, contents[i].size(), f);
+      fclose(f);
+    }
+  }
+  std::vector<const char *> path_ptrs;
+  for (const std::string &path : paths) {
+    path_ptrs.push_back(path.c_str());
+  }
+
+  std::vector<unsigned char> digests(16 * paths.size());
+  std::vector<int> errors(paths.size(), -1);
+  Md5MultiDigest::DigestFiles(path_ptrs.data(), paths.size(), digests.data(),
+                              errors.data());
+
+  EXPECT_EQ(ENOENT, errors[3]);
+  for (size_t i = 0; i < contents.size(); ++i) {
+    if (i == 3) {
+      continue;
+    }
+    EXPECT_EQ(0, errors[i]);
+    Md5Digest md5;
+    md5.Update(contents[i].data(), contents[i].size());
+    unsigned char expected[16];
+    md5.Finish(expected);
+    EXPECT_EQ(Hex(expected), Hex(&digests[16 * i])) << paths[i];
+  }
+}
+
+}  // namespace blaze_util
@@ -12,10 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "src/main/cpp/util/zip_headers.h"
 #include "googletest/include/gtest/gtest.h"
 
-#include "src/tools/singlejar/zip_headers.h"
-
 namespace {
 
 const uint8_t kPoison = 0xFB;
@@ -314,5 +313,164 @@ TEST(ZipHeadersTest, Zip64ExtraFieldTest) {
   EXPECT_EQ(kPoison, bytes[z64->size()]);
 }
 
-}  // namespace
+// Writes a Zip file with a preamble and a single stored entry "foo" into
+// bytes. Returns the Zip file size.
+size_t WriteZip(uint8_t *bytes, size_t preamble_size, bool zip64) {
+  memset(bytes, 'P', preamble_size);
+  uint8_t *p = bytes + preamble_size;
+
+  LH *lh = reinterpret_cast<LH *>(p);
+  lh->signature();
+  lh->version(10);
+  lh->bit_flag(0);
+  lh->compression_method(0);
+  lh->last_mod_file_time(0);
+  lh->last_mod_file_date(0);
+  lh->crc32(0);
+  lh->compressed_file_size32(3);
+  lh->uncompressed_file_size32(3);
+  lh->file_name("foo", 3);
+  lh->extra_fields(nullptr, 0);
+  memcpy(lh->data(), "bar", 3);
+  p = lh->data() + 3;
+
+  CDH *cdh = reinterpret_cast<CDH *>(p);
+  cdh->signature();
+  cdh->version(10);
+  cdh->version_to_extract(10);
+  cdh->bit_flag(0);
+  cdh->compression_method(0);
+  cdh->last_mod_file_time(0);
+  cdh->last_mod_file_date(0);
+  cdh->crc32(0);
+  cdh->compressed_file_size32(3);
+  cdh->uncompressed_file_size32(3);
+  cdh->file_name("foo", 3);
+  cdh->extra_fields(nullptr, 0);
+  cdh->comment_length(0);
+  cdh->start_disk_nr(0);
+  cdh->internal_attributes(0);
+  cdh->external_attributes(0);
+  cdh->local_header_offset32(0);
+  p += cdh->size();
+  uint64_t cen_size = cdh->size();
+  uint64_t cen_offset = ziph::byte_ptr(cdh) - bytes - preamble_size;
+
+  if (zip64) {
+    ECD64 *ecd64 = reinterpret_cast<ECD64 *>(p);
+    ecd64->signature();
+    ecd64->remaining_size(sizeof(ECD64) - 12);
+    ecd64->version(10);
+    ecd64->version_to_extract(10);
+    ecd64->this_disk_nr(0);
+    ecd64->cen_disk_nr(0);
+    ecd64->this_disk_entries(1);
+    ecd64->total_entries(1);
+    ecd64->cen_size(cen_size);
+    ecd64->cen_offset(cen_offset);
+    p += sizeof(ECD64);
+    ECD64Locator *locator = reinterpret_cast<ECD64Locator *>(p);
+    locator->signature();
+    locator->ecd64_disk_nr(0);
+    locator->ecd64_offset(ziph::byte_ptr(ecd64) - bytes - preamble_size);
+    locator->total_disks(1);
+    p += sizeof(ECD64Locator);
+  }
+
+  ECD *ecd = reinterpret_cast<ECD *>(p);
+  ecd->signature();
+  ecd->this_disk_nr(0);
+  ecd->cen_disk_nr(0);
+  ecd->this_disk_entries16(1);
+  ecd->total_entries16(1);
+  ecd->cen_size32(zip64 ? 0xFFFFFFFF : cen_size);
+  ecd->cen_offset32(zip64 ? 0xFFFFFFFF : cen_offset);
+  uint8_t comment[] = {'h', 'i'};
+  ecd->comment(comment, sizeof(comment));
+  p += sizeof(ECD) + sizeof(comment);
+  return p - bytes;
+}
+
+void ExpectSingleEntry(const uint8_t *bytes, size_t size,
+                       uint64_t preamble_size) {
+  CentralDirectory cen;
+  ASSERT_EQ(nullptr, cen.locate(bytes, bytes + size));
+  EXPECT_EQ(preamble_size, cen.preamble_size());
+  const CDH *cdh = cen.first();
+  ASSERT_TRUE(cdh->is());
+  EXPECT_TRUE(cdh->file_name_is("foo"));
+  const LH *lh = cen.local_header(cdh);
+  ASSERT_NE(nullptr, lh);
+  ASSERT_TRUE(lh->is());
+  EXPECT_EQ(0, memcmp("bar", lh->data(), 3));
+  EXPECT_FALSE(cen.next(cdh)->is());
+}
+
+TEST(ZipHeadersTest, CentralDirectory) {
+  uint8_t bytes[512];
+  ExpectSingleEntry(bytes, WriteZip(bytes, 0, false), 0);
+  ExpectSingleEntry(bytes, WriteZip(bytes, 0, true), 0);
+}
 
+TEST(ZipHeadersTest, CentralDirectoryWithPreamble) {
+  uint8_t bytes[512];
+  ExpectSingleEntry(bytes, WriteZip(bytes, 17, false), 17);
+  ExpectSingleEntry(bytes, WriteZip(bytes, 17, true), 17);
+}
+
+TEST(ZipHeadersTest, CentralDirectoryWithTrailingGarbage) {
+  uint8_t bytes[512];
+  size_t size = WriteZip(bytes, 0, false);
+  memset(bytes + size, 0xA5, 7);
+  ExpectSingleEntry(bytes, size + 7, 0);
+  size = WriteZip(bytes, 17, true);
+  memset(bytes + size, 0xA5, 7);
+  ExpectSingleEntry(bytes, size + 7, 17);
+}
+
+TEST(ZipHeadersTest, CentralDirectoryEmptyZip) {
+  uint8_t bytes[sizeof(ECD)];
+  ECD *ecd = reinterpret_cast<ECD *>(bytes);
+  ecd->signature();
+  ecd->this_disk_nr(0);
+  ecd->cen_disk_nr(0);
+  ecd->this_disk_entries16(0);
+  ecd->total_entries16(0);
+  ecd->cen_size32(0);
+  ecd->cen_offset32(0);
+  ecd->comment(nullptr, 0);
+
+  CentralDirectory cen;
+  ASSERT_EQ(nullptr, cen.locate(bytes, bytes + sizeof(bytes)));
+  EXPECT_FALSE(cen.first()->is());
+}
+
+TEST(ZipHeadersTest, CentralDirectoryCorrupted) {
+  uint8_t bytes[512];
+  CentralDirectory cen;
+  EXPECT_NE(nullptr, cen.locate(bytes, bytes + 10));
+
+  // The comment of the ECD runs past the end of the file.
+  size_t size = WriteZip(bytes, 0, false);
+  EXPECT_NE(nullptr, cen.locate(bytes, bytes + size - 1));
+
+  // A Central Directory Header runs past the Central Directory.
+  ASSERT_EQ(nullptr, cen.locate(bytes, bytes + size));
+  CDH *cdh = const_cast<CDH *>(cen.first());
+  ASSERT_TRUE(cdh->is());
+  cdh->comment_length(100);
+  EXPECT_NE(nullptr, cen.locate(bytes, bytes + size));
+  cdh->comment_length(0);
+
+  // The Central Directory is larger than the file.
+  ECD *ecd = reinterpret_cast<ECD *>(bytes + size - sizeof(ECD) - 2);
+  ASSERT_TRUE(ecd->is());
+  ecd->cen_size32(size);
+  EXPECT_NE(nullptr, cen.locate(bytes, bytes + size));
+
+  // Zip64 values without the Zip64 records.
+  ecd->cen_size32(0xFFFFFFFF);
+  EXPECT_NE(nullptr, cen.locate(bytes, bytes + size));
+}
+
+}  // namespace
@@ -48,4 +48,27 @@ public final class SymlinkTreeHelperTest {
     assertThat(commandLine[1]).isEqualTo("input_manifest");
     assertThat(commandLine[2]).isEqualTo("output/MANIFEST");
   }
+
+  @Test
+  public void collapseDirectories() {
+    Path execRoot = fs.getPath("/my/workspace");
+    Path inputManifestPath = execRoot.getRelative("input_manifest");
+    BinTools binTools =
+        BinTools.forUnitTesting(execRoot, ImmutableList.of(SymlinkTreeHelper.BUILD_RUNFILES));
+    Path output = execRoot.getRelative("output/MANIFEST");
+
+    Command command =
+        new SymlinkTreeHelper(inputManifestPath, output, false, /*collapseDirectories=*/ true)
+            .createCommand(execRoot, binTools, ImmutableMap.of());
+    assertThat(command.getCommandLineElements())
+        .asList()
+        .containsAtLeast("--collapse_directories", "input_manifest", "output/MANIFEST")
+        .inOrder();
+
+    // Fileset trees use relative targets and are never collapsed.
+    command =
+        new SymlinkTreeHelper(inputManifestPath, output, true, /*collapseDirectories=*/ true)
+            .createCommand(execRoot, binTools, ImmutableMap.of());
+    assertThat(command.getCommandLineElements()).asList().doesNotContain("--collapse_directories");
+  }
 }
@@ -63,6 +63,8 @@ public final class ProcessWrapperUtilTest {
     Path stdoutPath = testFS.getPath("/stdout.txt");
     Path stderrPath = testFS.getPath("/stderr.txt");
     Path statisticsPath = testFS.getPath("/stats.out");
+    Path outputsPath = testFS.getPath("/outputs.txt");
+    Path outputManifestPath = testFS.getPath("/outputs.manifest");
 
     ImmutableList<String> expectedCommandLine =
         ImmutableList.<String>builder()
@@ -72,6 +74,8 @@ public final class ProcessWrapperUtilTest {
             .add("--stdout=" + stdoutPath)
             .add("--stderr=" + stderrPath)
             .add("--stats=" + statisticsPath)
+            .add("--outputs=" + outputsPath)
+            .add("--output_manifest=" + outputManifestPath)
             .addAll(commandArguments)
             .build();
 
@@ -82,6 +86,7 @@ public final class ProcessWrapperUtilTest {
             .setStdoutPath(stdoutPath)
             .setStderrPath(stderrPath)
             .setStatisticsPath(statisticsPath)
+            .setOutputManifest(outputsPath, outputManifestPath)
             .build();
 
     assertThat(commandLine).containsExactlyElementsIn(expectedCommandLine).inOrder();
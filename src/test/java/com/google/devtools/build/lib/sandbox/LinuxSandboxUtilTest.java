@@ -56,6 +56,39 @@ public final class LinuxSandboxUtilTest {
     assertThat(e).hasMessageThat().contains("exclusive");
   }
 
+  @Test
+  public void testLinuxSandboxCommandLineBuilder_networkNamespaceOptionsAreExclusive() {
+    Path linuxSandboxPath = testFS.getPath("/linux-sandbox");
+    ImmutableList<String> commandArguments = ImmutableList.of("echo", "hello, flo");
+
+    Exception e =
+        assertThrows(
+            IllegalStateException.class,
+            () ->
+                LinuxSandboxUtil.commandLineBuilder(linuxSandboxPath, commandArguments)
+                    .setCreateNetworkNamespace(true)
+                    .setNetworkNamespacePath(testFS.getPath("/netns"))
+                    .build());
+    assertThat(e).hasMessageThat().contains("exclusive");
+  }
+
+  @Test
+  public void testLinuxSandboxCommandLineBuilder_sharedNetworkNamespace() {
+    Path linuxSandboxPath = testFS.getPath("/linux-sandbox");
+    Path networkNamespacePath = testFS.getPath("/netns");
+    ImmutableList<String> commandArguments = ImmutableList.of("echo", "hello, ann");
+
+    List<String> commandLine =
+        LinuxSandboxUtil.commandLineBuilder(linuxSandboxPath, commandArguments)
+            .setNetworkNamespacePath(networkNamespacePath)
+            .build();
+
+    assertThat(commandLine)
+        .containsExactly(
+            linuxSandboxPath.getPathString(), "-n", "/netns", "--", "echo", "hello, ann")
+        .inOrder();
+  }
+
   @Test
   public void testLinuxSandboxCommandLineBuilder_BuildsWithoutOptionalArguments() {
     Path linuxSandboxPath = testFS.getPath("/linux-sandbox");
@@ -84,6 +117,9 @@ public final class LinuxSandboxUtilTest {
     Duration timeout = Duration.ofSeconds(10);
     Duration killDelay = Duration.ofSeconds(2);
     Path statisticsPath = testFS.getPath("/stats.out");
+    Path inputTracePath = testFS.getPath("/inputs.out");
+    Path outputsPath = testFS.getPath("/outputs.txt");
+    Path outputManifestPath = testFS.getPath("/outputs.manifest");
 
     Path workingDirectory = testFS.getPath("/all-work-and-no-play");
     Path stdoutPath = testFS.getPath("/stdout.txt");
@@ -144,6 +180,9 @@ public final class LinuxSandboxUtilTest {
             .add("-M", bindMountSource2.getPathString())
             .add("-m", bindMountTarget2.getPathString())
             .add("-S", statisticsPath.getPathString())
+            .add("-I", inputTracePath.getPathString())
+            .add("-O", outputsPath.getPathString())
+            .add("-o", outputManifestPath.getPathString())
             .add("-H")
             .add("-N")
             .add("-U")
@@ -166,6 +205,8 @@ public final class LinuxSandboxUtilTest {
             .setCreateNetworkNamespace(createNetworkNamespace)
             .setUseFakeRoot(useFakeRoot)
             .setStatisticsPath(statisticsPath)
+            .setInputTracePath(inputTracePath)
+            .setOutputManifest(outputsPath, outputManifestPath)
             .setUseFakeUsername(useFakeUsername)
             .setUseDebugMode(useDebugMode)
             .build();
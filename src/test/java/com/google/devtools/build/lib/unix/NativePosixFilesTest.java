@@ -14,13 +14,23 @@
 package com.google.devtools.build.lib.unix;
 
 import static com.google.common.truth.Truth.assertThat;
+import static com.google.common.truth.Truth.assertWithMessage;
 import static com.google.devtools.build.lib.testutil.MoreAsserts.assertThrows;
+import static java.nio.charset.StandardCharsets.ISO_8859_1;
 import static java.nio.charset.StandardCharsets.UTF_8;
+import static java.util.stream.Collectors.toList;
 import static org.junit.Assert.fail;
 import static org.junit.Assume.assumeTrue;
 
+import build.bazel.remote.execution.v2.Digest;
+import build.bazel.remote.execution.v2.Directory;
+import build.bazel.remote.execution.v2.FileNode;
+import build.bazel.remote.execution.v2.Tree;
+import com.google.common.base.Strings;
+import com.google.common.collect.ImmutableList;
 import com.google.common.collect.ImmutableMap;
 import com.google.common.hash.HashCode;
+import com.google.common.hash.Hashing;
 import com.google.devtools.build.lib.testutil.TestUtils;
 import com.google.devtools.build.lib.util.OS;
 import com.google.devtools.build.lib.vfs.DigestHashFunction;
@@ -28,10 +38,16 @@ import com.google.devtools.build.lib.vfs.FileAccessException;
 import com.google.devtools.build.lib.vfs.FileSystem;
 import com.google.devtools.build.lib.vfs.FileSystemUtils;
 import com.google.devtools.build.lib.vfs.Path;
+import com.google.devtools.build.lib.vfs.PathFragment;
+import com.google.devtools.build.lib.vfs.Symlinks;
+import com.google.devtools.build.lib.vfs.UnixGlob;
 import java.io.File;
 import java.io.FileNotFoundException;
 import java.io.IOException;
 import java.nio.file.Files;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
 import org.junit.Before;
 import org.junit.Test;
 import org.junit.runner.RunWith;
@@ -153,6 +169,32 @@ public class NativePosixFilesTest {
         FileNotFoundException.class, () -> NativePosixFiles.lgetxattr(nonexistentFile, "foo"));
   }
 
+  @Test
+  public void fsVerity() throws Exception {
+    FileSystemUtils.writeContentAsLatin1(testFile, "hello");
+    String path = testFile.getPathString();
+
+    assertThat(NativePosixFiles.getFsVerityDigest(path)).isNull();
+    // Most file systems in test environments do not have fs-verity enabled.
+    assumeTrue(NativePosixFiles.enableFsVerity(path));
+
+    byte[] digest = NativePosixFiles.getFsVerityDigest(path);
+    assertThat(digest).hasLength(32);
+    assertThat(NativePosixFiles.enableFsVerity(path)).isTrue();
+    assertThat(NativePosixFiles.getFsVerityDigest(path)).isEqualTo(digest);
+    assertThrows(IOException.class, () -> FileSystemUtils.appendIsoLatin1(testFile, "world"));
+  }
+
+  @Test
+  public void fsVerity_fileNotFound() throws Exception {
+    String nonexistentFile = workingDir.getChild("nonexistent").toString();
+
+    assertThrows(
+        FileNotFoundException.class, () -> NativePosixFiles.getFsVerityDigest(nonexistentFile));
+    assertThrows(
+        FileNotFoundException.class, () -> NativePosixFiles.enableFsVerity(nonexistentFile));
+  }
+
   @Test
   public void writing() throws Exception {
     java.nio.file.Path myfile = Files.createTempFile("myfile", null);
@@ -178,4 +220,202 @@ public class NativePosixFilesTest {
     NativePosixFiles.close(fd2, null);
     assertThat(Files.readAllBytes(myfile)).isEqualTo(new byte[] {0, 1, 2, 3, 6, 7, 8});
   }
+
+  @Test
+  public void createRunfilesTree() throws Exception {
+    Path runfiles = workingDir.getRelative("runfiles");
+    FileSystemUtils.createDirectoryAndParents(runfiles.getRelative("ws/stale"));
+    FileSystemUtils.createEmptyFile(runfiles.getRelative("ws/stale/file"));
+    runfiles.getRelative("ws/bin").createSymbolicLink(PathFragment.create("/old/bin"));
+
+    byte[] entries = "ws/bin\0/real/bin\0ws/pkg/empty\0\0".getBytes(ISO_8859_1);
+    NativePosixFiles.createRunfilesTree(runfiles.getPathString(), entries, false);
+
+    assertThat(runfiles.getRelative("ws/stale").exists()).isFalse();
+    assertThat(runfiles.getRelative("ws/bin").readSymbolicLink())
+        .isEqualTo(PathFragment.create("/real/bin"));
+    assertThat(runfiles.getRelative("ws/pkg/empty").isFile(Symlinks.NOFOLLOW)).isTrue();
+    assertThat(FileSystemUtils.readContent(runfiles.getRelative("MANIFEST"), ISO_8859_1))
+        .isEqualTo("ws/bin /real/bin\nws/pkg/empty \n");
+  }
+
+  @Test
+  public void createRunfilesTree_relativeTargetNotAllowed() throws Exception {
+    String runfiles = workingDir.getRelative("runfiles").getPathString();
+    byte[] entries = "ws/bin\0bin\0".getBytes(ISO_8859_1);
+
+    IOException e =
+        assertThrows(
+            IOException.class, () -> NativePosixFiles.createRunfilesTree(runfiles, entries, false));
+    assertThat(e).hasMessageThat().contains("expected absolute path");
+    NativePosixFiles.createRunfilesTree(runfiles, entries, true);
+  }
+
+  @Test
+  public void md5sumsAsBytes() throws Exception {
+    String[] contents = {"", "abc", Strings.repeat("x", 100000)};
+    String[] paths = new String[contents.length];
+    for (int i = 0; i < contents.length; i++) {
+      Path file = workingDir.getRelative("file" + i);
+      FileSystemUtils.writeContentAsLatin1(file, contents[i]);
+      paths[i] = file.getPathString();
+    }
+
+    byte[] result = NativePosixFiles.md5sumsAsBytes(paths);
+
+    assertThat(result).hasLength(16 * contents.length);
+    for (int i = 0; i < contents.length; i++) {
+      assertThat(HashCode.fromBytes(Arrays.copyOfRange(result, 16 * i, 16 * (i + 1))))
+          .isEqualTo(Hashing.md5().hashString(contents[i], ISO_8859_1));
+    }
+  }
+
+  @Test
+  public void md5sumsAsBytes_throwsFileNotFoundException() throws Exception {
+    Path file = workingDir.getRelative("file");
+    FileSystemUtils.createEmptyFile(file);
+    String[] paths = {file.getPathString(), testFile.getPathString()};
+    FileNotFoundException e =
+        assertThrows(FileNotFoundException.class, () -> NativePosixFiles.md5sumsAsBytes(paths));
+    assertThat(e).hasMessageThat().isEqualTo(testFile + " (No such file or directory)");
+  }
+
+  @Test
+  public void md5MerkleTree() throws Exception {
+    Path dir = workingDir.getRelative("tree");
+    FileSystemUtils.createDirectoryAndParents(dir.getRelative("a/b"));
+    FileSystemUtils.createDirectoryAndParents(dir.getRelative("c/b"));
+    FileSystemUtils.writeContentAsLatin1(dir.getRelative("a/b/file"), "x");
+    FileSystemUtils.writeContentAsLatin1(dir.getRelative("c/b/file"), "x");
+
+    byte[] entries = ("\0" + dir.getPathString() + "\0top/empty\0\0").getBytes(ISO_8859_1);
+    byte[] result = NativePosixFiles.md5MerkleTree(entries, 2);
+    Tree tree = Tree.parseFrom(Arrays.copyOfRange(result, 16, result.length));
+
+    Directory root = tree.getRoot();
+    assertThat(HashCode.fromBytes(Arrays.copyOf(result, 16)))
+        .isEqualTo(Hashing.md5().hashBytes(root.toByteArray()));
+    assertThat(root.getFilesList()).isEmpty();
+    assertThat(root.getDirectoriesCount()).isEqualTo(3);
+    assertThat(root.getDirectories(0).getName()).isEqualTo("a");
+    assertThat(root.getDirectories(1).getName()).isEqualTo("c");
+    assertThat(root.getDirectories(2).getName()).isEqualTo("top");
+    // a and c have the same contents, so the Tree holds b, a and top only.
+    assertThat(root.getDirectories(0).getDigest()).isEqualTo(root.getDirectories(1).getDigest());
+    assertThat(tree.getChildrenCount()).isEqualTo(3);
+    assertThat(tree.getChildren(0).getFilesList())
+        .containsExactly(
+            FileNode.newBuilder()
+                .setName("file")
+                .setDigest(
+                    Digest.newBuilder()
+                        .setHash(Hashing.md5().hashString("x", ISO_8859_1).toString())
+                        .setSizeBytes(1))
+                .setIsExecutable(true)
+                .build());
+    assertThat(tree.getChildren(2).getFiles(0).getDigest().getHash())
+        .isEqualTo("d41d8cd98f00b204e9800998ecf8427e");
+  }
+
+  @Test
+  public void md5MerkleTree_conflictingInputs() throws Exception {
+    Path file = workingDir.getRelative("file");
+    FileSystemUtils.createEmptyFile(file);
+    byte[] entries =
+        ("a\0" + file.getPathString() + "\0a/b\0" + file.getPathString() + "\0")
+            .getBytes(ISO_8859_1);
+
+    IOException e =
+        assertThrows(IOException.class, () -> NativePosixFiles.md5MerkleTree(entries, 1));
+    assertThat(e).hasMessageThat().contains("a/b");
+  }
+
+  /** Decodes the result of {@link NativePosixFiles#glob} into "M path" and "P path" strings. */
+  private static ImmutableList<String> decodeGlob(byte[] result) {
+    ImmutableList.Builder<String> entries = ImmutableList.builder();
+    int start = 0;
+    for (int i = 0; i < result.length; i++) {
+      if (result[i] == 0) {
+        String entry = new String(result, start, i - start, ISO_8859_1);
+        entries.add(entry.charAt(0) + " " + entry.substring(1));
+        start = i + 1;
+      }
+    }
+    return entries.build();
+  }
+
+  @Test
+  public void glob_matchesUnixGlob() throws Exception {
+    Path dir = workingDir.getRelative("pkg");
+    for (String file :
+        new String[] {
+          "A.java",
+          ".hidden.java",
+          "b.txt",
+          "a/B.java",
+          "a/b/C.java",
+          "a/.d/D.java",
+          "sub/BUILD",
+          "sub/E.java"
+        }) {
+      FileSystemUtils.createDirectoryAndParents(dir.getRelative(file).getParentDirectory());
+      FileSystemUtils.createEmptyFile(dir.getRelative(file));
+    }
+    dir.getRelative("link").createSymbolicLink(PathFragment.create("a"));
+    dir.getRelative("dangling.java").createSymbolicLink(PathFragment.create("missing"));
+
+    for (String pattern : new String[] {"**/*.java", "*", "**", "a/**", "*/b/*", "link/*.java"}) {
+      List<String> expected = new ArrayList<>();
+      for (Path path :
+          UnixGlob.forPath(dir)
+              .addPattern(pattern)
+              .setDirectoryFilter(d -> d.equals(dir) || !d.getRelative("BUILD").isFile())
+              .glob()) {
+        if (!path.equals(dir)) {
+          expected.add("M " + path.relativeTo(dir).getPathString());
+        }
+      }
+      List<String> actual =
+          decodeGlob(
+              NativePosixFiles.glob(
+                  dir.getPathString(),
+                  new String[] {pattern},
+                  new String[0],
+                  false,
+                  new String[] {"BUILD"},
+                  2));
+      assertWithMessage(pattern)
+          .that(actual.stream().filter(e -> e.startsWith("M ")).collect(toList()))
+          .containsExactlyElementsIn(expected);
+    }
+  }
+
+  @Test
+  public void glob_subpackagesAndExcludes() throws Exception {
+    Path dir = workingDir.getRelative("pkg");
+    for (String file : new String[] {"A.java", "a/B.java", "a/Test.java", "sub/BUILD"}) {
+      FileSystemUtils.createDirectoryAndParents(dir.getRelative(file).getParentDirectory());
+      FileSystemUtils.createEmptyFile(dir.getRelative(file));
+    }
+
+    byte[] result =
+        NativePosixFiles.glob(
+            dir.getPathString(),
+            new String[] {"**"},
+            new String[] {"**/Test.java"},
+            true,
+            new String[] {"BUILD.bazel", "BUILD"},
+            0);
+
+    assertThat(decodeGlob(result)).containsExactly("M A.java", "M a/B.java", "P sub").inOrder();
+    assertThat(
+            NativePosixFiles.glob(
+                workingDir.getRelative("missing").getPathString(),
+                new String[] {"**"},
+                new String[0],
+                false,
+                new String[0],
+                1))
+        .isEmpty();
+  }
 }
@@ -0,0 +1,81 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.unix;
+
+import static com.google.common.truth.Truth.assertThat;
+import static com.google.devtools.build.lib.testutil.MoreAsserts.assertThrows;
+import static org.junit.Assume.assumeTrue;
+
+import java.time.Duration;
+import org.junit.After;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+import org.junit.runners.JUnit4;
+
+/** Tests for the {@link SystemLoad} class. */
+@RunWith(JUnit4.class)
+public class SystemLoadTest {
+
+  @After
+  public final void stopSampler() {
+    SystemLoad.stopSampler();
+  }
+
+  @Test
+  public void sample() throws Exception {
+    assumeTrue(SystemLoad.isSupported());
+    long[] values = SystemLoad.newSample();
+    long before = System.nanoTime();
+    SystemLoad.sample(values);
+
+    assertThat(values[SystemLoad.MEM_AVAILABLE]).isGreaterThan(0L);
+    assertThat(values[SystemLoad.SAMPLE_TIME]).isAtLeast(before);
+    assertThat(values[SystemLoad.SAMPLE_TIME]).isAtMost(System.nanoTime());
+    // Pressure stall information needs Linux 4.20 and may be disabled.
+    if (values[SystemLoad.MEMORY_SOME_AVG10] != -1) {
+      assertThat(values[SystemLoad.MEMORY_SOME_AVG10]).isAtMost(10000L);
+      assertThat(values[SystemLoad.MEMORY_SOME_TOTAL]).isAtLeast(0L);
+    }
+  }
+
+  @Test
+  public void sampleWithSampler() throws Exception {
+    assumeTrue(SystemLoad.isSupported());
+    long[] values = SystemLoad.newSample();
+    long before = System.nanoTime();
+    SystemLoad.startSampler(Duration.ofMillis(1));
+
+    // The first sample is taken before startSampler returns.
+    SystemLoad.sample(values);
+    assertThat(values[SystemLoad.SAMPLE_TIME]).isAtLeast(before);
+    long first = values[SystemLoad.SAMPLE_TIME];
+    while (values[SystemLoad.SAMPLE_TIME] == first) {
+      Thread.sleep(1);
+      SystemLoad.sample(values);
+    }
+    assertThat(values[SystemLoad.SAMPLE_TIME]).isGreaterThan(first);
+
+    // Stopping goes back to sampling on demand.
+    SystemLoad.stopSampler();
+    before = System.nanoTime();
+    SystemLoad.sample(values);
+    assertThat(values[SystemLoad.SAMPLE_TIME]).isAtLeast(before);
+  }
+
+  @Test
+  public void sample_rejectsShortArray() throws Exception {
+    assertThrows(IllegalArgumentException.class, () -> SystemLoad.sample(new long[1]));
+  }
+}
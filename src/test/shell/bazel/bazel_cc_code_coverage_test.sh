@@ -40,6 +40,9 @@ readonly COVERAGE_MANIFEST_VAR="${PWD}/coverage_manifest.txt"
 # Path to the canonical C++ coverage script.
 readonly COLLECT_CC_COVERAGE_SCRIPT=tools/test/collect_cc_coverage.sh
 
+# Path to the native C++ coverage collector.
+readonly COLLECT_CC_COVERAGE_NATIVE=tools/test/collect_cc_coverage_native
+
 # Return a string in the form "device_id%inode" for a given file.
 #
 # Checking if two files have the same deviceID and inode is enough to
@@ -233,7 +236,12 @@ lcount:5,0"
 }
 
 
-function test_cc_test_coverage_gcov() {
+# Runs the given C++ coverage collector and asserts its output.
+#
+# - collector     The script or binary that collects C++ coverage.
+function assert_cc_test_coverage_gcov() {
+    local collector="${1}"; shift
+
     "$gcov_location" -version | grep "LLVM" && \
       echo "gcov LLVM version not supported. Skipping test." && return
     # gcov -v | grep "gcov" outputs a line that looks like this:
@@ -247,7 +255,7 @@ function test_cc_test_coverage_gcov() {
     COVERAGE_GCOV_PATH="$COVERAGE_GCOV_PATH_VAR" \
     ROOT="$ROOT_VAR" COVERAGE_MANIFEST="$COVERAGE_MANIFEST_VAR" \
     BAZEL_CC_COVERAGE_TOOL="GCOV" \
-    "$COLLECT_CC_COVERAGE_SCRIPT") > "$TEST_log"
+    "$collector") > "$TEST_log"
 
     # Location of the output file of the C++ coverage script when gcov is used.
     local output_file="$COVERAGE_DIR_VAR/_cc_coverage.gcov"
@@ -270,4 +278,16 @@ function test_cc_test_coverage_gcov() {
       "$nr_lines and different than 17"
 }
 
+function test_cc_test_coverage_gcov() {
+    assert_cc_test_coverage_gcov "$COLLECT_CC_COVERAGE_SCRIPT"
+}
+
+function test_cc_test_coverage_gcov_native() {
+    assert_cc_test_coverage_gcov "$COLLECT_CC_COVERAGE_NATIVE"
+
+    # The native collector must clean up its scratch files.
+    [[ -z "$(ls -d "$COVERAGE_DIR_VAR"/_gcov_* 2>/dev/null)" ]] || \
+      fail "Scratch directories left behind in $COVERAGE_DIR_VAR"
+}
+
 run_suite "Testing tools/test/collect_cc_coverage.sh"
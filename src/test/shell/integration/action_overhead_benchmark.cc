@@ -0,0 +1,466 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the fixed cost of running an action through process-wrapper and
+// linux-sandbox, compared to spawning the command directly.
+//
+// For every configuration, a trivial command and a CPU-bound one (see
+// spend_cpu_time.cc) are run a number of times, one after the other, and the
+// percentiles of the wall time per run are reported. On Linux, each command is
+// then run once more under ptrace to count the system calls made by all the
+// processes involved. Tracing is slow, so it is kept out of the timed runs.
+//
+// Run it with
+//   bazel run //src/test/shell/integration:action_overhead_benchmark
+// and add e.g. -- --runs=1000 to change the defaults.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ptrace.h>
+#endif
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+extern char **environ;
+
+namespace {
+
+struct Flags {
+  std::string process_wrapper;
+  std::string linux_sandbox;
+  std::string spend_cpu_time;
+  std::string trivial_command = "/bin/true";
+  int runs = 100;
+  int cpu_bound_runs = 5;
+  int cpu_seconds = 1;
+  int mounts = 100;
+  int writable_paths = 100;
+  bool count_syscalls = true;
+};
+
+// A way of running a command: the arguments that go before it.
+struct Config {
+  std::string name;
+  std::vector<std::string> prefix;
+};
+
+void Usage(const char *progname) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --process_wrapper=PATH  the process-wrapper to measure\n"
+          "  --linux_sandbox=PATH  the linux-sandbox to measure\n"
+          "  --spend_cpu_time=PATH  the command to use as CPU-bound action\n"
+          "  --trivial_command=PATH  the command to use as trivial action "
+          "(default: /bin/true)\n"
+          "  --runs=N  how often to run the trivial command (default: 100)\n"
+          "  --cpu_bound_runs=N  how often to run the CPU-bound command "
+          "(default: 5)\n"
+          "  --cpu_seconds=N  CPU time spent by the CPU-bound command "
+          "(default: 1)\n"
+          "  --mounts=N  number of -M mounts in the many-mounts "
+          "configuration (default: 100)\n"
+          "  --writable_paths=N  number of -w paths in the many-writable-paths "
+          "configuration (default: 100)\n"
+          "  --nocount_syscalls  do not count system calls\n",
+          progname);
+  exit(EXIT_FAILURE);
+}
+
+// Returns whether `arg` is `--<name>=<value>`, and sets `value` if so.
+bool MatchFlag(const char *arg, const char *name, std::string *value) {
+  size_t len = strlen(name);
+  if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, len) != 0 ||
+      arg[2 + len] != '=') {
+    return false;
+  }
+  *value = arg + 3 + len;
+  return true;
+}
+
+bool MatchFlag(const char *arg, const char *name, int *value) {
+  std::string str;
+  if (!MatchFlag(arg, name, &str)) {
+    return false;
+  }
+  char *end;
+  long parsed = strtol(str.c_str(), &end, 10);
+  if (str.empty() || *end != '\0' || parsed < 0) {
+    fprintf(stderr, "Invalid value for --%s: %s\n", name, str.c_str());
+    exit(EXIT_FAILURE);
+  }
+  *value = static_cast<int>(parsed);
+  return true;
+}
+
+// Makes the path absolute, as linux-sandbox runs commands in another working
+// directory.
+void MakeAbsolute(std::string *path) {
+  if (path->empty() || (*path)[0] == '/') {
+    return;
+  }
+  char *cwd = getcwd(nullptr, 0);
+  if (cwd == nullptr) {
+    perror("getcwd");
+    exit(EXIT_FAILURE);
+  }
+  *path = std::string(cwd) + "/" + *path;
+  free(cwd);
+}
+
+Flags ParseFlags(int argc, char **argv) {
+  Flags flags;
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (MatchFlag(arg, "process_wrapper", &flags.process_wrapper) ||
+        MatchFlag(arg, "linux_sandbox", &flags.linux_sandbox) ||
+        MatchFlag(arg, "spend_cpu_time", &flags.spend_cpu_time) ||
+        MatchFlag(arg, "trivial_command", &flags.trivial_command) ||
+        MatchFlag(arg, "runs", &flags.runs) ||
+        MatchFlag(arg, "cpu_bound_runs", &flags.cpu_bound_runs) ||
+        MatchFlag(arg, "cpu_seconds", &flags.cpu_seconds) ||
+        MatchFlag(arg, "mounts", &flags.mounts) ||
+        MatchFlag(arg, "writable_paths", &flags.writable_paths)) {
+      continue;
+    }
+    if (strcmp(arg, "--nocount_syscalls") == 0) {
+      flags.count_syscalls = false;
+    } else if (strcmp(arg, "--count_syscalls") == 0) {
+      flags.count_syscalls = true;
+    } else {
+      fprintf(stderr, "Unknown argument: %s\n", arg);
+      Usage(argv[0]);
+    }
+  }
+  MakeAbsolute(&flags.process_wrapper);
+  MakeAbsolute(&flags.linux_sandbox);
+  MakeAbsolute(&flags.spend_cpu_time);
+  return flags;
+}
+
+std::vector<char *> ToArgv(const std::vector<std::string> &args) {
+  std::vector<char *> argv;
+  for (const std::string &arg : args) {
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+  return argv;
+}
+
+double NowSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs the command with its output discarded and returns its wall time in
+// seconds, or a negative value if it did not succeed.
+double TimeCommand(const std::vector<std::string> &args) {
+  std::vector<char *> argv = ToArgv(args);
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+
+  double start = NowSeconds();
+  pid_t pid;
+  int err = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(),
+                        environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (err != 0) {
+    return -1;
+  }
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+  double elapsed = NowSeconds() - start;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? elapsed : -1;
+}
+
+#ifdef __linux__
+// Runs the command under ptrace, following all its descendants, and returns
+// the total number of system calls they made, or -1 if tracing failed.
+int64_t CountSyscalls(const std::vector<std::string> &args) {
+  std::vector<char *> argv = ToArgv(args);
+  pid_t pid = fork();
+  if (pid < 0) {
+    return -1;
+  }
+  if (pid == 0) {
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull < 0 || dup2(devnull, STDOUT_FILENO) < 0 ||
+        dup2(devnull, STDERR_FILENO) < 0 ||
+        ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) < 0) {
+      _exit(127);
+    }
+    // Stops with SIGTRAP once the new program is loaded.
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+
+  int status;
+  if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status)) {
+    return -1;
+  }
+  long options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK |
+                 PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE |
+                 PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL;
+  if (ptrace(PTRACE_SETOPTIONS, pid, nullptr, options) < 0 ||
+      ptrace(PTRACE_SYSCALL, pid, nullptr, nullptr) < 0) {
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+    return -1;
+  }
+
+  int64_t syscalls = 0;
+  bool succeeded = false;
+  // The tracees we have seen, and those that are inside a system call, as
+  // syscall stops are reported on both entry and exit.
+  std::set<pid_t> tracees = {pid};
+  std::set<pid_t> in_syscall;
+  for (;;) {
+    pid_t tid = waitpid(-1, &status, __WALL);
+    if (tid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;  // ECHILD: all tracees are gone.
+    }
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+      if (tid == pid) {
+        succeeded = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+      }
+      tracees.erase(tid);
+      in_syscall.erase(tid);
+      continue;
+    }
+    if (!WIFSTOPPED(status)) {
+      continue;
+    }
+
+    int sig = WSTOPSIG(status);
+    int inject = 0;
+    if (sig == (SIGTRAP | 0x80)) {
+      if (in_syscall.erase(tid) == 0) {
+        in_syscall.insert(tid);
+        ++syscalls;
+      }
+    } else if (status >> 16 != 0) {
+      // A ptrace event, e.g. a fork or an exec.
+    } else if (sig == SIGSTOP && tracees.insert(tid).second) {
+      // The initial stop of a new tracee.
+    } else {
+      inject = sig;
+    }
+    ptrace(PTRACE_SYSCALL, tid, nullptr, reinterpret_cast<void *>(inject));
+  }
+  return succeeded ? syscalls : -1;
+}
+#else
+int64_t CountSyscalls(const std::vector<std::string> &args) { return -1; }
+#endif
+
+// Returns the given percentile of the sorted samples, by nearest rank.
+double Percentile(const std::vector<double> &sorted, double percentile) {
+  size_t rank = static_cast<size_t>(percentile / 100 * sorted.size() + 0.5);
+  rank = std::max<size_t>(rank, 1);
+  return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+void PrintHeader() {
+  printf("%-28s %-10s %6s %9s %9s %9s %9s %9s %9s\n", "configuration",
+         "command", "runs", "mean_ms", "p50_ms", "p90_ms", "p99_ms", "max_ms",
+         "syscalls");
+}
+
+// Runs the command `runs` times through the configuration and prints one
+// line of results. Returns false if the command failed.
+bool Measure(const Config &config, const std::string &command_name,
+             const std::vector<std::string> &command, int runs,
+             bool count_syscalls) {
+  if (runs == 0) {
+    return true;
+  }
+  std::vector<std::string> args = config.prefix;
+  args.insert(args.end(), command.begin(), command.end());
+
+  // Warm up the page cache and whatever else might be cold.
+  if (TimeCommand(args) < 0) {
+    fprintf(stderr, "%s: running %s failed\n", config.name.c_str(),
+            command_name.c_str());
+    return false;
+  }
+
+  std::vector<double> samples;
+  double total = 0;
+  for (int i = 0; i < runs; ++i) {
+    double elapsed = TimeCommand(args);
+    if (elapsed < 0) {
+      fprintf(stderr, "%s: running %s failed\n", config.name.c_str(),
+              command_name.c_str());
+      return false;
+    }
+    samples.push_back(elapsed * 1000);
+    total += elapsed * 1000;
+  }
+  std::sort(samples.begin(), samples.end());
+
+  char syscalls[32] = "n/a";
+  if (count_syscalls) {
+    int64_t count = CountSyscalls(args);
+    if (count >= 0) {
+      snprintf(syscalls, sizeof(syscalls), "%" PRId64, count);
+    }
+  }
+  printf("%-28s %-10s %6d %9.3f %9.3f %9.3f %9.3f %9.3f %9s\n",
+         config.name.c_str(), command_name.c_str(), runs, total / runs,
+         Percentile(samples, 50), Percentile(samples, 90),
+         Percentile(samples, 99), samples.back(), syscalls);
+  fflush(stdout);
+  return true;
+}
+
+// Creates `count` directories below `parent` and returns their paths.
+std::vector<std::string> CreateDirectories(const std::string &parent,
+                                           int count) {
+  if (mkdir(parent.c_str(), 0755) < 0 && errno != EEXIST) {
+    perror(parent.c_str());
+    exit(EXIT_FAILURE);
+  }
+  std::vector<std::string> dirs;
+  for (int i = 0; i < count; ++i) {
+    std::string dir = parent + "/" + std::to_string(i);
+    if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+      perror(dir.c_str());
+      exit(EXIT_FAILURE);
+    }
+    dirs.push_back(dir);
+  }
+  return dirs;
+}
+
+std::vector<Config> CreateConfigs(const Flags &flags,
+                                  const std::string &work_dir) {
+  std::vector<Config> configs;
+  configs.push_back({"direct", {}});
+  if (!flags.process_wrapper.empty()) {
+    configs.push_back({"process-wrapper", {flags.process_wrapper, "--"}});
+  }
+  if (!flags.linux_sandbox.empty()) {
+    std::string sandbox_dir = work_dir + "/sandbox";
+    if (mkdir(sandbox_dir.c_str(), 0755) < 0) {
+      perror(sandbox_dir.c_str());
+      exit(EXIT_FAILURE);
+    }
+    auto add_sandbox_config = [&](const std::string &name,
+                                  const std::vector<std::string> &options) {
+      Config config = {name, {flags.linux_sandbox, "-W", sandbox_dir}};
+      config.prefix.insert(config.prefix.end(), options.begin(),
+                           options.end());
+      config.prefix.push_back("--");
+      configs.push_back(config);
+    };
+
+    add_sandbox_config("linux-sandbox", {});
+    add_sandbox_config("linux-sandbox -N", {"-N"});
+    add_sandbox_config("linux-sandbox -R", {"-R"});
+
+    std::vector<std::string> options;
+    for (const std::string &dir :
+         CreateDirectories(work_dir + "/mounts", flags.mounts)) {
+      options.push_back("-M");
+      options.push_back(dir);
+    }
+    add_sandbox_config("linux-sandbox -M x" + std::to_string(flags.mounts),
+                       options);
+
+    options.clear();
+    for (const std::string &dir :
+         CreateDirectories(work_dir + "/writable", flags.writable_paths)) {
+      options.push_back("-w");
+      options.push_back(dir);
+    }
+    add_sandbox_config(
+        "linux-sandbox -w x" + std::to_string(flags.writable_paths), options);
+  }
+  return configs;
+}
+
+// Removes the directory tree created by the benchmark.
+void RemoveWorkDir(const std::string &work_dir) {
+  std::vector<std::string> args = {"/bin/rm", "-rf", work_dir};
+  TimeCommand(args);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Flags flags = ParseFlags(argc, argv);
+
+  const char *tmpdir = getenv("TEST_TMPDIR");
+  if (tmpdir == nullptr || tmpdir[0] == '\0') {
+    tmpdir = getenv("TMPDIR");
+  }
+  std::string work_dir_template =
+      std::string(tmpdir != nullptr && tmpdir[0] != '\0' ? tmpdir : "/tmp") +
+      "/action_overhead_benchmark.XXXXXX";
+  std::vector<char> work_dir_buf(work_dir_template.begin(),
+                                 work_dir_template.end());
+  work_dir_buf.push_back('\0');
+  if (mkdtemp(work_dir_buf.data()) == nullptr) {
+    perror("mkdtemp");
+    return EXIT_FAILURE;
+  }
+  const std::string work_dir = work_dir_buf.data();
+
+  const std::vector<std::string> trivial = {flags.trivial_command};
+  const std::vector<std::string> cpu_bound = {
+      flags.spend_cpu_time, std::to_string(flags.cpu_seconds), "0"};
+
+  bool ok = true;
+  PrintHeader();
+  for (const Config &config : CreateConfigs(flags, work_dir)) {
+    ok = Measure(config, "trivial", trivial, flags.runs,
+                 flags.count_syscalls) &&
+         ok;
+    if (!flags.spend_cpu_time.empty()) {
+      ok = Measure(config, "cpu_bound", cpu_bound, flags.cpu_bound_runs,
+                   flags.count_syscalls) &&
+           ok;
+    }
+  }
+
+  RemoveWorkDir(work_dir);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,105 @@
+#!/bin/bash
+#
+# Copyright 2019 The Bazel Authors. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+set -euo pipefail
+
+# Load the test setup defined in the parent directory
+CURRENT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${CURRENT_DIR}/../integration_test_setup.sh" \
+  || { echo "integration_test_setup.sh not found!" >&2; exit 1; }
+
+enable_errexit
+
+readonly BUILD_RUNFILES="${BAZEL_RUNFILES}/src/main/tools/build-runfiles"
+
+readonly SRC_DIR="${TEST_TMPDIR}/src"
+readonly OUT_DIR="${TEST_TMPDIR}/out"
+
+function set_up() {
+  rm -rf "$SRC_DIR" "$OUT_DIR"
+  mkdir -p "$SRC_DIR" "$OUT_DIR"
+}
+
+# Creates the given files under $SRC_DIR.
+function create_sources() {
+  for f in "$@"; do
+    mkdir -p "$(dirname "$SRC_DIR/$f")"
+    echo "$f" > "$SRC_DIR/$f"
+  done
+}
+
+# Writes a manifest that maps ws/<file> to $SRC_DIR/<file> for each argument.
+function write_manifest() {
+  for f in "$@"; do
+    echo "ws/$f $SRC_DIR/$f"
+  done > "$OUT_DIR/MANIFEST.in"
+}
+
+function build_runfiles() {
+  "$BUILD_RUNFILES" "$@" "$OUT_DIR/MANIFEST.in" "$OUT_DIR/runfiles" \
+      &> $TEST_log || fail "build-runfiles failed"
+}
+
+function test_without_collapsing() {
+  create_sources a/b/x a/y
+  write_manifest a/b/x a/y
+  build_runfiles
+
+  [[ -d "$OUT_DIR/runfiles/ws/a/b" && ! -L "$OUT_DIR/runfiles/ws/a/b" ]] \
+      || fail "ws/a/b should be a directory"
+  assert_equals "$SRC_DIR/a/b/x" "$(readlink "$OUT_DIR/runfiles/ws/a/b/x")"
+  assert_equals "$SRC_DIR/a/y" "$(readlink "$OUT_DIR/runfiles/ws/a/y")"
+}
+
+function test_collapse_directories() {
+  create_sources a/b/x a/y c/z
+  write_manifest a/b/x a/y c/z
+  # Not listed in the manifest, so ws itself must not become a symlink.
+  create_sources extra
+  build_runfiles --collapse_directories
+
+  [[ ! -L "$OUT_DIR/runfiles/ws" ]] || fail "ws should not be collapsed"
+  assert_equals "$SRC_DIR/a" "$(readlink "$OUT_DIR/runfiles/ws/a")"
+  assert_equals "$SRC_DIR/c" "$(readlink "$OUT_DIR/runfiles/ws/c")"
+  assert_equals "a/b/x" "$(cat "$OUT_DIR/runfiles/ws/a/b/x")"
+  [[ ! -e "$OUT_DIR/runfiles/ws/extra" ]] || fail "ws/extra should not exist"
+  # The manifest still lists every file.
+  assert_contains "^ws/a/b/x " "$OUT_DIR/runfiles/MANIFEST"
+}
+
+function test_collapse_directories_keeps_extra_source_files_hidden() {
+  create_sources a/x a/y
+  write_manifest a/x
+  build_runfiles --collapse_directories
+
+  [[ ! -L "$OUT_DIR/runfiles/ws/a" ]] || fail "ws/a should not be collapsed"
+  assert_equals "$SRC_DIR/a/x" "$(readlink "$OUT_DIR/runfiles/ws/a/x")"
+  [[ ! -e "$OUT_DIR/runfiles/ws/a/y" ]] || fail "ws/a/y should not exist"
+}
+
+function test_collapse_directories_with_sibling_sorted_in_between() {
+  # "a-c" sorts between "a" and "a/b", which must not make build-runfiles
+  # create "a/b" again below the collapsed "a".
+  create_sources a/b/x a/y a-c/z extra
+  write_manifest a/b/x a/y a-c/z
+  build_runfiles --collapse_directories
+
+  assert_equals "$SRC_DIR/a" "$(readlink "$OUT_DIR/runfiles/ws/a")"
+  assert_equals "$SRC_DIR/a-c" "$(readlink "$OUT_DIR/runfiles/ws/a-c")"
+  [[ ! -L "$SRC_DIR/a/b" ]] || fail "build-runfiles wrote into the sources"
+}
+
+run_suite "build-runfiles tests"
@@ -139,6 +139,44 @@ function test_max_idle_secs() {
   expect_not_log "WARNING: Running B\\(azel\\|laze\\) server needs to be killed"
 }
 
+function test_server_zygote() {
+  local options=( --experimental_server_zygote )
+  local output_user_root
+  output_user_root="$(dirname "$(bazel info output_base 2>"$TEST_log")")" \
+    || fail "bazel info failed"
+
+  bazel "${options[@]}" --output_base="$TEST_TMPDIR/zygote1" info \
+    >"$TEST_log" 2>&1 || fail "bazel info failed"
+  expect_log "Starting local.*server and connecting to it"
+
+  # The first client starts a zygote in the background.
+  local timeout=60
+  while ! ls "${output_user_root}"/zygote/*/server/zygote.ready \
+      >/dev/null 2>&1; do
+    timeout="$(( ${timeout} - 1 ))"
+    [[ "${timeout}" -gt 0 ]] || fail "No server zygote became ready"
+    sleep 1
+  done
+  local zygote_pid
+  zygote_pid="$(cut -d ' ' -f 1 \
+      "${output_user_root}"/zygote/*/server/zygote.ready)"
+
+  local server_pid
+  server_pid="$(bazel "${options[@]}" --output_base="$TEST_TMPDIR/zygote2" \
+      info server_pid 2>"$TEST_log")" || fail "bazel info failed"
+  expect_log "Connecting to pre-started local.*server"
+  assert_equals "$zygote_pid" "$server_pid"
+
+  # The claimed zygote is an ordinary server of the second output base.
+  local output_base
+  output_base="$(bazel "${options[@]}" --output_base="$TEST_TMPDIR/zygote2" \
+      info output_base 2>"$TEST_log")" || fail "bazel info failed"
+  assert_equals "$TEST_TMPDIR/zygote2" "$output_base"
+  expect_not_log "WARNING.* Running B\\(azel\\|laze\\) server needs to be killed"
+  [[ -e "$TEST_TMPDIR/zygote2/java.log" ]] \
+    || fail "Server does not log into its output base"
+}
+
 function test_dashdash_before_command() {
   bazel -- info &>$TEST_log && "Expected failure"
   exitcode=$?
@@ -28,6 +28,36 @@ readonly STATS_PROTO_DIR="$(cd "$(dirname "${STATS_PROTO_PATH}")" && pwd)"
 #
 # This relies on ${protoc_compiler} being set (currently set in testenv.sh)
 #
+# Prints the OutputManifest message in the given file as text.
+function decode_output_manifest() {
+  "${protoc_compiler}" --proto_path="${STATS_PROTO_DIR}" \
+      --decode tools.protos.OutputManifest execution_statistics.proto \
+      < "$1"
+}
+
+# Checks the output manifest written for a command that ran
+# ${WRITE_TEST_OUTPUTS} in its working directory, with the list of outputs from
+# write_test_output_list.
+function assert_test_output_manifest() {
+  decode_output_manifest "$1" > "${TEST_log}"
+  expect_log 'digest_function: "MD5"'
+  expect_log 'path: "out/a.txt"'
+  expect_log 'path: "out/dir"'
+  expect_log 'path: "out/dir/b.txt"'
+  expect_log 'path: "out/dir/link"'
+  expect_log 'symlink_target: "../a.txt"'
+  expect_not_log 'path: "missing"'
+  # Only the two regular files have digests.
+  assert_equals 2 "$(grep -c '^  digest:' "${TEST_log}")"
+}
+
+function write_test_output_list() {
+  printf 'out/a.txt\nout/dir/\nmissing\n' > "$1"
+}
+
+readonly WRITE_TEST_OUTPUTS='mkdir -p out/dir && echo a > out/a.txt &&
+    echo b > out/dir/b.txt && ln -s ../a.txt out/dir/link'
+
 function assert_execution_time_in_range() {
   local utime_low="$1"; shift
   local utime_high="$1"; shift
@@ -52,6 +52,50 @@ function test_ping_loopback() {
   expect_log "1 received"
 }
 
+function test_shared_network_namespace() {
+  local -r netns="${TEST_TMPDIR}/netns"
+  $linux_sandbox -C "$netns" &> $TEST_log &
+  local -r pid=$!
+  # As root, the namespace is bind-mounted and -C exits right away. Otherwise
+  # it keeps running and publishes the namespace as a symlink.
+  for i in $(seq 50); do
+    [[ -L "$netns" ]] && break
+    if ! kill -0 "$pid" 2>/dev/null; then
+      wait "$pid" || fail "linux-sandbox -C failed"
+      break
+    fi
+    sleep 0.1
+  done
+
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -n "$netns" -- \
+    /bin/sh -c 'readlink /proc/self/ns/net' > "${TEST_TMPDIR}/ns1" \
+    2>> $TEST_log || fail
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -n "$netns" -- ip link ls \
+    &>> $TEST_log || fail
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -n "$netns" -- \
+    /bin/sh -c 'readlink /proc/self/ns/net' > "${TEST_TMPDIR}/ns2" \
+    2>> $TEST_log || fail
+  expect_log "LOOPBACK,UP"
+  diff "${TEST_TMPDIR}/ns1" "${TEST_TMPDIR}/ns2" \
+    || fail "sandboxes did not share the network namespace"
+  [[ "$(cat "${TEST_TMPDIR}/ns1")" != "$(readlink /proc/self/ns/net)" ]] \
+    || fail "sandbox used the host network namespace"
+
+  if [[ -L "$netns" ]]; then
+    kill "$pid"
+    wait "$pid" || true
+    [[ ! -e "$netns" ]] || fail "$netns was not removed"
+  else
+    umount "$netns"
+  fi
+}
+
+function test_shared_and_new_network_namespace_are_exclusive() {
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -N -n "${TEST_TMPDIR}/netns" -- true \
+    &> $TEST_log && fail "expected failure"
+  expect_log "cannot be used at the same time"
+}
+
 # The test shouldn't fail if the environment doesn't support running it.
 check_supported_platform || exit 0
 check_sandbox_allowed || exit 0
@@ -223,6 +223,38 @@ function test_dev_shm_is_writable() {
     &> $TEST_log || fail
 }
 
+function test_input_trace() {
+  mkdir -p "${TEST_TMPDIR}/inputs" "${SANDBOX_DIR}/pkg"
+  echo used > "${TEST_TMPDIR}/inputs/used"
+  echo unused > "${TEST_TMPDIR}/inputs/unused"
+  ln -sf "${TEST_TMPDIR}/inputs/used" "${SANDBOX_DIR}/pkg/used"
+  ln -sf "${TEST_TMPDIR}/inputs/unused" "${SANDBOX_DIR}/pkg/unused"
+  ln -sf "${TEST_TMPDIR}/inputs" "${SANDBOX_DIR}/linked"
+
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -I "${OUT_DIR}/inputs" -D -- \
+    /bin/bash -c "cd pkg && cat used" &> $TEST_log || fail
+  expect_log "^used$"
+
+  # Every path of an opened file counts as accessed.
+  assert_contains "^accessed	linked/used$" "${OUT_DIR}/inputs"
+  assert_contains "^accessed	pkg/used$" "${OUT_DIR}/inputs"
+  # Without a tracing mechanism, all inputs are reported as accessed.
+  if grep -q "input tracing is not available" $TEST_log; then
+    assert_contains "^accessed	pkg/unused$" "${OUT_DIR}/inputs"
+  else
+    assert_contains "^unused	linked/unused$" "${OUT_DIR}/inputs"
+    assert_contains "^unused	pkg/unused$" "${OUT_DIR}/inputs"
+  fi
+}
+
+function test_output_manifest() {
+  write_test_output_list "${OUT_DIR}/outputs"
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS \
+    -O "${OUT_DIR}/outputs" -o "${OUT_DIR}/manifest" -- \
+    /bin/bash -c "${WRITE_TEST_OUTPUTS}" &> $TEST_log || fail
+  assert_test_output_manifest "${OUT_DIR}/manifest"
+}
+
 function assert_linux_sandbox_exec_time() {
   local user_time_low="$1"; shift
   local user_time_high="$1"; shift
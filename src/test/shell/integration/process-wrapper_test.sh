@@ -117,6 +117,27 @@ function test_execvp_error_message() {
   assert_contains "\"execvp(/bin/notexisting, ...)\": No such file or directory" "$ERR"
 }
 
+function test_output_manifest() {
+  write_test_output_list "${OUT_DIR}/outputs"
+  (cd "${OUT_DIR}" && "${process_wrapper}" \
+      --outputs="${OUT_DIR}/outputs" \
+      --output_manifest="${OUT_DIR}/manifest" \
+      /bin/bash -c "${WRITE_TEST_OUTPUTS}") &> $TEST_log || fail
+  assert_test_output_manifest "${OUT_DIR}/manifest"
+}
+
+function test_output_manifest_skips_unreadable_outputs() {
+  printf 'out/a.txt\nout/locked\n' > "${OUT_DIR}/outputs"
+  (cd "${OUT_DIR}" && "${process_wrapper}" \
+      --outputs="${OUT_DIR}/outputs" \
+      --output_manifest="${OUT_DIR}/manifest" \
+      /bin/bash -c "${WRITE_TEST_OUTPUTS} && mkdir out/locked &&
+          chmod 0 out/locked") &> $TEST_log || fail "action should succeed"
+  chmod 0755 "${OUT_DIR}/out/locked"
+  decode_output_manifest "${OUT_DIR}/manifest" > "${TEST_log}"
+  expect_log 'path: "out/a.txt"'
+}
+
 function assert_process_wrapper_exec_time() {
   local user_time_low="$1"; shift
   local user_time_high="$1"; shift
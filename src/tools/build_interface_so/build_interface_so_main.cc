@@ -0,0 +1,92 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// build_interface_so: writes the interface library of an ELF shared object.
+//
+// Usage: build_interface_so <so> <interface so>
+//
+// The interface library only changes when the ABI of the shared object does,
+// so actions linking against it are not rerun after implementation changes.
+// Inputs the tool does not understand are copied verbatim, which is what the
+// tool used to do for every input.
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "src/tools/build_interface_so/elf_interface.h"
+
+namespace {
+
+bool ReadFile(const char *path, std::string *contents) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == nullptr) {
+    fprintf(stderr, "build_interface_so: cannot open %s: %s\n", path,
+            strerror(errno));
+    return false;
+  }
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    contents->append(buf, n);
+  }
+  bool ok = !ferror(fp);
+  fclose(fp);
+  if (!ok) {
+    fprintf(stderr, "build_interface_so: cannot read %s\n", path);
+  }
+  return ok;
+}
+
+bool WriteFile(const char *path, const std::string &contents) {
+  FILE *fp = fopen(path, "wb");
+  if (fp == nullptr) {
+    fprintf(stderr, "build_interface_so: cannot create %s: %s\n", path,
+            strerror(errno));
+    return false;
+  }
+  bool ok = fwrite(contents.data(), 1, contents.size(), fp) == contents.size();
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok) {
+    fprintf(stderr, "build_interface_so: cannot write %s: %s\n", path,
+            strerror(errno));
+  }
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <so> <interface so>\n", argv[0]);
+    return 1;
+  }
+  std::string library;
+  if (!ReadFile(argv[1], &library)) {
+    return 1;
+  }
+  std::string interface;
+  std::string error;
+  if (!interface_so::BuildInterfaceSo(
+          reinterpret_cast<const unsigned char *>(library.data()),
+          library.size(), &interface, &error)) {
+    fprintf(stderr,
+            "build_interface_so: %s: %s; copying the library verbatim\n",
+            argv[1], error.c_str());
+    interface.swap(library);
+  }
+  return WriteFile(argv[2], interface) ? 0 : 1;
+}
@@ -0,0 +1,1094 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/build_interface_so/elf_interface.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace interface_so {
+
+namespace {
+
+// The subset of the ELF format we need. The structures are spelled out rather
+// than taken from <elf.h> so that the tool builds on every host platform.
+
+const unsigned char kElfMagic[] = {0x7f, 'E', 'L', 'F'};
+enum { kEiClass = 4, kEiData = 5, kEiNident = 16 };
+enum { kElfClass32 = 1, kElfClass64 = 2 };
+enum { kElfData2Lsb = 1, kElfData2Msb = 2 };
+
+enum : uint16_t { kEtDyn = 3 };
+
+enum : uint32_t {
+  kShtNull = 0,
+  kShtStrtab = 3,
+  kShtDynamic = 6,
+  kShtNobits = 8,
+  kShtDynsym = 11,
+  kShtGnuVerdef = 0x6ffffffd,
+  kShtGnuVerneed = 0x6ffffffe,
+  kShtGnuVersym = 0x6fffffff,
+};
+
+enum : uint32_t {
+  kShfWrite = 0x1,
+  kShfAlloc = 0x2,
+  kShfExecinstr = 0x4,
+  kShfTls = 0x400,
+};
+
+enum : uint16_t {
+  kShnUndef = 0,
+  kShnLoreserve = 0xff00,
+  kShnAbs = 0xfff1,
+  kShnCommon = 0xfff2,
+};
+
+enum : uint32_t {
+  kPtLoad = 1,
+  kPtDynamic = 2,
+  kPtTls = 7,
+  kPtGnuRelro = 0x6474e552,
+};
+
+enum : uint32_t { kPfX = 1, kPfW = 2, kPfR = 4 };
+
+enum : int64_t {
+  kDtNull = 0,
+  kDtNeeded = 1,
+  kDtStrtab = 5,
+  kDtSymtab = 6,
+  kDtStrsz = 10,
+  kDtSyment = 11,
+  kDtSoname = 14,
+  kDtRpath = 15,
+  kDtRunpath = 29,
+  kDtFlags = 30,
+  kDtVersym = 0x6ffffff0,
+  kDtFlags1 = 0x6ffffffb,
+  kDtVerdef = 0x6ffffffc,
+  kDtVerdefnum = 0x6ffffffd,
+  kDtVerneed = 0x6ffffffe,
+  kDtVerneednum = 0x6fffffff,
+  kDtAuxiliary = 0x7ffffffd,
+  kDtFilter = 0x7fffffff,
+};
+
+enum { kSttFunc = 2, kSttTls = 6, kSttGnuIfunc = 10 };
+enum { kStbLocal = 0 };
+
+const uint64_t kPageSize = 0x1000;
+
+struct Verdef {
+  uint16_t vd_version;
+  uint16_t vd_flags;
+  uint16_t vd_ndx;
+  uint16_t vd_cnt;
+  uint32_t vd_hash;
+  uint32_t vd_aux;
+  uint32_t vd_next;
+};
+
+struct Verdaux {
+  uint32_t vda_name;
+  uint32_t vda_next;
+};
+
+struct Verneed {
+  uint16_t vn_version;
+  uint16_t vn_cnt;
+  uint32_t vn_file;
+  uint32_t vn_aux;
+  uint32_t vn_next;
+};
+
+struct Vernaux {
+  uint32_t vna_hash;
+  uint16_t vna_flags;
+  uint16_t vna_other;
+  uint32_t vna_name;
+  uint32_t vna_next;
+};
+
+struct Elf32 {
+  typedef uint32_t Addr;
+  typedef uint32_t Off;
+  typedef uint32_t Xword;
+  typedef int32_t Sxword;
+
+  struct Ehdr {
+    unsigned char e_ident[kEiNident];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    Addr e_entry;
+    Off e_phoff;
+    Off e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+  };
+
+  struct Shdr {
+    uint32_t sh_name;
+    uint32_t sh_type;
+    Xword sh_flags;
+    Addr sh_addr;
+    Off sh_offset;
+    Xword sh_size;
+    uint32_t sh_link;
+    uint32_t sh_info;
+    Xword sh_addralign;
+    Xword sh_entsize;
+  };
+
+  struct Phdr {
+    uint32_t p_type;
+    Off p_offset;
+    Addr p_vaddr;
+    Addr p_paddr;
+    uint32_t p_filesz;
+    uint32_t p_memsz;
+    uint32_t p_flags;
+    uint32_t p_align;
+  };
+
+  struct Sym {
+    uint32_t st_name;
+    Addr st_value;
+    uint32_t st_size;
+    unsigned char st_info;
+    unsigned char st_other;
+    uint16_t st_shndx;
+  };
+
+  struct Dyn {
+    Sxword d_tag;
+    Xword d_val;
+  };
+};
+
+struct Elf64 {
+  typedef uint64_t Addr;
+  typedef uint64_t Off;
+  typedef uint64_t Xword;
+  typedef int64_t Sxword;
+
+  struct Ehdr {
+    unsigned char e_ident[kEiNident];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    Addr e_entry;
+    Off e_phoff;
+    Off e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+  };
+
+  struct Shdr {
+    uint32_t sh_name;
+    uint32_t sh_type;
+    Xword sh_flags;
+    Addr sh_addr;
+    Off sh_offset;
+    Xword sh_size;
+    uint32_t sh_link;
+    uint32_t sh_info;
+    Xword sh_addralign;
+    Xword sh_entsize;
+  };
+
+  struct Phdr {
+    uint32_t p_type;
+    uint32_t p_flags;
+    Off p_offset;
+    Addr p_vaddr;
+    Addr p_paddr;
+    Xword p_filesz;
+    Xword p_memsz;
+    Xword p_align;
+  };
+
+  struct Sym {
+    uint32_t st_name;
+    unsigned char st_info;
+    unsigned char st_other;
+    uint16_t st_shndx;
+    Addr st_value;
+    Xword st_size;
+  };
+
+  struct Dyn {
+    Sxword d_tag;
+    Xword d_val;
+  };
+};
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+  return alignment > 1 ? (value + alignment - 1) / alignment * alignment
+                       : value;
+}
+
+// Bounds-checked read access to the input file.
+class Input {
+ public:
+  Input(const unsigned char *data, size_t size) : data_(data), size_(size) {}
+
+  bool Contains(uint64_t offset, uint64_t length) const {
+    return offset <= size_ && length <= size_ - offset;
+  }
+
+  template <typename T>
+  bool Read(uint64_t offset, T *value) const {
+    if (!Contains(offset, sizeof(T))) {
+      return false;
+    }
+    memcpy(value, data_ + offset, sizeof(T));
+    return true;
+  }
+
+  // Reads the NUL-terminated string at `offset` of the string table that
+  // occupies [table, table + table_size).
+  bool String(uint64_t table, uint64_t table_size, uint64_t offset,
+              std::string *value) const {
+    if (offset >= table_size || !Contains(table, table_size)) {
+      return false;
+    }
+    const char *start = reinterpret_cast<const char *>(data_ + table + offset);
+    const void *nul = memchr(start, 0, table_size - offset);
+    if (nul == nullptr) {
+      return false;
+    }
+    value->assign(start, static_cast<const char *>(nul) - start);
+    return true;
+  }
+
+ private:
+  const unsigned char *data_;
+  size_t size_;
+};
+
+// A string table under construction; identical strings are stored once.
+class StringTable {
+ public:
+  StringTable() : data_(1, '\0') {}
+
+  uint32_t Add(const std::string &s) {
+    auto it = offsets_.find(s);
+    if (it != offsets_.end()) {
+      return it->second;
+    }
+    uint32_t offset = data_.size();
+    data_.append(s);
+    data_.push_back('\0');
+    offsets_.emplace(s, offset);
+    return offset;
+  }
+
+  const std::string &data() const { return data_; }
+
+ private:
+  std::string data_;
+  std::map<std::string, uint32_t> offsets_;
+};
+
+// The placeholder sections defined symbols are moved to.
+enum StubSection { kText, kRodata, kData, kTbss, kNumStubSections };
+
+struct Symbol {
+  std::string name;
+  std::string version;  // For ordering only.
+  unsigned char info;
+  unsigned char other;
+  uint16_t shndx;  // Original section index.
+  uint64_t value;  // Original value.
+  uint64_t size;
+  uint16_t versym;
+  bool defined;
+  StubSection stub;
+  uint64_t alignment;
+};
+
+template <typename Elf>
+class InterfaceBuilder {
+ public:
+  typedef typename Elf::Ehdr Ehdr;
+  typedef typename Elf::Shdr Shdr;
+  typedef typename Elf::Phdr Phdr;
+  typedef typename Elf::Sym Sym;
+  typedef typename Elf::Dyn Dyn;
+
+  InterfaceBuilder(const unsigned char *data, size_t size)
+      : in_(data, size) {}
+
+  bool Build(std::string *out, std::string *error);
+
+ private:
+  bool ReadSections();
+  bool ReadDynamic();
+  bool ReadSymbols();
+  bool ReadVersions();
+  StubSection Classify(const Sym &sym, uint64_t *alignment) const;
+  bool InRelro(uint64_t address) const;
+  void Write(std::string *out);
+
+  bool Fail(const std::string &message) {
+    error_ = message;
+    return false;
+  }
+
+  Input in_;
+  Ehdr ehdr_;
+  std::vector<Shdr> sections_;
+  std::vector<Phdr> segments_;
+  const Shdr *dynsym_ = nullptr;
+  const Shdr *dynstr_ = nullptr;
+  const Shdr *dynamic_ = nullptr;
+  const Shdr *versym_ = nullptr;
+  const Shdr *verdef_ = nullptr;
+  const Shdr *verneed_ = nullptr;
+
+  // Dynamic entries to keep, strings resolved.
+  std::vector<std::pair<int64_t, std::string>> dynamic_strings_;
+  std::vector<std::pair<int64_t, uint64_t>> dynamic_values_;
+
+  std::vector<Symbol> symbols_;
+  // Version index -> name, for both definitions and requirements.
+  std::map<uint16_t, std::string> version_names_;
+
+  struct VersionDef {
+    Verdef def;
+    std::vector<std::string> names;  // The version, then its parents.
+  };
+  std::vector<VersionDef> verdefs_;
+
+  struct VersionNeed {
+    Verneed need;
+    std::string file;
+    std::vector<std::pair<Vernaux, std::string>> aux;
+  };
+  std::vector<VersionNeed> verneeds_;
+
+  std::string error_;
+};
+
+template <typename Elf>
+bool InterfaceBuilder<Elf>::ReadSections() {
+  if (!in_.Read(0, &ehdr_) || ehdr_.e_type != kEtDyn) {
+    return Fail("not an ELF shared object");
+  }
+  if (ehdr_.e_shentsize != sizeof(Shdr) || ehdr_.e_shnum == 0 ||
+      ehdr_.e_shnum >= kShnLoreserve) {
+    return Fail("unsupported section header table");
+  }
+  sections_.resize(ehdr_.e_shnum);
+  for (size_t i = 0; i < sections_.size(); ++i) {
+    if (!in_.Read(ehdr_.e_shoff + i * sizeof(Shdr), &sections_[i])) {
+      return Fail("truncated section header table");
+    }
+  }
+  if (ehdr_.e_phnum > 0) {
+    if (ehdr_.e_phentsize != sizeof(Phdr)) {
+      return Fail("unsupported program header table");
+    }
+    segments_.resize(ehdr_.e_phnum);
+    for (size_t i = 0; i < segments_.size(); ++i) {
+      if (!in_.Read(ehdr_.e_phoff + i * sizeof(Phdr), &segments_[i])) {
+        return Fail("truncated program header table");
+      }
+    }
+  }
+  for (const Shdr &section : sections_) {
+    if (section.sh_type != kShtNobits && section.sh_type != kShtNull &&
+        !in_.Contains(section.sh_offset, section.sh_size)) {
+      return Fail("section extends past the end of the file");
+    }
+    switch (section.sh_type) {
+      case kShtDynsym:
+        dynsym_ = &section;
+        break;
+      case kShtDynamic:
+        dynamic_ = &section;
+        break;
+      case kShtGnuVersym:
+        versym_ = &section;
+        break;
+      case kShtGnuVerdef:
+        verdef_ = &section;
+        break;
+      case kShtGnuVerneed:
+        verneed_ = &section;
+        break;
+    }
+  }
+  if (dynsym_ == nullptr || dynamic_ == nullptr) {
+    return Fail("no dynamic symbol table");
+  }
+  if (dynsym_->sh_link >= sections_.size() ||
+      sections_[dynsym_->sh_link].sh_type != kShtStrtab) {
+    return Fail("no dynamic string table");
+  }
+  dynstr_ = &sections_[dynsym_->sh_link];
+  return true;
+}
+
+template <typename Elf>
+bool InterfaceBuilder<Elf>::ReadDynamic() {
+  for (uint64_t offset = 0; offset + sizeof(Dyn) <= dynamic_->sh_size;
+       offset += sizeof(Dyn)) {
+    Dyn dyn;
+    in_.Read(dynamic_->sh_offset + offset, &dyn);
+    switch (dyn.d_tag) {
+      case kDtNull:
+        return true;
+      case kDtNeeded:
+      case kDtSoname:
+      case kDtRpath:
+      case kDtRunpath:
+      case kDtAuxiliary:
+      case kDtFilter: {
+        std::string value;
+        if (!in_.String(dynstr_->sh_offset, dynstr_->sh_size, dyn.d_val,
+                        &value)) {
+          return Fail("bad string in dynamic section");
+        }
+        dynamic_strings_.emplace_back(dyn.d_tag, value);
+        break;
+      }
+      case kDtFlags:
+      case kDtFlags1:
+        dynamic_values_.emplace_back(dyn.d_tag, dyn.d_val);
+        break;
+    }
+  }
+  return true;
+}
+
+template <typename Elf>
+bool InterfaceBuilder<Elf>::ReadVersions() {
+  if (verdef_ != nullptr) {
+    uint64_t offset = verdef_->sh_offset;
+    for (uint32_t i = 0; i < verdef_->sh_info; ++i) {
+      VersionDef version;
+      if (!in_.Read(offset, &version.def)) {
+        return Fail("truncated version definitions");
+      }
+      uint64_t aux_offset = offset + version.def.vd_aux;
+      for (uint16_t j = 0; j < version.def.vd_cnt; ++j) {
+        Verdaux aux;
+        std::string name;
+        if (!in_.Read(aux_offset, &aux) ||
+            !in_.String(dynstr_->sh_offset, dynstr_->sh_size, aux.vda_name,
+                        &name)) {
+          return Fail("bad version definition");
+        }
+        version.names.push_back(name);
+        aux_offset += aux.vda_next;
+      }
+      if (!version.names.empty()) {
+        version_names_[version.def.vd_ndx] = version.names[0];
+      }
+      verdefs_.push_back(version);
+      if (version.def.vd_next == 0) {
+        break;
+      }
+      offset += version.def.vd_next;
+    }
+  }
+  if (verneed_ != nullptr) {
+    uint64_t offset = verneed_->sh_offset;
+    for (uint32_t i = 0; i < verneed_->sh_info; ++i) {
+      VersionNeed need;
+      if (!in_.Read(offset, &need.need) ||
+          !in_.String(dynstr_->sh_offset, dynstr_->sh_size,
+                      need.need.vn_file, &need.file)) {
+        return Fail("truncated version requirements");
+      }
+      uint64_t aux_offset = offset + need.need.vn_aux;
+      for (uint16_t j = 0; j < need.need.vn_cnt; ++j) {
+        Vernaux aux;
+        std::string name;
+        if (!in_.Read(aux_offset, &aux) ||
+            !in_.String(dynstr_->sh_offset, dynstr_->sh_size, aux.vna_name,
+                        &name)) {
+          return Fail("bad version requirement");
+        }
+        version_names_[aux.vna_other] = name;
+        need.aux.emplace_back(aux, name);
+        aux_offset += aux.vna_next;
+      }
+      verneeds_.push_back(need);
+      if (need.need.vn_next == 0) {
+        break;
+      }
+      offset += need.need.vn_next;
+    }
+  }
+  return true;
+}
+
+template <typename Elf>
+bool InterfaceBuilder<Elf>::InRelro(uint64_t address) const {
+  for (const Phdr &segment : segments_) {
+    if (segment.p_type == kPtGnuRelro && segment.p_vaddr <= address &&
+        address < segment.p_vaddr + segment.p_memsz) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Picks the placeholder section for a defined symbol. For data symbols also
+// computes the alignment the way linkers do for copy relocations: the largest
+// power of two dividing the address, capped by the section's alignment.
+template <typename Elf>
+StubSection InterfaceBuilder<Elf>::Classify(const Sym &sym,
+                                            uint64_t *alignment) const {
+  int type = sym.st_info & 0xf;
+  uint64_t section_flags = 0;
+  *alignment = 1;
+  if (sym.st_shndx < sections_.size()) {
+    const Shdr &section = sections_[sym.st_shndx];
+    section_flags = section.sh_flags;
+    *alignment = sym.st_value ? (sym.st_value & -sym.st_value) : kPageSize;
+    if (section.sh_addralign > 0 && section.sh_addralign < *alignment) {
+      *alignment = section.sh_addralign;
+    }
+  }
+  if (type == kSttTls) {
+    return kTbss;
+  }
+  if (type == kSttFunc || type == kSttGnuIfunc ||
+      (section_flags & kShfExecinstr)) {
+    *alignment = 16;
+    return kText;
+  }
+  if ((section_flags & kShfWrite) && !InRelro(sym.st_value)) {
+    return kData;
+  }
+  return kRodata;
+}
+
+template <typename Elf>
+bool InterfaceBuilder<Elf>::ReadSymbols() {
+  if (dynsym_->sh_entsize != sizeof(Sym)) {
+    return Fail("unsupported symbol table entry size");
+  }
+  size_t count = dynsym_->sh_size / sizeof(Sym);
+  if (versym_ != nullptr && versym_->sh_size < count * sizeof(uint16_t)) {
+    return Fail("truncated symbol version table");
+  }
+  for (size_t i = 1; i < count; ++i) {
+    Sym sym;
+    in_.Read(dynsym_->sh_offset + i * sizeof(Sym), &sym);
+    if ((sym.st_info >> 4) == kStbLocal) {
+      continue;
+    }
+    Symbol symbol;
+    if (!in_.String(dynstr_->sh_offset, dynstr_->sh_size, sym.st_name,
+                    &symbol.name)) {
+      return Fail("bad symbol name");
+    }
+    symbol.info = sym.st_info;
+    symbol.other = sym.st_other;
+    symbol.shndx = sym.st_shndx;
+    symbol.value = sym.st_value;
+    symbol.size = sym.st_size;
+    symbol.versym = 1;
+    if (versym_ != nullptr) {
+      in_.Read(versym_->sh_offset + i * sizeof(uint16_t), &symbol.versym);
+    }
+    auto version = version_names_.find(symbol.versym & 0x7fff);
+    if (version != version_names_.end()) {
+      symbol.version = version->second;
+    }
+    symbol.defined = sym.st_shndx != kShnUndef;
+    symbol.stub = kNumStubSections;
+    symbol.alignment = 1;
+    if (sym.st_shndx == kShnCommon) {
+      return Fail("unsupported common symbol " + symbol.name);
+    }
+    if (symbol.defined && sym.st_shndx != kShnAbs) {
+      if (sym.st_shndx >= sections_.size()) {
+        return Fail("bad section index for symbol " + symbol.name);
+      }
+      symbol.stub = Classify(sym, &symbol.alignment);
+    }
+    symbols_.push_back(symbol);
+  }
+  std::stable_sort(symbols_.begin(), symbols_.end(),
+                   [](const Symbol &a, const Symbol &b) {
+                     if (a.name != b.name) {
+                       return a.name < b.name;
+                     }
+                     if (a.version != b.version) {
+                       return a.version < b.version;
+                     }
+                     return a.defined && !b.defined;
+                   });
+  return true;
+}
+
+// Appends raw bytes of `value` to `out`.
+template <typename T>
+void Append(std::string *out, const T &value) {
+  out->append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+void Pad(std::string *out, uint64_t alignment) {
+  out->resize(AlignUp(out->size(), alignment), '\0');
+}
+
+template <typename Elf>
+void InterfaceBuilder<Elf>::Write(std::string *out) {
+  typedef typename Elf::Addr Addr;
+  StringTable dynstr;
+  // Dynamic entries first, so that the SONAME and NEEDED strings lead the
+  // table like in linker output.
+  std::vector<std::pair<int64_t, uint64_t>> dynamic;
+  for (const auto &entry : dynamic_strings_) {
+    dynamic.emplace_back(entry.first, dynstr.Add(entry.second));
+  }
+  for (const auto &entry : dynamic_values_) {
+    dynamic.push_back(entry);
+  }
+
+  // Assign placeholder addresses. Data symbols at the same original address
+  // (aliases such as environ and __environ) keep sharing one slot, as copy
+  // relocations must keep them aliased.
+  uint64_t stub_size[kNumStubSections] = {0, 0, 0, 0};
+  uint64_t stub_alignment[kNumStubSections] = {16, 1, 1, 1};
+  std::vector<uint64_t> stub_offset(symbols_.size());
+  std::map<std::pair<uint16_t, uint64_t>, uint64_t> slot_sizes;
+  for (const Symbol &symbol : symbols_) {
+    // Aliases may differ in size; reserve room for the largest one.
+    uint64_t &slot_size =
+        slot_sizes[std::make_pair(symbol.shndx, symbol.value)];
+    slot_size = std::max<uint64_t>(slot_size, symbol.size);
+  }
+  std::map<std::pair<uint16_t, uint64_t>, uint64_t> slots;
+  for (size_t i = 0; i < symbols_.size(); ++i) {
+    const Symbol &symbol = symbols_[i];
+    if (symbol.stub == kNumStubSections) {
+      continue;
+    }
+    uint64_t &size = stub_size[symbol.stub];
+    if (symbol.stub == kText) {
+      stub_offset[i] = size;
+      size += 16;
+      continue;
+    }
+    auto key = std::make_pair(symbol.shndx, symbol.value);
+    auto slot = slots.find(key);
+    if (slot != slots.end()) {
+      stub_offset[i] = slot->second;
+      continue;
+    }
+    size = AlignUp(size, symbol.alignment);
+    stub_offset[i] = size;
+    slots.emplace(key, size);
+    size += std::max<uint64_t>(slot_sizes[key], 1);
+    stub_alignment[symbol.stub] =
+        std::max(stub_alignment[symbol.stub], symbol.alignment);
+  }
+
+  std::vector<uint32_t> symbol_names;
+  for (const Symbol &symbol : symbols_) {
+    symbol_names.push_back(dynstr.Add(symbol.name));
+  }
+  std::vector<std::vector<uint32_t>> verdef_names;
+  for (const VersionDef &version : verdefs_) {
+    verdef_names.emplace_back();
+    for (const std::string &name : version.names) {
+      verdef_names.back().push_back(dynstr.Add(name));
+    }
+  }
+  std::vector<uint32_t> verneed_files;
+  std::vector<std::vector<uint32_t>> verneed_names;
+  for (const VersionNeed &need : verneeds_) {
+    verneed_files.push_back(dynstr.Add(need.file));
+    verneed_names.emplace_back();
+    for (const auto &aux : need.aux) {
+      verneed_names.back().push_back(dynstr.Add(aux.second));
+    }
+  }
+
+  // Section layout. File-backed sections are mapped at their file offsets.
+  enum {
+    kNullIdx,
+    kDynsymIdx,
+    kDynstrIdx,
+    kVersymIdx,
+    kVerdefIdx,
+    kVerneedIdx,
+    kDynamicIdx,
+    kTextIdx,
+    kRodataIdx,
+    kDataIdx,
+    kTbssIdx,
+    kShstrtabIdx,
+    kNumSections
+  };
+  std::vector<Shdr> shdrs(kNumSections);
+  memset(shdrs.data(), 0, shdrs.size() * sizeof(Shdr));
+  bool present[kNumSections] = {true, true, true};
+  present[kVersymIdx] = versym_ != nullptr;
+  present[kVerdefIdx] = !verdefs_.empty();
+  present[kVerneedIdx] = !verneeds_.empty();
+  present[kDynamicIdx] = true;
+  present[kTextIdx] = stub_size[kText] > 0;
+  present[kRodataIdx] = stub_size[kRodata] > 0;
+  present[kDataIdx] = stub_size[kData] > 0;
+  present[kTbssIdx] = stub_size[kTbss] > 0;
+  present[kShstrtabIdx] = true;
+  // Final section indices, with absent sections squeezed out.
+  uint16_t index[kNumSections];
+  uint16_t num_sections = 0;
+  for (int i = 0; i < kNumSections; ++i) {
+    index[i] = present[i] ? num_sections++ : 0;
+  }
+  const int num_segments = 2 + (present[kDataIdx] || present[kTbssIdx]) +
+                           present[kTbssIdx];
+
+  std::string file(sizeof(Ehdr) + num_segments * sizeof(Phdr), '\0');
+
+  // .dynsym
+  Pad(&file, sizeof(Addr));
+  shdrs[kDynsymIdx].sh_offset = file.size();
+  Sym null_sym;
+  memset(&null_sym, 0, sizeof(null_sym));
+  Append(&file, null_sym);
+  // Symbol addresses depend on where the placeholder sections end up, which
+  // depends on the size of everything before them. Emit symbols with offsets
+  // and patch the addresses in once the layout is known.
+  size_t first_symbol = file.size();
+  for (size_t i = 0; i < symbols_.size(); ++i) {
+    const Symbol &symbol = symbols_[i];
+    Sym sym;
+    memset(&sym, 0, sizeof(sym));
+    sym.st_name = symbol_names[i];
+    sym.st_info = symbol.info;
+    sym.st_other = symbol.other;
+    if (!symbol.defined) {
+      sym.st_shndx = kShnUndef;
+    } else if (symbol.stub == kNumStubSections) {
+      sym.st_shndx = symbol.shndx;  // SHN_ABS
+      sym.st_value = symbol.value;
+      sym.st_size = symbol.size;
+    } else {
+      sym.st_value = stub_offset[i];
+      sym.st_size = symbol.stub == kText ? 0 : symbol.size;
+    }
+    Append(&file, sym);
+  }
+  shdrs[kDynsymIdx].sh_size = file.size() - shdrs[kDynsymIdx].sh_offset;
+
+  // .dynstr
+  shdrs[kDynstrIdx].sh_offset = file.size();
+  file.append(dynstr.data());
+  shdrs[kDynstrIdx].sh_size = dynstr.data().size();
+
+  // .gnu.version
+  if (present[kVersymIdx]) {
+    Pad(&file, 2);
+    shdrs[kVersymIdx].sh_offset = file.size();
+    Append(&file, static_cast<uint16_t>(0));
+    for (const Symbol &symbol : symbols_) {
+      Append(&file, symbol.versym);
+    }
+    shdrs[kVersymIdx].sh_size = file.size() - shdrs[kVersymIdx].sh_offset;
+  }
+
+  // .gnu.version_d
+  if (present[kVerdefIdx]) {
+    Pad(&file, sizeof(Addr));
+    shdrs[kVerdefIdx].sh_offset = file.size();
+    for (size_t i = 0; i < verdefs_.size(); ++i) {
+      Verdef def = verdefs_[i].def;
+      def.vd_cnt = verdef_names[i].size();
+      def.vd_aux = sizeof(Verdef);
+      def.vd_next = i + 1 < verdefs_.size()
+                        ? sizeof(Verdef) + def.vd_cnt * sizeof(Verdaux)
+                        : 0;
+      Append(&file, def);
+      for (size_t j = 0; j < verdef_names[i].size(); ++j) {
+        Verdaux aux;
+        aux.vda_name = verdef_names[i][j];
+        aux.vda_next = j + 1 < verdef_names[i].size() ? sizeof(Verdaux) : 0;
+        Append(&file, aux);
+      }
+    }
+    shdrs[kVerdefIdx].sh_size = file.size() - shdrs[kVerdefIdx].sh_offset;
+    shdrs[kVerdefIdx].sh_info = verdefs_.size();
+  }
+
+  // .gnu.version_r
+  if (present[kVerneedIdx]) {
+    Pad(&file, sizeof(Addr));
+    shdrs[kVerneedIdx].sh_offset = file.size();
+    for (size_t i = 0; i < verneeds_.size(); ++i) {
+      Verneed need = verneeds_[i].need;
+      need.vn_file = verneed_files[i];
+      need.vn_cnt = verneed_names[i].size();
+      need.vn_aux = sizeof(Verneed);
+      need.vn_next = i + 1 < verneeds_.size()
+                         ? sizeof(Verneed) + need.vn_cnt * sizeof(Vernaux)
+                         : 0;
+      Append(&file, need);
+      for (size_t j = 0; j < verneed_names[i].size(); ++j) {
+        Vernaux aux = verneeds_[i].aux[j].first;
+        aux.vna_name = verneed_names[i][j];
+        aux.vna_next = j + 1 < verneed_names[i].size() ? sizeof(Vernaux) : 0;
+        Append(&file, aux);
+      }
+    }
+    shdrs[kVerneedIdx].sh_size = file.size() - shdrs[kVerneedIdx].sh_offset;
+    shdrs[kVerneedIdx].sh_info = verneeds_.size();
+  }
+
+  // .dynamic
+  dynamic.emplace_back(kDtStrtab, shdrs[kDynstrIdx].sh_offset);
+  dynamic.emplace_back(kDtSymtab, shdrs[kDynsymIdx].sh_offset);
+  dynamic.emplace_back(kDtStrsz, shdrs[kDynstrIdx].sh_size);
+  dynamic.emplace_back(kDtSyment, sizeof(Sym));
+  if (present[kVersymIdx]) {
+    dynamic.emplace_back(kDtVersym, shdrs[kVersymIdx].sh_offset);
+  }
+  if (present[kVerdefIdx]) {
+    dynamic.emplace_back(kDtVerdef, shdrs[kVerdefIdx].sh_offset);
+    dynamic.emplace_back(kDtVerdefnum, verdefs_.size());
+  }
+  if (present[kVerneedIdx]) {
+    dynamic.emplace_back(kDtVerneed, shdrs[kVerneedIdx].sh_offset);
+    dynamic.emplace_back(kDtVerneednum, verneeds_.size());
+  }
+  dynamic.emplace_back(kDtNull, 0);
+  Pad(&file, sizeof(Addr));
+  shdrs[kDynamicIdx].sh_offset = file.size();
+  for (const auto &entry : dynamic) {
+    Dyn dyn;
+    dyn.d_tag = entry.first;
+    dyn.d_val = entry.second;
+    Append(&file, dyn);
+  }
+  shdrs[kDynamicIdx].sh_size = file.size() - shdrs[kDynamicIdx].sh_offset;
+  const uint64_t loaded_end = file.size();
+
+  // Placeholder sections: read-only ones extend the first segment, writable
+  // ones get a second segment so that linkers can tell them apart.
+  const uint64_t text_address = AlignUp(loaded_end, stub_alignment[kText]);
+  const uint64_t rodata_address =
+      AlignUp(text_address + stub_size[kText], stub_alignment[kRodata]);
+  const uint64_t first_segment_end = rodata_address + stub_size[kRodata];
+  const uint64_t second_segment_start =
+      AlignUp(first_segment_end, kPageSize) + loaded_end % kPageSize;
+  const uint64_t data_address =
+      AlignUp(second_segment_start, stub_alignment[kData]);
+  const uint64_t tbss_address =
+      AlignUp(data_address + stub_size[kData], stub_alignment[kTbss]);
+  const uint64_t stub_addresses[kNumStubSections] = {
+      text_address, rodata_address, data_address, tbss_address};
+  for (size_t i = 0; i < symbols_.size(); ++i) {
+    StubSection stub = symbols_[i].stub;
+    if (stub == kNumStubSections) {
+      continue;
+    }
+    Sym sym;
+    size_t offset = first_symbol + i * sizeof(Sym);
+    memcpy(&sym, file.data() + offset, sizeof(Sym));
+    if (stub != kTbss) {
+      // TLS symbol values are offsets into the TLS block instead.
+      sym.st_value += stub_addresses[stub];
+    }
+    sym.st_shndx = index[kTextIdx + stub];
+    memcpy(&file[offset], &sym, sizeof(Sym));
+  }
+
+  // .shstrtab
+  StringTable shstrtab;
+  static const char *const kNames[kNumSections] = {
+      "",        ".dynsym",        ".dynstr",        ".gnu.version",
+      ".gnu.version_d", ".gnu.version_r", ".dynamic", ".text",
+      ".rodata", ".data",          ".tbss",          ".shstrtab"};
+  for (int i = 1; i < kNumSections; ++i) {
+    shdrs[i].sh_name = shstrtab.Add(kNames[i]);
+  }
+  shdrs[kShstrtabIdx].sh_offset = file.size();
+  file.append(shstrtab.data());
+  shdrs[kShstrtabIdx].sh_size = shstrtab.data().size();
+  shdrs[kShstrtabIdx].sh_type = kShtStrtab;
+  shdrs[kShstrtabIdx].sh_addralign = 1;
+
+  shdrs[kDynsymIdx].sh_type = kShtDynsym;
+  shdrs[kDynsymIdx].sh_flags = kShfAlloc;
+  shdrs[kDynsymIdx].sh_link = index[kDynstrIdx];
+  shdrs[kDynsymIdx].sh_info = 1;  // One local symbol, the null symbol.
+  shdrs[kDynsymIdx].sh_addralign = sizeof(Addr);
+  shdrs[kDynsymIdx].sh_entsize = sizeof(Sym);
+  shdrs[kDynstrIdx].sh_type = kShtStrtab;
+  shdrs[kDynstrIdx].sh_flags = kShfAlloc;
+  shdrs[kDynstrIdx].sh_addralign = 1;
+  shdrs[kVersymIdx].sh_type = kShtGnuVersym;
+  shdrs[kVersymIdx].sh_flags = kShfAlloc;
+  shdrs[kVersymIdx].sh_link = index[kDynsymIdx];
+  shdrs[kVersymIdx].sh_addralign = 2;
+  shdrs[kVersymIdx].sh_entsize = 2;
+  shdrs[kVerdefIdx].sh_type = kShtGnuVerdef;
+  shdrs[kVerdefIdx].sh_flags = kShfAlloc;
+  shdrs[kVerdefIdx].sh_link = index[kDynstrIdx];
+  shdrs[kVerdefIdx].sh_addralign = sizeof(Addr);
+  shdrs[kVerneedIdx].sh_type = kShtGnuVerneed;
+  shdrs[kVerneedIdx].sh_flags = kShfAlloc;
+  shdrs[kVerneedIdx].sh_link = index[kDynstrIdx];
+  shdrs[kVerneedIdx].sh_addralign = sizeof(Addr);
+  shdrs[kDynamicIdx].sh_type = kShtDynamic;
+  shdrs[kDynamicIdx].sh_flags = kShfAlloc | kShfWrite;
+  shdrs[kDynamicIdx].sh_link = index[kDynstrIdx];
+  shdrs[kDynamicIdx].sh_addralign = sizeof(Addr);
+  shdrs[kDynamicIdx].sh_entsize = sizeof(Dyn);
+  for (int i = kDynsymIdx; i <= kDynamicIdx; ++i) {
+    shdrs[i].sh_addr = shdrs[i].sh_offset;
+  }
+  const uint32_t stub_flags[kNumStubSections] = {
+      kShfAlloc | kShfExecinstr, kShfAlloc, kShfAlloc | kShfWrite,
+      kShfAlloc | kShfWrite | kShfTls};
+  for (int i = 0; i < kNumStubSections; ++i) {
+    Shdr &shdr = shdrs[kTextIdx + i];
+    shdr.sh_type = kShtNobits;
+    shdr.sh_flags = stub_flags[i];
+    shdr.sh_addr = stub_addresses[i];
+    shdr.sh_offset = loaded_end;
+    shdr.sh_size = stub_size[i];
+    shdr.sh_addralign = stub_alignment[i];
+  }
+
+  // Section header table.
+  Pad(&file, sizeof(Addr));
+  const uint64_t shoff = file.size();
+  for (int i = 0; i < kNumSections; ++i) {
+    if (present[i]) {
+      Append(&file, shdrs[i]);
+    }
+  }
+
+  // Program headers.
+  std::vector<Phdr> phdrs(num_segments);
+  memset(phdrs.data(), 0, phdrs.size() * sizeof(Phdr));
+  phdrs[0].p_type = kPtLoad;
+  phdrs[0].p_flags = kPfR | kPfX;
+  phdrs[0].p_filesz = loaded_end;
+  phdrs[0].p_memsz = first_segment_end;
+  phdrs[0].p_align = kPageSize;
+  phdrs[1].p_type = kPtDynamic;
+  phdrs[1].p_flags = kPfR | kPfW;
+  phdrs[1].p_offset = phdrs[1].p_vaddr = phdrs[1].p_paddr =
+      shdrs[kDynamicIdx].sh_offset;
+  phdrs[1].p_filesz = phdrs[1].p_memsz = shdrs[kDynamicIdx].sh_size;
+  phdrs[1].p_align = sizeof(Addr);
+  if (num_segments > 2) {
+    phdrs[2].p_type = kPtLoad;
+    phdrs[2].p_flags = kPfR | kPfW;
+    phdrs[2].p_offset = loaded_end;
+    phdrs[2].p_vaddr = phdrs[2].p_paddr = second_segment_start;
+    phdrs[2].p_memsz = data_address + stub_size[kData] - second_segment_start;
+    phdrs[2].p_align = kPageSize;
+  }
+  if (present[kTbssIdx]) {
+    phdrs[3].p_type = kPtTls;
+    phdrs[3].p_flags = kPfR;
+    phdrs[3].p_offset = loaded_end;
+    phdrs[3].p_vaddr = phdrs[3].p_paddr = tbss_address;
+    phdrs[3].p_memsz = stub_size[kTbss];
+    phdrs[3].p_align = stub_alignment[kTbss];
+  }
+  memcpy(&file[sizeof(Ehdr)], phdrs.data(), phdrs.size() * sizeof(Phdr));
+
+  // ELF header.
+  Ehdr ehdr;
+  memset(&ehdr, 0, sizeof(ehdr));
+  memcpy(ehdr.e_ident, ehdr_.e_ident, 9);  // Magic, class, data, OS ABI.
+  ehdr.e_type = kEtDyn;
+  ehdr.e_machine = ehdr_.e_machine;
+  ehdr.e_version = ehdr_.e_version;
+  ehdr.e_phoff = sizeof(Ehdr);
+  ehdr.e_shoff = shoff;
+  ehdr.e_flags = ehdr_.e_flags;
+  ehdr.e_ehsize = sizeof(Ehdr);
+  ehdr.e_phentsize = sizeof(Phdr);
+  ehdr.e_phnum = num_segments;
+  ehdr.e_shentsize = sizeof(Shdr);
+  ehdr.e_shnum = num_sections;
+  ehdr.e_shstrndx = index[kShstrtabIdx];
+  memcpy(&file[0], &ehdr, sizeof(Ehdr));
+
+  out->swap(file);
+}
+
+template <typename Elf>
+bool InterfaceBuilder<Elf>::Build(std::string *out, std::string *error) {
+  if (!ReadSections() || !ReadDynamic() || !ReadVersions() ||
+      !ReadSymbols()) {
+    *error = error_;
+    return false;
+  }
+  Write(out);
+  return true;
+}
+
+bool IsHostByteOrder(unsigned char data) {
+  const uint16_t probe = 1;
+  bool little_endian = *reinterpret_cast<const unsigned char *>(&probe) == 1;
+  return data == (little_endian ? kElfData2Lsb : kElfData2Msb);
+}
+
+}  // namespace
+
+bool BuildInterfaceSo(const unsigned char *data, size_t size, std::string *out,
+                      std::string *error) {
+  if (size < kEiNident || memcmp(data, kElfMagic, sizeof(kElfMagic)) != 0) {
+    *error = "not an ELF file";
+    return false;
+  }
+  if (!IsHostByteOrder(data[kEiData])) {
+    *error = "foreign byte order";
+    return false;
+  }
+  switch (data[kEiClass]) {
+    case kElfClass32:
+      return InterfaceBuilder<Elf32>(data, size).Build(out, error);
+    case kElfClass64:
+      return InterfaceBuilder<Elf64>(data, size).Build(out, error);
+    default:
+      *error = "unknown ELF class";
+      return false;
+  }
+}
+
+}  // namespace interface_so
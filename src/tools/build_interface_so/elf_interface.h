@@ -0,0 +1,44 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_BUILD_INTERFACE_SO_ELF_INTERFACE_H_
+#define BAZEL_SRC_TOOLS_BUILD_INTERFACE_SO_ELF_INTERFACE_H_ 1
+
+#include <stddef.h>
+
+#include <string>
+
+namespace interface_so {
+
+// Builds the interface ("stub") library of the ELF shared object in
+// [data, data + size) and stores it in `out`.
+//
+// The stub is a valid ET_DYN file that a static linker accepts in place of
+// the original. It keeps the global dynamic symbols with their types,
+// bindings, visibilities and versions, the version definitions and
+// requirements, and the SONAME, NEEDED, RPATH and RUNPATH entries. It
+// contains no code or data: every defined symbol points into an empty
+// (SHT_NOBITS) placeholder section. Symbols are sorted by name and all
+// addresses are synthesized, so the stub is a deterministic function of the
+// library's ABI. Only the sizes and alignments of data symbols, which copy
+// relocations depend on, are taken over from the original.
+//
+// Returns false and sets `error` if the input is not an ELF shared object
+// this implementation understands (e.g. a foreign byte order).
+bool BuildInterfaceSo(const unsigned char *data, size_t size, std::string *out,
+                      std::string *error);
+
+}  // namespace interface_so
+
+#endif  // BAZEL_SRC_TOOLS_BUILD_INTERFACE_SO_ELF_INTERFACE_H_
@@ -0,0 +1,114 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/build_interface_so/elf_interface.h"
+
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+
+#include "tools/cpp/runfiles/runfiles.h"
+#include "googletest/include/gtest/gtest.h"
+
+using bazel::tools::cpp::runfiles::Runfiles;
+
+namespace {
+
+const char kLibA[] = "io_bazel/src/tools/build_interface_so/libimpl_a.so";
+const char kLibACopy[] =
+    "io_bazel/src/tools/build_interface_so/libimpl_a_copy.so";
+const char kLibB[] = "io_bazel/src/tools/build_interface_so/libimpl_b.so";
+const char kLibC[] = "io_bazel/src/tools/build_interface_so/libimpl_c.so";
+
+class ElfInterfaceTest : public ::testing::Test {
+ protected:
+  void SetUp() override { runfiles_.reset(Runfiles::CreateForTest()); }
+
+  std::string Read(const char *runfile) {
+    std::string path = runfiles_->Rlocation(runfile);
+    std::string contents;
+    FILE *fp = fopen(path.c_str(), "rb");
+    EXPECT_NE(nullptr, fp) << path;
+    if (fp != nullptr) {
+      char buf[4096];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        contents.append(buf, n);
+      }
+      fclose(fp);
+    }
+    return contents;
+  }
+
+  std::string Interface(const char *runfile) {
+    std::string library = Read(runfile);
+    std::string interface;
+    std::string error;
+    EXPECT_TRUE(interface_so::BuildInterfaceSo(
+        reinterpret_cast<const unsigned char *>(library.data()),
+        library.size(), &interface, &error))
+        << error;
+    return interface;
+  }
+
+  std::unique_ptr<Runfiles> runfiles_;
+};
+
+TEST_F(ElfInterfaceTest, KeepsDynamicSymbols) {
+  std::string library = Read(kLibA);
+  std::string interface = Interface(kLibA);
+  EXPECT_LT(interface.size(), library.size());
+  EXPECT_EQ(0, interface.compare(0, 4, "\x7f" "ELF"));
+  EXPECT_EQ(library.substr(0, 8), interface.substr(0, 8));
+  for (const char *symbol :
+       {"Add", "_Z4Bumpv", "counter", "kTable", "tls_counter"}) {
+    EXPECT_NE(std::string::npos, interface.find(symbol)) << symbol;
+  }
+}
+
+TEST_F(ElfInterfaceTest, IsDeterministic) {
+  // The two libraries are linked separately, so their build IDs differ.
+  ASSERT_NE(Read(kLibA), Read(kLibACopy));
+  EXPECT_EQ(Interface(kLibA), Interface(kLibACopy));
+}
+
+TEST_F(ElfInterfaceTest, IgnoresImplementationChanges) {
+  std::string b = Interface(kLibB);
+  EXPECT_EQ(Interface(kLibA), b);
+  EXPECT_EQ(std::string::npos, b.find("Helper"));
+  EXPECT_EQ(std::string::npos, b.find("unexported"));
+}
+
+TEST_F(ElfInterfaceTest, ReflectsInterfaceChanges) {
+  std::string c = Interface(kLibC);
+  EXPECT_NE(Interface(kLibA), c);
+  EXPECT_NE(std::string::npos, c.find("Sub"));
+}
+
+TEST_F(ElfInterfaceTest, RejectsOtherFiles) {
+  std::string out;
+  std::string error;
+  const unsigned char kNotElf[] = "#!/bin/sh\nexit 0\n";
+  EXPECT_FALSE(
+      interface_so::BuildInterfaceSo(kNotElf, sizeof(kNotElf), &out, &error));
+  EXPECT_EQ("not an ELF file", error);
+
+  std::string truncated = Read(kLibA).substr(0, 200);
+  EXPECT_FALSE(interface_so::BuildInterfaceSo(
+      reinterpret_cast<const unsigned char *>(truncated.data()),
+      truncated.size(), &out, &error));
+}
+
+}  // namespace
@@ -0,0 +1,24 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// One implementation of the interface in impl_b.cc.
+
+extern const int kTable[4];
+const int kTable[4] = {1, 2, 3, 4};
+int counter = 3;
+__thread int tls_counter = 5;
+
+extern "C" int Add(int a, int b) { return a + b; }
+
+int Bump() { return ++counter + tls_counter; }
@@ -1,4 +1,4 @@
-// Copyright 2018 The Bazel Authors. All rights reserved.
+// Copyright 2019 The Bazel Authors. All rights reserved.
 //
 // Licensed under the Apache License, Version 2.0 (the "License");
 // you may not use this file except in compliance with the License.
@@ -12,17 +12,25 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-// Empty implementation of the test wrapper.
-//
-// As of 2018-08-10, every platform uses //tools/test:test-setup.sh as the test
-// wrapper, and we are working on introducing a C++ test wrapper for Windows.
-// See
-// https://github.com/laszlocsomor/proposals/blob/win-test-runner/designs/2018-07-18-windows-native-test-runner.md
+// A different implementation of the interface in impl_a.cc.
+
+extern const int kTable[4];
+const int kTable[4] = {4, 3, 2, 1};
+static int unexported[128];
+int counter = 7;
+__thread int tls_counter = 1;
 
-#include <stdio.h>
+static int Helper(int a) { return unexported[a & 127] += a; }
+
+extern "C" int Add(int a, int b) {
+  int sum = a;
+  for (int i = 0; i < b; ++i) {
+    sum += Helper(1) > 0 ? 1 : 0;
+  }
+  return sum;
+}
 
-int main(int, char**) {
-  fprintf(stderr,
-          __FILE__ ": The C++ test wrapper is not used on this platform.\n");
-  return 1;
+int Bump() {
+  counter += tls_counter;
+  return counter;
 }
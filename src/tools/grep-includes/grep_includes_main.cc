@@ -0,0 +1,274 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// grep-includes: extracts the literal inclusions of C++ and SWIG sources for
+// Bazel's include scanner.
+//
+// Usage:
+//   grep-includes <input> <output> <file type>
+//   grep-includes [--cache_dir=<dir>] [--jobs=<n>] --batch=<file>
+//
+// The first form scans a single file, which is how SpawnIncludeScanner runs
+// it. The output format is parsed by IncludeParser.processIncludes.
+//
+// In batch mode, <file> lists one argument per line, in groups of three that
+// are exactly the arguments of the first form; the files are scanned by <n>
+// threads. With --cache_dir, results are keyed by the MD5 of the input
+// contents and its file type, so identical files (e.g. the same header in
+// several output trees) are only scanned once across invocations.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "src/main/cpp/util/md5.h"
+#include "src/tools/grep-includes/include_scanner.h"
+
+namespace grep_includes {
+
+namespace {
+
+// A read-only memory mapping of an input file.
+class MappedInput {
+ public:
+  MappedInput() : data_(nullptr), size_(0) {}
+
+  ~MappedInput() {
+    if (size_ > 0) {
+      munmap(data_, size_);
+    }
+  }
+
+  bool Open(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      fprintf(stderr, "grep-includes: cannot open %s: %s\n", path.c_str(),
+              strerror(errno));
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+      fprintf(stderr, "grep-includes: cannot stat %s: %s\n", path.c_str(),
+              strerror(errno));
+      close(fd);
+      return false;
+    }
+    if (st.st_size > 0) {
+      void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        fprintf(stderr, "grep-includes: cannot mmap %s: %s\n", path.c_str(),
+                strerror(errno));
+        close(fd);
+        return false;
+      }
+      data_ = data;
+      size_ = st.st_size;
+      madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return true;
+  }
+
+  const char *begin() const { return static_cast<const char *>(data_); }
+  const char *end() const { return begin() + size_; }
+  size_t size() const { return size_; }
+
+ private:
+  void *data_;
+  size_t size_;
+};
+
+bool WriteFile(const std::string &path, const std::string &contents) {
+  FILE *fp = fopen(path.c_str(), "wb");
+  if (fp == nullptr) {
+    fprintf(stderr, "grep-includes: cannot create %s: %s\n", path.c_str(),
+            strerror(errno));
+    return false;
+  }
+  bool ok = fwrite(contents.data(), 1, contents.size(), fp) == contents.size();
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok) {
+    fprintf(stderr, "grep-includes: cannot write %s: %s\n", path.c_str(),
+            strerror(errno));
+  }
+  return ok;
+}
+
+bool ReadFile(const std::string &path, std::string *contents) {
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (fp == nullptr) {
+    return false;
+  }
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    contents->append(buf, n);
+  }
+  bool ok = !ferror(fp);
+  fclose(fp);
+  return ok;
+}
+
+// Publishes `contents` in the cache. Concurrent writers of the same key
+// produce identical contents, so a rename() over an existing entry is fine.
+void StoreCachedFile(const std::string &path, const std::string &contents) {
+  std::string tmp = path + ".tmp." + std::to_string(getpid()) + "." +
+                    std::to_string(std::hash<std::thread::id>()(
+                        std::this_thread::get_id()));
+  if (WriteFile(tmp, contents) && rename(tmp.c_str(), path.c_str()) == 0) {
+    return;
+  }
+  unlink(tmp.c_str());
+}
+
+bool ScanFile(const std::string &input, const std::string &output,
+              const std::string &type_name, const std::string &cache_dir) {
+  FileType type;
+  if (!ParseFileType(type_name, &type)) {
+    fprintf(stderr, "grep-includes: unknown file type '%s'\n",
+            type_name.c_str());
+    return false;
+  }
+  MappedInput source;
+  if (!source.Open(input)) {
+    return false;
+  }
+  std::string result;
+  std::string cache_path;
+  if (!cache_dir.empty()) {
+    blaze_util::Md5Digest digest;
+    digest.Update(source.begin(), source.size());
+    unsigned char unused[blaze_util::Md5Digest::kDigestLength];
+    digest.Finish(unused);
+    cache_path = cache_dir + "/" + digest.String() + "." + type_name;
+    if (ReadFile(cache_path, &result)) {
+      return WriteFile(output, result);
+    }
+  }
+  std::vector<Inclusion> inclusions;
+  ScanIncludes(source.begin(), source.end(), type, &inclusions);
+  FormatInclusions(inclusions, &result);
+  if (!cache_path.empty()) {
+    StoreCachedFile(cache_path, result);
+  }
+  return WriteFile(output, result);
+}
+
+bool ReadBatchFile(const std::string &path, std::vector<std::string> *args) {
+  std::string contents;
+  if (!ReadFile(path, &contents)) {
+    fprintf(stderr, "grep-includes: cannot read %s\n", path.c_str());
+    return false;
+  }
+  size_t start = 0;
+  while (start < contents.size()) {
+    size_t end = contents.find('\n', start);
+    if (end == std::string::npos) {
+      end = contents.size();
+    }
+    args->push_back(contents.substr(start, end - start));
+    start = end + 1;
+  }
+  if (args->size() % 3 != 0) {
+    fprintf(stderr,
+            "grep-includes: %s must list (input, output, file type) triples\n",
+            path.c_str());
+    return false;
+  }
+  return true;
+}
+
+void Usage() {
+  fprintf(stderr,
+          "Usage:\n"
+          "  grep-includes <input> <output> <c++|swig>\n"
+          "  grep-includes [--cache_dir=<dir>] [--jobs=<n>] --batch=<file>\n");
+}
+
+}  // namespace
+
+}  // namespace grep_includes
+
+int main(int argc, char **argv) {
+  using grep_includes::ScanFile;
+  std::string cache_dir;
+  std::string batch_file;
+  int jobs = std::thread::hardware_concurrency();
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (strncmp(arg, "--cache_dir=", 12) == 0) {
+      cache_dir = arg + 12;
+    } else if (strncmp(arg, "--batch=", 8) == 0) {
+      batch_file = arg + 8;
+    } else if (strncmp(arg, "--jobs=", 7) == 0) {
+      jobs = atoi(arg + 7);
+    } else {
+      positional.push_back(arg);
+    }
+  }
+
+  if (batch_file.empty()) {
+    if (positional.size() != 3) {
+      grep_includes::Usage();
+      return 1;
+    }
+    return ScanFile(positional[0], positional[1], positional[2], cache_dir)
+               ? 0
+               : 1;
+  }
+
+  std::vector<std::string> args;
+  if (!positional.empty() || !grep_includes::ReadBatchFile(batch_file, &args)) {
+    grep_includes::Usage();
+    return 1;
+  }
+  size_t files = args.size() / 3;
+  if (jobs < 1) {
+    jobs = 1;
+  }
+  if (static_cast<size_t>(jobs) > files) {
+    jobs = files;
+  }
+  std::atomic<size_t> next_file(0);
+  std::atomic<bool> ok(true);
+  auto worker = [&]() {
+    for (size_t i = next_file++; i < files; i = next_file++) {
+      if (!ScanFile(args[3 * i], args[3 * i + 1], args[3 * i + 2],
+                    cache_dir)) {
+        ok = false;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < jobs; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,464 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/grep-includes/include_scanner.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GREP_INCLUDES_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define GREP_INCLUDES_NEON 1
+#endif
+
+namespace grep_includes {
+
+namespace {
+
+inline bool IsHorizontalSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\f' || c == '\v' || c == '\r';
+}
+
+inline bool IsIdentifierChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+// Returns the first position in [p, end) holding a character that can change
+// the lexer state in the middle of a line ('\n', '/', '"', '\'' or '\\'), or
+// `end` if there is none. Most of a source file is ordinary code, so this is
+// where the scanner spends its time; it tests 16 bytes at a time where the
+// target supports it.
+const char *FindSpecial(const char *p, const char *end) {
+#if defined(GREP_INCLUDES_SSE2)
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i slash = _mm_set1_epi8('/');
+  const __m128i dquote = _mm_set1_epi8('"');
+  const __m128i squote = _mm_set1_epi8('\'');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, newline), _mm_cmpeq_epi8(v, slash)),
+        _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, dquote), _mm_cmpeq_epi8(v, squote)),
+            _mm_cmpeq_epi8(v, backslash)));
+    int mask = _mm_movemask_epi8(m);
+    if (mask != 0) {
+#if defined(_MSC_VER)
+      unsigned long index;
+      _BitScanForward(&index, mask);
+      return p + index;
+#else
+      return p + __builtin_ctz(mask);
+#endif
+    }
+    p += 16;
+  }
+#elif defined(GREP_INCLUDES_NEON)
+  const uint8x16_t newline = vdupq_n_u8('\n');
+  const uint8x16_t slash = vdupq_n_u8('/');
+  const uint8x16_t dquote = vdupq_n_u8('"');
+  const uint8x16_t squote = vdupq_n_u8('\'');
+  const uint8x16_t backslash = vdupq_n_u8('\\');
+  while (end - p >= 16) {
+    uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+    uint8x16_t m = vorrq_u8(
+        vorrq_u8(vceqq_u8(v, newline), vceqq_u8(v, slash)),
+        vorrq_u8(vorrq_u8(vceqq_u8(v, dquote), vceqq_u8(v, squote)),
+                 vceqq_u8(v, backslash)));
+    if (vmaxvq_u8(m) != 0) {
+      break;  // The scalar loop below pinpoints the match within the block.
+    }
+    p += 16;
+  }
+#endif
+  for (; p < end; ++p) {
+    char c = *p;
+    if (c == '\n' || c == '/' || c == '"' || c == '\'' || c == '\\') {
+      return p;
+    }
+  }
+  return end;
+}
+
+class Scanner {
+ public:
+  Scanner(const char *begin, const char *end, FileType type,
+          std::vector<Inclusion> *inclusions)
+      : begin_(begin), end_(end), type_(type), inclusions_(inclusions) {}
+
+  void Run();
+
+ private:
+  // Returns the length of the line splice (backslash-newline) at `p`, or 0.
+  size_t Splice(const char *p) const {
+    if (p[0] != '\\') {
+      return 0;
+    }
+    if (p + 1 < end_ && p[1] == '\n') {
+      return 2;
+    }
+    if (p + 2 < end_ && p[1] == '\r' && p[2] == '\n') {
+      return 3;
+    }
+    return 0;
+  }
+
+  // Skips a block comment whose body starts at `p`; returns the position
+  // after the closing "*/", or the end of the input.
+  const char *SkipBlockComment(const char *p) const {
+    while (p < end_) {
+      const char *star = static_cast<const char *>(memchr(p, '*', end_ - p));
+      if (star == nullptr) {
+        return end_;
+      }
+      if (star + 1 < end_ && star[1] == '/') {
+        return star + 2;
+      }
+      p = star + 1;
+    }
+    return end_;
+  }
+
+  // Skips a line comment whose body starts at `p`; returns the position of
+  // the newline terminating it (continuations extend the comment).
+  const char *SkipLineComment(const char *p) const {
+    while (p < end_) {
+      const char *nl = static_cast<const char *>(memchr(p, '\n', end_ - p));
+      if (nl == nullptr) {
+        return end_;
+      }
+      const char *last = nl;
+      if (last > p && last[-1] == '\r') {
+        --last;
+      }
+      if (last > p && last[-1] == '\\') {
+        p = nl + 1;
+        continue;
+      }
+      return nl;
+    }
+    return end_;
+  }
+
+  // Skips a string or character literal opening at `p`. Unterminated
+  // literals end at the newline, which is not consumed.
+  const char *SkipQuoted(const char *p, char quote) const {
+    for (++p; p < end_; ++p) {
+      char c = *p;
+      if (c == quote) {
+        return p + 1;
+      } else if (c == '\n') {
+        return p;
+      } else if (c == '\\' && p + 1 < end_) {
+        ++p;
+        if (*p == '\r' && p + 1 < end_ && p[1] == '\n') {
+          ++p;
+        }
+      }
+    }
+    return end_;
+  }
+
+  // Tells whether the '"' at `p` opens a raw string literal, i.e. whether it
+  // is preceded by exactly one of the R, LR, uR, UR or u8R prefixes.
+  bool IsRawString(const char *p) const {
+    const char *start = p;
+    while (start > begin_ && IsIdentifierChar(start[-1])) {
+      --start;
+    }
+    size_t len = p - start;
+    return (len == 1 && start[0] == 'R') ||
+           (len == 2 && (start[0] == 'L' || start[0] == 'u' ||
+                         start[0] == 'U') &&
+            start[1] == 'R') ||
+           (len == 3 && start[0] == 'u' && start[1] == '8' && start[2] == 'R');
+  }
+
+  // Skips the raw string literal opening at `p`.
+  const char *SkipRawString(const char *p) const {
+    const char *delim_begin = p + 1;
+    const char *delim_end = delim_begin;
+    while (delim_end < end_ && *delim_end != '(' &&
+           delim_end - delim_begin <= 16) {
+      char c = *delim_end;
+      if (c == ')' || c == '\\' || c == '"' ||
+          isspace(static_cast<unsigned char>(c))) {
+        return SkipQuoted(p, '"');
+      }
+      ++delim_end;
+    }
+    if (delim_end >= end_ || *delim_end != '(') {
+      return SkipQuoted(p, '"');
+    }
+    std::string terminator(")");
+    terminator.append(delim_begin, delim_end);
+    terminator.push_back('"');
+    const char *close = std::search(delim_end + 1, end_, terminator.begin(),
+                                    terminator.end());
+    return close == end_ ? end_ : close + terminator.size();
+  }
+
+  // Reads the rest of the preprocessor line starting at `p` into `line`,
+  // removing line splices and replacing each comment by a single space.
+  // Returns the position of the terminating newline.
+  const char *ReadDirective(const char *p, std::string *line) const;
+
+  void ScanCppDirective(const std::string &line);
+  void ScanSwigDirective(const std::string &line);
+
+  // Parses a "name" or <name> operand at `pos` of `line`.
+  void AddHeaderName(const std::string &line, size_t pos, bool next);
+
+  const char *const begin_;
+  const char *const end_;
+  const FileType type_;
+  std::vector<Inclusion> *const inclusions_;
+};
+
+void Scanner::Run() {
+  const char *p = begin_;
+  // Whether only whitespace and comments precede `p` on its logical line.
+  bool at_line_start = true;
+  const char directive_char = type_ == FileType::kCpp ? '#' : '%';
+  while (p < end_) {
+    if (!at_line_start && (p = FindSpecial(p, end_)) == end_) {
+      break;
+    }
+    char c = *p;
+    if (c == '\n') {
+      at_line_start = true;
+      ++p;
+    } else if (IsHorizontalSpace(c)) {
+      ++p;
+    } else if (c == '\\') {
+      size_t splice = Splice(p);
+      if (splice == 0) {
+        at_line_start = false;
+      }
+      p += splice ? splice : 1;
+    } else if (c == '/' && p + 1 < end_ && p[1] == '*') {
+      p = SkipBlockComment(p + 2);
+    } else if (c == '/' && p + 1 < end_ && p[1] == '/') {
+      p = SkipLineComment(p + 2);
+    } else if (c == '"') {
+      p = IsRawString(p) ? SkipRawString(p) : SkipQuoted(p, '"');
+      at_line_start = false;
+    } else if (c == '\'') {
+      // A quote following a digit is a C++14 digit separator.
+      if (p > begin_ && isdigit(static_cast<unsigned char>(p[-1]))) {
+        ++p;
+      } else {
+        p = SkipQuoted(p, '\'');
+      }
+      at_line_start = false;
+    } else if (c == directive_char && at_line_start) {
+      std::string line;
+      p = ReadDirective(p + 1, &line);
+      if (type_ == FileType::kCpp) {
+        ScanCppDirective(line);
+      } else {
+        ScanSwigDirective(line);
+      }
+    } else {
+      at_line_start = false;
+      ++p;
+    }
+  }
+}
+
+const char *Scanner::ReadDirective(const char *p, std::string *line) const {
+  while (p < end_) {
+    char c = *p;
+    if (c == '\n') {
+      break;
+    } else if (c == '\\' && Splice(p) > 0) {
+      p += Splice(p);
+    } else if (c == '/' && p + 1 < end_ && p[1] == '*') {
+      p = SkipBlockComment(p + 2);
+      line->push_back(' ');
+    } else if (c == '/' && p + 1 < end_ && p[1] == '/') {
+      return SkipLineComment(p + 2);
+    } else if (c == '"') {
+      // Copy quoted text verbatim so that "a/*b.h" is not taken for a
+      // comment. Header names have no escapes, so neither do we.
+      line->push_back(*p++);
+      while (p < end_ && *p != '\n') {
+        if (*p == '\\' && Splice(p) > 0) {
+          p += Splice(p);
+          continue;
+        }
+        line->push_back(*p);
+        if (*p++ == '"') {
+          break;
+        }
+      }
+    } else {
+      line->push_back(c);
+      ++p;
+    }
+  }
+  return p;
+}
+
+static size_t SkipSpace(const std::string &line, size_t pos) {
+  while (pos < line.size() && IsHorizontalSpace(line[pos])) {
+    ++pos;
+  }
+  return pos;
+}
+
+// If `line` has the identifier `keyword` at `pos`, returns the position after
+// it; otherwise returns std::string::npos.
+static size_t ExpectKeyword(const std::string &line, size_t pos,
+                            const char *keyword) {
+  size_t len = strlen(keyword);
+  if (line.compare(pos, len, keyword) != 0) {
+    return std::string::npos;
+  }
+  pos += len;
+  if (pos < line.size() && IsIdentifierChar(line[pos])) {
+    return std::string::npos;
+  }
+  return pos;
+}
+
+void Scanner::AddHeaderName(const std::string &line, size_t pos, bool next) {
+  pos = SkipSpace(line, pos);
+  if (pos >= line.size() || (line[pos] != '"' && line[pos] != '<')) {
+    return;  // A computed include; these are not resolved here.
+  }
+  char open = line[pos];
+  size_t close = line.find(open == '<' ? '>' : '"', pos + 1);
+  if (close == std::string::npos || close == pos + 1 || line[pos + 1] == '/') {
+    return;  // Unterminated, empty or absolute.
+  }
+  Inclusion::Kind kind;
+  if (open == '"') {
+    kind = next ? Inclusion::kNextQuote : Inclusion::kQuote;
+  } else {
+    kind = next ? Inclusion::kNextAngle : Inclusion::kAngle;
+  }
+  inclusions_->emplace_back(kind, line.substr(pos + 1, close - pos - 1));
+}
+
+void Scanner::ScanCppDirective(const std::string &line) {
+  size_t start = SkipSpace(line, 0);
+  size_t pos;
+  if ((pos = ExpectKeyword(line, start, "include")) != std::string::npos) {
+    AddHeaderName(line, pos, false);
+  } else if ((pos = ExpectKeyword(line, start, "include_next")) !=
+             std::string::npos) {
+    AddHeaderName(line, pos, true);
+  } else if ((pos = ExpectKeyword(line, start, "import")) !=
+             std::string::npos) {
+    AddHeaderName(line, pos, false);
+  } else {
+    // Any other directive, typically #if or #elif, may test for the
+    // presence of headers, possibly several of them.
+    static const char kHasInclude[] = "__has_include";
+    const size_t has_include_len = sizeof(kHasInclude) - 1;
+    for (pos = line.find(kHasInclude, start); pos != std::string::npos;
+         pos = line.find(kHasInclude, pos)) {
+      if (pos > 0 && IsIdentifierChar(line[pos - 1])) {
+        pos += has_include_len;
+        continue;
+      }
+      size_t operand = ExpectKeyword(line, pos, kHasInclude);
+      bool next = false;
+      if (operand == std::string::npos) {
+        operand = ExpectKeyword(line, pos, "__has_include_next");
+        next = true;
+      }
+      pos += has_include_len;
+      if (operand == std::string::npos) {
+        continue;
+      }
+      operand = SkipSpace(line, operand);
+      if (operand < line.size() && line[operand] == '(') {
+        AddHeaderName(line, operand + 1, next);
+      }
+    }
+  }
+}
+
+void Scanner::ScanSwigDirective(const std::string &line) {
+  size_t pos;
+  if ((pos = ExpectKeyword(line, 0, "include")) == std::string::npos &&
+      (pos = ExpectKeyword(line, 0, "extern")) == std::string::npos &&
+      (pos = ExpectKeyword(line, 0, "import")) == std::string::npos) {
+    return;
+  }
+  size_t operand = SkipSpace(line, pos);
+  if (operand < line.size() && line[operand] == '(') {
+    // Skip the directive's options, as in %import(module="foo") "foo.i".
+    operand = line.find(')', operand);
+    if (operand == std::string::npos) {
+      return;
+    }
+    operand = SkipSpace(line, operand + 1);
+  }
+  if (operand == pos) {
+    return;
+  }
+  if (operand < line.size() && (line[operand] == '"' || line[operand] == '<')) {
+    AddHeaderName(line, operand, false);
+    return;
+  }
+  // SWIG treats a bare file name like a quoted one. Comments have been
+  // removed already, so only trailing whitespace is left to trim.
+  size_t last = line.size();
+  while (last > operand &&
+         isspace(static_cast<unsigned char>(line[last - 1]))) {
+    --last;
+  }
+  if (last > operand && line[operand] != '/') {
+    inclusions_->emplace_back(Inclusion::kQuote,
+                              line.substr(operand, last - operand));
+  }
+}
+
+}  // namespace
+
+bool ParseFileType(const std::string &name, FileType *type) {
+  if (name == "c++") {
+    *type = FileType::kCpp;
+  } else if (name == "swig") {
+    *type = FileType::kSwig;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void ScanIncludes(const char *begin, const char *end, FileType type,
+                  std::vector<Inclusion> *inclusions) {
+  Scanner(begin, end, type, inclusions).Run();
+}
+
+void FormatInclusions(const std::vector<Inclusion> &inclusions,
+                      std::string *out) {
+  for (const Inclusion &inclusion : inclusions) {
+    out->push_back(inclusion.kind);
+    out->append(inclusion.name);
+    out->push_back('\n');
+  }
+}
+
+}  // namespace grep_includes
@@ -0,0 +1,79 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_GREP_INCLUDES_INCLUDE_SCANNER_H_
+#define BAZEL_SRC_TOOLS_GREP_INCLUDES_INCLUDE_SCANNER_H_ 1
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+namespace grep_includes {
+
+// The kind of source file being scanned. The command line spelling of each
+// value must be kept in sync with IncludeParser.GrepIncludesFileType.
+enum class FileType {
+  kCpp,   // "c++": C, C++ and Objective-C sources and headers.
+  kSwig,  // "swig": SWIG interface files.
+};
+
+// Parses the command line spelling of a file type. Returns false if `name` is
+// not a known file type.
+bool ParseFileType(const std::string &name, FileType *type);
+
+// A single literal inclusion found in a source file.
+struct Inclusion {
+  // The kind is written verbatim as the first character of an output line,
+  // see IncludeParser.KIND_MAP.
+  enum Kind : char {
+    kQuote = '"',
+    kAngle = '<',
+    kNextQuote = 'q',
+    kNextAngle = 'a',
+  };
+
+  Inclusion(Kind kind, std::string name) : kind(kind), name(std::move(name)) {}
+
+  bool operator==(const Inclusion &other) const {
+    return kind == other.kind && name == other.name;
+  }
+
+  Kind kind;
+  std::string name;
+};
+
+// Extracts all literal inclusions from the source text in [begin, end).
+//
+// For C++ files these are the `#include`, `#include_next` and `#import`
+// directives plus every `__has_include`/`__has_include_next` operand on a
+// preprocessor line. Comments, line continuations and string literals
+// (including raw strings) are honored, so a directive inside a comment is
+// ignored and one following a comment on the same line is not. Computed
+// includes (`#include MACRO`) and absolute paths are skipped, exactly like
+// the Java IncludeParser does.
+//
+// For SWIG files these are the `%include`, `%extern` and `%import`
+// directives.
+void ScanIncludes(const char *begin, const char *end, FileType type,
+                  std::vector<Inclusion> *inclusions);
+
+// Appends `inclusions` to `out` in the format grep-includes writes its output
+// in: one inclusion per line, its kind character followed by the name.
+void FormatInclusions(const std::vector<Inclusion> &inclusions,
+                      std::string *out);
+
+}  // namespace grep_includes
+
+#endif  // BAZEL_SRC_TOOLS_GREP_INCLUDES_INCLUDE_SCANNER_H_
@@ -0,0 +1,160 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/grep-includes/include_scanner.h"
+
+#include <string>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+using grep_includes::FileType;
+using grep_includes::FormatInclusions;
+using grep_includes::Inclusion;
+using grep_includes::ScanIncludes;
+
+std::string Scan(const std::string &source, FileType type = FileType::kCpp) {
+  std::vector<Inclusion> inclusions;
+  ScanIncludes(source.data(), source.data() + source.size(), type,
+               &inclusions);
+  std::string result;
+  FormatInclusions(inclusions, &result);
+  return result;
+}
+
+TEST(IncludeScannerTest, IncludeKinds) {
+  EXPECT_EQ(
+      "\"a/b.h\n"
+      "<vector\n"
+      "qc.h\n"
+      "anext\n"
+      "\"d.h\n"
+      "<Foundation/Foundation.h\n",
+      Scan("#include \"a/b.h\"\n"
+           "  #  include <vector>\n"
+           "#include_next \"c.h\"\n"
+           "#include_next<next>\n"
+           "#import \"d.h\"\n"
+           "#import <Foundation/Foundation.h>\n"));
+}
+
+TEST(IncludeScannerTest, IgnoresNonLiteralAndAbsoluteIncludes) {
+  EXPECT_EQ("", Scan("#include FOO_H\n"
+                     "#include \"/usr/include/stdio.h\"\n"
+                     "#include </abs.h>\n"
+                     "#included \"x.h\"\n"
+                     "#include \"unterminated.h\n"
+                     "int x; #include \"not_a_directive.h\"\n"));
+}
+
+TEST(IncludeScannerTest, Comments) {
+  EXPECT_EQ(
+      "\"after_comment.h\n"
+      "\"after_multiline_comment.h\n"
+      "\"commented_keyword.h\n"
+      "\"trailing.h\n",
+      Scan("// #include \"line_comment.h\"\n"
+           "/* #include \"block_comment.h\" */\n"
+           "/* c */ #include \"after_comment.h\"\n"
+           "/*\n"
+           "#include \"inside_comment.h\"\n"
+           "*/ #include \"after_multiline_comment.h\"\n"
+           "# /* c */ include \"commented_keyword.h\"\n"
+           "#include \"trailing.h\"  // #include \"x.h\"\n"
+           "// continued \\\n"
+           "#include \"continued_comment.h\"\n"
+           "int a; /*\n"
+           "*/ #include \"not_at_line_start.h\"\n"));
+}
+
+TEST(IncludeScannerTest, LineContinuations) {
+  EXPECT_EQ(
+      "\"a.h\n"
+      "<b/c.h\n"
+      "\"crlf.h\n",
+      Scan("#\\\ninclude \\\n\"a.h\"\n"
+           "#include <b/\\\nc.h>\n"
+           "#define X \\\n"
+           "#include \"in_macro_body.h\"\n"
+           "#include \\\r\n\"crlf.h\"\r\n"));
+}
+
+TEST(IncludeScannerTest, StringLiterals) {
+  EXPECT_EQ(
+      "\"after_string.h\n"
+      "\"after_raw_string.h\n"
+      "\"after_char.h\n"
+      "\"a/*b.h\n",
+      Scan("const char *s = \"/*\";\n"
+           "#include \"after_string.h\"\n"
+           "const char *r = R\"x(\n"
+           "#include \"in_raw_string.h\"\n"
+           ")\" /* )x\";\n"
+           "#include \"after_raw_string.h\"\n"
+           "char c = '\"'; int n = 1'000;\n"
+           "#include \"after_char.h\"\n"
+           "#include \"a/*b.h\"\n"));
+}
+
+TEST(IncludeScannerTest, HasInclude) {
+  EXPECT_EQ(
+      "<optional\n"
+      "\"x.h\n"
+      "ay.h\n",
+      Scan("#if __has_include(<optional>)\n"
+           "#elif defined(X) && __has_include ( \"x.h\" ) || "
+           "__has_include_next(<y.h>)\n"
+           "#endif\n"
+           "bool b = __has_include(\"not_a_directive.h\");\n"
+           "#if my__has_include(\"z.h\")\n"));
+}
+
+TEST(IncludeScannerTest, Swig) {
+  EXPECT_EQ(
+      "\"a.i\n"
+      "<b.i\n"
+      "\"c.i\n"
+      "\"d.swig\n",
+      Scan("%include \"a.i\"\n"
+           "%import(module=\"m\") <b.i>\n"
+           "%extern c.i  // comment\n"
+           "  %include d.swig\n"
+           "%include /abs.i\n"
+           "#include \"ignored.h\"\n"
+           "%includefoo \"e.i\"\n",
+           FileType::kSwig));
+}
+
+TEST(IncludeScannerTest, LongLines) {
+  // Exercise the vectorized skipping on either side of block boundaries.
+  for (size_t padding = 0; padding < 40; ++padding) {
+    std::string code(padding, 'x');
+    EXPECT_EQ("\"a.h\n",
+              Scan(code + "/*\n#include \"no.h\"\n*/\n#include \"a.h\"\n" +
+                   code));
+  }
+}
+
+TEST(IncludeScannerTest, ParseFileType) {
+  FileType type;
+  ASSERT_TRUE(grep_includes::ParseFileType("c++", &type));
+  EXPECT_EQ(FileType::kCpp, type);
+  ASSERT_TRUE(grep_includes::ParseFileType("swig", &type));
+  EXPECT_EQ(FileType::kSwig, type);
+  EXPECT_FALSE(grep_includes::ParseFileType("java", &type));
+}
+
+}  // namespace
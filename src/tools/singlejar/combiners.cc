@@ -20,6 +20,11 @@
 
 Combiner::~Combiner() {}
 
+LH *Combiner::OutputHeader(bool compress, const TransientBytes **payload) {
+  *payload = nullptr;
+  return reinterpret_cast<LH *>(OutputEntry(compress));
+}
+
 Concatenator::~Concatenator() {}
 
 bool Concatenator::Merge(const CDH *cdh, const LH *lh) {
@@ -42,25 +47,42 @@ bool Concatenator::Merge(const CDH *cdh, const LH *lh) {
 }
 
 void *Concatenator::OutputEntry(bool compress) {
-  if (!buffer_) {
+  const TransientBytes *payload;
+  LH *lh = OutputHeader(compress, &payload);
+  if (lh == nullptr) {
     return nullptr;
   }
 
-  // Allocate a contiguous buffer for the local file header and
-  // deflated data. We assume that deflate decreases the size, so if
-  //  the deflater reports overflow, we just save original data.
-  size_t deflated_buffer_size =
-      sizeof(LH) + filename_.size() + buffer_->data_size();
+  // Append the payload to the local file header.
+  size_t lh_size = lh->size();
+  LH *entry =
+      reinterpret_cast<LH *>(realloc(lh, lh_size + payload->data_size()));
+  if (entry == nullptr) {
+    free(lh);
+    return nullptr;
+  }
+  uint32_t checksum;
+  payload->CopyOut(entry->data(), &checksum);
+  compressed_.reset();
+  return reinterpret_cast<void *>(entry);
+}
+
+LH *Concatenator::OutputHeader(bool compress,
+                               const TransientBytes **payload) {
+  if (!buffer_) {
+    return nullptr;
+  }
 
   // Huge entry (>4GB) needs Zip64 extension field with 64-bit original
   // and compressed size values.
+  size_t lh_size = sizeof(LH) + filename_.size();
   uint8_t
       zip64_extension_buffer[sizeof(Zip64ExtraField) + 2 * sizeof(uint64_t)];
   bool huge_buffer = ziph::zfield_needs_ext64(buffer_->data_size());
   if (huge_buffer) {
-    deflated_buffer_size += sizeof(zip64_extension_buffer);
+    lh_size += sizeof(zip64_extension_buffer);
   }
-  LH *lh = reinterpret_cast<LH *>(malloc(deflated_buffer_size));
+  LH *lh = reinterpret_cast<LH *>(malloc(lh_size));
   if (lh == nullptr) {
     return nullptr;
   }
@@ -87,16 +109,23 @@ void *Concatenator::OutputEntry(bool compress) {
     lh->extra_fields(nullptr, 0);
   }
 
+  // Deflate into a separate buffer. If the deflater reports that the result
+  // would not be smaller than the original, we just save original data.
   uint32_t checksum;
-  uint64_t compressed_size;
-  uint16_t method;
+  uint16_t method = Z_NO_COMPRESSION;
   if (compress) {
-    method = buffer_->CompressOut(lh->data(), &checksum, &compressed_size);
+    compressed_.reset(new TransientBytes());
+    method = buffer_->CompressOut(compressed_.get(), &checksum);
+  } else {
+    checksum = buffer_->Checksum();
+  }
+  if (method == Z_DEFLATED) {
+    *payload = compressed_.get();
   } else {
-    buffer_->CopyOut(lh->data(), &checksum);
-    method = Z_NO_COMPRESSION;
-    compressed_size = buffer_->data_size();
+    compressed_.reset();
+    *payload = buffer_.get();
   }
+  uint64_t compressed_size = (*payload)->data_size();
   lh->crc32(checksum);
   lh->compression_method(method);
   if (huge_buffer) {
@@ -111,7 +140,7 @@ void *Concatenator::OutputEntry(bool compress) {
     // If original data is <4GB, the compressed one is, too.
     lh->compressed_file_size32(compressed_size);
   }
-  return reinterpret_cast<void *>(lh);
+  return lh;
 }
 
 NullCombiner::~NullCombiner() {}
@@ -174,6 +203,15 @@ void *XmlCombiner::OutputEntry(bool compress) {
   return concatenator_->OutputEntry(compress);
 }
 
+LH *XmlCombiner::OutputHeader(bool compress, const TransientBytes **payload) {
+  if (!concatenator_) {
+    return nullptr;
+  }
+  concatenator_->Append(end_tag_);
+  concatenator_->Append("\n");
+  return concatenator_->OutputHeader(compress, payload);
+}
+
 PropertyCombiner::~PropertyCombiner() {}
 
 bool PropertyCombiner::Merge(const CDH * /*cdh*/, const LH * /*lh*/) {
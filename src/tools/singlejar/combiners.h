@@ -21,8 +21,8 @@
 #include <unordered_map>
 #include <vector>
 
+#include "src/main/cpp/util/zip_headers.h"
 #include "src/tools/singlejar/transient_bytes.h"
-#include "src/tools/singlejar/zip_headers.h"
 
 // An interface for combining the files.
 class Combiner {
@@ -36,6 +36,14 @@ class Combiner {
   // Otherwise the payload is compressed, provided that the compressed data
   // is smaller than the original.
   virtual void *OutputEntry(bool compress) = 0;
+  // Returns a pointer to the Local Header of the entry (allocated with
+  // malloc, to be freed by the caller), and sets `payload' to the bytes to be
+  // written right after it, which this combiner owns until the next call.
+  // This way large entries can be streamed out rather than copied into one
+  // contiguous buffer. The default implementation returns the buffer created
+  // by OutputEntry() and sets `payload' to nullptr to tell that the payload
+  // follows the Local Header in that buffer.
+  virtual LH *OutputHeader(bool compress, const TransientBytes **payload);
 };
 
 // An output jar entry consisting of a concatenation of the input jar
@@ -51,6 +59,8 @@ class Concatenator : public Combiner {
 
   void *OutputEntry(bool compress) override;
 
+  LH *OutputHeader(bool compress, const TransientBytes **payload) override;
+
   void Append(const char *s, size_t n) {
     CreateBuffer();
     buffer_->Append(reinterpret_cast<const uint8_t *>(s), n);
@@ -70,6 +80,8 @@ class Concatenator : public Combiner {
   }
   const std::string filename_;
   std::unique_ptr<TransientBytes> buffer_;
+  // The deflated contents of buffer_ returned by the last OutputHeader call.
+  std::unique_ptr<TransientBytes> compressed_;
   std::unique_ptr<Inflater> inflater_;
   bool insert_newlines_;
 };
@@ -98,6 +110,8 @@ class XmlCombiner : public Combiner {
 
   void *OutputEntry(bool compress) override;
 
+  LH *OutputHeader(bool compress, const TransientBytes **payload) override;
+
   const std::string filename() const { return filename_; }
 
  private:
@@ -14,8 +14,8 @@
 
 #include "src/tools/singlejar/combiners.h"
 
+#include "src/main/cpp/util/zip_headers.h"
 #include "src/tools/singlejar/input_jar.h"
-#include "src/tools/singlejar/zip_headers.h"
 #include "src/tools/singlejar/zlib_interface.h"
 #include "googletest/include/gtest/gtest.h"
 
@@ -105,6 +105,37 @@ TEST_F(CombinersTest, ConcatenatorSmall) {
   free(reinterpret_cast<void *>(entry));
 }
 
+// Test that Concatenator::OutputHeader returns the payload separately.
+TEST_F(CombinersTest, ConcatenatorOutputHeader) {
+  Concatenator concatenator("concat");
+  concatenator.Append(kConcatenatedContents);
+
+  const TransientBytes *payload = nullptr;
+  LH *entry = concatenator.OutputHeader(true, &payload);
+  ASSERT_NE(nullptr, entry);
+  ASSERT_NE(nullptr, payload);
+  EXPECT_TRUE(entry->is());
+  EXPECT_EQ(Z_DEFLATED, entry->compression_method());
+  EXPECT_TRUE(entry->file_name_is("concat"));
+  EXPECT_EQ(strlen(kConcatenatedContents), entry->uncompressed_file_size());
+  EXPECT_EQ(payload->data_size(), entry->compressed_file_size());
+  free(reinterpret_cast<void *>(entry));
+
+  entry = concatenator.OutputHeader(false, &payload);
+  ASSERT_NE(nullptr, entry);
+  ASSERT_NE(nullptr, payload);
+  EXPECT_EQ(Z_NO_COMPRESSION, entry->compression_method());
+  EXPECT_EQ(strlen(kConcatenatedContents), entry->compressed_file_size());
+  EXPECT_EQ(payload->Checksum(), entry->crc32());
+  std::unique_ptr<uint8_t[]> data(new uint8_t[payload->data_size()]);
+  uint32_t checksum;
+  payload->CopyOut(data.get(), &checksum);
+  EXPECT_EQ(kConcatenatedContents,
+            std::string(reinterpret_cast<char *>(data.get()),
+                        payload->data_size()));
+  free(reinterpret_cast<void *>(entry));
+}
+
 // Tests that Concatenator creates huge (>4GB original/compressed sizes)
 // correctly. This test is slow.
 TEST_F(CombinersTest, ConcatenatorHuge) {
@@ -119,7 +150,6 @@ TEST_F(CombinersTest, ConcatenatorHuge) {
   }
   free(buf);
 
-  // Now hope that we have enough memory :-)
   LH *entry = reinterpret_cast<LH *>(concatenator.OutputEntry(true));
   ASSERT_NE(nullptr, entry);
   ASSERT_TRUE(entry->is());
@@ -21,9 +21,9 @@
 #include <unordered_map>
 #include <vector>
 
+#include "src/main/cpp/util/zip_headers.h"
 #include "src/tools/singlejar/combiners.h"
 #include "src/tools/singlejar/transient_bytes.h"
-#include "src/tools/singlejar/zip_headers.h"
 
 // Combiner that checks META-INF/desugar_deps files (b/65645388) to ensure
 // correct bytecode desugaring, specifically of default and static interface
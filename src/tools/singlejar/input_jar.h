@@ -24,9 +24,9 @@
 
 #include <string>
 
+#include "src/main/cpp/util/zip_headers.h"
 #include "src/tools/singlejar/diag.h"
 #include "src/tools/singlejar/mapped_file.h"
-#include "src/tools/singlejar/zip_headers.h"
 
 /*
  * An input jar. The usage pattern is:
@@ -72,7 +72,7 @@ class InputJar {
           cdh_->file_name_length(), cdh_->extra_fields_length(),
           cdh_->comment_length());
     }
-    cdh_ = reinterpret_cast<const CDH *>(new_cdr);
+    cdh_ = central_directory_.next(cdh_);
     *local_header_ptr = LocalHeader(current_cdh);
     return current_cdh;
   }
@@ -85,8 +85,8 @@ class InputJar {
   }
 
   const LH *LocalHeader(const CDH *cdh) const {
-    return reinterpret_cast<const LH *>(
-        mapped_file_.address(cdh->local_header_offset() + preamble_size_));
+    return reinterpret_cast<const LH *>(mapped_file_.address(
+        cdh->local_header_offset() + central_directory_.preamble_size()));
   }
 
   uint64_t LocalHeaderOffset(const LH *lh) const {
@@ -100,8 +100,8 @@ class InputJar {
  private:
   std::string path_;
   MappedFile mapped_file_;
+  CentralDirectory central_directory_;
   const CDH *cdh_;  // current directory entry
-  uint64_t preamble_size_;  // Bytes before the Zip proper.
 };
 
 #endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_H_
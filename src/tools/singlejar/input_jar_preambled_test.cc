@@ -101,6 +101,24 @@ TEST(InputJarPreambledTest, SmallAdjusted) {
   Verify(out_path);
 }
 
+// Archive followed by bytes which are not part of the ECD comment.
+TEST(InputJarPreambledTest, TrailingGarbage) {
+  std::unique_ptr<Runfiles> runfiles(Runfiles::CreateForTest());
+  std::string out_path = singlejar_test_util::OutputFilePath("out.jwp");
+  std::string tail_path = singlejar_test_util::OutputFilePath("tail");
+  ASSERT_TRUE(singlejar_test_util::AllocateFile(tail_path, 7));
+  ASSERT_EQ(
+      0,
+      singlejar_test_util::RunCommand(
+          "cat",
+          runfiles
+              ->Rlocation(
+                  "io_bazel/src/tools/singlejar/libtest1.jar")
+              .c_str(),
+          tail_path.c_str(), ">", out_path.c_str(), nullptr));
+  Verify(out_path);
+}
+
 // 64-bit Zip file with preamble
 TEST(InputJarPreambledTest, Huge) {
   std::string file4g = singlejar_test_util::OutputFilePath("file4g");
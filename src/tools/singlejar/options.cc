@@ -14,6 +14,8 @@
 
 #include "src/tools/singlejar/options.h"
 
+#include <stdlib.h>
+
 #include "src/tools/singlejar/diag.h"
 
 void Options::ParseCommandLine(int argc, const char *const argv[]) {
@@ -36,8 +38,10 @@ bool Options::ParseToken(ArgTokenStream *tokens) {
   if (tokens->MatchAndSet("--output", &output_jar) ||
       tokens->MatchAndSet("--main_class", &main_class) ||
       tokens->MatchAndSet("--java_launcher", &java_launcher) ||
+      tokens->MatchAndSet("--report", &report) ||
       tokens->MatchAndSet("--deploy_manifest_lines", &manifest_lines) ||
       tokens->MatchAndSet("--sources", &input_jars) ||
+      tokens->MatchAndSet("--source_manifests", &source_manifests) ||
       tokens->MatchAndSet("--resources", &resources) ||
       tokens->MatchAndSet("--classpath_resources", &classpath_resources) ||
       tokens->MatchAndSet("--include_prefixes", &include_prefixes) ||
@@ -60,6 +64,17 @@ bool Options::ParseToken(ArgTokenStream *tokens) {
   } else if (tokens->MatchAndSet("--extra_build_info", &optarg)) {
     build_info_lines.push_back(optarg);
     return true;
+  } else if (tokens->MatchAndSet("--align", &optarg)) {
+    char *end;
+    long value = strtol(optarg.c_str(), &end, 10);
+    // The alignment is recorded in a 16-bit field of each aligned entry.
+    if (optarg.empty() || *end != '\0' || value < 1 || value > 32768 ||
+        (value & (value - 1)) != 0) {
+      diag_errx(1, "--align requires a power of 2 between 1 and 32768, got %s",
+                optarg.c_str());
+    }
+    align = static_cast<int>(value);
+    return true;
   }
 
   return false;
@@ -24,7 +24,8 @@
 class Options {
  public:
   Options()
-      : exclude_build_data(false),
+      : align(0),
+        exclude_build_data(false),
         force_compression(false),
         normalize_timestamps(false),
         add_missing_directories(false),
@@ -43,14 +44,23 @@ class Options {
   std::string output_jar;
   std::string main_class;
   std::string java_launcher;
+  // If set, the statistics of the run are written to this file as JSON.
+  std::string report;
   std::vector<std::string> manifest_lines;
+  // The sources: jars, or directories whose files are added as if they had
+  // been zipped.
   std::vector<std::pair<std::string, std::string> > input_jars;
+  // Files listing <path>TAB<entry name> lines, added after the sources.
+  std::vector<std::string> source_manifests;
   std::vector<std::string> resources;
   std::vector<std::string> classpath_resources;
   std::vector<std::string> build_info_files;
   std::vector<std::string> build_info_lines;
   std::vector<std::string> include_prefixes;
   std::vector<std::string> nocompress_suffixes;
+  // If greater than 1, the data of stored file entries starts at a multiple
+  // of this many bytes (a power of 2).
+  int align;
   bool exclude_build_data;
   bool force_compression;
   bool normalize_timestamps;
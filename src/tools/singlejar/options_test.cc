@@ -62,6 +62,7 @@ TEST(OptionsTest, SingleOptargs) {
   const char *args[] = {"--output", "output_jar",
                         "--main_class", "com.google.Main",
                         "--java_launcher", "//tools:mylauncher",
+                        "--report", "report.json",
                         "--build_info_file", "build_file1",
                         "--extra_build_info", "extra_build_line1",
                         "--build_info_file", "build_file2",
@@ -72,12 +73,22 @@ TEST(OptionsTest, SingleOptargs) {
   EXPECT_EQ("output_jar", options.output_jar);
   EXPECT_EQ("com.google.Main", options.main_class);
   EXPECT_EQ("//tools:mylauncher", options.java_launcher);
+  EXPECT_EQ("report.json", options.report);
   ASSERT_EQ(2UL, options.build_info_files.size());
   EXPECT_EQ("build_file1", options.build_info_files[0]);
   EXPECT_EQ("build_file2", options.build_info_files[1]);
   ASSERT_EQ(2UL, options.build_info_lines.size());
   EXPECT_EQ("extra_build_line1", options.build_info_lines[0]);
   EXPECT_EQ("extra_build_line2", options.build_info_lines[1]);
+  EXPECT_EQ(0, options.align);
+}
+
+TEST(OptionsTest, Align) {
+  const char *args[] = {"--output", "output_jar", "--align", "4096"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+
+  EXPECT_EQ(4096, options.align);
 }
 
 TEST(OptionsTest, MultiOptargs) {
@@ -86,6 +97,7 @@ TEST(OptionsTest, MultiOptargs) {
                         "--resources", "res1", "res2",
                         "--classpath_resources", "cpres1", "cpres2",
                         "--sources", "jar3",
+                        "--source_manifests", "manifest1", "manifest2",
                         "--include_prefixes", "prefix1", "prefix2",
                         "--nocompress_suffixes", ".png", ".so"};
   Options options;
@@ -95,6 +107,9 @@ TEST(OptionsTest, MultiOptargs) {
   EXPECT_EQ("jar1", options.input_jars[0].first);
   EXPECT_EQ("jar2", options.input_jars[1].first);
   EXPECT_EQ("jar3", options.input_jars[2].first);
+  ASSERT_EQ(2UL, options.source_manifests.size());
+  EXPECT_EQ("manifest1", options.source_manifests[0]);
+  EXPECT_EQ("manifest2", options.source_manifests[1]);
   ASSERT_EQ(2UL, options.resources.size());
   EXPECT_EQ("res1", options.resources[0]);
   EXPECT_EQ("res2", options.resources[1]);
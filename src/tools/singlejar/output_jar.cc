@@ -24,6 +24,8 @@
 #include <sys/stat.h>
 #include <time.h>
 
+#include <algorithm>
+
 #ifndef _WIN32
 #include <unistd.h>
 #else
@@ -35,13 +37,15 @@
 
 #endif  // _WIN32
 
+#include "src/main/cpp/util/file.h"
 #include "src/main/cpp/util/path_platform.h"
+#include "src/main/cpp/util/zip_headers.h"
 #include "src/tools/singlejar/combiners.h"
 #include "src/tools/singlejar/diag.h"
 #include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/mapped_file.h"
 #include "src/tools/singlejar/options.h"
-#include "src/tools/singlejar/zip_headers.h"
+#include "src/tools/singlejar/zlib_interface.h"
 
 #include <zlib.h>
 
@@ -50,6 +54,24 @@
     diag_errx(2, "%s:%d: TODO(asmundak): " msg, __FILE__, __LINE__); \
   }
 
+// The extra field used to pad local headers so that the entry data is aligned
+// (as written by Android's zipalign). Its payload is the 16-bit alignment
+// followed by zero bytes.
+static const uint16_t kAlignmentExtraFieldTag = 0xD935;
+static const uint16_t kMinAlignmentExtraFieldSize = sizeof(ExtraField) + 2;
+
+// Writes an alignment extra field of `size` bytes for the given alignment.
+static void WriteAlignmentExtraField(uint8_t *field, uint16_t size,
+                                     uint16_t alignment) {
+  auto extra_field = reinterpret_cast<ExtraField *>(field);
+  extra_field->signature(kAlignmentExtraFieldTag);
+  extra_field->payload_size(size - sizeof(ExtraField));
+  uint8_t *payload = field + sizeof(ExtraField);
+  payload[0] = alignment & 0xFF;
+  payload[1] = alignment >> 8;
+  memset(payload + 2, 0, size - kMinAlignmentExtraFieldSize);
+}
+
 OutputJar::OutputJar()
     : options_(nullptr),
       file_(nullptr),
@@ -77,6 +99,12 @@ OutputJar::OutputJar()
       "Created-By: singlejar\r\n");
 }
 
+// True if `path` is an existing directory.
+static bool IsDirectory(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFDIR) == S_IFDIR;
+}
+
 static std::string Basename(const std::string &path) {
   size_t pos = path.rfind('/');
   if (pos == std::string::npos) {
@@ -113,6 +141,8 @@ int OutputJar::Doit(Options *options) {
               options_->java_launcher.c_str());
     }
     fprintf(stderr, "%zu source files\n", options_->input_jars.size());
+    fprintf(stderr, "%zu source manifests\n",
+            options_->source_manifests.size());
     fprintf(stderr, "%zu manifest lines\n", options_->manifest_lines.size());
   }
 
@@ -223,25 +253,16 @@ int OutputJar::Doit(Options *options) {
   // file, followed by the build properties file.
   WriteMetaInf();
   manifest_.Append("\r\n");
-  WriteEntry(manifest_.OutputEntry(compress));
+  WriteCombinedEntry(&manifest_, compress);
   if (!options_->exclude_build_data) {
-    WriteEntry(build_properties_.OutputEntry(compress));
+    WriteCombinedEntry(&build_properties_, compress);
   }
 
   // Then classpath resources.
   for (auto &classpath_resource : classpath_resources_) {
-    bool do_compress = compress;
-    if (do_compress && !options_->nocompress_suffixes.empty()) {
-      for (auto &suffix : options_->nocompress_suffixes) {
-        auto entry_name = classpath_resource->filename();
-        if (entry_name.length() >= suffix.size() &&
-            !entry_name.compare(entry_name.length() - suffix.size(),
-                                suffix.size(), suffix)) {
-          do_compress = false;
-          break;
-        }
-      }
-    }
+    const std::string &entry_name = classpath_resource->filename();
+    bool do_compress =
+        compress && !NoCompressSuffix(entry_name.c_str(), entry_name.size());
 
     // Add parent directory entries.
     size_t pos = classpath_resource->filename().find('/');
@@ -253,12 +274,19 @@ int OutputJar::Doit(Options *options) {
       pos = classpath_resource->filename().find('/', pos + 1);
     }
 
-    WriteEntry(classpath_resource->OutputEntry(do_compress));
+    WriteCombinedEntry(classpath_resource.get(), do_compress);
   }
 
-  // Then copy source files' contents.
+  // Then copy source files' contents. A source can also be a directory, or
+  // a manifest of files, which are added as if they had been zipped first.
   for (size_t ix = 0; ix < options_->input_jars.size(); ++ix) {
-    if (!AddJar(ix)) {
+    if (!(IsDirectory(options_->input_jars[ix].first) ? AddDirectory(ix)
+                                                       : AddJar(ix))) {
+      exit(1);
+    }
+  }
+  for (size_t ix = 0; ix < options_->source_manifests.size(); ++ix) {
+    if (!AddManifest(options_->input_jars.size() + ix)) {
       exit(1);
     }
   }
@@ -341,13 +369,16 @@ bool OutputJar::AddJar(int jar_path_index) {
   const std::string &input_jar_aux_label =
       options_->input_jars[jar_path_index].second;
 
+  RunReport::Input *input_stats = report_.StartInput(input_jar_path);
   InputJar input_jar;
   if (!input_jar.Open(input_jar_path)) {
+    report_.EndInput();
     return false;
   }
   const CDH *jar_entry;
   const LH *lh;
   while ((jar_entry = input_jar.NextEntry(&lh))) {
+    ++input_stats->entries;
     const char *file_name = jar_entry->file_name();
     auto file_name_length = jar_entry->file_name_length();
     if (!file_name_length) {
@@ -356,102 +387,12 @@ bool OutputJar::AddJar(int jar_path_index) {
           __FILE__, __LINE__, input_jar_path.c_str(),
           input_jar.CentralDirectoryRecordOffset(jar_entry));
     }
-    // Special files that cannot be handled by looking up known_members_ map:
-    // * ignore *.SF, *.RSA, *.DSA
-    //   (TODO(asmundak): should this be done only in META-INF?
-    //
-    if (ends_with(file_name, file_name_length, ".SF") ||
-        ends_with(file_name, file_name_length, ".RSA") ||
-        ends_with(file_name, file_name_length, ".DSA")) {
-      continue;
-    }
-
-    bool include_entry = true;
-    if (!options_->include_prefixes.empty()) {
-      for (auto &prefix : options_->include_prefixes) {
-        if ((include_entry =
-                 (prefix.size() <= file_name_length &&
-                  0 == strncmp(file_name, prefix.c_str(), prefix.size())))) {
-          break;
-        }
-      }
-    }
-    if (!include_entry) {
+    if (!ClaimEntry(input_jar_path, jar_path_index, &input_jar_aux_label,
+                    jar_entry, [lh]() { return lh; })) {
       continue;
     }
 
     bool is_file = (file_name[file_name_length - 1] != '/');
-    if (is_file &&
-        begins_with(file_name, file_name_length, "META-INF/services/")) {
-      // The contents of the META-INF/services/<SERVICE> on the output is the
-      // concatenation of the META-INF/services/<SERVICE> files from all inputs.
-      std::string service_path(file_name, file_name_length);
-      if (NewEntry(service_path)) {
-        // Create a concatenator and add it to the known_members_ map.
-        // The call to Merge() below will then take care of the rest.
-        Concatenator *service_handler = new Concatenator(service_path);
-        service_handlers_.emplace_back(service_handler);
-        known_members_.emplace(service_path, EntryInfo{service_handler});
-      }
-    } else {
-      ExtraHandler(input_jar_path, jar_entry, &input_jar_aux_label);
-    }
-
-    if (options_->check_desugar_deps &&
-        begins_with(file_name, file_name_length, "j$/")) {
-      diag_errx(1, "%s:%d: desugar_jdk_libs file %.*s unexpectedly found in %s",
-                __FILE__, __LINE__, file_name_length, file_name,
-                input_jar_path.c_str());
-    }
-
-    // Install a new entry unless it is already present. All the plain (non-dir)
-    // entries that require a combiner have been already installed, so the call
-    // will add either a directory entry whose handler will ignore subsequent
-    // duplicates, or an ordinary plain entry, for which we save the index of
-    // the first input jar (in order to provide diagnostics on duplicate).
-    auto got =
-        known_members_.emplace(std::string(file_name, file_name_length),
-                               EntryInfo{is_file ? nullptr : &null_combiner_,
-                                         is_file ? jar_path_index : -1});
-    if (!got.second) {
-      auto &entry_info = got.first->second;
-      // Handle special entries (the ones that have a combiner).
-      if (entry_info.combiner_ != nullptr) {
-        // TODO(kmb,asmundak): Should be checking Merge() return value but fails
-        // for build-data.properties when merging deploy jars into deploy jars.
-        entry_info.combiner_->Merge(jar_entry, lh);
-        continue;
-      }
-
-      // Plain file entry. If duplicates are not allowed, bail out. Otherwise
-      // just ignore this entry.
-      if (options_->no_duplicates ||
-          (options_->no_duplicate_classes &&
-           ends_with(file_name, file_name_length, ".class"))) {
-        diag_errx(
-            1, "%s:%d: %.*s is present both in %s and %s", __FILE__, __LINE__,
-            file_name_length, file_name,
-            options_->input_jars[entry_info.input_jar_index_].first.c_str(),
-            input_jar_path.c_str());
-      } else {
-        duplicate_entries_++;
-        continue;
-      }
-    }
-
-    // Add any missing parent directory entries (first) if requested.
-    if (options_->add_missing_directories) {
-      // Ignore very last character in case this entry is a directory itself.
-      for (size_t pos = 0; pos < file_name_length - 1; ++pos) {
-        if (file_name[pos] == '/') {
-          std::string dir(file_name, 0, pos + 1);
-          if (NewEntry(dir)) {
-            WriteDirEntry(dir, nullptr, 0);
-          }
-        }
-      }
-    }
-
     // For the file entries, decide whether output should be compressed.
     if (is_file) {
       bool input_compressed =
@@ -459,15 +400,8 @@ bool OutputJar::AddJar(int jar_path_index) {
       bool output_compressed =
           options_->force_compression ||
           (options_->preserve_compression && input_compressed);
-      if (output_compressed && !options_->nocompress_suffixes.empty()) {
-        for (auto &suffix : options_->nocompress_suffixes) {
-          if (file_name_length >= suffix.size() &&
-              !strncmp(file_name + file_name_length - suffix.size(),
-                       suffix.c_str(), suffix.size())) {
-            output_compressed = false;
-            break;
-          }
-        }
+      if (output_compressed && NoCompressSuffix(file_name, file_name_length)) {
+        output_compressed = false;
       }
       if (input_compressed != output_compressed) {
         Concatenator combiner(jar_entry->file_name_string());
@@ -475,7 +409,9 @@ bool OutputJar::AddJar(int jar_path_index) {
           diag_err(1, "%s:%d: cannot add %.*s", __FILE__, __LINE__,
                    jar_entry->file_name_length(), jar_entry->file_name());
         }
-        WriteEntry(combiner.OutputEntry(output_compressed));
+        WriteCombinedEntry(&combiner, output_compressed);
+        ++input_stats->recompressed_entries;
+        input_stats->recompressed_bytes += jar_entry->uncompressed_file_size();
         continue;
       }
     }
@@ -516,31 +452,53 @@ bool OutputJar::AddJar(int jar_path_index) {
                       jar_entry->last_mod_file_time() != normalized_time ||
                       lh_field_to_remove != nullptr;
     }
-    if (fix_timestamp) {
+    // Stored entries may have to be (re)aligned, which replaces the alignment
+    // extra field of the input, if any.
+    bool align = options_->align > 1 && is_file &&
+                 jar_entry->compression_method() == Z_NO_COMPRESSION;
+    if (fix_timestamp || align) {
       uint8_t lh_buffer[512];
       size_t lh_size = lh->size();
-      LH *lh_new = lh_size > sizeof(lh_buffer)
-                       ? reinterpret_cast<LH *>(malloc(lh_size))
+      size_t lh_capacity =
+          lh_size + (align ? options_->align + kMinAlignmentExtraFieldSize : 0);
+      LH *lh_new = lh_capacity > sizeof(lh_buffer)
+                       ? reinterpret_cast<LH *>(malloc(lh_capacity))
                        : reinterpret_cast<LH *>(lh_buffer);
-      // Remove Unix timestamp field.
-      if (lh_field_to_remove != nullptr) {
-        auto from_end = ziph::byte_ptr(lh) + lh->size();
-        size_t removed_size = lh_field_to_remove->size();
-        size_t chunk1_size =
-            ziph::byte_ptr(lh_field_to_remove) - ziph::byte_ptr(lh);
-        size_t chunk2_size = lh->size() - (chunk1_size + removed_size);
-        memcpy(lh_new, lh, chunk1_size);
-        if (chunk2_size) {
-          memcpy(reinterpret_cast<uint8_t *>(lh_new) + chunk1_size,
-                 from_end - chunk2_size, chunk2_size);
+      // Copy the local header without the extra fields that are replaced: the
+      // Unix timestamp field and the alignment field.
+      memcpy(lh_new, lh, sizeof(LH) + lh->file_name_length());
+      uint8_t *to = lh_new->extra_fields();
+      const uint8_t *from = lh->extra_fields();
+      const uint8_t *from_end = from + lh->extra_fields_length();
+      while (from < from_end) {
+        auto field = reinterpret_cast<const ExtraField *>(from);
+        if (from_end - from < static_cast<ptrdiff_t>(sizeof(ExtraField)) ||
+            from_end - from < field->size()) {
+          // Not a well-formed extra field (e.g. zero padding); keep the rest.
+          memcpy(to, from, from_end - from);
+          to += from_end - from;
+          break;
+        }
+        if (!(fix_timestamp && field->is_unix_time()) &&
+            !(align && field->is(kAlignmentExtraFieldTag))) {
+          memcpy(to, from, field->size());
+          to += field->size();
         }
+        from += field->size();
+      }
+      lh_new->extra_fields(lh_new->extra_fields(),
+                           to - lh_new->extra_fields());
+      uint16_t padding = align ? AlignmentPadding(lh_new->size()) : 0;
+      if (padding > 0 &&
+          lh_new->extra_fields_length() + padding <= UINT16_MAX) {
+        WriteAlignmentExtraField(to, padding, options_->align);
         lh_new->extra_fields(lh_new->extra_fields(),
-                             lh->extra_fields_length() - removed_size);
-      } else {
-        memcpy(lh_new, lh, lh_size);
+                             lh_new->extra_fields_length() + padding);
+      }
+      if (fix_timestamp) {
+        lh_new->last_mod_file_date(kDefaultDate);
+        lh_new->last_mod_file_time(normalized_time);
       }
-      lh_new->last_mod_file_date(kDefaultDate);
-      lh_new->last_mod_file_time(normalized_time);
       // Now write these few bytes and adjust read/write positions accordingly.
       if (!WriteBytes(lh_new, lh_new->size())) {
         diag_err(1, "%s:%d: Cannot copy modified local header for %.*s",
@@ -563,10 +521,301 @@ bool OutputJar::AddJar(int jar_path_index) {
     AppendToDirectoryBuffer(jar_entry, local_header_offset, normalized_time,
                             fix_timestamp);
     ++entries_;
+    ++input_stats->copied_entries;
+    input_stats->copied_bytes += Position() - local_header_offset;
   }
+  report_.EndInput();
   return input_jar.Close();
 }
 
+// Adds the files under the given directory, named by their paths relative to
+// it. Directories themselves are only added by --add_missing_directories.
+bool OutputJar::AddDirectory(int input_index) {
+  const std::string &dir_path = options_->input_jars[input_index].first;
+  std::string root(dir_path);
+  while (root.size() > 1 && (root.back() == '/' || root.back() == '\\')) {
+    root.pop_back();
+  }
+  std::vector<std::string> paths;
+  blaze_util::GetAllFilesUnder(root, &paths);
+  std::vector<std::pair<std::string, std::string> > files;
+  files.reserve(paths.size());
+  for (auto &path : paths) {
+    // Every path has the root and a separator as its prefix.
+    std::string name(path, root.size() + 1);
+    std::replace(name.begin(), name.end(), '\\', '/');
+    files.emplace_back(std::move(path), std::move(name));
+  }
+  return AddFiles(input_index, &options_->input_jars[input_index].second,
+                  &files);
+}
+
+// Adds the files listed in the given manifest. Each line of the manifest is
+// the path of a file, a tab, and the name of its entry.
+bool OutputJar::AddManifest(int input_index) {
+  const std::string &manifest_path = InputPath(input_index);
+  MappedFile mapped_file;
+  if (!mapped_file.Open(manifest_path)) {
+    diag_err(1, "%s:%d: Cannot read %s", __FILE__, __LINE__,
+             manifest_path.c_str());
+  }
+  std::vector<std::pair<std::string, std::string> > files;
+  const char *data = reinterpret_cast<const char *>(mapped_file.start());
+  const char *data_end = reinterpret_cast<const char *>(mapped_file.end());
+  while (data < data_end) {
+    const char *line_end = static_cast<const char *>(
+        memchr(data, '\n', data_end - data));
+    if (line_end == nullptr) {
+      line_end = data_end;
+    }
+    std::string line(data, line_end);
+    data = line_end + 1;
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty()) {
+      continue;
+    }
+    std::size_t tab = line.find('\t');
+    if (tab == std::string::npos || tab == 0 || tab + 1 == line.size()) {
+      diag_errx(1, "%s:%d: Bad line in %s, expected <path>TAB<name>: %s",
+                __FILE__, __LINE__, manifest_path.c_str(), line.c_str());
+    }
+    files.emplace_back(line.substr(0, tab), line.substr(tab + 1));
+  }
+  mapped_file.Close();
+  std::string no_label;
+  return AddFiles(input_index, &no_label, &files);
+}
+
+// Adds the given (path, entry name) pairs as the entries of one input. The
+// entries are added in the order of their names, so that the output does not
+// depend on the order in which the files were listed.
+bool OutputJar::AddFiles(
+    int input_index, const std::string *input_aux_label,
+    std::vector<std::pair<std::string, std::string> > *files) {
+  const std::string &input_path = InputPath(input_index);
+  std::sort(files->begin(), files->end(),
+            [](const std::pair<std::string, std::string> &a,
+               const std::pair<std::string, std::string> &b) {
+              return a.second < b.second;
+            });
+  RunReport::Input *input_stats = report_.StartInput(input_path);
+  for (auto &file : *files) {
+    const std::string &file_path = file.first;
+    const std::string &name = file.second;
+    if (IsDirectory(file_path)) {
+      continue;
+    }
+    if (name.empty() || name[0] == '/' || name.back() == '/' ||
+        name.size() > UINT16_MAX) {
+      diag_errx(1, "%s:%d: Bad entry name '%s' for %s in %s", __FILE__,
+                __LINE__, name.c_str(), file_path.c_str(), input_path.c_str());
+    }
+    ++input_stats->entries;
+    MappedFile mapped_file;
+    if (!mapped_file.Open(file_path)) {
+      diag_err(1, "%s:%d: Cannot read %s", __FILE__, __LINE__,
+               file_path.c_str());
+    }
+    const uint8_t *data = mapped_file.start();
+    const size_t size = mapped_file.size();
+    TODO(size < 0xFFFFFFFF, "Handle Zip64");
+    uint32_t crc = crc32(0, data, size);
+
+    // Describe the file as a stored Zip entry, for the filters and the
+    // combiners. Its Local Header is only needed for the combiners, which
+    // take the entry data right after the header.
+    std::vector<uint8_t> cdh_buffer(sizeof(CDH) + name.size());
+    CDH *cdh = reinterpret_cast<CDH *>(cdh_buffer.data());
+    cdh->signature();
+    cdh->version(20);
+    cdh->version_to_extract(20);
+    cdh->bit_flag(0x0);
+    cdh->compression_method(Z_NO_COMPRESSION);
+    cdh->last_mod_file_time(0);
+    cdh->last_mod_file_date(kDefaultDate);
+    cdh->crc32(crc);
+    cdh->compressed_file_size32(size);
+    cdh->uncompressed_file_size32(size);
+    cdh->file_name(name.c_str(), name.size());
+    cdh->extra_fields(nullptr, 0);
+    cdh->comment_length(0);
+    cdh->start_disk_nr(0);
+    cdh->internal_attributes(0);
+    cdh->external_attributes(0);
+    cdh->local_header_offset32(0);
+    std::vector<uint8_t> lh_buffer;
+    auto local_header = [&]() {
+      lh_buffer.resize(sizeof(LH) + name.size() + size);
+      LH *lh = reinterpret_cast<LH *>(lh_buffer.data());
+      lh->signature();
+      lh->version(20);
+      lh->bit_flag(0x0);
+      lh->compression_method(Z_NO_COMPRESSION);
+      lh->last_mod_file_time(0);
+      lh->last_mod_file_date(kDefaultDate);
+      lh->crc32(crc);
+      lh->compressed_file_size32(size);
+      lh->uncompressed_file_size32(size);
+      lh->file_name(name.c_str(), name.size());
+      lh->extra_fields(nullptr, 0);
+      memcpy(const_cast<uint8_t *>(lh->data()), data, size);
+      return static_cast<const LH *>(lh);
+    };
+    if (!ClaimEntry(input_path, input_index, input_aux_label, cdh,
+                    local_header)) {
+      continue;
+    }
+
+    // Compress the way classpath resources are compressed.
+    bool compress =
+        (options_->force_compression || options_->preserve_compression) &&
+        !NoCompressSuffix(name.c_str(), name.size());
+    off64_t local_header_offset = Position();
+    if (WriteFileEntry(name, data, size, crc, compress)) {
+      ++input_stats->recompressed_entries;
+      input_stats->recompressed_bytes += size;
+    } else {
+      ++input_stats->copied_entries;
+      input_stats->copied_bytes += Position() - local_header_offset;
+    }
+  }
+  report_.EndInput();
+  return true;
+}
+
+// Decides whether an entry of the given input is to be written to the output:
+// skips the entries that are filtered out, hands the entries that have a
+// combiner over to it, and handles duplicates. `local_header` returns the
+// Local Header of the entry, followed by its data; it is only called for the
+// entries that have a combiner. Returns true if the caller is to write the
+// entry.
+bool OutputJar::ClaimEntry(const std::string &input_path, int input_index,
+                           const std::string *input_aux_label, const CDH *entry,
+                           const std::function<const LH *()> &local_header) {
+  const char *file_name = entry->file_name();
+  auto file_name_length = entry->file_name_length();
+  // Special files that cannot be handled by looking up known_members_ map:
+  // * ignore *.SF, *.RSA, *.DSA
+  //   (TODO(asmundak): should this be done only in META-INF?
+  //
+  if (ends_with(file_name, file_name_length, ".SF") ||
+      ends_with(file_name, file_name_length, ".RSA") ||
+      ends_with(file_name, file_name_length, ".DSA")) {
+    return false;
+  }
+
+  bool include_entry = true;
+  if (!options_->include_prefixes.empty()) {
+    for (auto &prefix : options_->include_prefixes) {
+      if ((include_entry =
+               (prefix.size() <= file_name_length &&
+                0 == strncmp(file_name, prefix.c_str(), prefix.size())))) {
+        break;
+      }
+    }
+  }
+  if (!include_entry) {
+    return false;
+  }
+
+  bool is_file = (file_name[file_name_length - 1] != '/');
+  if (is_file &&
+      begins_with(file_name, file_name_length, "META-INF/services/")) {
+    // The contents of the META-INF/services/<SERVICE> on the output is the
+    // concatenation of the META-INF/services/<SERVICE> files from all inputs.
+    std::string service_path(file_name, file_name_length);
+    if (NewEntry(service_path)) {
+      // Create a concatenator and add it to the known_members_ map.
+      // The call to Merge() below will then take care of the rest.
+      Concatenator *service_handler = new Concatenator(service_path);
+      service_handlers_.emplace_back(service_handler);
+      known_members_.emplace(service_path, EntryInfo{service_handler});
+    }
+  } else {
+    ExtraHandler(input_path, entry, input_aux_label);
+  }
+
+  if (options_->check_desugar_deps &&
+      begins_with(file_name, file_name_length, "j$/")) {
+    diag_errx(1, "%s:%d: desugar_jdk_libs file %.*s unexpectedly found in %s",
+              __FILE__, __LINE__, file_name_length, file_name,
+              input_path.c_str());
+  }
+
+  // Install a new entry unless it is already present. All the plain (non-dir)
+  // entries that require a combiner have been already installed, so the call
+  // will add either a directory entry whose handler will ignore subsequent
+  // duplicates, or an ordinary plain entry, for which we save the index of
+  // the first input jar (in order to provide diagnostics on duplicate).
+  auto got =
+      known_members_.emplace(std::string(file_name, file_name_length),
+                             EntryInfo{is_file ? nullptr : &null_combiner_,
+                                       is_file ? input_index : -1});
+  if (!got.second) {
+    auto &entry_info = got.first->second;
+    // Handle special entries (the ones that have a combiner).
+    if (entry_info.combiner_ != nullptr) {
+      // TODO(kmb,asmundak): Should be checking Merge() return value but fails
+      // for build-data.properties when merging deploy jars into deploy jars.
+      entry_info.combiner_->Merge(entry, local_header());
+      if (entry_info.combiner_ == &null_combiner_) {
+        report_.DuplicateEntry(file_name, file_name_length);
+      } else {
+        report_.MergedEntry(got.first->first,
+                            entry->uncompressed_file_size());
+      }
+      return false;
+    }
+
+    // Plain file entry. If duplicates are not allowed, bail out. Otherwise
+    // just ignore this entry.
+    if (options_->no_duplicates ||
+        (options_->no_duplicate_classes &&
+         ends_with(file_name, file_name_length, ".class"))) {
+      diag_errx(1, "%s:%d: %.*s is present both in %s and %s", __FILE__,
+                __LINE__, file_name_length, file_name,
+                InputPath(entry_info.input_jar_index_).c_str(),
+                input_path.c_str());
+    } else {
+      duplicate_entries_++;
+      report_.DuplicateEntry(file_name, file_name_length);
+      return false;
+    }
+  }
+
+  // Add any missing parent directory entries (first) if requested.
+  if (options_->add_missing_directories) {
+    // Ignore very last character in case this entry is a directory itself.
+    for (size_t pos = 0; pos < file_name_length - 1; ++pos) {
+      if (file_name[pos] == '/') {
+        std::string dir(file_name, 0, pos + 1);
+        if (NewEntry(dir)) {
+          WriteDirEntry(dir, nullptr, 0);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+const std::string &OutputJar::InputPath(int input_index) const {
+  size_t ix = input_index;
+  return ix < options_->input_jars.size()
+             ? options_->input_jars[ix].first
+             : options_->source_manifests[ix - options_->input_jars.size()];
+}
+
+bool OutputJar::NoCompressSuffix(const char *name, size_t name_length) const {
+  for (auto &suffix : options_->nocompress_suffixes) {
+    if (ends_with(name, name_length, suffix.c_str())) {
+      return true;
+    }
+  }
+  return false;
+}
+
 off64_t OutputJar::Position() {
   if (file_ == nullptr) {
     diag_err(1, "%s:%d: output file is not open", __FILE__, __LINE__);
@@ -585,6 +834,47 @@ void OutputJar::WriteEntry(void *buffer) {
     return;
   }
   LH *entry = reinterpret_cast<LH *>(buffer);
+  WriteLocalHeader(entry);
+  if (!WriteBytes(entry->data(), entry->in_zip_size())) {
+    diag_err(1, "%s:%d: write", __FILE__, __LINE__);
+  }
+  free(buffer);
+}
+
+// Writes an entry created by the combiner. Unless the combiner only provides
+// a contiguous buffer, the data are streamed from the combiner's buffers,
+// which may be partially spilled to disk, so that huge entries are never
+// held in memory in full.
+void OutputJar::WriteCombinedEntry(Combiner *combiner, bool compress) {
+  const TransientBytes *payload;
+  LH *entry = combiner->OutputHeader(compress, &payload);
+  if (entry == nullptr) {
+    return;
+  }
+  // Entries recompressed by a temporary combiner are not combined entries.
+  std::string name(entry->file_name(), entry->file_name_length());
+  auto known_member = known_members_.find(name);
+  if (known_member != known_members_.end() &&
+      known_member->second.combiner_ == combiner) {
+    report_.CombinedEntry(name, entry->uncompressed_file_size(),
+                          entry->in_zip_size());
+  }
+  if (payload == nullptr) {
+    WriteEntry(entry);
+    return;
+  }
+  WriteLocalHeader(entry);
+  payload->stream_out([this](const void *chunk, uint64_t chunk_size) {
+    if (!WriteBytes(chunk, chunk_size)) {
+      diag_err(1, "%s:%d: write", __FILE__, __LINE__);
+    }
+  });
+  free(entry);
+}
+
+// Writes the Local Header of an entry, setting its timestamp and alignment,
+// and creates its Central Directory Header. The header is not freed.
+void OutputJar::WriteLocalHeader(LH *entry) {
   if (options_->verbose) {
     fprintf(stderr, "%-.*s combiner has %zu bytes, %s to %zu\n",
             entry->file_name_length(), entry->file_name(),
@@ -618,12 +908,32 @@ void OutputJar::WriteEntry(void *buffer) {
     entry->last_mod_file_date(dos_date);
   }
 
-  uint8_t *data = reinterpret_cast<uint8_t *>(entry);
   off64_t output_position = Position();
-  if (!WriteBytes(data, entry->data() + entry->in_zip_size() - data)) {
+  uint16_t padding = 0;
+  if (options_->align > 1 &&
+      entry->compression_method() == Z_NO_COMPRESSION &&
+      entry->uncompressed_file_size() > 0) {
+    padding = AlignmentPadding(entry->size());
+    if (entry->extra_fields_length() + padding > UINT16_MAX) {
+      padding = 0;
+    }
+  }
+  if (padding > 0) {
+    // Write a copy of the local header with the alignment field appended to
+    // its extra fields. The CDH does not get the padding.
+    std::vector<uint8_t> lh_buffer(entry->size() + padding);
+    memcpy(lh_buffer.data(), entry, entry->size());
+    WriteAlignmentExtraField(lh_buffer.data() + entry->size(), padding,
+                             options_->align);
+    LH *lh = reinterpret_cast<LH *>(lh_buffer.data());
+    lh->extra_fields(lh->extra_fields(), lh->extra_fields_length() + padding);
+    if (!WriteBytes(lh_buffer.data(), lh_buffer.size())) {
+      diag_err(1, "%s:%d: write", __FILE__, __LINE__);
+    }
+  } else if (!WriteBytes(entry, entry->size())) {
     diag_err(1, "%s:%d: write", __FILE__, __LINE__);
   }
-  // Data written, allocate CDH space and populate CDH.
+  // Header written, allocate CDH space and populate CDH.
   // Space needed for the CDH varies depending on whether output position field
   // fits into 32 bits (we do not handle compressed/uncompressed entry sizes
   // exceeding 32 bits at the moment).
@@ -668,7 +978,67 @@ void OutputJar::WriteEntry(void *buffer) {
   cdh->internal_attributes(0);
   cdh->external_attributes(0);
   ++entries_;
-  free(reinterpret_cast<void *>(entry));
+}
+
+// Writes an entry with the given data, which is deflated if `compress` is
+// true and that makes it smaller. Returns true if the data has been deflated.
+bool OutputJar::WriteFileEntry(const std::string &name, const uint8_t *data,
+                               size_t size, uint32_t crc, bool compress) {
+  const size_t lh_size = sizeof(LH) + name.size();
+  LH *lh = nullptr;
+  uint16_t method = Z_NO_COMPRESSION;
+  size_t compressed_size = size;
+  if (compress && size > 0) {
+    Deflater deflater;
+    size_t bound = deflateBound(&deflater, size);
+    lh = reinterpret_cast<LH *>(malloc(lh_size + bound));
+    if (lh == nullptr) {
+      diag_err(1, "%s:%d: malloc", __FILE__, __LINE__);
+    }
+    deflater.next_out = reinterpret_cast<uint8_t *>(lh) + lh_size;
+    deflater.avail_out = bound;
+    if (deflater.Deflate(data, size, Z_FINISH) == Z_STREAM_END &&
+        deflater.total_out < size) {
+      method = Z_DEFLATED;
+      compressed_size = deflater.total_out;
+    }
+  } else {
+    lh = reinterpret_cast<LH *>(malloc(lh_size));
+    if (lh == nullptr) {
+      diag_err(1, "%s:%d: malloc", __FILE__, __LINE__);
+    }
+  }
+  lh->signature();
+  lh->version(20);
+  lh->bit_flag(0x0);
+  lh->compression_method(method);
+  lh->crc32(crc);
+  lh->compressed_file_size32(compressed_size);
+  lh->uncompressed_file_size32(size);
+  lh->file_name(name.c_str(), name.size());
+  lh->extra_fields(nullptr, 0);
+  if (method == Z_DEFLATED) {
+    WriteEntry(lh);
+    return true;
+  }
+  // Stored data is written straight from the input.
+  WriteLocalHeader(lh);
+  if (!WriteBytes(data, size)) {
+    diag_err(1, "%s:%d: write", __FILE__, __LINE__);
+  }
+  free(lh);
+  return false;
+}
+
+uint16_t OutputJar::AlignmentPadding(size_t lh_size) {
+  const off64_t alignment = options_->align;
+  const off64_t misalignment = (Position() + lh_size) % alignment;
+  off64_t padding = misalignment ? alignment - misalignment : 0;
+  // An extra field cannot be smaller than kMinAlignmentExtraFieldSize.
+  while (padding > 0 && padding < kMinAlignmentExtraFieldSize) {
+    padding += alignment;
+  }
+  return padding;
 }
 
 void OutputJar::WriteMetaInf() {
@@ -836,16 +1206,26 @@ bool OutputJar::Close() {
   }
 
   for (auto &service_handler : service_handlers_) {
-    WriteEntry(service_handler->OutputEntry(options_->force_compression));
+    WriteCombinedEntry(service_handler.get(), options_->force_compression);
   }
   for (auto &extra_combiner : extra_combiners_) {
-    WriteEntry(extra_combiner->OutputEntry(options_->force_compression));
+    WriteCombinedEntry(extra_combiner.get(), options_->force_compression);
   }
-  WriteEntry(spring_handlers_.OutputEntry(options_->force_compression));
-  WriteEntry(spring_schemas_.OutputEntry(options_->force_compression));
-  WriteEntry(protobuf_meta_handler_.OutputEntry(options_->force_compression));
+  WriteCombinedEntry(&spring_handlers_, options_->force_compression);
+  WriteCombinedEntry(&spring_schemas_, options_->force_compression);
+  WriteCombinedEntry(&protobuf_meta_handler_, options_->force_compression);
   // TODO(asmundak): handle manifest;
   off64_t output_position = Position();
+  uint64_t uncompressed_size = 0;
+  uint64_t compressed_size = 0;
+  if (!options_->report.empty()) {
+    for (const uint8_t *p = cen_; p < cen_ + cen_size_;) {
+      const CDH *cdh = reinterpret_cast<const CDH *>(p);
+      uncompressed_size += cdh->uncompressed_file_size();
+      compressed_size += cdh->compressed_file_size();
+      p += cdh->size();
+    }
+  }
   bool write_zip64_ecd = output_position >= 0xFFFFFFFF || entries_ >= 0xFFFF ||
                          cen_size_ >= 0xFFFFFFFF;
 
@@ -903,6 +1283,14 @@ bool OutputJar::Close() {
     diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path());
   }
   file_ = nullptr;
+  if (!options_->report.empty()) {
+    report_.SetOutput(entries_, cen_size, outpos_, uncompressed_size,
+                      compressed_size);
+    if (!report_.Write(options_->report)) {
+      diag_err(1, "%s:%d: Cannot write %s", __FILE__, __LINE__,
+               options_->report.c_str());
+    }
+  }
   // Free the buffer only after fclose(); stdio may flush data from the
   // buffer on close.
   buffer_.reset();
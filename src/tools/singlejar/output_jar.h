@@ -19,9 +19,11 @@
 
 #include <cinttypes>
 #include <cstddef>
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 // Must be included before <io.h> (on Windows) and <fcntl.h>.
@@ -30,6 +32,7 @@
 
 #include "src/tools/singlejar/combiners.h"
 #include "src/tools/singlejar/options.h"
+#include "src/tools/singlejar/run_report.h"
 
 /*
  * Jar file we are writing.
@@ -74,10 +77,38 @@ class OutputJar {
   bool Open();
   // Add the contents of the given input jar.
   bool AddJar(int jar_path_index);
+  // Add the files under the given input directory.
+  bool AddDirectory(int input_index);
+  // Add the files listed in the given source manifest.
+  bool AddManifest(int input_index);
+  // Add the given (path, entry name) pairs as the entries of an input.
+  bool AddFiles(int input_index, const std::string *input_aux_label,
+                std::vector<std::pair<std::string, std::string> > *files);
+  // Decide whether an input entry is to be written to the output.
+  bool ClaimEntry(const std::string &input_path, int input_index,
+                  const std::string *input_aux_label, const CDH *entry,
+                  const std::function<const LH *()> &local_header);
+  // Returns the path of the input with the given index: the source jars and
+  // directories come first, followed by the source manifests.
+  const std::string &InputPath(int input_index) const;
+  // True if the entry name has one of the --nocompress_suffixes.
+  bool NoCompressSuffix(const char *name, size_t name_length) const;
   // Returns the current output position.
   off64_t Position();
   // Write Jar entry.
   void WriteEntry(void *local_header_and_payload);
+  // Write the entry created by the given combiner, streaming its payload.
+  void WriteCombinedEntry(Combiner *combiner, bool compress);
+  // Write an entry with the given data, deflating it if requested.
+  bool WriteFileEntry(const std::string &name, const uint8_t *data,
+                      size_t size, uint32_t crc, bool compress);
+  // Write the Local Header of an entry and add its Central Directory Header.
+  // The entry data is to be written right after.
+  void WriteLocalHeader(LH *local_header);
+  // Returns the size of the alignment extra field to add to a local header of
+  // `lh_size` bytes written at the current position so that the entry data
+  // starts at a multiple of options_->align, or 0 if none is needed.
+  uint16_t AlignmentPadding(size_t lh_size);
   // Write META_INF/ entry (the first entry on output).
   void WriteMetaInf();
   // Write a directory entry.
@@ -128,6 +159,7 @@ class OutputJar {
   std::vector<std::unique_ptr<Concatenator> > service_handlers_;
   std::vector<std::unique_ptr<Concatenator> > classpath_resources_;
   std::vector<std::unique_ptr<Combiner> > extra_combiners_;
+  RunReport report_;
 };
 
 #endif  //   SRC_TOOLS_SINGLEJAR_COMBINED_JAR_H_
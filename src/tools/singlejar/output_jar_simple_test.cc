@@ -412,6 +412,65 @@ TEST_F(OutputJarSimpleTest, ResourcesDirectories) {
   EXPECT_EQ(expected_entries, jar_entries);
 }
 
+// Directories in --sources.
+TEST_F(OutputJarSimpleTest, SourceDirectory) {
+  CreateTextFile("classes/b/B.class", "B");
+  CreateTextFile("classes/a/A.class", "A");
+  CreateTextFile("classes/META-INF/services/foo.Service", "foo.Impl1\n");
+  CreateTextFile("services/META-INF/services/foo.Service", "foo.Impl2\n");
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--exclude_build_data", "--normalize",
+                          "--compression", "--add_missing_directories",
+                          "--sources", OutputFilePath("classes"),
+                          OutputFilePath("services") + "/"});
+
+  // The files are added in the order of their names, with normalized
+  // timestamps, and the services are combined as usual.
+  std::vector<string> expected_entries(
+      {"META-INF/", "META-INF/MANIFEST.MF", "a/", "a/A.class", "b/",
+       "b/B.class", "META-INF/services/foo.Service"});
+  std::vector<string> jar_entries;
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(out_path));
+  const LH *lh;
+  const CDH *cdh;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    jar_entries.push_back(cdh->file_name_string());
+    EXPECT_EQ(30 << 9 | 1 << 5 | 1, cdh->last_mod_file_date());
+  }
+  input_jar.Close();
+  EXPECT_EQ(expected_entries, jar_entries);
+  EXPECT_EQ("A", GetEntryContents(out_path, "a/A.class"));
+  EXPECT_EQ("foo.Impl1\nfoo.Impl2\n",
+            GetEntryContents(out_path, "META-INF/services/foo.Service"));
+}
+
+// --source_manifests
+TEST_F(OutputJarSimpleTest, SourceManifests) {
+  string a_path = CreateTextFile("files/a.txt", "a\n");
+  string b_path = CreateTextFile("files/b.txt", "b\n");
+  string manifest_path = CreateTextFile(
+      "files.manifest",
+      (b_path + "\tthe/b.txt\n" + a_path + "\tthe/a.txt\n").c_str());
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--exclude_build_data", "--source_manifests",
+                          manifest_path});
+
+  std::vector<string> expected_entries(
+      {"META-INF/", "META-INF/MANIFEST.MF", "the/a.txt", "the/b.txt"});
+  std::vector<string> jar_entries;
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(out_path));
+  const LH *lh;
+  const CDH *cdh;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    jar_entries.push_back(cdh->file_name_string());
+  }
+  input_jar.Close();
+  EXPECT_EQ(expected_entries, jar_entries);
+  EXPECT_EQ("b\n", GetEntryContents(out_path, "the/b.txt"));
+}
+
 // --classpath_resources
 TEST_F(OutputJarSimpleTest, ClasspathResources) {
   string res1_path = OutputFilePath("cp_res");
@@ -790,6 +849,55 @@ TEST_F(OutputJarSimpleTest, DontChangeCompressionOption) {
   input_jar.Close();
 }
 
+// Test --align option: the data of each stored file entry starts at a
+// multiple of the alignment, both for the entries copied from the input jars
+// and for the ones singlejar creates. Compressed entries are not padded.
+TEST_F(OutputJarSimpleTest, Align) {
+  const int kAlignment = 64;
+  string res_path = CreateTextFile("resource.so", "line1\nline2\n");
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(
+      out_path,
+      {"--align", "64", "--dont_change_compression", "--sources",
+       runfiles->Rlocation("io_bazel/src/tools/singlejar/libtest1.jar"),
+       runfiles->Rlocation("io_bazel/src/tools/singlejar/stored.jar"),
+       "--resources", res_path, "--nocompress_suffixes", ".so"});
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(out_path));
+  const LH *lh;
+  const CDH *cdh;
+  int stored_files = 0;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    const uint8_t *alignment_field = nullptr;
+    for (auto field = reinterpret_cast<const ExtraField *>(lh->extra_fields());
+         ziph::byte_ptr(field) < lh->extra_fields() + lh->extra_fields_length();
+         field = field->next()) {
+      if (field->is(0xD935)) {
+        alignment_field = ziph::byte_ptr(field);
+      }
+    }
+    bool is_file = lh->file_name()[lh->file_name_length() - 1] != '/';
+    if (is_file && lh->compression_method() == Z_NO_COMPRESSION &&
+        lh->uncompressed_file_size() > 0) {
+      ++stored_files;
+      EXPECT_EQ(0, (lh->data() - input_jar.mapped_start()) % kAlignment)
+          << "Entry " << lh->file_name_string() << " is not aligned";
+    } else {
+      EXPECT_EQ(nullptr, alignment_field)
+          << "Entry " << lh->file_name_string() << " should not be padded";
+    }
+    // The padding is only in the local header.
+    EXPECT_EQ(nullptr, ExtraField::find(0xD935, cdh->extra_fields(),
+                                        cdh->extra_fields() +
+                                            cdh->extra_fields_length()))
+        << "Entry " << lh->file_name_string();
+  }
+  input_jar.Close();
+  // The manifest, build-data.properties, output_jar.cc from stored.jar and
+  // the resource.
+  EXPECT_LE(4, stored_files);
+}
+
 const char kBuildDataFile[] = "build-data.properties";
 
 // Test --exclude_build_data option when none of the source archives contain
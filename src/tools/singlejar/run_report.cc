@@ -0,0 +1,228 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/run_report.h"
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS 1
+#endif
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Appends `str` as a JSON string literal.
+void AppendJsonString(std::string *out, const std::string &str) {
+  out->push_back('"');
+  for (unsigned char c : str) {
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out->append(escaped);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+// Appends `"key": value,` for an integral value.
+void AppendField(std::string *out, const char *key, uint64_t value,
+                 bool last = false) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "\"%s\": %" PRIu64 "%s", key, value,
+           last ? "" : ", ");
+  out->append(buffer);
+}
+
+// Same, for a floating point value.
+void AppendField(std::string *out, const char *key, double value,
+                 bool last = false) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "\"%s\": %.6f%s", key, value,
+           last ? "" : ", ");
+  out->append(buffer);
+}
+
+}  // namespace
+
+RunReport::RunReport()
+    : start_time_(std::chrono::steady_clock::now()),
+      input_start_minor_faults_(0),
+      input_start_major_faults_(0),
+      duplicate_classes_(0),
+      duplicate_files_(0),
+      duplicate_directories_(0),
+      entries_(0),
+      cen_size_(0),
+      output_size_(0),
+      uncompressed_size_(0),
+      compressed_size_(0) {}
+
+RunReport::Input *RunReport::StartInput(const std::string &path) {
+  inputs_.emplace_back(path);
+  PageFaults(&input_start_minor_faults_, &input_start_major_faults_);
+  input_start_time_ = std::chrono::steady_clock::now();
+  return &inputs_.back();
+}
+
+void RunReport::EndInput() {
+  if (inputs_.empty()) {
+    return;
+  }
+  Input &input = inputs_.back();
+  input.seconds = SecondsSince(input_start_time_);
+  int64_t minor_faults, major_faults;
+  PageFaults(&minor_faults, &major_faults);
+  input.minor_page_faults = minor_faults - input_start_minor_faults_;
+  input.major_page_faults = major_faults - input_start_major_faults_;
+}
+
+void RunReport::MergedEntry(const std::string &name, uint64_t size) {
+  Combined &combined = combined_[name];
+  ++combined.merged_entries;
+  combined.merged_bytes += size;
+  if (!inputs_.empty()) {
+    ++inputs_.back().merged_entries;
+    inputs_.back().merged_bytes += size;
+  }
+}
+
+void RunReport::CombinedEntry(const std::string &name, uint64_t size,
+                              uint64_t compressed_size) {
+  Combined &combined = combined_[name];
+  combined.size = size;
+  combined.compressed_size = compressed_size;
+}
+
+void RunReport::DuplicateEntry(const char *name, size_t name_length) {
+  if (name_length > 0 && name[name_length - 1] == '/') {
+    ++duplicate_directories_;
+  } else if (name_length >= 6 &&
+             !strncmp(name + name_length - 6, ".class", 6)) {
+    ++duplicate_classes_;
+  } else {
+    ++duplicate_files_;
+  }
+  if (!inputs_.empty()) {
+    ++inputs_.back().duplicate_entries;
+  }
+}
+
+void RunReport::SetOutput(uint64_t entries, uint64_t cen_size,
+                          uint64_t output_size, uint64_t uncompressed_size,
+                          uint64_t compressed_size) {
+  entries_ = entries;
+  cen_size_ = cen_size;
+  output_size_ = output_size;
+  uncompressed_size_ = uncompressed_size;
+  compressed_size_ = compressed_size;
+}
+
+std::string RunReport::ToJson() const {
+  std::string out("{\n  \"output\": {");
+  AppendField(&out, "entries", entries_);
+  AppendField(&out, "cen_size", cen_size_);
+  AppendField(&out, "size", output_size_);
+  AppendField(&out, "uncompressed_size", uncompressed_size_);
+  AppendField(&out, "compressed_size", compressed_size_);
+  // The compressed size relative to the uncompressed one.
+  AppendField(&out, "compression_ratio",
+              uncompressed_size_ ? static_cast<double>(compressed_size_) /
+                                       uncompressed_size_
+                                 : 1.0);
+  AppendField(&out, "seconds", SecondsSince(start_time_), true);
+  out.append("},\n  \"duplicates\": {");
+  AppendField(&out, "classes", duplicate_classes_);
+  AppendField(&out, "files", duplicate_files_);
+  AppendField(&out, "directories", duplicate_directories_, true);
+  out.append("},\n  \"inputs\": [");
+  for (size_t i = 0; i < inputs_.size(); ++i) {
+    const Input &input = inputs_[i];
+    out.append(i ? ",\n    {\"path\": " : "\n    {\"path\": ");
+    AppendJsonString(&out, input.path);
+    out.append(", ");
+    AppendField(&out, "entries", input.entries);
+    AppendField(&out, "copied_entries", input.copied_entries);
+    AppendField(&out, "copied_bytes", input.copied_bytes);
+    AppendField(&out, "recompressed_entries", input.recompressed_entries);
+    AppendField(&out, "recompressed_bytes", input.recompressed_bytes);
+    AppendField(&out, "merged_entries", input.merged_entries);
+    AppendField(&out, "merged_bytes", input.merged_bytes);
+    AppendField(&out, "duplicate_entries", input.duplicate_entries);
+    AppendField(&out, "seconds", input.seconds);
+    AppendField(&out, "minor_page_faults", input.minor_page_faults);
+    AppendField(&out, "major_page_faults", input.major_page_faults, true);
+    out.append("}");
+  }
+  out.append(inputs_.empty() ? "],\n" : "\n  ],\n");
+  out.append("  \"combined_entries\": [");
+  bool first = true;
+  for (const auto &combined : combined_) {
+    out.append(first ? "\n    {\"name\": " : ",\n    {\"name\": ");
+    first = false;
+    AppendJsonString(&out, combined.first);
+    out.append(", ");
+    AppendField(&out, "merged_entries", combined.second.merged_entries);
+    AppendField(&out, "merged_bytes", combined.second.merged_bytes);
+    AppendField(&out, "size", combined.second.size);
+    AppendField(&out, "compressed_size", combined.second.compressed_size,
+                true);
+    out.append("}");
+  }
+  out.append(combined_.empty() ? "]\n}\n" : "\n  ]\n}\n");
+  return out;
+}
+
+bool RunReport::Write(const std::string &path) const {
+  FILE *fp = fopen(path.c_str(), "wb");
+  if (fp == nullptr) {
+    return false;
+  }
+  std::string json = ToJson();
+  bool ok = fwrite(json.data(), 1, json.size(), fp) == json.size();
+  return fclose(fp) == 0 && ok;
+}
+
+void RunReport::PageFaults(int64_t *minor, int64_t *major) {
+#ifdef _WIN32
+  // Not available on Windows.
+  *minor = 0;
+  *major = 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage)) {
+    *minor = 0;
+    *major = 0;
+    return;
+  }
+  *minor = usage.ru_minflt;
+  *major = usage.ru_majflt;
+#endif
+}
@@ -0,0 +1,131 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_TOOLS_SINGLEJAR_RUN_REPORT_H_
+#define SRC_TOOLS_SINGLEJAR_RUN_REPORT_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Statistics of a singlejar run, written out as JSON by --report. Per input
+ * jar, it records how its entries were handled, how long that took and how
+ * many page faults it caused. Per combined entry, it records how many input
+ * entries were merged into it and the resulting sizes.
+ */
+class RunReport {
+ public:
+  // How the entries of an input jar were handled.
+  struct Input {
+    explicit Input(const std::string &path)
+        : path(path),
+          entries(0),
+          copied_entries(0),
+          copied_bytes(0),
+          recompressed_entries(0),
+          recompressed_bytes(0),
+          merged_entries(0),
+          merged_bytes(0),
+          duplicate_entries(0),
+          seconds(0),
+          minor_page_faults(0),
+          major_page_faults(0) {}
+
+    std::string path;
+    // All the entries in the input's central directory.
+    uint64_t entries;
+    // Entries copied verbatim, and the number of bytes copied for them.
+    uint64_t copied_entries;
+    uint64_t copied_bytes;
+    // Entries inflated and/or deflated because of the compression options,
+    // and their uncompressed size.
+    uint64_t recompressed_entries;
+    uint64_t recompressed_bytes;
+    // Entries merged into a combined entry, and their uncompressed size.
+    uint64_t merged_entries;
+    uint64_t merged_bytes;
+    // Entries skipped because an entry with the same name is already present.
+    uint64_t duplicate_entries;
+    double seconds;
+    uint64_t minor_page_faults;
+    uint64_t major_page_faults;
+  };
+
+  RunReport();
+
+  // Starts recording the statistics of the given input jar, and returns
+  // them. The returned instance is valid until the next call.
+  Input *StartInput(const std::string &path);
+
+  // Stops timing the current input.
+  void EndInput();
+
+  // Records that an input entry of `size` uncompressed bytes has been merged
+  // into the combined entry `name`.
+  void MergedEntry(const std::string &name, uint64_t size);
+
+  // Records the sizes of a combined entry written to the output.
+  void CombinedEntry(const std::string &name, uint64_t size,
+                     uint64_t compressed_size);
+
+  // Records a duplicate entry of the current input. Duplicates are counted
+  // separately for classes, other files and directories.
+  void DuplicateEntry(const char *name, size_t name_length);
+
+  // Records the totals of the output jar. `uncompressed_size` and
+  // `compressed_size` are the sums of the respective sizes of all the entries.
+  void SetOutput(uint64_t entries, uint64_t cen_size, uint64_t output_size,
+                 uint64_t uncompressed_size, uint64_t compressed_size);
+
+  // Returns the report as a JSON object.
+  std::string ToJson() const;
+
+  // Writes the report to the given file. Returns false on failure.
+  bool Write(const std::string &path) const;
+
+ private:
+  struct Combined {
+    Combined()
+        : merged_entries(0), merged_bytes(0), size(0), compressed_size(0) {}
+    uint64_t merged_entries;
+    uint64_t merged_bytes;
+    uint64_t size;
+    uint64_t compressed_size;
+  };
+
+  // Returns the page fault counts of this process so far.
+  static void PageFaults(int64_t *minor, int64_t *major);
+
+  std::chrono::steady_clock::time_point start_time_;
+  std::chrono::steady_clock::time_point input_start_time_;
+  int64_t input_start_minor_faults_;
+  int64_t input_start_major_faults_;
+  std::vector<Input> inputs_;
+  std::map<std::string, Combined> combined_;
+  uint64_t duplicate_classes_;
+  uint64_t duplicate_files_;
+  uint64_t duplicate_directories_;
+  uint64_t entries_;
+  uint64_t cen_size_;
+  uint64_t output_size_;
+  uint64_t uncompressed_size_;
+  uint64_t compressed_size_;
+};
+
+#endif  // SRC_TOOLS_SINGLEJAR_RUN_REPORT_H_
@@ -0,0 +1,89 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/run_report.h"
+
+#include <string>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+bool Contains(const std::string &str, const std::string &substr) {
+  return str.find(substr) != std::string::npos;
+}
+
+TEST(RunReportTest, Empty) {
+  RunReport report;
+  std::string json = report.ToJson();
+  EXPECT_TRUE(Contains(json, "\"entries\": 0, \"cen_size\": 0")) << json;
+  EXPECT_TRUE(Contains(json, "\"compression_ratio\": 1.000000")) << json;
+  EXPECT_TRUE(Contains(json, "\"inputs\": [],\n")) << json;
+  EXPECT_TRUE(Contains(json, "\"combined_entries\": []\n}\n")) << json;
+}
+
+TEST(RunReportTest, Inputs) {
+  RunReport report;
+  RunReport::Input *input = report.StartInput("dir/a \"quoted\".jar");
+  input->entries = 5;
+  input->copied_entries = 2;
+  input->copied_bytes = 300;
+  report.MergedEntry("META-INF/services/foo", 10);
+  report.DuplicateEntry("dir/", 4);
+  report.DuplicateEntry("a/B.class", 9);
+  report.EndInput();
+
+  input = report.StartInput("b.jar");
+  input->recompressed_entries = 1;
+  input->recompressed_bytes = 1000;
+  report.MergedEntry("META-INF/services/foo", 20);
+  report.DuplicateEntry("a/res.txt", 9);
+  report.EndInput();
+
+  report.CombinedEntry("META-INF/services/foo", 30, 25);
+  report.SetOutput(7, 400, 2000, 4000, 1000);
+
+  std::string json = report.ToJson();
+  EXPECT_TRUE(
+      Contains(json,
+               "\"output\": {\"entries\": 7, \"cen_size\": 400, "
+               "\"size\": 2000, \"uncompressed_size\": 4000, "
+               "\"compressed_size\": 1000, \"compression_ratio\": 0.250000"))
+      << json;
+  EXPECT_TRUE(Contains(json,
+                       "\"duplicates\": {\"classes\": 1, \"files\": 1, "
+                       "\"directories\": 1}"))
+      << json;
+  EXPECT_TRUE(Contains(json,
+                       "{\"path\": \"dir/a \\\"quoted\\\".jar\", "
+                       "\"entries\": 5, \"copied_entries\": 2, "
+                       "\"copied_bytes\": 300, \"recompressed_entries\": 0, "
+                       "\"recompressed_bytes\": 0, \"merged_entries\": 1, "
+                       "\"merged_bytes\": 10, \"duplicate_entries\": 2, "))
+      << json;
+  EXPECT_TRUE(Contains(json,
+                       "{\"path\": \"b.jar\", \"entries\": 0, "
+                       "\"copied_entries\": 0, \"copied_bytes\": 0, "
+                       "\"recompressed_entries\": 1, "
+                       "\"recompressed_bytes\": 1000, \"merged_entries\": 1, "
+                       "\"merged_bytes\": 20, \"duplicate_entries\": 1, "))
+      << json;
+  EXPECT_TRUE(Contains(json,
+                       "{\"name\": \"META-INF/services/foo\", "
+                       "\"merged_entries\": 2, \"merged_bytes\": 30, "
+                       "\"size\": 30, \"compressed_size\": 25}"))
+      << json;
+}
+
+}  // namespace
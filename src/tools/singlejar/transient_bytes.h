@@ -19,11 +19,18 @@
 #endif
 
 #include <inttypes.h>
+#include <stdlib.h>
 #include <algorithm>
+#include <memory>
 #include <ostream>
+#include <string>
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "src/main/cpp/util/zip_headers.h"
 #include "src/tools/singlejar/diag.h"
-#include "src/tools/singlejar/zip_headers.h"
 #include "src/tools/singlejar/zlib_interface.h"
 
 /*
@@ -34,14 +41,24 @@
  * Use Append() to append a sequence of bytes or a string.
  * Use Write() to write out the contents, it will compress the entry if
  * necessary.
+ * Once the chunks held in memory would exceed the memory limit, they are
+ * spilled to an unlinked temporary file (in $TMPDIR or /tmp), so that huge
+ * combined entries do not have to fit in memory. Spilling is not supported
+ * on Windows, where all the chunks are kept in memory.
  */
 class TransientBytes {
  public:
-  TransientBytes()
+  // The default amount of memory an instance may use for its contents.
+  static const uint64_t kDefaultMemoryLimit = 64 << 20;
+
+  explicit TransientBytes(uint64_t memory_limit = kDefaultMemoryLimit)
       : allocated_(0),
         data_size_(0),
         first_block_(nullptr),
-        last_block_(nullptr) {}
+        last_block_(nullptr),
+        memory_limit_(memory_limit),
+        spill_fd_(-1),
+        spilled_size_(0) {}
 
   ~TransientBytes() {
     while (first_block_) {
@@ -50,6 +67,11 @@ class TransientBytes {
       delete block;
     }
     last_block_ = nullptr;
+#ifndef _WIN32
+    if (spill_fd_ >= 0) {
+      close(spill_fd_);
+    }
+#endif
   }
 
   // Appends raw bytes.
@@ -155,7 +177,7 @@ class TransientBytes {
   // bytes written and returns Z_DEFLATED if compression took place or
   // Z_NO_COMPRESSION otherwise.
   uint16_t CompressOut(uint8_t *buffer, uint32_t *checksum,
-                       uint64_t *bytes_written) {
+                       uint64_t *bytes_written) const {
     *checksum = 0;
     uint64_t to_compress = data_size();
     if (to_compress == 0) {
@@ -167,23 +189,16 @@ class TransientBytes {
     deflater.next_out = buffer;
     uint16_t compression_method = Z_DEFLATED;
 
-    // Feed data blocks to the deflater one by one, but break if the compressed
+    // Feed data chunks to the deflater one by one, but break if the compressed
     // size exceeds the original size.
-    for (auto data_block = first_block_;
-         data_block && compression_method != Z_NO_COMPRESSION;
-         data_block = data_block->next_block_) {
+    ForEachChunk([&](const uint8_t *chunk, uint64_t chunk_size) {
       // The compressed size should not exceed the original size less the number
       // of bytes already compressed. And, it should not exceed 4GB-1.
       deflater.avail_out = std::min(data_size() - deflater.total_out,
                                     static_cast<uint64_t>(0xFFFFFFFF));
-      // Out of the total number of bytes that remain to be compressed, we
-      // can compress no more than this block.
-      uint32_t chunk_size = static_cast<uint32_t>(std::min(
-          static_cast<uint64_t>(sizeof(data_block->data_)), to_compress));
-      *checksum = crc32(*checksum, data_block->data_, chunk_size);
-      deflater.avail_in = chunk_size;
+      *checksum = crc32(*checksum, chunk, chunk_size);
       to_compress -= chunk_size;
-      int ret = deflater.Deflate(data_block->data_, chunk_size,
+      int ret = deflater.Deflate(chunk, chunk_size,
                                  to_compress ? Z_NO_FLUSH : Z_FINISH);
       if (ret == Z_OK) {
         if (!deflater.avail_out) {
@@ -193,9 +208,9 @@ class TransientBytes {
           compression_method = Z_NO_COMPRESSION;
         }
       } else if (ret == Z_BUF_ERROR && !deflater.avail_in) {
-        // We ran out of data block, this is not a error.
+        // We ran out of data chunk, this is not a error.
       } else if (ret == Z_STREAM_END) {
-        if (data_block->next_block_ || to_compress) {
+        if (to_compress) {
           diag_errx(2,
                     "%s:%d: Internal error: deflate() call at the end, but "
                     "there is more data to compress!",
@@ -205,7 +220,8 @@ class TransientBytes {
         diag_errx(2, "%s:%d: deflate error %d(%s)", __FILE__, __LINE__, ret,
                   deflater.msg);
       }
-    }
+      return compression_method != Z_NO_COMPRESSION;
+    });
     if (compression_method != Z_NO_COMPRESSION) {
       *bytes_written = deflater.total_out;
       return compression_method;
@@ -217,40 +233,102 @@ class TransientBytes {
     return Z_NO_COMPRESSION;
   }
 
-  // Copies the bytes to the buffer and sets the checksum.
-  void CopyOut(uint8_t *buffer, uint32_t *checksum) {
-    uint64_t to_copy = data_size();
-    uint8_t *buffer_end = buffer + to_copy;
+  // Same, but appends the compressed bytes to `compressed', which is expected
+  // to be empty, rather than to a buffer that has to be large enough for them.
+  // Always sets the checksum of the whole contents. If compression does not
+  // help, returns Z_NO_COMPRESSION and leaves partially compressed data in
+  // `compressed', which should then be discarded.
+  uint16_t CompressOut(TransientBytes *compressed, uint32_t *checksum) const {
     *checksum = 0;
-    for (auto data_block = first_block_; data_block;
-         data_block = data_block->next_block_) {
-      size_t chunk_size =
-          std::min(static_cast<uint64_t>(sizeof(data_block->data_)), to_copy);
-      *checksum = crc32(*checksum, data_block->data_, chunk_size);
-      memcpy(buffer_end - to_copy, data_block->data_, chunk_size);
-      to_copy -= chunk_size;
+    uint64_t to_compress = data_size();
+    if (to_compress == 0) {
+      return Z_NO_COMPRESSION;
     }
+
+    Deflater deflater;
+    bool compression_helps = true;
+    ForEachChunk([&](const uint8_t *chunk, uint64_t chunk_size) {
+      *checksum = crc32(*checksum, chunk, chunk_size);
+      to_compress -= chunk_size;
+      if (!compression_helps) {
+        return true;
+      }
+      int flush = to_compress ? Z_NO_FLUSH : Z_FINISH;
+      deflater.next_in = const_cast<uint8_t *>(chunk);
+      deflater.avail_in = chunk_size;
+      for (;;) {
+        // As above, the compressed size should not reach the original size.
+        uint64_t space_left = data_size() - compressed->data_size();
+        if (space_left == 0) {
+          compression_helps = false;
+          break;
+        }
+        uint32_t available_out = static_cast<uint32_t>(std::min(
+            std::min(compressed->ensure_space(), space_left),
+            static_cast<uint64_t>(0xFFFFFFFF)));
+        deflater.next_out = compressed->append_position();
+        deflater.avail_out = available_out;
+        int ret = deflate(&deflater, flush);
+        compressed->advance(available_out - deflater.avail_out);
+        if (ret == Z_STREAM_END) {
+          if (to_compress) {
+            diag_errx(2,
+                      "%s:%d: Internal error: deflate() call at the end, but "
+                      "there is more data to compress!",
+                      __FILE__, __LINE__);
+          }
+          break;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+          diag_errx(2, "%s:%d: deflate error %d(%s)", __FILE__, __LINE__, ret,
+                    deflater.msg);
+        }
+        if (deflater.avail_out) {
+          // The deflater has consumed the chunk and is waiting for more.
+          break;
+        }
+      }
+      return true;
+    });
+    return compression_helps ? Z_DEFLATED : Z_NO_COMPRESSION;
+  }
+
+  // Copies the bytes to the buffer and sets the checksum.
+  void CopyOut(uint8_t *buffer, uint32_t *checksum) const {
+    *checksum = 0;
+    ForEachChunk([&](const uint8_t *chunk, uint64_t chunk_size) {
+      *checksum = crc32(*checksum, chunk, chunk_size);
+      memcpy(buffer, chunk, chunk_size);
+      buffer += chunk_size;
+      return true;
+    });
+  }
+
+  // Returns the checksum of the bytes.
+  uint32_t Checksum() const {
+    uint32_t checksum = 0;
+    ForEachChunk([&](const uint8_t *chunk, uint64_t chunk_size) {
+      checksum = crc32(checksum, chunk, chunk_size);
+      return true;
+    });
+    return checksum;
   }
 
   // Number of data bytes.
   uint64_t data_size() const { return data_size_; }
 
-  // This is mostly for testing: stream out contents to a Sink instance.
+  // Number of data bytes spilled to the temporary file.
+  uint64_t spilled_size() const { return spilled_size_; }
+
+  // Streams out contents to a Sink instance, chunk by chunk.
   // The class Sink has to have
   //     void operator()(const void *chunk, uint64_t chunk_size) const;
   //
   template <class Sink>
   void stream_out(const Sink &sink) const {
-    uint64_t to_copy = data_size();
-    for (auto data_block = first_block_; data_block;
-         data_block = data_block->next_block_) {
-      uint64_t chunk_size = sizeof(data_block->data_);
-      if (chunk_size > to_copy) {
-        chunk_size = to_copy;
-      }
-      sink.operator()(data_block->data_, chunk_size);
-      to_copy -= chunk_size;
-    }
+    ForEachChunk([&](const uint8_t *chunk, uint64_t chunk_size) {
+      sink.operator()(chunk, chunk_size);
+      return true;
+    });
   }
 
   uint8_t last_byte() const {
@@ -258,6 +336,11 @@ class TransientBytes {
       diag_errx(1, "%s:%d: last_char() cannot be called if buffer is empty",
                 __FILE__, __LINE__);
     }
+    if (data_size() == spilled_size_) {
+      uint8_t byte;
+      ReadSpilled(&byte, 1, spilled_size_ - 1);
+      return byte;
+    }
     if (free_size() >= sizeof(last_block_->data_)) {
       diag_errx(1, "%s:%d: internal error: the last data block is empty",
                 __FILE__, __LINE__);
@@ -268,7 +351,13 @@ class TransientBytes {
  private:
   // Ensures there is some space to write to, returns the amount available.
   uint64_t ensure_space() {
-    if (!free_size()) {
+    if (!free_size() && first_block_ &&
+        data_size_ - spilled_size_ + sizeof(first_block_->data_) >
+            memory_limit_ &&
+        Spill()) {
+      // The first block is reused after spilling, see Spill().
+      allocated_ += sizeof(first_block_->data_);
+    } else if (!free_size()) {
       auto *data_block = new DataBlock();
       if (last_block_) {
         last_block_->next_block_ = data_block;
@@ -306,6 +395,98 @@ class TransientBytes {
   // Returns the amount of free space.
   uint64_t free_size() const { return allocated_ - data_size_; }
 
+  // Calls f(chunk, chunk_size) for each consecutive non-empty chunk of the
+  // contents, the spilled ones first, until f returns false.
+  template <class F>
+  void ForEachChunk(const F &f) const {
+    uint64_t to_copy = data_size();
+    if (spilled_size_) {
+      std::unique_ptr<DataBlock> buffer(new DataBlock());
+      for (uint64_t offset = 0; offset < spilled_size_;) {
+        uint64_t chunk_size =
+            std::min(static_cast<uint64_t>(sizeof(buffer->data_)),
+                     spilled_size_ - offset);
+        ReadSpilled(buffer->data_, chunk_size, offset);
+        offset += chunk_size;
+        to_copy -= chunk_size;
+        if (!f(const_cast<const uint8_t *>(buffer->data_), chunk_size)) {
+          return;
+        }
+      }
+    }
+    for (auto data_block = first_block_; data_block && to_copy;
+         data_block = data_block->next_block_) {
+      uint64_t chunk_size =
+          std::min(static_cast<uint64_t>(sizeof(data_block->data_)), to_copy);
+      to_copy -= chunk_size;
+      if (!f(const_cast<const uint8_t *>(data_block->data_), chunk_size)) {
+        return;
+      }
+    }
+  }
+
+  // Appends the (full) blocks held in memory to the temporary file, then
+  // frees all of them but the first one, which is kept as the new last block.
+  // Returns false if the blocks cannot be spilled.
+  bool Spill() {
+#ifdef _WIN32
+    return false;
+#else
+    if (spill_fd_ < 0) {
+      const char *tmpdir = getenv("TMPDIR");
+      std::string path(tmpdir && *tmpdir ? tmpdir : "/tmp");
+      path += "/singlejar.XXXXXX";
+      spill_fd_ = mkstemp(&path[0]);
+      if (spill_fd_ < 0) {
+        diag_err(1, "%s:%d: cannot create %s", __FILE__, __LINE__,
+                 path.c_str());
+      }
+      unlink(path.c_str());
+    }
+    for (auto data_block = first_block_; data_block;
+         data_block = data_block->next_block_) {
+      const uint8_t *data = data_block->data_;
+      size_t to_write = sizeof(data_block->data_);
+      while (to_write > 0) {
+        ssize_t written = pwrite(spill_fd_, data, to_write, spilled_size_);
+        if (written <= 0) {
+          diag_err(1, "%s:%d: cannot spill %" PRIu64 " bytes", __FILE__,
+                   __LINE__, data_size_ - spilled_size_);
+        }
+        data += written;
+        to_write -= written;
+        spilled_size_ += written;
+      }
+    }
+    while (first_block_->next_block_) {
+      auto block = first_block_->next_block_;
+      first_block_->next_block_ = block->next_block_;
+      delete block;
+    }
+    last_block_ = first_block_;
+    return true;
+#endif
+  }
+
+  // Reads `count' spilled bytes starting at `offset'.
+  void ReadSpilled(uint8_t *buffer, uint64_t count, uint64_t offset) const {
+#ifdef _WIN32
+    diag_errx(2, "%s:%d: Internal error: nothing is spilled on Windows",
+              __FILE__, __LINE__);
+#else
+    while (count > 0) {
+      ssize_t n_read = pread(spill_fd_, buffer, count, offset);
+      if (n_read <= 0) {
+        diag_err(1, "%s:%d: cannot read back spilled bytes", __FILE__,
+                 __LINE__);
+      }
+      buffer += n_read;
+      count -= n_read;
+      offset += n_read;
+    }
+#endif
+  }
+
   // The bytes are kept in an linked list of the DataBlock instances.
   // TODO(asmundak): perhaps use mmap to allocate these?
   struct DataBlock {
@@ -319,6 +500,10 @@ class TransientBytes {
   uint64_t data_size_;
   struct DataBlock *first_block_;
   struct DataBlock *last_block_;
+  // The bytes beyond this limit are spilled to the file open as `spill_fd_'.
+  const uint64_t memory_limit_;
+  int spill_fd_;
+  uint64_t spilled_size_;
 };
 
 #endif  // SRC_TOOLS_SINGLEJAR_TRANSIENT_BYTES_H_
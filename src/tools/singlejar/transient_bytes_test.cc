@@ -342,4 +342,71 @@ TEST_F(TransientBytesTest, CopyOut) {
   ASSERT_EQ(0xE8B7BE43, crc32);
 }
 
+// Verify that the contents survive spilling to disk.
+TEST_F(TransientBytesTest, Spill) {
+  // With no memory allowed, every full block is spilled.
+  transient_bytes_.reset(new TransientBytes(0));
+  const int kIter = 10000;
+  const size_t size = strlen(kBytesSmall);
+  for (int i = 0; i < kIter; ++i) {
+    transient_bytes_->Append(kBytesSmall);
+  }
+  transient_bytes_->Append("!");
+  ASSERT_EQ(kIter * size + 1, transient_bytes_->data_size());
+  EXPECT_LT(0, transient_bytes_->spilled_size());
+  EXPECT_GT(transient_bytes_->data_size(), transient_bytes_->spilled_size());
+  EXPECT_EQ('!', transient_bytes_->last_byte());
+
+  std::ostringstream out;
+  out << *transient_bytes_;
+  std::string out_string = out.str();
+  ASSERT_EQ(transient_bytes_->data_size(), out_string.size());
+  for (size_t pos = 0; pos < kIter * size; pos += size) {
+    ASSERT_STREQ(kBytesSmall, out_string.substr(pos, size).c_str())
+        << (pos / size) << "-th chunk does not match";
+  }
+
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[out_string.size()]);
+  uint32_t crc32 = 0;
+  transient_bytes_->CopyOut(buffer.get(), &crc32);
+  EXPECT_EQ(0, memcmp(out_string.data(), buffer.get(), out_string.size()));
+  EXPECT_EQ(crc32, transient_bytes_->Checksum());
+}
+
+// Verify CompressOut into another TransientBytes instance.
+TEST_F(TransientBytesTest, CompressOutTransientBytes) {
+  transient_bytes_.reset(new TransientBytes(0));
+  for (int i = 0; i < 10000; ++i) {
+    transient_bytes_->Append(kBytesSmall);
+  }
+  TransientBytes compressed(0);
+  uint32_t checksum = 0;
+  ASSERT_EQ(Z_DEFLATED, transient_bytes_->CompressOut(&compressed, &checksum));
+  EXPECT_EQ(transient_bytes_->Checksum(), checksum);
+  EXPECT_LT(0, compressed.data_size());
+  EXPECT_GT(transient_bytes_->data_size(), compressed.data_size());
+
+  // Inflate it back.
+  std::ostringstream out;
+  out << compressed;
+  std::string deflated = out.str();
+  std::unique_ptr<uint8_t[]> inflated(
+      new uint8_t[transient_bytes_->data_size() + 1]);
+  Inflater inflater;
+  inflater.DataToInflate(reinterpret_cast<const uint8_t *>(deflated.data()),
+                         deflated.size());
+  ASSERT_EQ(Z_STREAM_END, inflater.Inflate(inflated.get(),
+                                           transient_bytes_->data_size() + 1));
+  ASSERT_EQ(transient_bytes_->data_size(), inflater.total_out());
+  EXPECT_EQ(checksum, crc32(0, inflated.get(), inflater.total_out()));
+
+  // Data that does not compress is not compressed.
+  TransientBytes incompressible;
+  incompressible.Append("a");
+  TransientBytes compressed_a;
+  ASSERT_EQ(Z_NO_COMPRESSION,
+            incompressible.CompressOut(&compressed_a, &checksum));
+  ASSERT_EQ(0xE8B7BE43, checksum);
+}
+
 }  // namespace
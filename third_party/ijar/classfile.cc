@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
 #include <set>
 #include <sstream>
 #include <string>
@@ -114,6 +115,7 @@ struct Constant;
 static std::vector<Constant*>        const_pool_in; // input constant pool
 static std::vector<Constant*>        const_pool_out; // output constant_pool
 static std::set<std::string>         used_class_names;
+static std::set<std::string>         referenced_class_names;
 static Constant *                    class_name;
 
 // Returns the Constant object, given an index into the input constant pool.
@@ -184,7 +186,8 @@ struct Constant {
 };
 
 // Extracts class names from a signature and puts them into the global
-// variable used_class_names.
+// variable used_class_names. The binary names of the class types it mentions
+// are also put into referenced_class_names.
 //
 // desc: the descriptor class names should be extracted from.
 // p: the position where the extraction should tart.
@@ -1335,8 +1338,21 @@ struct ClassFile : HasAttrs {
     // Constants do not need to be deleted; they are owned by the constant pool.
   }
 
+  // Fills used_class_names and referenced_class_names from the signatures
+  // and descriptors of the class and its members.
+  void ExtractAllClassNames();
+
+  // Adds the classes mentioned by ExtractAllClassNames() and by the class
+  // constants in `pool` to `names`, except for this class itself.
+  void ReferencedClasses(const std::vector<Constant *> &pool,
+                         std::set<std::string> *names);
+
   void WriteClass(u1 *&p);
 
+  // Writes the class again, with its fields and methods sorted by name and
+  // descriptor, to `out`. Must be called after WriteClass().
+  void WriteCanonicalClass(std::string *out);
+
   bool ReadConstantPool(const u1 *&p);
 
   bool IsExplicitlyKept();
@@ -1712,36 +1728,44 @@ void Expect(const std::string& desc, size_t* p, char expected) {
 // This parser is a bit more liberal than the spec, but this should be fine,
 // because it accepts all valid class files and croaks only on invalid ones.
 void ParseFromClassTypeSignature(const std::string& desc, size_t* p);
-void ParseSimpleClassTypeSignature(const std::string& desc, size_t* p);
-void ParseClassTypeSignatureSuffix(const std::string& desc, size_t* p);
-void ParseIdentifier(const std::string& desc, size_t* p);
+std::string ParseSimpleClassTypeSignature(const std::string& desc, size_t* p);
+void ParseClassTypeSignatureSuffix(const std::string& desc, size_t* p,
+                                   std::string* name);
+std::string ParseIdentifier(const std::string& desc, size_t* p);
 void ParseTypeArgumentsOpt(const std::string& desc, size_t* p);
 void ParseMethodDescriptor(const std::string& desc, size_t* p);
 
 void ParseClassTypeSignature(const std::string& desc, size_t* p) {
   Expect(desc, p, 'L');
-  ParseSimpleClassTypeSignature(desc, p);
-  ParseClassTypeSignatureSuffix(desc, p);
+  std::string name = ParseSimpleClassTypeSignature(desc, p);
+  ParseClassTypeSignatureSuffix(desc, p, &name);
   Expect(desc, p, ';');
+  referenced_class_names.insert(name);
 }
 
-void ParseSimpleClassTypeSignature(const std::string& desc, size_t* p) {
-  ParseIdentifier(desc, p);
+// Returns the identifier of the simple class type signature.
+std::string ParseSimpleClassTypeSignature(const std::string& desc, size_t* p) {
+  std::string id = ParseIdentifier(desc, p);
   ParseTypeArgumentsOpt(desc, p);
+  return id;
 }
 
-void ParseClassTypeSignatureSuffix(const std::string& desc, size_t* p) {
+// Appends the inner classes named by the suffix to the binary name in *name,
+// e.g. "Outer<TT;>.Inner" denotes Outer$Inner.
+void ParseClassTypeSignatureSuffix(const std::string& desc, size_t* p,
+                                   std::string* name) {
   while (desc[*p] == '.') {
     *p += 1;
-    ParseSimpleClassTypeSignature(desc, p);
+    *name += "$" + ParseSimpleClassTypeSignature(desc, p);
   }
 }
 
-void ParseIdentifier(const std::string& desc, size_t* p) {
+std::string ParseIdentifier(const std::string& desc, size_t* p) {
   size_t next = desc.find_first_of(SIGNATURE_NON_IDENTIFIER_CHARS, *p);
   std::string id = desc.substr(*p, next - *p);
   used_class_names.insert(id);
   *p = next;
+  return id;
 }
 
 void ParseTypeArgumentsOpt(const std::string& desc, size_t* p) {
@@ -1842,8 +1866,9 @@ void ExtractClassNames(const std::string& desc, size_t* p) {
   }
 }
 
-void ClassFile::WriteClass(u1 *&p) {
+void ClassFile::ExtractAllClassNames() {
   used_class_names.clear();
+  referenced_class_names.clear();
   std::vector<Member *> members;
   members.insert(members.end(), fields.begin(), fields.end());
   members.insert(members.end(), methods.begin(), methods.end());
@@ -1853,6 +1878,29 @@ void ClassFile::WriteClass(u1 *&p) {
     devtools_ijar::ExtractClassNames(member->descriptor->Display(), &idx);
     member->ExtractClassNames();
   }
+}
+
+void ClassFile::ReferencedClasses(const std::vector<Constant *> &pool,
+                                  std::set<std::string> *names) {
+  for (Constant *constant : pool) {
+    if (constant == NULL || constant->tag_ != CONSTANT_Class) {
+      continue;
+    }
+    std::string name = constant->Display();
+    if (name[0] == '[') {
+      // An array class; its element type, if any, is referenced.
+      size_t idx = 0;
+      devtools_ijar::ExtractClassNames(name, &idx);
+    } else {
+      referenced_class_names.insert(name);
+    }
+  }
+  referenced_class_names.erase(this_class->Display());
+  names->insert(referenced_class_names.begin(), referenced_class_names.end());
+}
+
+void ClassFile::WriteClass(u1 *&p) {
+  ExtractAllClassNames();
 
   // We have to write the body out before the header in order to reference
   // the essential constants and populate the output constant pool:
@@ -1866,7 +1914,38 @@ void ClassFile::WriteClass(u1 *&p) {
   delete[] body;
 }
 
-bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length) {
+static bool MemberLess(Member *a, Member *b) {
+  int names = a->name->Display().compare(b->name->Display());
+  if (names != 0) {
+    return names < 0;
+  }
+  return a->descriptor->Display() < b->descriptor->Display();
+}
+
+void ClassFile::WriteCanonicalClass(std::string *out) {
+  // Start over with an empty output constant pool; it is filled in the order
+  // in which the (now sorted) members refer to constants.
+  for (Constant *constant : const_pool_in) {
+    if (constant != NULL) {
+      constant->slot_ = 0;
+    }
+  }
+  const_pool_out.clear();
+  const_pool_out.push_back(NULL);
+  std::stable_sort(fields.begin(), fields.end(), MemberLess);
+  std::stable_sort(methods.begin(), methods.end(), MemberLess);
+
+  u1 *buf = new u1[length];
+  u1 *p = buf;
+  WriteClass(p);
+  out->assign(reinterpret_cast<char *>(buf), p - buf);
+  delete[] buf;
+}
+
+bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length,
+                std::string *defined_class,
+                std::set<std::string> *referenced_classes,
+                std::string *canonical_class) {
   ClassFile *clazz = ReadClass(classdata_in, in_length);
   bool keep = true;
   if (clazz == NULL || clazz->IsExplicitlyKept()) {
@@ -1874,14 +1953,38 @@ bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length) {
     // TODO: If kept, only emit methods marked with KeepForCompile attribute,
     // as opposed to the entire type.
     put_n(classdata_out, classdata_in, in_length);
+    if (clazz != NULL && defined_class != NULL) {
+      *defined_class = clazz->this_class->Display();
+    }
+    if (clazz != NULL && referenced_classes != NULL) {
+      // The whole constant pool is kept, and so is everything it refers to.
+      clazz->ExtractAllClassNames();
+      clazz->ReferencedClasses(const_pool_in, referenced_classes);
+    }
+    if (canonical_class != NULL) {
+      canonical_class->assign(reinterpret_cast<const char *>(classdata_in),
+                              in_length);
+    }
+    delete clazz;
   } else if (clazz->IsLocalOrAnonymous()) {
     keep = false;
+    delete clazz;
   } else {
     // Constant pool item zero is a dummy entry.  Setting it marks the
     // beginning of the output phase; calls to Constant::slot() will
     // fail if called prior to this.
     const_pool_out.push_back(NULL);
     clazz->WriteClass(classdata_out);
+    if (defined_class != NULL) {
+      *defined_class = clazz->this_class->Display();
+    }
+    if (referenced_classes != NULL) {
+      clazz->ReferencedClasses(const_pool_out, referenced_classes);
+    }
+    if (canonical_class != NULL) {
+      // Reordering members in the source does not change the interface.
+      clazz->WriteCanonicalClass(canonical_class);
+    }
 
     delete clazz;
   }
@@ -20,8 +20,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <map>
 #include <memory>
+#include <set>
+#include <string>
 
+#include "src/main/cpp/util/md5.h"
 #include "third_party/ijar/zip.h"
 
 namespace devtools_ijar {
@@ -31,13 +35,25 @@ bool verbose = false;
 // Reads a JVM class from classdata_in (of the specified length), and
 // writes out a simplified class to classdata_out, advancing the
 // pointer. Returns true if the class should be kept.
-bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length);
+//
+// If the class is kept, also fills in the optional outputs that are not NULL:
+// defined_class is set to the name of the class, the classes its interface
+// refers to are added to referenced_classes, and canonical_class is set to a
+// serialization of the interface that does not depend on the order of its
+// members. Names are in internal form, e.g. "java/lang/String".
+bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length,
+                std::string *defined_class,
+                std::set<std::string> *referenced_classes,
+                std::string *canonical_class);
 
 const char *CLASS_EXTENSION = ".class";
 const size_t CLASS_EXTENSION_LENGTH = strlen(CLASS_EXTENSION);
 const char *KOTLIN_MODULE_EXTENSION = ".kotlin_module";
 const size_t KOTLIN_MODULE_EXTENSION_LENGTH = strlen(KOTLIN_MODULE_EXTENSION);
 
+const char *DUMMY_FILE = "dummy";
+const size_t DUMMY_FILE_LENGTH = strlen(DUMMY_FILE);
+
 const char *MANIFEST_DIR_PATH = "META-INF/";
 const size_t MANIFEST_DIR_PATH_LENGTH = strlen(MANIFEST_DIR_PATH);
 const char *MANIFEST_PATH = "META-INF/MANIFEST.MF";
@@ -53,18 +69,159 @@ const size_t TARGET_LABEL_KEY_LENGTH = strlen(TARGET_LABEL_KEY);
 const char *INJECTING_RULE_KIND_KEY = "Injecting-Rule-Kind: ";
 const size_t INJECTING_RULE_KIND_KEY_LENGTH = strlen(INJECTING_RULE_KIND_KEY);
 
+// The classes defined by an interface jar, the classes outside of it that
+// their interfaces refer to, and fingerprints of their interfaces.
+//
+// The class index (--class_index) is written in the following format, with
+// all integers in little-endian order:
+//
+//   u4 magic ("IJCI")
+//   u4 version (1)
+//   u4 defined_count     followed by that many names
+//   u4 referenced_count  followed by that many names
+//
+// Each name is a u2 length followed by the class name in internal form, as it
+// appears in the class file (modified UTF-8). Both lists are sorted.
+//
+// The ABI manifest (--abi_manifest) is a text file with one line per defined
+// class, sorted by name:
+//
+//   <class name> <hex MD5 of the canonical interface class>
+//
+// The fingerprint of a class changes iff its interface does, so tools can
+// recompile only the dependents of the classes that changed.
+class ClassIndex {
+ public:
+  explicit ClassIndex(bool fingerprint) : fingerprint_(fingerprint) {}
+
+  // Strips the class to record its interface, e.g. for classes that are
+  // copied to the interface jar unchanged.
+  void AddClass(const u1 *data, size_t size) {
+    std::string defined_class;
+    std::string canonical_class;
+    u1 *buf = reinterpret_cast<u1 *>(malloc(size));
+    u1 *p = buf;
+    if (StripClass(p, data, size, &defined_class, &referenced_,
+                   canonical_class_ptr(&canonical_class))) {
+      AddDefinedClass(defined_class, canonical_class);
+    }
+    free(buf);
+  }
+
+  // Records a class stripped by StripClass() with the given outputs.
+  void AddDefinedClass(const std::string &name,
+                       const std::string &canonical_class);
+
+  std::set<std::string> *referenced() { return &referenced_; }
+
+  // Returns `canonical_class` if fingerprints are needed, NULL otherwise, for
+  // passing to StripClass().
+  std::string *canonical_class_ptr(std::string *canonical_class) const {
+    return fingerprint_ ? canonical_class : NULL;
+  }
+
+  // Write the index and the ABI manifest to `path`. Return false on I/O
+  // errors.
+  bool WriteIndex(const char *path) const;
+  bool WriteAbiManifest(const char *path) const;
+
+ private:
+  static void PutNames(std::string *out, const std::set<std::string> &names);
+
+  const bool fingerprint_;
+  // Class name -> hex MD5 of its canonical interface, or "" if !fingerprint_.
+  std::map<std::string, std::string> defined_;
+  std::set<std::string> referenced_;
+};
+
+void ClassIndex::AddDefinedClass(const std::string &name,
+                                 const std::string &canonical_class) {
+  if (name.empty()) {
+    return;
+  }
+  std::string &fingerprint = defined_[name];
+  if (fingerprint_) {
+    blaze_util::Md5Digest digest;
+    digest.Update(canonical_class.data(), canonical_class.size());
+    unsigned char unused[blaze_util::Md5Digest::kDigestLength];
+    digest.Finish(unused);
+    fingerprint = digest.String();
+  }
+}
+
+void ClassIndex::PutNames(std::string *out,
+                          const std::set<std::string> &names) {
+  u1 count[4];
+  u1 *p = count;
+  put_u4le(p, names.size());
+  out->append(reinterpret_cast<const char *>(count), sizeof(count));
+  for (const std::string &name : names) {
+    u1 length[2];
+    p = length;
+    put_u2le(p, name.size());
+    out->append(reinterpret_cast<const char *>(length), sizeof(length));
+    out->append(name);
+  }
+}
+
+static bool WriteFile(const char *path, const std::string &contents) {
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL) {
+    return false;
+  }
+  bool ok = fwrite(contents.data(), 1, contents.size(), fp) == contents.size();
+  return fclose(fp) == 0 && ok;
+}
+
+bool ClassIndex::WriteIndex(const char *path) const {
+  std::string out("IJCI");
+  u1 version[4];
+  u1 *p = version;
+  put_u4le(p, 1);
+  out.append(reinterpret_cast<const char *>(version), sizeof(version));
+
+  std::set<std::string> defined;
+  for (const auto &entry : defined_) {
+    defined.insert(defined.end(), entry.first);
+  }
+  std::set<std::string> external;
+  for (const std::string &name : referenced_) {
+    if (defined_.count(name) == 0) {
+      external.insert(external.end(), name);
+    }
+  }
+  PutNames(&out, defined);
+  PutNames(&out, external);
+  return WriteFile(path, out);
+}
+
+bool ClassIndex::WriteAbiManifest(const char *path) const {
+  std::string out;
+  for (const auto &entry : defined_) {
+    out += entry.first + " " + entry.second + "\n";
+  }
+  return WriteFile(path, out);
+}
+
 class JarExtractorProcessor : public ZipExtractorProcessor {
  public:
+  JarExtractorProcessor() : builder_(NULL), class_index_(NULL) {}
+
   // Set the ZipBuilder to add the ijar class to the output zip file.
   // This pointer should not be deleted while this class is still in use and
   // it should be set before any call to the Process() method.
   void SetZipBuilder(ZipBuilder *builder) { this->builder_ = builder; }
+  // Set the ClassIndex to record the processed classes in, or NULL. The same
+  // restrictions as for SetZipBuilder() apply.
+  void SetClassIndex(ClassIndex *index) { this->class_index_ = index; }
   virtual void WriteManifest(const char *target_label,
                              const char *injecting_rule_kind) = 0;
 
  protected:
   // Not owned by JarStripperProcessor, see SetZipBuilder().
   ZipBuilder *builder_;
+  // Not owned, see SetClassIndex().
+  ClassIndex *class_index_;
 };
 
 // ZipExtractorProcessor that select only .class file and use
@@ -136,10 +293,22 @@ void JarStripperProcessor::Process(const char *filename, const u4 /*attr*/,
   } else {
     u1 *buf = reinterpret_cast<u1 *>(malloc(size));
     u1 *classdata_out = buf;
-    if (!StripClass(buf, data, size)) {
+    std::string defined_class;
+    std::set<std::string> *referenced_classes = NULL;
+    std::string canonical_class;
+    std::string *canonical_class_ptr = NULL;
+    if (class_index_ != NULL) {
+      referenced_classes = class_index_->referenced();
+      canonical_class_ptr = class_index_->canonical_class_ptr(&canonical_class);
+    }
+    if (!StripClass(buf, data, size, &defined_class, referenced_classes,
+                    canonical_class_ptr)) {
       free(classdata_out);
       return;
     }
+    if (class_index_ != NULL) {
+      class_index_->AddDefinedClass(defined_class, canonical_class);
+    }
     u1 *q = builder_->NewFile(filename, 0);
     size_t out_length = buf - classdata_out;
     memcpy(q, classdata_out, out_length);
@@ -187,7 +356,8 @@ void JarStripperProcessor::WriteManifest(const char *target_label,
 
 class JarCopierProcessor : public JarExtractorProcessor {
  public:
-  JarCopierProcessor(const char *jar) : jar_(jar) {}
+  JarCopierProcessor(const char *jar, bool jar_is_manifest)
+      : jar_(jar), jar_is_manifest_(jar_is_manifest) {}
   virtual ~JarCopierProcessor() {}
 
   virtual void Process(const char *filename, const u4 /*attr*/, const u1 *data,
@@ -219,6 +389,8 @@ class JarCopierProcessor : public JarExtractorProcessor {
   };
 
   const char *jar_;
+  // Whether jar_ is a manifest of files rather than a jar or a directory.
+  bool jar_is_manifest_;
 
   u1 *AppendTargetLabelToManifest(u1 *buf, const u1 *manifest_data,
                                   const size_t size, const char *target_label,
@@ -235,6 +407,12 @@ void JarCopierProcessor::Process(const char *filename, const u4 /*attr*/,
       strcmp(filename, MANIFEST_PATH) == 0) {
     return;
   }
+  if (class_index_ != NULL && !IsModuleInfo(filename) &&
+      EndsWith(filename, strlen(filename), CLASS_EXTENSION,
+               CLASS_EXTENSION_LENGTH)) {
+    // The class is copied as is, but the index describes its interface.
+    class_index_->AddClass(data, size);
+  }
   u1 *q = builder_->NewFile(filename, 0);
   memcpy(q, data, size);
   builder_->FinishFile(size, /* compress: */ false, /* compute_crc: */ true);
@@ -248,7 +426,9 @@ void JarCopierProcessor::WriteManifest(const char *target_label,
                                        const char *injecting_rule_kind) {
   ManifestLocator manifest_locator;
   std::unique_ptr<ZipExtractor> in(
-      ZipExtractor::Create(jar_, &manifest_locator));
+      jar_is_manifest_
+          ? ZipExtractor::CreateFromManifest(jar_, &manifest_locator)
+          : ZipExtractor::Create(jar_, &manifest_locator));
   in->ProcessAll();
 
   bool wants_manifest =
@@ -339,29 +519,42 @@ static size_t EstimateManifestOutputSize(const char *target_label,
   return length;
 }
 
-// Opens "file_in" (a .jar file) for reading, and writes an interface
-// .jar to "file_out".
+// Opens "file_in" (a .jar file, a directory, or a manifest of files if
+// "file_in_is_manifest" is true) for reading, and writes an interface .jar to
+// "file_out".
+// If "class_index" or "abi_manifest" are not NULL, also writes the index of
+// the classes in the interface .jar, respectively the fingerprints of their
+// interfaces, to them.
 static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
-                                   bool strip_jar, const char *target_label,
-                                   const char *injecting_rule_kind) {
+                                   bool file_in_is_manifest, bool strip_jar,
+                                   const char *target_label,
+                                   const char *injecting_rule_kind,
+                                   const char *class_index,
+                                   const char *abi_manifest) {
   std::unique_ptr<JarExtractorProcessor> processor;
   if (strip_jar) {
     processor =
         std::unique_ptr<JarExtractorProcessor>(new JarStripperProcessor());
   } else {
-    processor =
-        std::unique_ptr<JarExtractorProcessor>(new JarCopierProcessor(file_in));
+    processor = std::unique_ptr<JarExtractorProcessor>(
+        new JarCopierProcessor(file_in, file_in_is_manifest));
   }
   std::unique_ptr<ZipExtractor> in(
-      ZipExtractor::Create(file_in, processor.get()));
+      file_in_is_manifest
+          ? ZipExtractor::CreateFromManifest(file_in, processor.get())
+          : ZipExtractor::Create(file_in, processor.get()));
   if (in == NULL) {
-    fprintf(stderr, "Unable to open Zip file %s: %s\n", file_in,
+    fprintf(stderr, "Unable to open %s %s: %s\n",
+            file_in_is_manifest ? "manifest" : "Zip file", file_in,
             strerror(errno));
     abort();
   }
   u8 output_length =
       in->CalculateOutputLength() +
-      EstimateManifestOutputSize(target_label, injecting_rule_kind);
+      EstimateManifestOutputSize(target_label, injecting_rule_kind) +
+      // The "dummy" entry added to empty jars below, with its Zip metadata.
+      // Inputs other than Zip files have no skipped entries to make up for it.
+      DUMMY_FILE_LENGTH * 2 + 100;
   std::unique_ptr<ZipBuilder> out(ZipBuilder::Create(file_out, output_length));
   if (out == NULL) {
     fprintf(stderr, "Unable to open output file %s: %s\n", file_out,
@@ -369,6 +562,10 @@ static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
     abort();
   }
   processor->SetZipBuilder(out.get());
+  ClassIndex index(abi_manifest != NULL);
+  if (class_index != NULL || abi_manifest != NULL) {
+    processor->SetClassIndex(&index);
+  }
   processor->WriteManifest(target_label, injecting_rule_kind);
 
   // Process all files in the zip
@@ -379,13 +576,23 @@ static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
 
   // Add dummy file, since javac doesn't like truly empty jars.
   if (out->GetNumberFiles() == 0) {
-    out->WriteEmptyFile("dummy");
+    out->WriteEmptyFile(DUMMY_FILE);
   }
   // Finish writing the output file
   if (out->Finish() < 0) {
     fprintf(stderr, "%s\n", out->GetError());
     abort();
   }
+  if (class_index != NULL && !index.WriteIndex(class_index)) {
+    fprintf(stderr, "Unable to write class index %s: %s\n", class_index,
+            strerror(errno));
+    abort();
+  }
+  if (abi_manifest != NULL && !index.WriteAbiManifest(abi_manifest)) {
+    fprintf(stderr, "Unable to write ABI manifest %s: %s\n", abi_manifest,
+            strerror(errno));
+    abort();
+  }
   // Get all file size
   size_t in_length = in->GetSize();
   size_t out_length = out->GetSize();
@@ -404,8 +611,16 @@ static void usage() {
           "Usage: ijar "
           "[-v] [--[no]strip_jar] "
           "[--target label label] [--injecting_rule_kind kind] "
-          "x.jar [x_interface.jar>]\n");
+          "[--class_index index] [--abi_manifest manifest] "
+          "{x.jar | dir | --input_manifest files} [x_interface.jar>]\n");
   fprintf(stderr, "Creates an interface jar from the specified jar file.\n");
+  fprintf(stderr,
+          "The input can also be a directory of classes, or a manifest "
+          "listing one\n<path>TAB<entry name> pair per line.\n");
+  fprintf(stderr,
+          "With --class_index, also writes the classes it defines and the "
+          "classes\noutside of it that they refer to. With --abi_manifest, "
+          "also writes a\nfingerprint of the interface of each class.\n");
   exit(1);
 }
 
@@ -413,8 +628,11 @@ int main(int argc, char **argv) {
   bool strip_jar = true;
   const char *target_label = NULL;
   const char *injecting_rule_kind = NULL;
+  const char *class_index = NULL;
+  const char *abi_manifest = NULL;
   const char *filename_in = NULL;
   const char *filename_out = NULL;
+  bool filename_in_is_manifest = false;
 
   for (int ii = 1; ii < argc; ++ii) {
     if (strcmp(argv[ii], "-v") == 0) {
@@ -433,6 +651,22 @@ int main(int argc, char **argv) {
         usage();
       }
       injecting_rule_kind = argv[ii];
+    } else if (strcmp(argv[ii], "--class_index") == 0) {
+      if (++ii >= argc) {
+        usage();
+      }
+      class_index = argv[ii];
+    } else if (strcmp(argv[ii], "--abi_manifest") == 0) {
+      if (++ii >= argc) {
+        usage();
+      }
+      abi_manifest = argv[ii];
+    } else if (strcmp(argv[ii], "--input_manifest") == 0) {
+      if (++ii >= argc || filename_in != NULL) {
+        usage();
+      }
+      filename_in = argv[ii];
+      filename_in_is_manifest = true;
     } else if (filename_in == NULL) {
       filename_in = argv[ii];
     } else if (filename_out == NULL) {
@@ -466,7 +700,8 @@ int main(int argc, char **argv) {
     fprintf(stderr, "INFO: writing to '%s'.\n", filename_out);
   }
 
-  devtools_ijar::OpenFilesAndProcessJar(filename_out, filename_in, strip_jar,
-                                        target_label, injecting_rule_kind);
+  devtools_ijar::OpenFilesAndProcessJar(
+      filename_out, filename_in, filename_in_is_manifest, strip_jar,
+      target_label, injecting_rule_kind, class_index, abi_manifest);
   return 0;
 }
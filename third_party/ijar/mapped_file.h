@@ -65,7 +65,11 @@ class MappedOutputFile {
   size_t estimated_size_;
 
  public:
-  MappedOutputFile(const char* name, size_t estimated_size);
+  // Maps the first estimated_size bytes of the file "name". The file is
+  // created or truncated unless keep_contents is true, in which case it must
+  // exist and its contents stay readable through Buffer().
+  MappedOutputFile(const char* name, size_t estimated_size,
+                   bool keep_contents = false);
   virtual ~MappedOutputFile();
 
   // If opening the file succeeded or not.
@@ -90,11 +90,13 @@ struct MappedOutputFileImpl {
   int mmap_length_;
 };
 
-MappedOutputFile::MappedOutputFile(const char* name, size_t estimated_size)
+MappedOutputFile::MappedOutputFile(const char* name, size_t estimated_size,
+                                   bool keep_contents)
     : estimated_size_(estimated_size) {
   impl_ = NULL;
   opened_ = false;
-  int fd = open(name, O_CREAT|O_RDWR|O_TRUNC, 0644);
+  int fd = keep_contents ? open(name, O_RDWR)
+                         : open(name, O_CREAT|O_RDWR|O_TRUNC, 0644);
   if (fd < 0) {
     snprintf(errmsg, MAX_ERROR, "open(): %s", strerror(errno));
     errmsg_ = errmsg;
@@ -113,7 +115,8 @@ MappedOutputFile::MappedOutputFile(const char* name, size_t estimated_size)
   size_t mmap_length =
       std::min(static_cast<size_t>(estimated_size + sysconf(_SC_PAGESIZE)),
                std::numeric_limits<size_t>::max());
-  void* mapped = mmap(NULL, mmap_length, PROT_WRITE, MAP_SHARED, fd, 0);
+  int prot = keep_contents ? PROT_READ|PROT_WRITE : PROT_WRITE;
+  void* mapped = mmap(NULL, mmap_length, prot, MAP_SHARED, fd, 0);
   if (mapped == MAP_FAILED) {
     snprintf(errmsg, MAX_ERROR, "mmap(): %s", strerror(errno));
     errmsg_ = errmsg;
@@ -132,7 +132,8 @@ struct MappedOutputFileImpl {
   }
 };
 
-MappedOutputFile::MappedOutputFile(const char* name, size_t estimated_size) {
+MappedOutputFile::MappedOutputFile(const char* name, size_t estimated_size,
+                                   bool keep_contents) {
   impl_ = NULL;
   opened_ = false;
   errmsg_ = errmsg;
@@ -144,7 +145,8 @@ MappedOutputFile::MappedOutputFile(const char* name, size_t estimated_size) {
                    << "): AsAbsoluteWindowsPath failed: " << error;
   }
   HANDLE file = CreateFileW(wname.c_str(), GENERIC_READ | GENERIC_WRITE, 0,
-                            NULL, CREATE_ALWAYS, 0, NULL);
+                            NULL, keep_contents ? OPEN_EXISTING : CREATE_ALWAYS,
+                            0, NULL);
   if (file == INVALID_HANDLE_VALUE) {
     string errormsg = blaze_util::GetLastErrorString();
     BAZEL_DIE(255) << "MappedOutputFile(" << name << "): CreateFileW("
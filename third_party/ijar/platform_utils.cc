@@ -25,7 +25,9 @@
 #include <unistd.h>
 #endif  // defined(_WIN32) || defined(__CYGWIN__)
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "src/main/cpp/util/errors.h"
 #include "src/main/cpp/util/file.h"
@@ -75,9 +77,10 @@ bool stat_file(const char* path, Stat* result) {
     success = true;
     bool is_dir = (info.dwFileAttributes != INVALID_FILE_ATTRIBUTES) &&
                   (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
-    // TODO(laszlocsomor): use info.nFileSizeHigh after we updated total_size to
-    // be u8 type.
-    result->total_size = is_dir ? 0 : info.nFileSizeLow;
+    result->total_size =
+        is_dir ? 0
+               : ((static_cast<u8>(info.nFileSizeHigh) << 32) |
+                  info.nFileSizeLow);
     // TODO(laszlocsomor): query the actual permissions and write in file_mode.
     result->file_mode = 0777;
     result->is_directory = is_dir;
@@ -105,6 +108,22 @@ bool read_file(const char* path, void* buffer, size_t size) {
   return blaze_util::ReadFile(path, buffer, size);
 }
 
+void list_files(const char* path, std::vector<string>* result) {
+  string root(path);
+  while (root.size() > 1 && (root.back() == '/' || root.back() == '\\')) {
+    root.pop_back();
+  }
+  std::vector<string> files;
+  blaze_util::GetAllFilesUnder(root, &files);
+  for (string& file : files) {
+    // Every entry has `root` and a separator as its prefix.
+    string relative = file.substr(root.size() + 1);
+    std::replace(relative.begin(), relative.end(), '\\', '/');
+    result->push_back(relative);
+  }
+  std::sort(result->begin(), result->end());
+}
+
 string get_cwd() { return blaze_util::GetCwd(); }
 
 bool make_dirs(const char* path, unsigned int mode) {
@@ -20,6 +20,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <string>
+#include <vector>
 
 #include "third_party/ijar/common.h"
 
@@ -28,7 +29,7 @@ namespace devtools_ijar {
 // Platform-independent stat data.
 struct Stat {
   // Total size of the file in bytes.
-  int total_size;
+  u8 total_size;
   // The Unix file mode from the stat.st_mode field.
   mode_t file_mode;
   // True if this is a directory.
@@ -60,6 +61,11 @@ bool write_file(const char* path, unsigned int perm, const void* data,
 // Returns false upon failure and reports the error to stderr.
 bool read_file(const char* path, void* buffer, size_t size);
 
+// Lists the files under the directory `path` and all of its subdirectories.
+// The paths in `result` are relative to `path`, use '/' as the separator, and
+// are sorted. Symlinks are listed but not followed.
+void list_files(const char* path, std::vector<std::string>* result);
+
 // Returns the current working directory.
 // Returns the empty string upon failure and reports the error to stderr.
 std::string get_cwd();
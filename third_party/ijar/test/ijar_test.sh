@@ -511,6 +511,164 @@ EOF
   cmp one/one-ijar.jar three/three-ijar.jar
 }
 
+# print_class_index INDEX
+#
+# Prints the names in a class index written by ijar --class_index, one per
+# line, prefixed with "defined" or "referenced".
+function print_class_index() {
+  perl -e '
+    local $/;
+    my $data = <STDIN>;
+    substr($data, 0, 8) eq "IJCI\x01\x00\x00\x00" or die "bad header";
+    my $offset = 8;
+    for my $kind ("defined", "referenced") {
+      my $count = unpack("V", substr($data, $offset, 4));
+      $offset += 4;
+      for my $i (1..$count) {
+        my $length = unpack("v", substr($data, $offset, 2));
+        print "$kind " . substr($data, $offset + 2, $length) . "\n";
+        $offset += 2 + $length;
+      }
+    }' < "$1"
+}
+
+function test_class_index() {
+  cd $TEST_TMPDIR
+
+  mkdir -p index/a
+  cat > index/a/A.java <<EOF
+package a;
+
+import java.util.List;
+import java.util.Map;
+
+public class A<T extends Runnable> extends java.io.Writer {
+  public Map.Entry<String, T> entry;
+  public static class Nested {}
+  public List<Nested> nested() throws java.io.IOException { return null; }
+  public void write(char[] c, int o, int l) {}
+  public void flush() {}
+  public void close() {}
+  private java.util.concurrent.Future<?> hidden() {
+    new java.util.BitSet();
+    return null;
+  }
+}
+EOF
+
+  $JAVAC -d index index/a/A.java || fail "javac failed"
+  (cd index; $JAR cf index.jar a/*.class)
+
+  $IJAR --class_index index/index.idx index/index.jar index/index-ijar.jar \
+    || fail "ijar failed"
+  print_class_index index/index.idx > $TEST_log || fail "bad class index"
+  expect_log "^defined a/A$"
+  expect_log "^defined a/A\$Nested$"
+  expect_log "^referenced java/io/IOException$"
+  expect_log "^referenced java/io/Writer$"
+  expect_log "^referenced java/lang/Runnable$"
+  expect_log "^referenced java/lang/String$"
+  expect_log "^referenced java/util/List$"
+  expect_log "^referenced java/util/Map\$Entry$"
+  # Private members and method bodies are not part of the interface.
+  expect_not_log "BitSet"
+  expect_not_log "Future"
+  # Neither are type variables or the classes defined by the jar itself.
+  expect_not_log "^referenced T$"
+  expect_not_log "^referenced a/"
+
+  # The index does not depend on whether the classes are stripped.
+  $IJAR --nostrip_jar --class_index index/nostrip.idx index/index.jar \
+    index/nostrip-ijar.jar || fail "ijar failed"
+  cmp index/index.idx index/nostrip.idx || fail "class indexes differ"
+}
+
+function test_directory_and_manifest_input() {
+  cd $TEST_TMPDIR
+
+  $JAVAC -g -d $TEST_TMPDIR/classes $IJAR_SRCDIR/test/A.java ||
+    fail "javac failed"
+  $JAR cf $A_JAR -C $TEST_TMPDIR/classes . || fail "jar failed"
+  $IJAR --class_index jar.idx $A_JAR $A_INTERFACE_JAR || fail "ijar failed"
+
+  # A directory of classes gives the same interface as their jar. The entries
+  # of a directory are written in the order of their names.
+  $IJAR --class_index dir.idx classes dir-interface.jar \
+    || fail "ijar failed on a directory"
+  $JAR tf $A_INTERFACE_JAR | sort > jar.entries
+  $JAR tf dir-interface.jar > dir.entries
+  diff jar.entries dir.entries || fail "interface jar entries differ"
+  cmp jar.idx dir.idx || fail "class indexes differ"
+
+  # So does a manifest of the same classes, whatever the order of its lines.
+  (cd classes; find . -name '*.class' | sed 's|^\./||' | sort -r) |
+    while read -r f; do
+      printf '%s\t%s\n' "classes/$f" "$f"
+    done > classes.manifest
+  $IJAR --input_manifest classes.manifest manifest-interface.jar \
+    || fail "ijar failed on a manifest"
+  cmp dir-interface.jar manifest-interface.jar || fail "interface jars differ"
+
+  echo "no tab" > bad.manifest
+  $IJAR --input_manifest bad.manifest bad-interface.jar >& $TEST_log \
+    && fail "ijar accepted a malformed manifest"
+  expect_log "expected <path>TAB<name>"
+}
+
+function test_abi_manifest() {
+  cd $TEST_TMPDIR
+
+  mkdir -p abi/{one,two,three}/a
+  cat > abi/one/a/A.java <<EOF
+package a;
+
+public class A {
+  public int f;
+  public int first() { return 1; }
+  public String second(int i) { return "one"; }
+  private void hidden() {}
+}
+EOF
+  # The same interface, with different method bodies and member order.
+  cat > abi/two/a/A.java <<EOF
+package a;
+
+public class A {
+  public String second(int i) { return String.valueOf(i); }
+  public int first() { return f + 2; }
+  private int hidden;
+  public int f;
+}
+EOF
+  # A different interface.
+  cat > abi/three/a/A.java <<EOF
+package a;
+
+public class A {
+  public int f;
+  public int first() { return 1; }
+  public String second(long l) { return "one"; }
+}
+EOF
+
+  for v in one two three; do
+    $JAVAC -d abi/$v abi/$v/a/A.java || fail "javac failed"
+    (cd abi/$v; $JAR cf lib.jar a/*.class)
+    $IJAR --abi_manifest abi/$v/abi.txt abi/$v/lib.jar abi/$v/lib-ijar.jar \
+      || fail "ijar failed"
+  done
+
+  cat abi/one/abi.txt > $TEST_log
+  expect_log "^a/A [0-9a-f]\{32\}$"
+  cmp abi/one/abi.txt abi/two/abi.txt || fail "equal interfaces differ"
+  cmp -s abi/one/abi.txt abi/three/abi.txt && fail "interfaces do not differ"
+
+  # The fingerprint does not depend on whether the classes are stripped.
+  $IJAR --nostrip_jar --abi_manifest abi/one/nostrip.txt abi/one/lib.jar \
+    abi/one/nostrip-ijar.jar || fail "ijar failed"
+  cmp abi/one/abi.txt abi/one/nostrip.txt || fail "ABI manifests differ"
+}
+
 function test_method_parameters_attribute() {
   # Check that Java 8 MethodParameters attributes are preserved
   $IJAR $METHODPARAM_JAR $METHODPARAM_IJAR || fail "ijar failed"
@@ -211,4 +211,72 @@ function test_zipper_permissions() {
   fi
 }
 
+function test_zipper_update() {
+  local -r LOCAL_TEST_DIR="${TEST_TMPDIR}/${FUNCNAME[0]}"
+  mkdir -p ${LOCAL_TEST_DIR}/files
+  echo "toto" > ${LOCAL_TEST_DIR}/files/a.txt
+  echo "titi" > ${LOCAL_TEST_DIR}/files/b.txt
+  echo "tata" > ${LOCAL_TEST_DIR}/files/c.txt
+  seq 1 10000 > ${LOCAL_TEST_DIR}/files/big.txt
+  mkdir -p ${LOCAL_TEST_DIR}/expect/foo
+  echo "toto" > ${LOCAL_TEST_DIR}/expect/foo/a.txt
+  echo "tata" > ${LOCAL_TEST_DIR}/expect/foo/b.txt
+  echo "titi" > ${LOCAL_TEST_DIR}/expect/foo/c.txt
+
+  ${ZIPPER} cC ${LOCAL_TEST_DIR}/output.zip \
+      foo/a.txt=${LOCAL_TEST_DIR}/files/a.txt \
+      foo/b.txt=${LOCAL_TEST_DIR}/files/b.txt \
+      foo/big.txt=${LOCAL_TEST_DIR}/files/big.txt
+  # Replacing b.txt leaves a few unused bytes, which are not worth compacting.
+  ${ZIPPER} uC ${LOCAL_TEST_DIR}/output.zip \
+      foo/b.txt=${LOCAL_TEST_DIR}/files/c.txt \
+      foo/c.txt=${LOCAL_TEST_DIR}/files/b.txt
+  local big_size=$(cat ${LOCAL_TEST_DIR}/output.zip | wc -c | xargs)
+  # Deleting big.txt makes the updated zip compact its entries.
+  ${ZIPPER} u ${LOCAL_TEST_DIR}/output.zip -foo/big.txt
+  local small_size=$(cat ${LOCAL_TEST_DIR}/output.zip | wc -c | xargs)
+  check_gt "${big_size}" "${small_size}" "Deleted entry was not compacted"
+
+  mkdir -p ${LOCAL_TEST_DIR}/out
+  (cd ${LOCAL_TEST_DIR}/out && $UNZIP -q ${LOCAL_TEST_DIR}/output.zip)
+  diff -r ${LOCAL_TEST_DIR}/expect ${LOCAL_TEST_DIR}/out &> $TEST_log \
+      || fail "Unzip after zipper update is not expected"
+}
+
+function test_zipper_unordered_central_directory() {
+  local -r LOCAL_TEST_DIR="${TEST_TMPDIR}/${FUNCNAME[0]}"
+  mkdir -p ${LOCAL_TEST_DIR}/expect
+  # Larger than the region the reader unmaps once it has been processed.
+  head -c $((40 * 1024 * 1024)) /dev/zero > ${LOCAL_TEST_DIR}/expect/big.bin
+  echo "toto" > ${LOCAL_TEST_DIR}/expect/small.txt
+  (cd ${LOCAL_TEST_DIR}/expect && \
+      ${ZIPPER} c ${LOCAL_TEST_DIR}/output.zip big.bin small.txt)
+  # List small.txt first in the central directory, so that the entry of
+  # big.bin is read after the one following it.
+  perl -e '
+    open(FH, "+<", $ARGV[0]) or die $!;
+    binmode FH;
+    local $/;
+    my $zip = <FH>;
+    my ($entries, $size, $offset) =
+        unpack("x10 v V V", substr($zip, length($zip) - 22, 22));
+    my @headers;
+    my $p = $offset;
+    for (1 .. $entries) {
+      my ($name, $extra, $comment) = unpack("x28 v v v", substr($zip, $p, 46));
+      push @headers, substr($zip, $p, 46 + $name + $extra + $comment);
+      $p += 46 + $name + $extra + $comment;
+    }
+    substr($zip, $offset, $size) = join("", reverse @headers);
+    seek(FH, 0, 0);
+    print FH $zip;
+    close(FH);' ${LOCAL_TEST_DIR}/output.zip
+
+  mkdir -p ${LOCAL_TEST_DIR}/out
+  (cd ${LOCAL_TEST_DIR}/out && ${ZIPPER} x ${LOCAL_TEST_DIR}/output.zip) \
+      || fail "Zipper failed to extract an unordered central directory"
+  diff -r ${LOCAL_TEST_DIR}/expect ${LOCAL_TEST_DIR}/out &> $TEST_log \
+      || fail "Zipper extracted an unordered central directory incorrectly"
+}
+
 run_suite "zipper tests"
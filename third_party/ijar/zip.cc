@@ -31,30 +31,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <algorithm>
 #include <limits>
+#include <set>
+#include <string>
+#include <utility>
 #include <vector>
 
+#include "src/main/cpp/util/zip_headers.h"
 #include "third_party/ijar/mapped_file.h"
 #include "third_party/ijar/platform_utils.h"
 #include "third_party/ijar/zip.h"
 #include "third_party/ijar/zlib_client.h"
 
 #define LOCAL_FILE_HEADER_SIGNATURE   0x04034b50
-#define CENTRAL_FILE_HEADER_SIGNATURE 0x02014b50
 #define UNIX_ZIP_FILE_VERSION 0x0300
 #define DIGITAL_SIGNATURE             0x05054b50
 #define ZIP64_EOCD_SIGNATURE          0x06064b50
-#define ZIP64_EOCD_LOCATOR_SIGNATURE  0x07064b50
 #define EOCD_SIGNATURE                0x06054b50
-#define DATA_DESCRIPTOR_SIGNATURE     0x08074b50
 
 #define U2_MAX 0xffff
 #define U4_MAX 0xffffffffUL
 
-#define ZIP64_EOCD_LOCATOR_SIZE 20
-// zip64 eocd is fixed size in the absence of a zip64 extensible data sector
-#define ZIP64_EOCD_FIXED_SIZE 56
-
 // version to extract: 1.0 - default value from APPNOTE.TXT.
 // Output JAR files contain no extra ZIP features, so this is enough.
 #define ZIP_VERSION_TO_EXTRACT                10
@@ -70,10 +68,6 @@
   | GENERAL_PURPOSE_BIT_FLAG_COMPRESSION_SPEED)
 
 namespace devtools_ijar {
-// In the absence of ZIP64 support, zip files are limited to 4GB.
-// http://www.info-zip.org/FAQ.html#limits
-static const size_t kMaximumOutputSize = std::numeric_limits<uint32_t>::max();
-
 static const u4 kDefaultTimestamp =
     30 << 25 | 1 << 21 | 1 << 16;  // January 1, 2010 in DOS time
 
@@ -102,11 +96,6 @@ class InputZipFile : public ZipExtractor {
 
   virtual u8 CalculateOutputLength();
 
-  virtual bool ProcessCentralDirEntry(const u1 *&p, size_t *compressed_size,
-                                      size_t *uncompressed_size, char *filename,
-                                      size_t filename_size, u4 *attr,
-                                      u4 *offset);
-
  private:
   ZipExtractorProcessor *processor;
   const char* filename_;
@@ -117,13 +106,15 @@ class InputZipFile : public ZipExtractor {
   // the object is actually created using mmap.
   const u1 * zipdata_in_;   // start of input file mmap
   size_t bytes_unmapped_;         // bytes that have already been unmapped
-  const u1 * central_dir_;  // central directory in input file
-
-  size_t in_offset_;  // offset  the input file
+  // Whether the local headers are in the order of the central directory, so
+  // that no entry refers to a region preceding the previous entry.
+  bool local_headers_ordered_;
 
-  const u1 *p;  // input cursor
+  // The central directory of the input file, shared with the other Zip
+  // readers in the tree.
+  CentralDirectory central_dir_;
 
-  const u1* central_dir_current_;  // central dir input cursor
+  const CDH* central_dir_current_;  // central dir input cursor
 
   // Buffer size is initially INITIAL_BUFFER_SIZE. It doubles in size every
   // time it is found too small, until it reaches MAX_BUFFER_SIZE. If that is
@@ -136,18 +127,6 @@ class InputZipFile : public ZipExtractor {
   static const size_t MAX_BUFFER_SIZE = std::numeric_limits<int32_t>::max();
   static const size_t MAX_MAPPED_REGION = 32 * 1024 * 1024;
 
-  // These metadata fields are the fields of the ZIP header of the file being
-  // processed.
-  u2 extract_version_;
-  u2 general_purpose_bit_flag_;
-  u2 compression_method_;
-  u4 uncompressed_size_;
-  u4 compressed_size_;
-  u2 file_name_length_;
-  u2 extra_field_length_;
-  const u1 *file_name_;
-  const u1 *extra_field_;
-
   // Copy of the last filename entry - Null-terminated.
   char filename[PATH_MAX];
   // The external file attribute field
@@ -166,10 +145,10 @@ class InputZipFile : public ZipExtractor {
     return -1;
   }
 
-  // Check that at least n bytes remain in the input file, otherwise
-  // abort with an error message.  "state" is the name of the field
+  // Check that at least n bytes starting at p remain in the input file,
+  // otherwise abort with an error message.  "state" is the name of the field
   // we're about to read, for diagnostics.
-  int EnsureRemaining(size_t n, const char *state) {
+  int EnsureRemaining(const u1 *p, size_t n, const char *state) {
     size_t in_offset = p - zipdata_in_;
     size_t remaining = input_file_->Length() - in_offset;
     if (n > remaining) {
@@ -181,18 +160,77 @@ class InputZipFile : public ZipExtractor {
   }
 
   // Read one entry from input zip file
-  int ProcessLocalFileEntry(size_t compressed_size, size_t uncompressed_size);
+  int ProcessLocalFileEntry(const LH *lh, size_t compressed_size,
+                            size_t uncompressed_size);
+
+  // Unmap the region of the input file preceding the entries not processed
+  // yet.
+  void DiscardProcessed();
+
+  // Process a file. Its data starts at data.
+  int ProcessFile(const u1 *data, const bool compressed,
+                  size_t uncompressed_size);
+};
+
+//
+// A class representing plain files for reading as if they were the entries of
+// a ZIP file: the files under a directory, or the files listed in a manifest.
+// The files are memory mapped one at a time and handed to the processor as
+// is, so there is nothing to decompress. Its public API is exposed using the
+// ZipExtractor abstract class.
+//
+class InputFileList : public ZipExtractor {
+ public:
+  explicit InputFileList(ZipExtractorProcessor *processor)
+      : processor(processor), current_(0), total_size_(0) {
+    errmsg[0] = 0;
+  }
+  virtual ~InputFileList() {}
+
+  virtual const char* GetError() {
+    if (errmsg[0] == 0) {
+      return NULL;
+    }
+    return errmsg;
+  }
+
+  // Lists the files under the directory "path".
+  bool OpenDirectory(const char *path);
+  // Lists the files named in the manifest "path".
+  bool OpenManifest(const char *path);
+  virtual bool ProcessNext();
+  virtual void Reset() { current_ = 0; }
+  virtual size_t GetSize() { return total_size_; }
+  virtual u8 CalculateOutputLength();
 
-  // Uncompress a file from the archive using zlib. The pointer returned
-  // is owned by InputZipFile, so it must not be freed. Advances the input
-  // cursor to the first byte after the compressed data.
-  u1* UncompressFile();
+ private:
+  struct Entry {
+    std::string name;
+    std::string path;
+    Stat stat;
+  };
+
+  // Stats the file "path" and adds it as the entry "name". Directories are
+  // skipped.
+  bool AddEntry(const std::string &name, const std::string &path);
+  // Sorts the entries by name and checks that the names are unique.
+  bool SortEntries();
+
+  ZipExtractorProcessor *processor;
+  std::vector<Entry> entries_;
+  size_t current_;
+  size_t total_size_;
 
-  // Skip a file
-  int SkipFile(const bool compressed);
+  // last error
+  char errmsg[4*PATH_MAX];
 
-  // Process a file
-  int ProcessFile(const bool compressed);
+  int error(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(errmsg, 4*PATH_MAX, fmt, ap);
+    va_end(ap);
+    return -1;
+  }
 };
 
 //
@@ -227,7 +265,11 @@ class OutputZipFile : public ZipBuilder {
     return entries_.size();
   }
   virtual int Finish();
-  bool Open();
+  bool Open(bool keep_contents = false);
+
+  // Opens the existing file for update, see ZipBuilder::Update().
+  bool OpenForUpdate(char const* const* removed_paths, int nb_removed,
+                     double max_garbage_ratio);
 
  private:
   struct LocalFileEntry {
@@ -254,6 +296,10 @@ class OutputZipFile : public ZipBuilder {
     // Start/length of the extra_field in the local header.
     const u1 *extra_field;
     u2 extra_field_length;
+
+    // Copy of the central directory header of an entry kept from the file
+    // being updated, NULL for the entries written by this object.
+    u1 *central_header;
   };
 
   MappedOutputFile* output_file_;
@@ -287,6 +333,10 @@ class OutputZipFile : public ZipBuilder {
   // entry in "entries".
   void WriteCentralDirectory();
 
+  // Write the central directory header of an entry kept by OpenForUpdate(),
+  // pointing it to the entry's new local header offset.
+  void WriteKeptCentralHeader(const LocalFileEntry *entry);
+
   // Returns the offset of the pointer relative to the start of the
   // output zip file.
   size_t Offset(const u1 *const x) {
@@ -311,266 +361,163 @@ class OutputZipFile : public ZipBuilder {
 // Implementation of InputZipFile
 //
 bool InputZipFile::ProcessNext() {
-  // Process the next entry in the central directory. Also make sure that the
-  // content pointer is in sync.
-  size_t compressed, uncompressed;
-  u4 offset;
-  if (!ProcessCentralDirEntry(central_dir_current_, &compressed, &uncompressed,
-                              filename, PATH_MAX, &attr, &offset)) {
+  // Process the next entry in the central directory.
+  const CDH *cdh = central_dir_current_;
+  if (EnsureRemaining(ziph::byte_ptr(cdh), 4, "signature") < 0) {
+    return false;
+  }
+  if (!cdh->is()) {
+    const u1 *p = ziph::byte_ptr(cdh);
+    u4 signature = get_u4le(p);
+    if (signature != DIGITAL_SIGNATURE && signature != EOCD_SIGNATURE &&
+        signature != ZIP64_EOCD_SIGNATURE) {
+      error("invalid central file header signature: 0x%x\n", signature);
+    }
+    return false;
+  }
+  if (EnsureRemaining(ziph::byte_ptr(cdh), sizeof(CDH), "central_dir") < 0 ||
+      EnsureRemaining(ziph::byte_ptr(cdh), cdh->size(), "central_dir") < 0) {
     return false;
   }
+  central_dir_current_ = central_dir_.next(cdh);
 
-  // There might be an offset specified in the central directory that does
-  // not match the file offset, if so, correct the pointer.
-  if (offset != 0 && (p != (zipdata_in_ + in_offset_ + offset))) {
-    p = zipdata_in_ + offset;
+  {
+    size_t len = (cdh->file_name_length() < PATH_MAX)
+      ? cdh->file_name_length()
+      : (PATH_MAX - 1);
+    memcpy(reinterpret_cast<void*>(filename), cdh->file_name(), len);
+    filename[len] = 0;
   }
+  attr = cdh->external_attributes();
 
-  if (EnsureRemaining(4, "signature") < 0) {
+  const LH *lh = central_dir_.local_header(cdh);
+  if (lh == NULL || !lh->is()) {
+    error("local file header signature for file %s not found\n", filename);
     return false;
   }
-  u4 signature = get_u4le(p);
-  if (signature == LOCAL_FILE_HEADER_SIGNATURE) {
-    if (ProcessLocalFileEntry(compressed, uncompressed) < 0) {
-      return false;
-    }
-  } else {
-    error("local file header signature for file %s not found\n", filename);
+  if (ProcessLocalFileEntry(lh, cdh->compressed_file_size(),
+                            cdh->uncompressed_file_size()) < 0) {
     return false;
   }
-
+  DiscardProcessed();
   return true;
 }
 
+void InputZipFile::DiscardProcessed() {
+  // The next local header is the first one of the remaining entries only if
+  // they are ordered, otherwise keep the whole file mapped.
+  const CDH *cdh = central_dir_current_;
+  if (!local_headers_ordered_ || !cdh->is()) {
+    return;
+  }
+  u8 next_offset = cdh->local_header_offset() + central_dir_.preamble_size();
+  if (next_offset > bytes_unmapped_ + MAX_MAPPED_REGION) {
+    input_file_->Discard(MAX_MAPPED_REGION);
+    bytes_unmapped_ += MAX_MAPPED_REGION;
+  }
+}
+
 int InputZipFile::ProcessLocalFileEntry(
-    size_t compressed_size, size_t uncompressed_size) {
-  if (EnsureRemaining(26, "extract_version") < 0) {
+    const LH *lh, size_t compressed_size, size_t uncompressed_size) {
+  if (EnsureRemaining(ziph::byte_ptr(lh), sizeof(LH), "extract_version") < 0) {
     return -1;
   }
-  extract_version_ = get_u2le(p);
-  general_purpose_bit_flag_ = get_u2le(p);
-
-  if ((general_purpose_bit_flag_ & ~GENERAL_PURPOSE_BIT_FLAG_SUPPORTED) != 0) {
+  u2 general_purpose_bit_flag = lh->bit_flag();
+  if ((general_purpose_bit_flag & ~GENERAL_PURPOSE_BIT_FLAG_SUPPORTED) != 0) {
     return error("Unsupported value (0x%04x) in general purpose bit flag.\n",
-                 general_purpose_bit_flag_);
+                 general_purpose_bit_flag);
   }
 
-  compression_method_ = get_u2le(p);
-
-  if (compression_method_ != COMPRESSION_METHOD_DEFLATED &&
-      compression_method_ != COMPRESSION_METHOD_STORED) {
+  u2 compression_method = lh->compression_method();
+  if (compression_method != COMPRESSION_METHOD_DEFLATED &&
+      compression_method != COMPRESSION_METHOD_STORED) {
     return error("Unsupported compression method (%d).\n",
-                 compression_method_);
-  }
-
-  // skip over: last_mod_file_time, last_mod_file_date, crc32
-  p += 2 + 2 + 4;
-  compressed_size_ = get_u4le(p);
-  uncompressed_size_ = get_u4le(p);
-  file_name_length_ = get_u2le(p);
-  extra_field_length_ = get_u2le(p);
-
-  if (EnsureRemaining(file_name_length_, "file_name") < 0) {
-    return -1;
+                 compression_method);
   }
-  file_name_ = p;
-  p += file_name_length_;
 
-  if (EnsureRemaining(extra_field_length_, "extra_field") < 0) {
+  if (EnsureRemaining(ziph::byte_ptr(lh), lh->size(), "file_name") < 0) {
     return -1;
   }
-  extra_field_ = p;
-  p += extra_field_length_;
-
-  bool is_compressed = compression_method_ == COMPRESSION_METHOD_DEFLATED;
 
   // If the zip is compressed, compressed and uncompressed size members are
   // zero in the local file header. If not, check that they are the same as the
   // lengths from the central directory, otherwise, just believe the central
   // directory
-  if (compressed_size_ == 0) {
-    compressed_size_ = compressed_size;
-  } else {
-    if (compressed_size_ != compressed_size) {
-      return error("central directory and file header inconsistent\n");
-    }
+  size_t lh_compressed_size = lh->compressed_file_size();
+  if (lh_compressed_size != 0 && lh_compressed_size != compressed_size) {
+    return error("central directory and file header inconsistent\n");
+  }
+  size_t lh_uncompressed_size = lh->uncompressed_file_size();
+  if (lh_uncompressed_size != 0 && lh_uncompressed_size != uncompressed_size) {
+    return error("central directory and file header inconsistent\n");
   }
 
-  if (uncompressed_size_ == 0) {
-    uncompressed_size_ = uncompressed_size;
-  } else {
-    if (uncompressed_size_ != uncompressed_size) {
-      return error("central directory and file header inconsistent\n");
+  bool is_compressed = compression_method == COMPRESSION_METHOD_DEFLATED;
+  if (!is_compressed) {
+    // In this case, compressed_size == uncompressed_size (since the file is
+    // uncompressed), so we can use either.
+    if (compressed_size != uncompressed_size) {
+      return error("compressed size != uncompressed size, although the file "
+                   "is uncompressed.\n");
     }
   }
+  if (EnsureRemaining(lh->data(), compressed_size, "file_data") < 0) {
+    return -1;
+  }
 
   if (processor->Accept(filename, attr)) {
-    if (ProcessFile(is_compressed) < 0) {
-      return -1;
-    }
-  } else {
-    if (SkipFile(is_compressed) < 0) {
+    if (ProcessFile(lh->data(), is_compressed, uncompressed_size) < 0) {
       return -1;
     }
   }
 
-  if (general_purpose_bit_flag_ & GENERAL_PURPOSE_BIT_FLAG_COMPRESSED) {
-    // Skip the data descriptor. Some implementations do not put the signature
-    // here, so check if the next 4 bytes are a signature, and if so, skip the
-    // next 12 bytes (for CRC, compressed/uncompressed size), otherwise skip
-    // the next 8 bytes (because the value just read was the CRC).
-    u4 signature = get_u4le(p);
-    if (signature == DATA_DESCRIPTOR_SIGNATURE) {
-      p += 4 * 3;
-    } else {
-      p += 4 * 2;
-    }
-  }
-
-  size_t bytes_processed = p - zipdata_in_;
-  if (bytes_processed > bytes_unmapped_ + MAX_MAPPED_REGION) {
-    input_file_->Discard(MAX_MAPPED_REGION);
-    bytes_unmapped_ += MAX_MAPPED_REGION;
-  }
-
   return 0;
 }
 
-int InputZipFile::SkipFile(const bool compressed) {
+int InputZipFile::ProcessFile(const u1 *data, const bool compressed,
+                              size_t uncompressed_size) {
   if (!compressed) {
-    // In this case, compressed_size_ == uncompressed_size_ (since the file is
-    // uncompressed), so we can use either.
-    if (compressed_size_ != uncompressed_size_) {
-      return error("compressed size != uncompressed size, although the file "
-                   "is uncompressed.\n");
-    }
-  }
-
-  if (EnsureRemaining(compressed_size_, "file_data") < 0) {
-    return -1;
+    processor->Process(filename, attr, data, uncompressed_size);
+    return 0;
   }
-  p += compressed_size_;
-  return 0;
-}
 
-u1* InputZipFile::UncompressFile() {
-  size_t in_offset = p - zipdata_in_;
-  size_t remaining = input_file_->Length() - in_offset;
+  size_t remaining = input_file_->Length() - (data - zipdata_in_);
   DecompressedFile *decompressed_file =
-      decompressor_->UncompressFile(p, remaining);
+      decompressor_->UncompressFile(data, remaining);
   if (decompressed_file == NULL) {
     if (decompressor_->GetError() != NULL) {
       error(decompressor_->GetError());
     }
-    return NULL;
-  } else {
-    compressed_size_ = decompressed_file->compressed_size;
-    uncompressed_size_ = decompressed_file->uncompressed_size;
-    u1 *uncompressed_data = decompressed_file->uncompressed_data;
-    free(decompressed_file);
-    p += compressed_size_;
-    return uncompressed_data;
-  }
-}
-
-int InputZipFile::ProcessFile(const bool compressed) {
-  const u1 *file_data;
-  if (compressed) {
-    file_data = UncompressFile();
-    if (file_data == NULL) {
-      return -1;
-    }
-  } else {
-    // In this case, compressed_size_ == uncompressed_size_ (since the file is
-    // uncompressed), so we can use either.
-    if (compressed_size_ != uncompressed_size_) {
-      return error("compressed size != uncompressed size, although the file "
-                   "is uncompressed.\n");
-    }
-
-    if (EnsureRemaining(compressed_size_, "file_data") < 0) {
-      return -1;
-    }
-    file_data = p;
-    p += compressed_size_;
+    return -1;
   }
-  processor->Process(filename, attr, file_data, uncompressed_size_);
+  processor->Process(filename, attr, decompressed_file->uncompressed_data,
+                     decompressed_file->uncompressed_size);
+  free(decompressed_file);
   return 0;
 }
 
-
-// Reads and returns some metadata of the next file from the central directory:
-// - compressed size
-// - uncompressed size
-// - whether the entry is a class file (to be included in the output).
-// Precondition: p points to the beginning of an entry in the central dir
-// Postcondition: p points to the beginning of the next entry in the central dir
-// Returns true if the central directory contains another file and false if not.
-// Of course, in the latter case, the size output variables are not changed.
-// Note that the central directory is always followed by another data structure
-// that has a signature, so parsing it this way is safe.
-bool InputZipFile::ProcessCentralDirEntry(const u1 *&p, size_t *compressed_size,
-                                          size_t *uncompressed_size,
-                                          char *filename, size_t filename_size,
-                                          u4 *attr, u4 *offset) {
-  u4 signature = get_u4le(p);
-
-  if (signature != CENTRAL_FILE_HEADER_SIGNATURE) {
-    if (signature != DIGITAL_SIGNATURE && signature != EOCD_SIGNATURE &&
-        signature != ZIP64_EOCD_SIGNATURE) {
-      error("invalid central file header signature: 0x%x\n", signature);
-    }
-    return false;
-  }
-
-  p += 16;  // skip to 'compressed size' field
-  *compressed_size = get_u4le(p);
-  *uncompressed_size = get_u4le(p);
-  u2 file_name_length = get_u2le(p);
-  u2 extra_field_length = get_u2le(p);
-  u2 file_comment_length = get_u2le(p);
-  p += 4;  // skip to external file attributes field
-  *attr = get_u4le(p);
-  *offset = get_u4le(p);
-  {
-    size_t len = (file_name_length < filename_size)
-      ? file_name_length
-      : (filename_size - 1);
-    memcpy(reinterpret_cast<void*>(filename), p, len);
-    filename[len] = 0;
-  }
-  p += file_name_length;
-  p += extra_field_length;
-  p += file_comment_length;
-  return true;
-}
-
 // Gives a maximum bound on the size of the interface JAR. Basically, adds
 // the difference between the compressed and uncompressed sizes to the size
 // of the input file.
 u8 InputZipFile::CalculateOutputLength() {
-  const u1* current = central_dir_;
-
   u8 compressed_size = 0;
   u8 uncompressed_size = 0;
   u8 skipped_compressed_size = 0;
-  u4 attr;
-  u4 offset;
   char filename[PATH_MAX];
 
-  while (true) {
-    size_t file_compressed, file_uncompressed;
-    if (!ProcessCentralDirEntry(current,
-                                &file_compressed, &file_uncompressed,
-                                filename, PATH_MAX, &attr, &offset)) {
-      break;
-    }
+  for (const CDH *cdh = central_dir_.first(); cdh->is();
+       cdh = central_dir_.next(cdh)) {
+    size_t len = (cdh->file_name_length() < PATH_MAX)
+      ? cdh->file_name_length()
+      : (PATH_MAX - 1);
+    memcpy(reinterpret_cast<void*>(filename), cdh->file_name(), len);
+    filename[len] = 0;
 
-    if (processor->Accept(filename, attr)) {
-      compressed_size += (u8) file_compressed;
-      uncompressed_size += (u8) file_uncompressed;
+    if (processor->Accept(filename, cdh->external_attributes())) {
+      compressed_size += (u8) cdh->compressed_file_size();
+      uncompressed_size += (u8) cdh->uncompressed_file_size();
     } else {
-      skipped_compressed_size += file_compressed;
+      skipped_compressed_size += cdh->compressed_file_size();
     }
   }
 
@@ -581,201 +528,134 @@ u8 InputZipFile::CalculateOutputLength() {
       + (uncompressed_size - compressed_size);
 }
 
-// An end of central directory record, sized for optional zip64 contents.
-struct EndOfCentralDirectoryRecord {
-  u4 number_of_this_disk;
-  u4 disk_with_central_dir;
-  u8 central_dir_entries_on_this_disk;
-  u8 central_dir_entries;
-  u8 central_dir_size;
-  u8 central_dir_offset;
-};
-
-// Checks for a zip64 end of central directory record. If a valid zip64 EOCD is
-// found, updates the original EOCD record and returns true.
-bool MaybeReadZip64CentralDirectory(const u1 *bytes, size_t /*in_length*/,
-                                    const u1 *current,
-                                    const u1 **end_of_central_dir,
-                                    EndOfCentralDirectoryRecord *cd) {
-  if (current < bytes) {
-    return false;
-  }
-  const u1 *candidate = current;
-  u4 zip64_directory_signature = get_u4le(current);
-  if (zip64_directory_signature != ZIP64_EOCD_SIGNATURE) {
-    return false;
-  }
-
-  // size of zip64 end of central directory record
-  // (fixed size unless there's a zip64 extensible data sector, which
-  // we don't need to read)
-  get_u8le(current);
-  get_u2be(current);  // version made by
-  get_u2be(current);  // version needed to extract
-
-  u4 number_of_this_disk = get_u4be(current);
-  u4 disk_with_central_dir = get_u4le(current);
-  u8 central_dir_entries_on_this_disk = get_u8le(current);
-  u8 central_dir_entries = get_u8le(current);
-  u8 central_dir_size = get_u8le(current);
-  u8 central_dir_offset = get_u8le(current);
+void InputZipFile::Reset() {
+  central_dir_current_ = central_dir_.first();
+  bytes_unmapped_ = 0;
+}
 
-  // check for a zip64 EOCD that matches the regular EOCD
-  if (number_of_this_disk != cd->number_of_this_disk &&
-      cd->number_of_this_disk != U2_MAX) {
-    return false;
-  }
-  if (disk_with_central_dir != cd->disk_with_central_dir &&
-      cd->disk_with_central_dir != U2_MAX) {
+bool InputFileList::AddEntry(const std::string &name,
+                             const std::string &path) {
+  Entry entry;
+  if (!stat_file(path.c_str(), &entry.stat)) {
+    errno = ENOENT;
+    error("Cannot stat %s\n", path.c_str());
     return false;
   }
-  if (central_dir_entries_on_this_disk !=
-          cd->central_dir_entries_on_this_disk &&
-      cd->central_dir_entries_on_this_disk != U2_MAX) {
-    return false;
-  }
-  if (central_dir_entries != cd->central_dir_entries &&
-      cd->central_dir_entries != U2_MAX) {
-    return false;
-  }
-  if (central_dir_size != cd->central_dir_size &&
-      cd->central_dir_size != U4_MAX) {
-    return false;
+  if (entry.stat.is_directory) {
+    return true;
   }
-  if (central_dir_offset != cd->central_dir_offset &&
-      cd->central_dir_offset != U4_MAX) {
+  if (name.empty() || name.size() >= PATH_MAX || name[0] == '/') {
+    errno = EINVAL;
+    error("Invalid entry name '%s' for %s\n", name.c_str(), path.c_str());
     return false;
   }
-
-  *end_of_central_dir = candidate;
-  cd->number_of_this_disk = number_of_this_disk;
-  cd->disk_with_central_dir = disk_with_central_dir;
-  cd->central_dir_entries_on_this_disk = central_dir_entries_on_this_disk;
-  cd->central_dir_entries = central_dir_entries;
-  cd->central_dir_size = central_dir_size;
-  cd->central_dir_offset = central_dir_offset;
+  entry.name = name;
+  entry.path = path;
+  total_size_ += entry.stat.total_size;
+  entries_.push_back(std::move(entry));
   return true;
 }
 
-// Starting from the end of central directory record, attempts to locate a zip64
-// end of central directory record. If found, updates the given record and
-// offset with the zip64 data. Returns false on error.
-bool FindZip64CentralDirectory(const u1 *bytes, size_t in_length,
-                               const u1 **end_of_central_dir,
-                               EndOfCentralDirectoryRecord *cd) {
-  // In the absence of a zip64 extensible data sector, the zip64 EOCD is at a
-  // fixed offset from the regular central directory.
-  if (MaybeReadZip64CentralDirectory(
-          bytes, in_length,
-          *end_of_central_dir - ZIP64_EOCD_LOCATOR_SIZE - ZIP64_EOCD_FIXED_SIZE,
-          end_of_central_dir, cd)) {
-    return true;
+bool InputFileList::SortEntries() {
+  std::sort(entries_.begin(), entries_.end(),
+            [](const Entry &a, const Entry &b) { return a.name < b.name; });
+  for (size_t i = 1; i < entries_.size(); ++i) {
+    if (entries_[i].name == entries_[i - 1].name) {
+      errno = EINVAL;
+      error("Duplicate entry %s\n", entries_[i].name.c_str());
+      return false;
+    }
   }
+  return true;
+}
 
-  // If we couldn't find a zip64 EOCD at a fixed offset, either it doesn't exist
-  // or there was a zip64 extensible data sector, so try going through the
-  // locator. This approach doesn't work if data was prepended to the archive
-  // without updating the offset in the locator.
-  const u1 *zip64_locator = *end_of_central_dir - ZIP64_EOCD_LOCATOR_SIZE;
-  if (zip64_locator - ZIP64_EOCD_FIXED_SIZE < bytes) {
-    return true;
-  }
-  u4 zip64_locator_signature = get_u4le(zip64_locator);
-  if (zip64_locator_signature != ZIP64_EOCD_LOCATOR_SIGNATURE) {
-    return true;
+bool InputFileList::OpenDirectory(const char *path) {
+  std::vector<std::string> files;
+  list_files(path, &files);
+  std::string prefix(path);
+  if (!prefix.empty() && prefix.back() != '/') {
+    prefix += '/';
   }
-  u4 disk_with_zip64_central_directory = get_u4le(zip64_locator);
-  u8 zip64_end_of_central_dir_offset = get_u8le(zip64_locator);
-  u4 zip64_total_disks = get_u4le(zip64_locator);
-  if (MaybeReadZip64CentralDirectory(bytes, in_length,
-                                     bytes + zip64_end_of_central_dir_offset,
-                                     end_of_central_dir, cd)) {
-    if (disk_with_zip64_central_directory != 0 || zip64_total_disks != 1) {
-      fprintf(stderr, "multi-disk JAR files are not supported\n");
+  for (const std::string &file : files) {
+    if (!AddEntry(file, prefix + file)) {
       return false;
     }
-    return true;
   }
-  return true;
+  return SortEntries();
 }
 
-// Given the data in the zip file, returns the offset of the central directory
-// and the number of files contained in it.
-bool FindZipCentralDirectory(const u1 *bytes, size_t in_length, u4 *offset,
-                             const u1 **central_dir) {
-  static const int MAX_COMMENT_LENGTH = 0xffff;
-  static const int CENTRAL_DIR_LOCATOR_SIZE = 22;
-  // Maximum distance of start of central dir locator from end of file
-  static const int MAX_DELTA = MAX_COMMENT_LENGTH + CENTRAL_DIR_LOCATOR_SIZE;
-  const u1* last_pos_to_check = in_length < MAX_DELTA
-      ? bytes
-      : bytes + (in_length - MAX_DELTA);
-  const u1* current;
-  bool found = false;
-
-  for (current = bytes + in_length - CENTRAL_DIR_LOCATOR_SIZE;
-       current >= last_pos_to_check;
-       current-- ) {
-    const u1* p = current;
-    if (get_u4le(p) != EOCD_SIGNATURE) {
-      continue;
+bool InputFileList::OpenManifest(const char *path) {
+  MappedInputFile manifest(path);
+  if (!manifest.Opened()) {
+    error("%s", manifest.Error());
+    return false;
+  }
+  const char *p = reinterpret_cast<const char *>(manifest.Buffer());
+  const char *end = p + manifest.Length();
+  bool ok = true;
+  while (ok && p < end) {
+    const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (eol == NULL) {
+      eol = end;
     }
-
-    p += 16;  // skip to comment length field
-    u2 comment_length = get_u2le(p);
-
-    // Does the comment go exactly till the end of the file?
-    if (current + comment_length + CENTRAL_DIR_LOCATOR_SIZE
-        != bytes + in_length) {
+    std::string line(p, eol);
+    p = eol + 1;
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty()) {
       continue;
     }
-
-    // Hooray, we found it!
-    found = true;
-    break;
+    size_t tab = line.find('\t');
+    if (tab == std::string::npos) {
+      errno = EINVAL;
+      error("%s: expected <path>TAB<name>, got '%s'\n", path, line.c_str());
+      ok = false;
+    } else {
+      ok = AddEntry(line.substr(tab + 1), line.substr(0, tab));
+    }
   }
+  manifest.Close();
+  return ok && SortEntries();
+}
 
-  if (!found) {
-    fprintf(stderr, "file is invalid or corrupted (missing end of central "
-                    "directory record)\n");
+bool InputFileList::ProcessNext() {
+  if (current_ >= entries_.size()) {
     return false;
   }
-
-  EndOfCentralDirectoryRecord cd;
-  const u1* end_of_central_dir = current;
-  get_u4le(current);  // central directory locator signature, already checked
-  cd.number_of_this_disk = get_u2le(current);
-  cd.disk_with_central_dir = get_u2le(current);
-  cd.central_dir_entries_on_this_disk = get_u2le(current);
-  cd.central_dir_entries = get_u2le(current);
-  cd.central_dir_size = get_u4le(current);
-  cd.central_dir_offset = get_u4le(current);
-  u2 file_comment_length = get_u2le(current);
-  current += file_comment_length;  // set current to the end of the central dir
-
-  if (!FindZip64CentralDirectory(bytes, in_length, &end_of_central_dir, &cd)) {
-    return false;
+  const Entry &entry = entries_[current_++];
+  u4 attr = stat_to_zipattr(entry.stat);
+  if (!processor->Accept(entry.name.c_str(), attr)) {
+    return true;
   }
-
-  if (cd.number_of_this_disk != 0 || cd.disk_with_central_dir != 0 ||
-      cd.central_dir_entries_on_this_disk != cd.central_dir_entries) {
-    fprintf(stderr, "multi-disk JAR files are not supported\n");
+  if (entry.stat.total_size == 0) {
+    // Empty files cannot be mapped.
+    static const u1 kEmpty[1] = {0};
+    processor->Process(entry.name.c_str(), attr, kEmpty, 0);
+    return true;
+  }
+  MappedInputFile input_file(entry.path.c_str());
+  if (!input_file.Opened()) {
+    error("Cannot open %s: %s\n", entry.path.c_str(), input_file.Error());
     return false;
   }
-
-  // Do not change output values before determining that they are OK.
-  *offset = cd.central_dir_offset;
-  // Central directory start can then be used to determine the actual
-  // starts of the zip file (which can be different in case of a non-zip
-  // header like for auto-extractable binaries).
-  *central_dir = end_of_central_dir - cd.central_dir_size;
+  processor->Process(entry.name.c_str(), attr, input_file.Buffer(),
+                     input_file.Length());
+  input_file.Discard(input_file.Length());
+  input_file.Close();
   return true;
 }
 
-void InputZipFile::Reset() {
-  central_dir_current_ = central_dir_;
-  bytes_unmapped_ = 0;
-  p = zipdata_in_ + in_offset_;
+// Gives a maximum bound on the size of the interface JAR, as if all the
+// accepted files were stored, the same way ZipBuilder::EstimateSize() does.
+u8 InputFileList::CalculateOutputLength() {
+  u8 size = 104;
+  for (const Entry &entry : entries_) {
+    if (processor->Accept(entry.name.c_str(), stat_to_zipattr(entry.stat))) {
+      size += entry.stat.total_size + 100 + 2 * entry.name.size();
+    }
+  }
+  return size;
 }
 
 int ZipExtractor::ProcessAll() {
@@ -788,6 +668,18 @@ int ZipExtractor::ProcessAll() {
 
 ZipExtractor* ZipExtractor::Create(const char* filename,
                                    ZipExtractorProcessor *processor) {
+  Stat file_stat;
+  if (stat_file(filename, &file_stat) && file_stat.is_directory) {
+    InputFileList* result = new InputFileList(processor);
+    if (!result->OpenDirectory(filename)) {
+      fprintf(stderr, "Listing directory \"%s\": %s\n", filename,
+              result->GetError());
+      delete result;
+      return NULL;
+    }
+    return result;
+  }
+
   InputZipFile* result = new InputZipFile(processor, filename);
   if (!result->Open()) {
     fprintf(stderr, "Opening zip \"%s\": %s\n", filename, result->GetError());
@@ -798,12 +690,22 @@ ZipExtractor* ZipExtractor::Create(const char* filename,
   return result;
 }
 
-// zipdata_in_, in_offset_, p, central_dir_current_
+ZipExtractor* ZipExtractor::CreateFromManifest(
+    const char* manifest, ZipExtractorProcessor *processor) {
+  InputFileList* result = new InputFileList(processor);
+  if (!result->OpenManifest(manifest)) {
+    fprintf(stderr, "Reading manifest \"%s\": %s\n", manifest,
+            result->GetError());
+    delete result;
+    return NULL;
+  }
+  return result;
+}
 
 InputZipFile::InputZipFile(ZipExtractorProcessor *processor,
                            const char* filename)
     : processor(processor), filename_(filename), input_file_(NULL),
-      bytes_unmapped_(0) {
+      bytes_unmapped_(0), local_headers_ordered_(true) {
   decompressor_ = new Decompressor();
   errmsg[0] = 0;
 }
@@ -816,28 +718,29 @@ bool InputZipFile::Open() {
     return false;
   }
 
-  void *zipdata_in = input_file->Buffer();
-  u4 central_dir_offset;
-  const u1 *central_dir = NULL;
-
-  if (!devtools_ijar::FindZipCentralDirectory(
-          static_cast<const u1*>(zipdata_in), input_file->Length(),
-          &central_dir_offset, &central_dir)) {
+  const u1 *zipdata_start = static_cast<const u1*>(input_file->Buffer());
+  const char *central_dir_error = central_dir_.locate(
+      zipdata_start, zipdata_start + input_file->Length());
+  if (central_dir_error != NULL) {
     errno = EIO;  // we don't really have a good error number
-    error("Cannot find central directory");
+    error("Cannot find central directory: %s", central_dir_error);
     delete input_file;
     return false;
   }
-  const u1 *zipdata_start = static_cast<const u1*>(zipdata_in);
-  in_offset_ = - static_cast<off_t>(zipdata_start
-                                    + central_dir_offset
-                                    - central_dir);
+
+  u8 previous_offset = 0;
+  for (const CDH *cdh = central_dir_.first(); cdh->is();
+       cdh = central_dir_.next(cdh)) {
+    if (cdh->local_header_offset() < previous_offset) {
+      local_headers_ordered_ = false;
+      break;
+    }
+    previous_offset = cdh->local_header_offset();
+  }
 
   input_file_ = input_file;
   zipdata_in_ = zipdata_start;
-  central_dir_ = central_dir;
-  central_dir_current_ = central_dir;
-  p = zipdata_in_ + in_offset_;
+  central_dir_current_ = central_dir_.first();
   errmsg[0] = 0;
   return true;
 }
@@ -883,6 +786,7 @@ int OutputZipFile::WriteEmptyFile(const char *filename) {
   entry->compression_method = 0;
   entry->extra_field = (const u1 *)"";
   entry->file_name = (u1*) strdup((const char *) file_name);
+  entry->central_header = NULL;
   entries_.push_back(entry);
 
   return 0;
@@ -893,83 +797,135 @@ void OutputZipFile::WriteCentralDirectory() {
   const u1 *central_directory_start = q;
   for (size_t ii = 0; ii < entries_.size(); ++ii) {
     LocalFileEntry *entry = entries_[ii];
-    put_u4le(q, CENTRAL_FILE_HEADER_SIGNATURE);
-    put_u2le(q, UNIX_ZIP_FILE_VERSION);
-
-    put_u2le(q, ZIP_VERSION_TO_EXTRACT);  // version to extract
-    put_u2le(q, 0);  // general purpose bit flag
-    put_u2le(q, entry->compression_method);  // compression method:
-    put_u4le(q, kDefaultTimestamp);          // last_mod_file date and time
-    put_u4le(q, entry->crc32);  // crc32
-    put_u4le(q, entry->compressed_length);    // compressed_size
-    put_u4le(q, entry->uncompressed_length);  // uncompressed_size
-    put_u2le(q, entry->file_name_length);
-    put_u2le(q, entry->extra_field_length);
-
-    put_u2le(q, 0);  // file comment length
-    put_u2le(q, 0);  // disk number start
-    put_u2le(q, 0);  // internal file attributes
-    put_u4le(q, entry->external_attr);  // external file attributes
-    // relative offset of local header:
-    put_u4le(q, entry->local_header_offset);
-
-    put_n(q, entry->file_name, entry->file_name_length);
-    put_n(q, entry->extra_field, entry->extra_field_length);
+    if (entry->central_header != NULL) {
+      WriteKeptCentralHeader(entry);
+      continue;
+    }
+    CDH *cdh = reinterpret_cast<CDH *>(q);
+    cdh->signature();
+    cdh->version(UNIX_ZIP_FILE_VERSION);
+    cdh->version_to_extract(ZIP_VERSION_TO_EXTRACT);
+    cdh->bit_flag(0);
+    cdh->compression_method(entry->compression_method);
+    cdh->last_mod_file_time(kDefaultTimestamp & 0xFFFF);
+    cdh->last_mod_file_date(kDefaultTimestamp >> 16);
+    cdh->crc32(entry->crc32);
+    cdh->compressed_file_size32(entry->compressed_length);
+    cdh->uncompressed_file_size32(entry->uncompressed_length);
+    cdh->file_name(reinterpret_cast<const char *>(entry->file_name),
+                   entry->file_name_length);
+    cdh->comment_length(0);
+    cdh->start_disk_nr(0);
+    cdh->internal_attributes(0);
+    cdh->external_attributes(entry->external_attr);
+
+    // Entries are limited to 4GB by FinishFile(), but their local headers
+    // may start beyond 4GB, in which case the offset goes to the Zip64 extra
+    // field.
+    u1 *extra_fields = cdh->extra_fields();
+    if (ziph::zfield_needs_ext64(entry->local_header_offset)) {
+      cdh->local_header_offset32(0xFFFFFFFF);
+      Zip64ExtraField *zip64_ef =
+          reinterpret_cast<Zip64ExtraField *>(extra_fields);
+      zip64_ef->signature();
+      zip64_ef->attr_count(1);
+      zip64_ef->attr64(0, entry->local_header_offset);
+      extra_fields += zip64_ef->size();
+    } else {
+      cdh->local_header_offset32(entry->local_header_offset);
+    }
+    memcpy(extra_fields, entry->extra_field, entry->extra_field_length);
+    extra_fields += entry->extra_field_length;
+    cdh->extra_fields(cdh->extra_fields(), extra_fields - cdh->extra_fields());
+    q += cdh->size();
   }
   u8 central_directory_size = q - central_directory_start;
 
   if (entries_.size() > U2_MAX || central_directory_size > U4_MAX ||
       Offset(central_directory_start) > U4_MAX) {
-    u1 *zip64_end_of_central_directory_start = q;
-
-    put_u4le(q, ZIP64_EOCD_SIGNATURE);
+    ECD64 *ecd64 = reinterpret_cast<ECD64 *>(q);
+    ecd64->signature();
     // signature and size field doesn't count towards size
-    put_u8le(q, ZIP64_EOCD_FIXED_SIZE - 12);
-    put_u2le(q, UNIX_ZIP_FILE_VERSION);  // version made by
-    put_u2le(q, 0);  // version needed to extract
-    put_u4le(q, 0);  // number of this disk
-    put_u4le(q, 0);  // # of the disk with the start of the central directory
-    put_u8le(q, entries_.size());  // # central dir entries on this disk
-    put_u8le(q, entries_.size());  // total # entries in the central directory
-    put_u8le(q, central_directory_size);  // size of the central directory
-    // offset of start of central directory wrt starting disk
-    put_u8le(q, Offset(central_directory_start));
-
-    put_u4le(q, ZIP64_EOCD_LOCATOR_SIGNATURE);
-    // number of the disk with the start of the zip64 end of central directory
-    put_u4le(q, 0);
-    // relative offset of the zip64 end of central directory record
-    put_u8le(q, Offset(zip64_end_of_central_directory_start));
-    // total number of disks
-    put_u4le(q, 1);
-
-    put_u4le(q, EOCD_SIGNATURE);
-    put_u2le(q, 0);  // number of this disk
-    put_u2le(q, 0);  // # of disk with the start of the central directory
-    // # central dir entries on this disk
-    put_u2le(q, entries_.size() > 0xffff ? 0xffff : entries_.size());
-    // total # entries in the central directory
-    put_u2le(q, entries_.size() > 0xffff ? 0xffff : entries_.size());
-    // size of the central directory
-    put_u4le(q,
-             central_directory_size > U4_MAX ? U4_MAX : central_directory_size);
-    // offset of start of central
-    put_u4le(q, Offset(central_directory_start) > U4_MAX
-                    ? U4_MAX
-                    : Offset(central_directory_start));
-    put_u2le(q, 0);  // .ZIP file comment length
+    ecd64->remaining_size(sizeof(ECD64) - 12);
+    ecd64->version(UNIX_ZIP_FILE_VERSION);
+    ecd64->version_to_extract(0);
+    ecd64->this_disk_nr(0);
+    ecd64->cen_disk_nr(0);
+    ecd64->this_disk_entries(entries_.size());
+    ecd64->total_entries(entries_.size());
+    ecd64->cen_size(central_directory_size);
+    ecd64->cen_offset(Offset(central_directory_start));
+    q += sizeof(ECD64);
+
+    ECD64Locator *locator = reinterpret_cast<ECD64Locator *>(q);
+    locator->signature();
+    locator->ecd64_disk_nr(0);
+    locator->ecd64_offset(Offset(reinterpret_cast<u1 *>(ecd64)));
+    locator->total_disks(1);
+    q += sizeof(ECD64Locator);
+  }
+
+  ECD *ecd = reinterpret_cast<ECD *>(q);
+  ecd->signature();
+  ecd->this_disk_nr(0);
+  ecd->cen_disk_nr(0);
+  ecd->this_disk_entries16(entries_.size() > U2_MAX ? U2_MAX : entries_.size());
+  ecd->total_entries16(entries_.size() > U2_MAX ? U2_MAX : entries_.size());
+  ecd->cen_size32(central_directory_size > U4_MAX ? U4_MAX
+                                                  : central_directory_size);
+  ecd->cen_offset32(Offset(central_directory_start) > U4_MAX
+                        ? U4_MAX
+                        : Offset(central_directory_start));
+  ecd->comment(NULL, 0);
+  q += sizeof(ECD);
+}
+
+void OutputZipFile::WriteKeptCentralHeader(const LocalFileEntry *entry) {
+  const CDH *kept = reinterpret_cast<const CDH *>(entry->central_header);
+  CDH *cdh = reinterpret_cast<CDH *>(q);
+  memcpy(cdh, kept, sizeof(CDH) + kept->file_name_length());
 
+  // The Zip64 extra field is rebuilt as the local header offset may have
+  // moved across the 4GB boundary, the other extra fields are copied as is.
+  u8 attrs[3];
+  int attr_count = 0;
+  if (ziph::zfield_has_ext64(kept->uncompressed_file_size32())) {
+    attrs[attr_count++] = kept->uncompressed_file_size();
+  }
+  if (ziph::zfield_has_ext64(kept->compressed_file_size32())) {
+    attrs[attr_count++] = kept->compressed_file_size();
+  }
+  if (ziph::zfield_needs_ext64(entry->local_header_offset)) {
+    cdh->local_header_offset32(0xFFFFFFFF);
+    attrs[attr_count++] = entry->local_header_offset;
   } else {
-    put_u4le(q, EOCD_SIGNATURE);
-    put_u2le(q, 0);  // number of this disk
-    put_u2le(q, 0);  // # of the disk with the start of the central directory
-    put_u2le(q, entries_.size());  // # central dir entries on this disk
-    put_u2le(q, entries_.size());  // total # entries in the central directory
-    put_u4le(q, central_directory_size);  // size of the central directory
-    // offset of start of central directory wrt starting disk
-    put_u4le(q, Offset(central_directory_start));
-    put_u2le(q, 0);  // .ZIP file comment length
+    cdh->local_header_offset32(entry->local_header_offset);
+  }
+  u1 *extra_fields = cdh->extra_fields();
+  if (attr_count > 0) {
+    Zip64ExtraField *zip64_ef =
+        reinterpret_cast<Zip64ExtraField *>(extra_fields);
+    zip64_ef->signature();
+    zip64_ef->attr_count(attr_count);
+    for (int i = 0; i < attr_count; ++i) {
+      zip64_ef->attr64(i, attrs[i]);
+    }
+    extra_fields += zip64_ef->size();
+  }
+  const u1 *kept_extra_fields_end =
+      kept->extra_fields() + kept->extra_fields_length();
+  for (const ExtraField *ef =
+           reinterpret_cast<const ExtraField *>(kept->extra_fields());
+       reinterpret_cast<const u1 *>(ef) < kept_extra_fields_end;
+       ef = ef->next()) {
+    if (!ef->is_zip64()) {
+      memcpy(extra_fields, ef, ef->size());
+      extra_fields += ef->size();
+    }
   }
+  cdh->extra_fields(cdh->extra_fields(), extra_fields - cdh->extra_fields());
+  memcpy(extra_fields, kept_extra_fields_end, kept->comment_length());
+  q += cdh->size();
 }
 
 u1* OutputZipFile::WriteLocalFileHeader(const char* filename, const u4 attr) {
@@ -983,6 +939,7 @@ u1* OutputZipFile::WriteLocalFileHeader(const char* filename, const u4 attr) {
   entry->extra_field_length = 0;
   entry->extra_field = (const u1 *)"";
   entry->crc32 = 0;
+  entry->central_header = NULL;
 
   // Output the ZIP local_file_header:
   put_u4le(q, LOCAL_FILE_HEADER_SIGNATURE);
@@ -1026,7 +983,7 @@ size_t OutputZipFile::WriteFileSizeInLocalFileHeader(u1 *header_ptr,
 }
 
 int OutputZipFile::Finish() {
-  if (finished_) {
+  if (finished_ || output_file_ == NULL) {
     return 0;
   }
 
@@ -1047,6 +1004,13 @@ u1* OutputZipFile::NewFile(const char* filename, const u4 attr) {
 
 int OutputZipFile::FinishFile(size_t filelength, bool compress,
                               bool compute_crc) {
+  // The local file header has no room for the Zip64 extra field.
+  if (ziph::zfield_needs_ext64(filelength)) {
+    return error("File %.*s is too large (%zu bytes), Zip entries are "
+                 "limited to 4GB.\n",
+                 entries_.back()->file_name_length, entries_.back()->file_name,
+                 filelength);
+  }
   u4 crc = 0;
   if (compute_crc) {
     crc = ComputeCrcChecksum(q, filelength);
@@ -1076,18 +1040,9 @@ int OutputZipFile::FinishFile(size_t filelength, bool compress,
   return 0;
 }
 
-bool OutputZipFile::Open() {
-  if (estimated_size_ > kMaximumOutputSize) {
-    fprintf(stderr,
-            "Uncompressed input jar has size %zu, "
-            "which exceeds the maximum supported output size %zu.\n"
-            "Assuming that ijar will be smaller and hoping for the best.\n",
-            estimated_size_, kMaximumOutputSize);
-    estimated_size_ = kMaximumOutputSize;
-  }
-
+bool OutputZipFile::Open(bool keep_contents) {
   MappedOutputFile* output_file = new MappedOutputFile(
-      filename_, estimated_size_);
+      filename_, estimated_size_, keep_contents);
   if (!output_file->Opened()) {
     snprintf(errmsg, sizeof(errmsg), "%s", output_file->Error());
     delete output_file;
@@ -1100,6 +1055,128 @@ bool OutputZipFile::Open() {
   return true;
 }
 
+bool OutputZipFile::OpenForUpdate(char const* const* removed_paths,
+                                  int nb_removed, double max_garbage_ratio) {
+  MappedInputFile input_file(filename_);
+  if (!input_file.Opened()) {
+    snprintf(errmsg, sizeof(errmsg), "%s", input_file.Error());
+    return false;
+  }
+  const u1 *zipdata_start = input_file.Buffer();
+  CentralDirectory central_dir;
+  const char *central_dir_error = central_dir.locate(
+      zipdata_start, zipdata_start + input_file.Length());
+  if (central_dir_error != NULL) {
+    error("Cannot find central directory: %s", central_dir_error);
+    input_file.Close();
+    return false;
+  }
+  if (central_dir.preamble_size() != 0) {
+    error("Updating a zip file with a preamble is not supported");
+    input_file.Close();
+    return false;
+  }
+
+  const size_t cen_offset =
+      reinterpret_cast<const u1 *>(central_dir.first()) - zipdata_start;
+  std::set<std::string> removed(removed_paths, removed_paths + nb_removed);
+  std::vector<std::pair<size_t, size_t> > extents;  // offset, length
+  size_t live_bytes = 0;
+  for (const CDH *cdh = central_dir.first(); cdh->is();
+       cdh = central_dir.next(cdh)) {
+    if (removed.count(cdh->file_name_string()) != 0) {
+      continue;
+    }
+    const LH *lh = central_dir.local_header(cdh);
+    if (lh == NULL || !lh->is()) {
+      error("Bad local header for %s", cdh->file_name_string().c_str());
+      input_file.Close();
+      return false;
+    }
+    size_t offset = reinterpret_cast<const u1 *>(lh) - zipdata_start;
+    size_t length = lh->size() + cdh->compressed_file_size();
+    if (cdh->no_size_in_local_header() &&
+        offset + length + sizeof(DDR) <= cen_offset) {
+      const DDR *ddr = reinterpret_cast<const DDR *>(zipdata_start + offset +
+                                                     length);
+      bool zip64 = lh->zip64_extra_field() != NULL;
+      length += ddr->size(zip64, zip64);
+    }
+    if (offset + length > cen_offset) {
+      error("Entry %s overlaps the central directory",
+            cdh->file_name_string().c_str());
+      input_file.Close();
+      return false;
+    }
+
+    LocalFileEntry *entry = new LocalFileEntry;
+    entry->local_header_offset = offset;
+    entry->central_header = new u1[cdh->size()];
+    memcpy(entry->central_header, cdh, cdh->size());
+    entry->file_name = entry->central_header + sizeof(CDH);
+    entry->file_name_length = cdh->file_name_length();
+    entries_.push_back(entry);
+    extents.push_back(std::make_pair(offset, length));
+    live_bytes += length;
+  }
+
+  // Entries must not share bytes for them to be moved.
+  std::vector<size_t> order(entries_.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&extents](size_t a, size_t b) {
+    return extents[a].first < extents[b].first;
+  });
+  size_t entries_end = 0;
+  for (size_t i : order) {
+    if (extents[i].first < entries_end) {
+      error("Entry %.*s overlaps another entry",
+            entries_[i]->file_name_length, entries_[i]->file_name);
+      input_file.Close();
+      return false;
+    }
+    entries_end = extents[i].first + extents[i].second;
+  }
+  // Without compaction, new entries overwrite the old central directory.
+  size_t garbage = cen_offset - live_bytes;
+  bool compact = garbage > max_garbage_ratio * cen_offset;
+
+  // Kept central directory headers may grow a Zip64 extra field.
+  estimated_size_ += input_file.Length() +
+                     entries_.size() * Zip64ExtraField::space_needed(3);
+  input_file.Close();
+  if (!Open(true)) {
+    return false;
+  }
+  q = zipdata_out_ + cen_offset;
+  if (compact) {
+    q = zipdata_out_;
+    for (size_t i : order) {
+      if (q != zipdata_out_ + extents[i].first) {
+        memmove(q, zipdata_out_ + extents[i].first, extents[i].second);
+        entries_[i]->local_header_offset = Offset(q);
+      }
+      q += extents[i].second;
+    }
+  }
+  return true;
+}
+
+ZipBuilder *ZipBuilder::Update(const char *zip_file, size_t estimated_size,
+                               char const* const* removed_paths,
+                               int nb_removed, double max_garbage_ratio) {
+  OutputZipFile* result = new OutputZipFile(zip_file, estimated_size);
+  if (!result->OpenForUpdate(removed_paths, nb_removed, max_garbage_ratio)) {
+    fprintf(stderr, "Updating zip \"%s\": %s\n", zip_file,
+            result->GetError());
+    delete result;
+    return NULL;
+  }
+
+  return result;
+}
+
 ZipBuilder *ZipBuilder::Create(const char *zip_file, size_t estimated_size) {
   OutputZipFile* result = new OutputZipFile(zip_file, estimated_size);
   if (!result->Open()) {
@@ -1115,8 +1192,10 @@ u8 ZipBuilder::EstimateSize(char const* const* files,
                             char const* const* zip_paths,
                             int nb_entries) {
   Stat file_stat;
-  // Digital signature field size = 6, End of central directory = 22, Total = 28
-  u8 size = 28;
+  // Digital signature field size = 6, End of central directory = 22,
+  // Zip64 end of central directory = 56, Zip64 end of central directory
+  // locator = 20, Total = 104
+  u8 size = 104;
   // Count the size of all the files in the input to estimate the size of the
   // output.
   for (int i = 0; i < nb_entries; i++) {
@@ -1130,8 +1209,9 @@ u8 ZipBuilder::EstimateSize(char const* const* files,
     // local file header = 30 bytes
     // data descriptor = 12 bytes
     // central directory descriptor = 46 bytes
-    //    Total: 88bytes
-    size += 88;
+    // Zip64 extra field of the central directory descriptor = 12 bytes
+    //    Total: 100bytes
+    size += 100;
     // The filename is stored twice (once in the central directory
     // and once in the local file header).
     size += strlen((zip_paths[i] != NULL) ? zip_paths[i] : files[i]) * 2;
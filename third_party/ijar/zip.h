@@ -95,6 +95,21 @@ class ZipBuilder {
   // On failure, returns NULL. Refer to errno for error code.
   static ZipBuilder* Create(const char* zip_file, size_t estimated_size);
 
+  // Open the existing ZIP file zip_file for update. The entries named in the
+  // "removed_paths" array of nb_removed paths are dropped, all the other ones
+  // are kept without being decompressed or even read: their bytes stay where
+  // they are and only the central directory is rewritten when Finish() is
+  // called. Files added through NewFile/FinishFile/WriteEmptyFile are
+  // appended after the kept entries and estimated_size is the size
+  // ZipBuilder::EstimateSize() returns for them. When the bytes no longer
+  // referenced by the central directory exceed max_garbage_ratio of the
+  // entries, the kept entries are moved down to compact the file first.
+  // The file is modified in place and is left corrupted if the update fails.
+  // On failure, returns NULL and prints the error.
+  static ZipBuilder* Update(const char* zip_file, size_t estimated_size,
+                            char const* const* removed_paths, int nb_removed,
+                            double max_garbage_ratio);
+
   // Estimate the maximum size of the ZIP files containing files in the "files"
   // null-terminated array.
   // Returns 0 on error.
@@ -157,11 +172,23 @@ class ZipExtractor {
   virtual u8 CalculateOutputLength() = 0;
 
   // Create a ZipExtractor that extract the zip file "filename" and process
-  // it with "processor".
+  // it with "processor". If "filename" is a directory, the files under it are
+  // processed instead, as if they were the entries of a ZIP file named by
+  // their paths relative to the directory.
   // On error, a null pointer is returned and the value of errno should be
   // checked.
   static ZipExtractor* Create(const char* filename,
                               ZipExtractorProcessor *processor);
+
+  // Create a ZipExtractor that processes the files listed in "manifest" with
+  // "processor", as if they were the entries of a ZIP file. Each line of the
+  // manifest is the path of a file, a tab, and the name of its entry.
+  // Both kinds of plain file inputs are processed in the order of the entry
+  // names, so that the output does not depend on the order of the listing.
+  // On error, a null pointer is returned and the value of errno should be
+  // checked.
+  static ZipExtractor* CreateFromManifest(const char* manifest,
+                                          ZipExtractorProcessor *processor);
 };
 
 }  // namespace devtools_ijar
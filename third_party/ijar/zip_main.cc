@@ -30,6 +30,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "third_party/ijar/platform_utils.h"
 #include "third_party/ijar/zip.h"
@@ -175,6 +176,27 @@ int extract(char *zipfile, char *exdir, char **files, bool verbose,
   return 0;
 }
 
+// Compute in path the path of a file in the zip, flattening it if requested.
+bool entry_path(char *final_path, bool flatten, bool isdir, char *path) {
+  size_t len = strlen(final_path);
+  if (len > PATH_MAX) {
+    fprintf(stderr, "Path too long: %s.\n", final_path);
+    return false;
+  }
+  if (flatten) {
+    basename(final_path, path, PATH_MAX);
+  } else {
+    strncpy(path, final_path, PATH_MAX);
+    path[PATH_MAX - 1] = 0;
+    if (isdir && len < PATH_MAX - 1) {
+      // Add the trailing slash for folders
+      path[len] = '/';
+      path[len + 1] = 0;
+    }
+  }
+  return true;
+}
+
 // add a file to the zip
 int add_file(std::unique_ptr<ZipBuilder> const &builder, char *file,
              char *zip_path, bool flatten, bool verbose, bool compress) {
@@ -193,24 +215,10 @@ int add_file(std::unique_ptr<ZipBuilder> const &builder, char *file,
     return 0;
   }
 
-  // Compute the path, flattening it if requested
   char path[PATH_MAX];
-  size_t len = strlen(final_path);
-  if (len > PATH_MAX) {
-    fprintf(stderr, "Path too long: %s.\n", final_path);
+  if (!entry_path(final_path, flatten, isdir, path)) {
     return -1;
   }
-  if (flatten) {
-    basename(final_path, path, PATH_MAX);
-  } else {
-    strncpy(path, final_path, PATH_MAX);
-    path[PATH_MAX - 1] = 0;
-    if (isdir && len < PATH_MAX - 1) {
-      // Add the trailing slash for folders
-      path[len] = '/';
-      path[len + 1] = 0;
-    }
-  }
 
   if (verbose) {
     mode_t perm = file_stat.file_mode & 0777;
@@ -244,7 +252,7 @@ char **read_filelist(char *filename) {
   }
 
   int nb_entries = 1;
-  for (int i = 0; i < file_stat.total_size; i++) {
+  for (u8 i = 0; i < file_stat.total_size; i++) {
     if (data[i] == '\n') {
       nb_entries++;
     }
@@ -260,7 +268,7 @@ char **read_filelist(char *filename) {
   // Create the corresponding array
   int j = 1;
   filelist[0] = content;
-  for (int i = 0; i < file_stat.total_size; i++) {
+  for (u8 i = 0; i < file_stat.total_size; i++) {
     if (content[i] == '\n') {
       content[i] = 0;
       if (i + 1 < file_stat.total_size) {
@@ -345,6 +353,84 @@ int create(char *zipfile, char **file_entries, bool flatten, bool verbose,
   return 0;
 }
 
+// An updated zip file is compacted once a quarter of its entry bytes are not
+// referenced anymore.
+static const double kMaxGarbageRatio = 0.25;
+
+// Execute the update operation: files are added to the zip, replacing the
+// entries with the same path, and the entries given as -zip_path are deleted.
+int update(char *zipfile, char **file_entries, bool flatten, bool verbose,
+           bool compress) {
+  int nb_entries = 0;
+  while (file_entries[nb_entries] != NULL) {
+    nb_entries++;
+  }
+  std::vector<const char *> removed;
+  std::vector<char *> added;
+  for (int i = 0; i < nb_entries; i++) {
+    if (file_entries[i][0] == '-') {
+      removed.push_back(file_entries[i] + 1);
+      if (verbose) {
+        printf("- %s\n", file_entries[i] + 1);
+      }
+    } else {
+      added.push_back(file_entries[i]);
+    }
+  }
+  const int nb_added = added.size();
+  char **zip_paths = added.data();
+  char **files = NULL;
+  std::vector<std::string> replaced;
+  if (nb_added > 0) {
+    files = parse_filelist(zipfile, zip_paths, nb_added, flatten);
+    if (files == NULL) {
+      return -1;
+    }
+    for (int i = 0; i < nb_added; i++) {
+      Stat file_stat = {0, 0666, false};
+      if (files[i] != NULL && !stat_file(files[i], &file_stat)) {
+        fprintf(stderr, "Cannot stat file %s: %s\n", files[i],
+                strerror(errno));
+        return -1;
+      }
+      if (flatten && file_stat.is_directory) {
+        continue;
+      }
+      char path[PATH_MAX];
+      if (!entry_path(zip_paths[i] != NULL ? zip_paths[i] : files[i], flatten,
+                      file_stat.is_directory, path)) {
+        return -1;
+      }
+      replaced.push_back(path);
+    }
+  }
+  for (const std::string &path : replaced) {
+    removed.push_back(path.c_str());
+  }
+
+  u8 size = ZipBuilder::EstimateSize(files, zip_paths, nb_added);
+  if (size == 0) {
+    return -1;
+  }
+  std::unique_ptr<ZipBuilder> builder(ZipBuilder::Update(
+      zipfile, size, removed.data(), removed.size(), kMaxGarbageRatio));
+  if (builder == NULL) {
+    return -1;
+  }
+
+  for (int i = 0; i < nb_added; i++) {
+    if (add_file(builder, files[i], zip_paths[i], flatten, verbose, compress) <
+        0) {
+      return -1;
+    }
+  }
+  if (builder->Finish() < 0) {
+    fprintf(stderr, "%s\n", builder->GetError());
+    return -1;
+  }
+  return 0;
+}
+
 }  // namespace devtools_ijar
 
 //
@@ -352,7 +438,7 @@ int create(char *zipfile, char **file_entries, bool flatten, bool verbose,
 //
 static void usage(char *progname) {
   fprintf(stderr,
-          "Usage: %s [vxc[fC]] x.zip [-d exdir] [[zip_path1=]file1 ... "
+          "Usage: %s [vxcu[fC]] x.zip [-d exdir] [[zip_path1=]file1 ... "
           "[zip_pathn=]filen]\n",
           progname);
   fprintf(stderr, "  v verbose - list all file in x.zip\n");
@@ -361,12 +447,17 @@ static void usage(char *progname) {
           "    an optional directory relative to the current directory "
           "    specified through -d option\n");
   fprintf(stderr, "  c create  - add files to x.zip\n");
+  fprintf(stderr,
+          "  u update  - add files to the existing x.zip, replacing the "
+          "entries with the same path, and delete the entries given as "
+          "-zip_path\n");
   fprintf(stderr,
           "  f flatten - flatten files to use with create or "
           "extract operation\n");
   fprintf(stderr,
-          "  C compress - compress files when using the create operation\n");
-  fprintf(stderr, "x and c cannot be used in the same command-line.\n");
+          "  C compress - compress files when using the create or update "
+          "operation\n");
+  fprintf(stderr, "x, c and u cannot be used in the same command-line.\n");
   fprintf(stderr,
           "\nFor every file, a path in the zip can be specified. Examples:\n");
   fprintf(stderr,
@@ -375,6 +466,9 @@ static void usage(char *progname) {
   fprintf(stderr,
           "  zipper c x.zip a/b/main.py=foo/bar/bin.py # Add file "
           "foo/bar/bin.py at a/b/main.py\n");
+  fprintf(stderr,
+          "  zipper u x.zip -a/b/old.py a/b/main.py=bin.py # Delete "
+          "a/b/old.py and replace a/b/main.py\n");
   fprintf(stderr,
           "\nIf the zip path is not specified, it is assumed to be the file "
           "path.\n");
@@ -385,6 +479,7 @@ int main(int argc, char **argv) {
   bool extract = false;
   bool verbose = false;
   bool create = false;
+  bool update = false;
   bool compress = false;
   bool flatten = false;
 
@@ -403,6 +498,9 @@ int main(int argc, char **argv) {
     case 'c':
       create = true;
       break;
+    case 'u':
+      update = true;
+      break;
     case 'f':
       flatten = true;
       break;
@@ -414,14 +512,14 @@ int main(int argc, char **argv) {
     }
   }
 
-  // x and c cannot be used in the same command-line.
-  if (create && extract) {
+  // x, c and u cannot be used in the same command-line.
+  if ((create && extract) || (update && (create || extract))) {
     usage(argv[0]);
   }
 
   // Calculate the argument index of the first entry file.
   int filelist_start_index;
-  if (argc > 3 && strcmp(argv[3], "-d") == 0) {
+  if (!update && argc > 3 && strcmp(argv[3], "-d") == 0) {
     filelist_start_index = 5;
   } else {
     filelist_start_index = 3;
@@ -449,9 +547,16 @@ int main(int argc, char **argv) {
       fprintf(stderr, "Can't create zip without input files specified.");
       return -1;
     }
+    if (update) {
+      fprintf(stderr, "Can't update zip without input files specified.");
+      return -1;
+    }
   }
 
-  if (create) {
+  if (update) {
+    return devtools_ijar::update(argv[2], filelist, flatten, verbose,
+                                 compress);
+  } else if (create) {
     // Create a zip
     return devtools_ijar::create(argv[2], filelist, flatten, verbose, compress);
   } else {
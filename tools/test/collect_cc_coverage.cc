@@ -0,0 +1,400 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Native replacement for tools/test/collect_cc_coverage.sh.
+//
+// The script runs gcov once per .gcda file, one after the other, and then
+// concatenates the resulting .gcov files. This tool runs the gcov invocations
+// concurrently, each in its own scratch directory (gcov writes its output to
+// the current directory, so concurrent runs cannot share one), and streams
+// their results into the output file in manifest order, so the output is
+// deterministic and the scratch files are deleted as soon as they are merged.
+//
+// It reads the same environment variables as the script:
+// - COVERAGE_DIR            Directory containing the .gcda or .profraw files.
+// - COVERAGE_MANIFEST       Location of the instrumented file manifest.
+// - COVERAGE_GCOV_PATH      Location of gcov (or llvm-profdata).
+// - ROOT                    Location from where the code coverage collection
+//                           was invoked.
+// - BAZEL_CC_COVERAGE_TOOL  "GCOV" or "PROFDATA".
+// and additionally:
+// - COVERAGE_COLLECTOR_JOBS How many gcov processes to run at once. Defaults
+//                           to the number of online CPUs.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// A .gcda file to convert, and the state of its conversion.
+struct GcovJob {
+  enum State { kPending, kSkipped, kDone, kFailed };
+
+  // The .gcno path from the manifest, relative to ROOT.
+  std::string gcno;
+  // The scratch directory that gcov writes its output into.
+  std::string scratch_dir;
+  State state = kPending;
+};
+
+// The configuration from the environment.
+struct Config {
+  std::string coverage_dir;
+  std::string manifest;
+  std::string gcov_path;
+  std::string root;
+  int jobs;
+};
+
+std::string GetEnv(const char* name) {
+  const char* value = getenv(name);
+  return value == nullptr ? std::string() : std::string(value);
+}
+
+std::string Absolute(const std::string& cwd, const std::string& path) {
+  return path.empty() || path[0] == '/' ? path : cwd + "/" + path;
+}
+
+std::string Dirname(const std::string& path) {
+  std::string::size_type pos = path.find_last_of('/');
+  if (pos == std::string::npos) {
+    return ".";
+  }
+  return pos == 0 ? "/" : path.substr(0, pos);
+}
+
+bool EndsWith(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool FileExists(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// Creates `path` and all of its missing parents, like `mkdir -p`. Safe to
+// call concurrently for overlapping paths.
+bool CreateDirectories(const std::string& path) {
+  struct stat st;
+  if (path.empty() || (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))) {
+    return true;
+  }
+  std::string parent = Dirname(path);
+  if (parent != path && !CreateDirectories(parent)) {
+    return false;
+  }
+  if (mkdir(path.c_str(), 0777) != 0 && errno != EEXIST) {
+    fprintf(stderr, "mkdir(%s): %s\n", path.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+// Appends the contents of the file at `path` to `out_fd`.
+bool AppendFile(const std::string& path, int out_fd) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "open(%s): %s\n", path.c_str(), strerror(errno));
+    return false;
+  }
+  char buf[65536];
+  bool ok = true;
+  ssize_t n;
+  while (ok && (n = read(fd, buf, sizeof(buf))) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "read(%s): %s\n", path.c_str(), strerror(errno));
+      ok = false;
+      break;
+    }
+    for (ssize_t written = 0; ok && written < n;) {
+      ssize_t w = write(out_fd, buf + written, n - written);
+      if (w < 0 && errno != EINTR) {
+        fprintf(stderr, "write: %s\n", strerror(errno));
+        ok = false;
+      } else if (w > 0) {
+        written += w;
+      }
+    }
+  }
+  close(fd);
+  return ok;
+}
+
+bool CopyFile(const std::string& from, const std::string& to) {
+  int fd = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "open(%s): %s\n", to.c_str(), strerror(errno));
+    return false;
+  }
+  bool ok = AppendFile(from, fd);
+  return close(fd) == 0 && ok;
+}
+
+// Returns the sorted names of the regular files in `dir`.
+std::vector<std::string> ListFiles(const std::string& dir) {
+  std::vector<std::string> result;
+  DIR* d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return result;
+  }
+  struct dirent* ent;
+  while ((ent = readdir(d)) != nullptr) {
+    if (FileExists(dir + "/" + ent->d_name)) {
+      result.push_back(ent->d_name);
+    }
+  }
+  closedir(d);
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+// Runs `argv` in `cwd` with stdout and stderr redirected to `log`, and returns
+// its exit code.
+int Run(const std::vector<std::string>& argv, const std::string& cwd,
+        const std::string& log) {
+  std::vector<char*> args;
+  for (const auto& arg : argv) {
+    args.push_back(const_cast<char*>(arg.c_str()));
+  }
+  args.push_back(nullptr);
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    fprintf(stderr, "fork: %s\n", strerror(errno));
+    return -1;
+  }
+  if (pid == 0) {
+    if (!cwd.empty() && chdir(cwd.c_str()) != 0) {
+      fprintf(stderr, "chdir(%s): %s\n", cwd.c_str(), strerror(errno));
+      _exit(127);
+    }
+    if (!log.empty()) {
+      int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+      }
+    }
+    execv(args[0], args.data());
+    fprintf(stderr, "execv(%s): %s\n", args[0], strerror(errno));
+    _exit(127);
+  }
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// Converts the .gcda file belonging to `job->gcno` into gcov's intermediate
+// format in `job->scratch_dir`.
+GcovJob::State RunGcov(const Config& config, const std::string& gcov,
+                       GcovJob* job) {
+  const std::string gcno = config.coverage_dir + "/" + job->gcno;
+  const std::string gcda = gcno.substr(0, gcno.size() - 5) + ".gcda";
+  // If the gcda file was not found we skip generating coverage from the gcno
+  // file.
+  if (!FileExists(gcda)) {
+    return GcovJob::kSkipped;
+  }
+  // gcov expects both gcno and gcda files to be in the same directory. We
+  // overcome this by copying the gcno to $COVERAGE_DIR where the gcda files
+  // are expected to be.
+  if (!FileExists(gcno) && (!CreateDirectories(Dirname(gcno)) ||
+                            !CopyFile(config.root + "/" + job->gcno, gcno))) {
+    return GcovJob::kFailed;
+  }
+  if (!CreateDirectories(job->scratch_dir)) {
+    return GcovJob::kFailed;
+  }
+  // See collect_cc_coverage.sh for the meaning of the flags.
+  const std::string log = job->scratch_dir + ".log";
+  int exit_code =
+      Run({gcov, "-i", "-o", Dirname(gcda), gcda}, job->scratch_dir, log);
+  if (exit_code != 0) {
+    // Like the script, keep going and merge whatever gcov managed to write.
+    fprintf(stderr, "gcov failed for %s with exit code %d:\n", gcda.c_str(),
+            exit_code);
+    AppendFile(log, STDERR_FILENO);
+  }
+  unlink(log.c_str());
+  return GcovJob::kDone;
+}
+
+// Generates a code coverage report in gcov intermediate text format by
+// invoking gcov on every .gcda file under COVERAGE_DIR that belongs to a .gcno
+// file in the manifest.
+bool GcovCoverage(const Config& config, const std::string& output_file) {
+  std::vector<GcovJob> jobs;
+  std::ifstream manifest(config.manifest);
+  std::string line;
+  while (std::getline(manifest, line)) {
+    if (EndsWith(line, ".gcno")) {
+      GcovJob job;
+      job.gcno = line;
+      job.scratch_dir =
+          config.coverage_dir + "/_gcov_" + std::to_string(jobs.size());
+      jobs.push_back(job);
+    }
+  }
+
+  // Symlink the gcov tool such with a link called gcov. Clang comes with a
+  // tool called llvm-cov, which behaves like gcov if symlinked in this way
+  // (otherwise we would need to invoke it with "llvm-cov gcov").
+  const std::string gcov = config.coverage_dir + "/gcov";
+  if (symlink(config.gcov_path.c_str(), gcov.c_str()) != 0 &&
+      errno != EEXIST) {
+    fprintf(stderr, "symlink(%s, %s): %s\n", config.gcov_path.c_str(),
+            gcov.c_str(), strerror(errno));
+    return false;
+  }
+
+  int out_fd = open(output_file.c_str(),
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (out_fd < 0) {
+    fprintf(stderr, "open(%s): %s\n", output_file.c_str(), strerror(errno));
+    return false;
+  }
+
+  std::mutex mu;
+  std::condition_variable job_finished;
+  std::atomic<size_t> next_job(0);
+  auto worker = [&]() {
+    for (size_t i = next_job++; i < jobs.size(); i = next_job++) {
+      GcovJob::State state = RunGcov(config, gcov, &jobs[i]);
+      std::lock_guard<std::mutex> lock(mu);
+      jobs[i].state = state;
+      job_finished.notify_all();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < config.jobs && i < static_cast<int>(jobs.size()); ++i) {
+    threads.emplace_back(worker);
+  }
+
+  // Merge the results in manifest order while later jobs are still running.
+  bool ok = true;
+  for (auto& job : jobs) {
+    {
+      std::unique_lock<std::mutex> lock(mu);
+      job_finished.wait(lock,
+                        [&job] { return job.state != GcovJob::kPending; });
+    }
+    if (job.state == GcovJob::kFailed) {
+      ok = false;
+    }
+    for (const auto& name : ListFiles(job.scratch_dir)) {
+      const std::string path = job.scratch_dir + "/" + name;
+      ok = AppendFile(path, out_fd) && ok;
+      // Remove the intermediate gcov file because it is not useful anymore.
+      unlink(path.c_str());
+    }
+    rmdir(job.scratch_dir.c_str());
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return close(out_fd) == 0 && ok;
+}
+
+// Computes code coverage data using the clang generated metadata found under
+// COVERAGE_DIR, by merging all .profraw files into `output_file`.
+bool LlvmCoverage(const Config& config, const std::string& output_file,
+                  const std::vector<std::string>& profraw_files) {
+  std::vector<std::string> argv = {
+      config.gcov_path, "merge", "-output", output_file,
+      "-num-threads=" + std::to_string(config.jobs)};
+  for (const auto& name : profraw_files) {
+    argv.push_back(config.coverage_dir + "/" + name);
+  }
+  return Run(argv, std::string(), std::string()) == 0;
+}
+
+}  // namespace
+
+int main() {
+  char cwd_buf[PATH_MAX];
+  if (getcwd(cwd_buf, sizeof(cwd_buf)) == nullptr) {
+    fprintf(stderr, "getcwd: %s\n", strerror(errno));
+    return 1;
+  }
+  const std::string cwd = cwd_buf;
+
+  Config config;
+  config.coverage_dir = Absolute(cwd, GetEnv("COVERAGE_DIR"));
+  config.manifest = Absolute(cwd, GetEnv("COVERAGE_MANIFEST"));
+  config.gcov_path = Absolute(cwd, GetEnv("COVERAGE_GCOV_PATH"));
+  config.root = Absolute(cwd, GetEnv("ROOT"));
+  config.jobs = atoi(GetEnv("COVERAGE_COLLECTOR_JOBS").c_str());
+  if (config.jobs <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    config.jobs = cpus > 0 ? static_cast<int>(cpus) : 1;
+  }
+  if (config.coverage_dir.empty() || config.gcov_path.empty()) {
+    fprintf(stderr, "COVERAGE_DIR and COVERAGE_GCOV_PATH must be set\n");
+    return 1;
+  }
+
+  // If llvm code coverage is used, we output the raw code coverage report in
+  // the $COVERAGE_OUTPUT_FILE. This report will not be converted to any other
+  // format by LcovMerger.
+  std::string tool = GetEnv("BAZEL_CC_COVERAGE_TOOL");
+  std::vector<std::string> profraw_files;
+  for (const auto& name : ListFiles(config.coverage_dir)) {
+    if (EndsWith(name, ".profraw")) {
+      profraw_files.push_back(name);
+    }
+  }
+  if (!profraw_files.empty()) {
+    tool = "PROFDATA";
+  }
+
+  // Like the script, generate an output file specific to the format under
+  // COVERAGE_DIR, where LcovMerger picks it up.
+  bool ok;
+  if (tool == "GCOV") {
+    ok = GcovCoverage(config, config.coverage_dir + "/_cc_coverage.gcov");
+  } else if (tool == "PROFDATA") {
+    ok = LlvmCoverage(config, config.coverage_dir + "/_cc_coverage.profdata",
+                      profraw_files);
+  } else {
+    fprintf(stderr, "Coverage tool %s not supported\n", tool.c_str());
+    return 1;
+  }
+  return ok ? 0 : 1;
+}
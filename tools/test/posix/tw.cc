@@ -0,0 +1,1278 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Test wrapper implementation for POSIX systems.
+//
+// It does the same job as tools/test/test-setup.sh and
+// tools/test/generate-xml.sh, but without forking a shell and a dozen helper
+// processes for every test. See also tools/test/windows/tw.cc.
+
+#include "tools/test/posix/tw.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "third_party/ijar/common.h"
+#include "third_party/ijar/platform_utils.h"
+#include "third_party/ijar/zip.h"
+
+namespace bazel {
+namespace tools {
+namespace test_wrapper {
+
+namespace {
+
+// Paths to the undeclared outputs and their annotations, as passed by Bazel.
+struct UndeclaredOutputs {
+  std::string root;
+  std::string zip;
+  std::string manifest;
+  std::string annotations;
+  std::string annotations_dir;
+};
+
+// The signal the test wrapper received while the test was running, or 0.
+volatile sig_atomic_t received_signal = 0;
+
+// The pid of the test process, or 0 if it is not running.
+volatile pid_t test_pid = 0;
+
+// The write end of the pipe that SIGCHLD is reported to, or -1.
+volatile int sigchld_fd = -1;
+
+void LogError(const int line, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+void LogError(const int line, const char* format, ...) {
+  fprintf(stderr, "ERROR(" __FILE__ ":%d) ", line);
+  va_list ap;
+  va_start(ap, format);
+  vfprintf(stderr, format, ap);
+  va_end(ap);
+  fputc('\n', stderr);
+}
+
+void LogErrno(const int line, const char* what, const std::string& arg) {
+  int err = errno;
+  LogError(line, "%s (%s): %s", what, arg.c_str(), strerror(err));
+}
+
+inline bool IsAbsolute(const std::string& path) {
+  return !path.empty() && path[0] == '/';
+}
+
+inline std::string Dirname(const std::string& path) {
+  std::string::size_type pos = path.find_last_of('/');
+  if (pos == std::string::npos) {
+    return ".";
+  }
+  return pos == 0 ? "/" : path.substr(0, pos);
+}
+
+inline bool EndsWith(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Returns the value of the environment variable `name`, or the empty string
+// if it's undefined.
+std::string GetEnv(const char* name) {
+  const char* value = getenv(name);
+  return value == nullptr ? std::string() : std::string(value);
+}
+
+bool SetEnv(const char* name, const std::string& value) {
+  if (setenv(name, value.c_str(), 1) != 0) {
+    LogErrno(__LINE__, "Failed to set environment variable", name);
+    return false;
+  }
+  return true;
+}
+
+bool UnsetEnv(const char* name) {
+  if (unsetenv(name) != 0) {
+    LogErrno(__LINE__, "Failed to unset environment variable", name);
+    return false;
+  }
+  return true;
+}
+
+// Makes the path in the environment variable `name` absolute by resolving it
+// against `cwd`. Leaves undefined and empty variables alone.
+bool AbsolutizeEnv(const std::string& cwd, const char* name,
+                   std::string* result = nullptr) {
+  std::string value = GetEnv(name);
+  if (!value.empty() && !IsAbsolute(value)) {
+    value = cwd + "/" + value;
+    if (!SetEnv(name, value)) {
+      return false;
+    }
+  }
+  if (result != nullptr) {
+    *result = value;
+  }
+  return true;
+}
+
+// Creates `path` and all of its missing parents, like `mkdir -p`.
+bool CreateDirectories(const std::string& path) {
+  if (path.empty()) {
+    return true;
+  }
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0) {
+    if (S_ISDIR(st.st_mode)) {
+      return true;
+    }
+    errno = ENOTDIR;
+    LogErrno(__LINE__, "Failed to create directory", path);
+    return false;
+  }
+  std::string parent = Dirname(path);
+  if (parent != path && !CreateDirectories(parent)) {
+    return false;
+  }
+  if (mkdir(path.c_str(), 0777) != 0 && errno != EEXIST) {
+    LogErrno(__LINE__, "Failed to create directory", path);
+    return false;
+  }
+  return true;
+}
+
+bool GetCwd(std::string* result) {
+  char buf[PATH_MAX];
+  if (getcwd(buf, sizeof(buf)) == nullptr) {
+    LogErrno(__LINE__, "Failed to get current directory", ".");
+    return false;
+  }
+  *result = buf;
+  return true;
+}
+
+bool WriteAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+inline void WriteStdout(const std::string& s) {
+  (void)WriteAll(STDOUT_FILENO, s.data(), s.size());
+}
+
+bool WriteFile(const std::string& path, const std::string& content) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0) {
+    LogErrno(__LINE__, "Failed to open file for writing", path);
+    return false;
+  }
+  bool ok = WriteAll(fd, content.data(), content.size());
+  if (!ok) {
+    LogErrno(__LINE__, "Failed to write file", path);
+  }
+  if (close(fd) != 0 && ok) {
+    LogErrno(__LINE__, "Failed to close file", path);
+    ok = false;
+  }
+  return ok;
+}
+
+bool AppendFileTo(const std::string& path, int out_fd) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    LogErrno(__LINE__, "Failed to open file for reading", path);
+    return false;
+  }
+  char buf[16384];
+  ssize_t n;
+  bool ok = true;
+  while (ok && (n = read(fd, buf, sizeof(buf))) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LogErrno(__LINE__, "Failed to read file", path);
+      ok = false;
+    } else if (!WriteAll(out_fd, buf, n)) {
+      LogErrno(__LINE__, "Failed to append file", path);
+      ok = false;
+    }
+  }
+  close(fd);
+  return ok;
+}
+
+// Lists all files and directories under `root`, recursing into directories
+// and following symlinks, like `find -L`. The result is sorted by relative
+// path, so the manifest and the zip file are deterministic. A symlink to one
+// of the directories being listed, `ancestors`, is skipped, like the loops
+// that `find -L` reports.
+//
+// `depth_limit` limits the recursion: 0 means only list the direct children
+// of `root`, a negative value means no limit.
+bool GetFileListRelativeTo(const std::string& root, const std::string& rel,
+                           int depth_limit,
+                           std::set<std::pair<dev_t, ino_t>>* ancestors,
+                           std::vector<FileInfo>* result) {
+  const std::string dir_path = rel.empty() ? root : root + "/" + rel;
+  DIR* dir = opendir(dir_path.c_str());
+  if (dir == nullptr) {
+    LogErrno(__LINE__, "Failed to open directory", dir_path);
+    return false;
+  }
+  std::vector<std::string> names;
+  struct dirent* ent;
+  while ((ent = readdir(dir)) != nullptr) {
+    if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) {
+      names.push_back(ent->d_name);
+    }
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+
+  for (const auto& name : names) {
+    const std::string child_rel = rel.empty() ? name : rel + "/" + name;
+    const std::string child_path = root + "/" + child_rel;
+    struct stat st;
+    if (stat(child_path.c_str(), &st) != 0) {
+      // A dangling symlink; `find -L -type f` would skip it too.
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      const std::pair<dev_t, ino_t> id(st.st_dev, st.st_ino);
+      if (!ancestors->insert(id).second) {
+        continue;
+      }
+      result->push_back(FileInfo(child_rel));
+      bool ok = depth_limit == 0 ||
+                GetFileListRelativeTo(root, child_rel, depth_limit - 1,
+                                      ancestors, result);
+      ancestors->erase(id);
+      if (!ok) {
+        return false;
+      }
+    } else if (S_ISREG(st.st_mode)) {
+      result->push_back(FileInfo(child_rel, static_cast<uint64_t>(st.st_size),
+                                 st.st_mode & 07777));
+    }
+  }
+  return true;
+}
+
+bool GetFileListRelativeTo(const std::string& root,
+                           std::vector<FileInfo>* result,
+                           int depth_limit = -1) {
+  if (!IsAbsolute(root)) {
+    LogError(__LINE__, "Root should be absolute: %s", root.c_str());
+    return false;
+  }
+  struct stat st;
+  if (stat(root.c_str(), &st) != 0) {
+    LogErrno(__LINE__, "Failed to stat directory", root);
+    return false;
+  }
+  std::set<std::pair<dev_t, ino_t>> ancestors;
+  ancestors.insert(std::make_pair(st.st_dev, st.st_ino));
+  return GetFileListRelativeTo(root, std::string(), depth_limit, &ancestors,
+                               result);
+}
+
+// Returns the MIME type of the file name, based on its extension.
+// If the MIME type is unknown, the method returns "application/octet-stream".
+//
+// test-setup.sh asks `file --mime-type` instead, which looks at the contents;
+// the common extensions below give the same answer without forking per file.
+std::string GetMimeType(const std::string& filename) {
+  static constexpr const char* kDefaultMimeType = "application/octet-stream";
+  static const struct {
+    const char* extension;
+    const char* mime_type;
+  } kMimeTypes[] = {
+      {"bmp", "image/bmp"},          {"css", "text/css"},
+      {"csv", "text/csv"},           {"gif", "image/gif"},
+      {"gz", "application/gzip"},    {"htm", "text/html"},
+      {"html", "text/html"},         {"jpeg", "image/jpeg"},
+      {"jpg", "image/jpeg"},         {"js", "application/javascript"},
+      {"json", "application/json"},  {"log", "text/plain"},
+      {"pdf", "application/pdf"},    {"png", "image/png"},
+      {"svg", "image/svg+xml"},      {"tar", "application/x-tar"},
+      {"txt", "text/plain"},         {"xml", "application/xml"},
+      {"zip", "application/zip"},
+  };
+
+  std::string::size_type dot = filename.find_last_of('.');
+  std::string::size_type slash = filename.find_last_of('/');
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash)) {
+    return kDefaultMimeType;
+  }
+  std::string ext = filename.substr(dot + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  for (const auto& e : kMimeTypes) {
+    if (ext == e.extension) {
+      return e.mime_type;
+    }
+  }
+  return kDefaultMimeType;
+}
+
+bool CreateUndeclaredOutputsManifestContent(const std::vector<FileInfo>& files,
+                                            std::string* result) {
+  std::stringstream stm;
+  for (const auto& e : files) {
+    if (!e.IsDirectory()) {
+      // For each file, write a tab-separated line to the manifest with name
+      // (relative to TEST_UNDECLARED_OUTPUTS_DIR), size, and mime type.
+      // Example:
+      //   foo.txt<TAB>9<TAB>text/plain
+      //   bar/baz<TAB>2944<TAB>application/octet-stream
+      stm << e.RelativePath() << "\t" << e.Size() << "\t"
+          << GetMimeType(e.RelativePath()) << "\n";
+    }
+  }
+  *result = stm.str();
+  return true;
+}
+
+bool CreateUndeclaredOutputsManifest(const std::vector<FileInfo>& files,
+                                     const std::string& output) {
+  std::string content;
+  if (!CreateUndeclaredOutputsManifestContent(files, &content)) {
+    LogError(__LINE__, "Failed to create manifest content for file %s",
+             output.c_str());
+    return false;
+  }
+  // Only write the manifest if there are any undeclared output files.
+  return content.empty() || WriteFile(output, content);
+}
+
+bool CreateZip(const std::string& root, const std::vector<FileInfo>& files,
+               const std::string& zip) {
+  // Zip entry names of directories end with "/".
+  std::vector<std::string> abs_paths, entry_paths;
+  abs_paths.reserve(files.size());
+  entry_paths.reserve(files.size());
+  for (const auto& e : files) {
+    abs_paths.push_back(root + "/" + e.RelativePath());
+    entry_paths.push_back(e.IsDirectory() ? e.RelativePath() + "/"
+                                          : e.RelativePath());
+  }
+  // ZipBuilder::EstimateSize expects NULL-terminated arrays.
+  std::vector<const char*> abs_path_ptrs, entry_path_ptrs;
+  for (size_t i = 0; i < files.size(); ++i) {
+    abs_path_ptrs.push_back(abs_paths[i].c_str());
+    entry_path_ptrs.push_back(entry_paths[i].c_str());
+  }
+  abs_path_ptrs.push_back(nullptr);
+  entry_path_ptrs.push_back(nullptr);
+
+  const devtools_ijar::u8 estimated_size =
+      devtools_ijar::ZipBuilder::EstimateSize(
+          abs_path_ptrs.data(), entry_path_ptrs.data(), files.size());
+  if (estimated_size == 0) {
+    LogError(__LINE__, "Failed to estimate zip size");
+    return false;
+  }
+  std::unique_ptr<devtools_ijar::ZipBuilder> zip_builder(
+      devtools_ijar::ZipBuilder::Create(zip.c_str(), estimated_size));
+  if (zip_builder == nullptr) {
+    LogErrno(__LINE__, "Failed to create zip builder", zip);
+    return false;
+  }
+
+  for (size_t i = 0; i < files.size(); ++i) {
+    devtools_ijar::Stat file_stat;
+    file_stat.total_size = files[i].Size();
+    file_stat.is_directory = files[i].IsDirectory();
+    file_stat.file_mode =
+        files[i].IsDirectory() ? (S_IFDIR | 0755) : (S_IFREG | files[i].Mode());
+
+    devtools_ijar::u1* dest = zip_builder->NewFile(
+        entry_paths[i].c_str(), devtools_ijar::stat_to_zipattr(file_stat));
+    if (dest == nullptr) {
+      LogError(__LINE__, "Failed to add new zip entry for file %s: %s",
+               abs_paths[i].c_str(), zip_builder->GetError());
+      return false;
+    }
+    if (!files[i].IsDirectory() &&
+        !devtools_ijar::read_file(abs_paths[i].c_str(), dest,
+                                  files[i].Size())) {
+      LogError(__LINE__, "Failed to dump file into zip: %s",
+               abs_paths[i].c_str());
+      return false;
+    }
+    if (zip_builder->FinishFile(files[i].Size(),
+                                /* compress */ !files[i].IsDirectory(),
+                                /* compute_crc */ true) == -1) {
+      LogError(__LINE__, "Failed to finish writing file to zip: %s: %s",
+               abs_paths[i].c_str(), zip_builder->GetError());
+      return false;
+    }
+  }
+
+  if (zip_builder->Finish() == -1) {
+    LogError(__LINE__, "Failed to write zip file %s: %s", zip.c_str(),
+             zip_builder->GetError());
+    return false;
+  }
+  return true;
+}
+
+bool GetAndUnexportUndeclaredOutputsEnvvars(const std::string& cwd,
+                                            UndeclaredOutputs* result) {
+  // The test may only see TEST_UNDECLARED_OUTPUTS_DIR and
+  // TEST_UNDECLARED_OUTPUTS_ANNOTATIONS_DIR, so keep those but unexport others.
+  if (!AbsolutizeEnv(cwd, "TEST_UNDECLARED_OUTPUTS_DIR", &result->root) ||
+      !AbsolutizeEnv(cwd, "TEST_UNDECLARED_OUTPUTS_ANNOTATIONS_DIR",
+                     &result->annotations_dir) ||
+      !AbsolutizeEnv(cwd, "TEST_UNDECLARED_OUTPUTS_ZIP", &result->zip) ||
+      !UnsetEnv("TEST_UNDECLARED_OUTPUTS_ZIP") ||
+      !AbsolutizeEnv(cwd, "TEST_UNDECLARED_OUTPUTS_MANIFEST",
+                     &result->manifest) ||
+      !UnsetEnv("TEST_UNDECLARED_OUTPUTS_MANIFEST") ||
+      !AbsolutizeEnv(cwd, "TEST_UNDECLARED_OUTPUTS_ANNOTATIONS",
+                     &result->annotations) ||
+      !UnsetEnv("TEST_UNDECLARED_OUTPUTS_ANNOTATIONS")) {
+    return false;
+  }
+  return CreateDirectories(result->root) &&
+         CreateDirectories(result->annotations_dir);
+}
+
+// Exports the environment variables that test-setup.sh exports, and makes the
+// paths in them absolute.
+bool ExportEnvvars(const std::string& cwd, std::string* xml_log,
+                   UndeclaredOutputs* undecl) {
+  // Bazel sets some environment vars to relative paths to improve caching and
+  // support remote execution, where the absolute path may not be known to
+  // Bazel. Convert them to absolute paths here before running the actual test.
+  static constexpr const char* kPathEnvvars[] = {
+      "TEST_PREMATURE_EXIT_FILE",
+      "TEST_WARNINGS_OUTPUT_FILE",
+      "TEST_LOGSPLITTER_OUTPUT_FILE",
+      "TEST_INFRASTRUCTURE_FAILURE_FILE",
+      "TEST_UNUSED_RUNFILES_LOG_FILE",
+      "TEST_SRCDIR",
+      "RUNFILES_DIR",
+      // TODO(ulfjack): Standardize on RUNFILES_DIR and remove the
+      // {JAVA,PYTHON}_RUNFILES vars.
+      "JAVA_RUNFILES",
+      "PYTHON_RUNFILES",
+  };
+  for (const char* name : kPathEnvvars) {
+    if (!AbsolutizeEnv(cwd, name)) {
+      return false;
+    }
+  }
+
+  std::string tmpdir;
+  if (!AbsolutizeEnv(cwd, "TEST_TMPDIR", &tmpdir) ||
+      (!IsAbsolute(GetEnv("HOME")) && !SetEnv("HOME", tmpdir)) ||
+      !AbsolutizeEnv(cwd, "XML_OUTPUT_FILE", xml_log)) {
+    return false;
+  }
+
+  // Set USER to the current user, unless passed by Bazel via --test_env.
+  if (GetEnv("USER").empty()) {
+    struct passwd* pw = getpwuid(geteuid());
+    if (pw != nullptr && !SetEnv("USER", pw->pw_name)) {
+      return false;
+    }
+  }
+
+  // The test shard status file is only set for sharded tests.
+  std::string shard_status_file;
+  if (!AbsolutizeEnv(cwd, "TEST_SHARD_STATUS_FILE", &shard_status_file) ||
+      (!shard_status_file.empty() &&
+       !CreateDirectories(Dirname(shard_status_file)))) {
+    return false;
+  }
+
+  // Create the test temp directory, which may not exist on the remote host
+  // when doing a remote build.
+  if ((!xml_log->empty() && !CreateDirectories(Dirname(*xml_log))) ||
+      !CreateDirectories(tmpdir) ||
+      !GetAndUnexportUndeclaredOutputsEnvvars(cwd, undecl)) {
+    return false;
+  }
+
+  // Tell googletest about Bazel sharding.
+  const std::string total_shards = GetEnv("TEST_TOTAL_SHARDS");
+  if (!total_shards.empty() && atoi(total_shards.c_str()) != 0) {
+    if (!SetEnv("GTEST_SHARD_INDEX", GetEnv("TEST_SHARD_INDEX")) ||
+        !SetEnv("GTEST_TOTAL_SHARDS", total_shards)) {
+      return false;
+    }
+  }
+  // TODO(ulfjack): Update Gunit to accept XML_OUTPUT_FILE and drop the
+  // GUNIT_OUTPUT env variable.
+  if (!SetEnv("GTEST_TMP_DIR", tmpdir) ||
+      !SetEnv("GUNIT_OUTPUT", "xml:" + *xml_log)) {
+    return false;
+  }
+
+  // If RUNFILES_MANIFEST_ONLY is set to 1 and the manifest file does exist,
+  // then test programs should use manifest file to find runfiles.
+  const std::string manifest = GetEnv("TEST_SRCDIR") + "/MANIFEST";
+  if (GetEnv("RUNFILES_MANIFEST_ONLY") == "1" &&
+      access(manifest.c_str(), F_OK) == 0 &&
+      !SetEnv("RUNFILES_MANIFEST_FILE", manifest)) {
+    return false;
+  }
+
+  // If the test is at the top of the tree, we have to add '.' to $PATH.
+  return SetEnv("PATH", ".:" + GetEnv("PATH"));
+}
+
+// Looks up `path` in the runfiles of the test, like `rlocation` in
+// test-setup.sh. Returns the empty string if it's not found.
+std::string Rlocation(const std::string& path) {
+  if (IsAbsolute(path)) {
+    return path;
+  }
+  const std::string srcdir = GetEnv("TEST_SRCDIR");
+  const std::string in_tree = srcdir + "/" + path;
+  if (access(in_tree.c_str(), F_OK) == 0) {
+    return in_tree;
+  }
+  std::ifstream manifest(srcdir + "/MANIFEST");
+  const std::string prefix = path + " ";
+  std::string line;
+  while (std::getline(manifest, line)) {
+    if (line.compare(0, prefix.size(), prefix) == 0) {
+      return line.substr(prefix.size());
+    }
+  }
+  return std::string();
+}
+
+// Changes into the runfiles directory, unless collecting coverage. Normal
+// commands are run in the exec-root where they have access to the entire
+// source tree. By chdir'ing to the runfiles root, tests only have direct
+// access to their declared dependencies.
+bool ChdirToRunfiles() {
+  if (!GetEnv("RUNTEST_PRESERVE_CWD").empty() ||
+      !GetEnv("COVERAGE_DIR").empty()) {
+    return true;
+  }
+  std::string dir = GetEnv("TEST_SRCDIR");
+  const std::string workspace = GetEnv("TEST_WORKSPACE");
+  if (!workspace.empty()) {
+    dir += "/" + workspace;
+  }
+  if (chdir(dir.c_str()) != 0) {
+    WriteStdout("Could not chdir " + dir + "\n");
+    return false;
+  }
+  return true;
+}
+
+void ForwardSignal(int signum) {
+  received_signal = signum;
+  if (test_pid > 0) {
+    kill(test_pid, signum);
+  }
+}
+
+void NotifyChildExited(int) {
+  int saved_errno = errno;
+  if (sigchld_fd >= 0) {
+    char c = 0;
+    (void)write(sigchld_fd, &c, 1);
+  }
+  errno = saved_errno;
+}
+
+const int kForwardedSignals[] = {SIGHUP, SIGINT, SIGQUIT, SIGTERM,
+                                 SIGUSR1, SIGUSR2};
+
+void InstallSignalHandlers() {
+  struct sigaction sa = {};
+  sa.sa_handler = ForwardSignal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  for (int signum : kForwardedSignals) {
+    sigaction(signum, &sa, nullptr);
+  }
+}
+
+void RestoreSignalHandlers() {
+  struct sigaction sa = {};
+  sa.sa_handler = SIG_DFL;
+  sigemptyset(&sa.sa_mask);
+  for (int signum : kForwardedSignals) {
+    sigaction(signum, &sa, nullptr);
+  }
+}
+
+// Makes SIGCHLD write to a non-blocking pipe, so that the exit of the test
+// can be waited for with poll() together with its output.
+bool InstallSigchldHandler(int fds[2]) {
+  if (pipe(fds) != 0) {
+    return false;
+  }
+  for (int i = 0; i < 2; ++i) {
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+  }
+  sigchld_fd = fds[1];
+  struct sigaction sa = {};
+  sa.sa_handler = NotifyChildExited;
+  sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGCHLD, &sa, nullptr);
+  return true;
+}
+
+void RestoreSigchldHandler(int fds[2]) {
+  struct sigaction sa = {};
+  sa.sa_handler = SIG_DFL;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGCHLD, &sa, nullptr);
+  sigchld_fd = -1;
+  close(fds[0]);
+  close(fds[1]);
+}
+
+std::string SignalName(int signum) {
+  switch (signum) {
+    case SIGHUP:
+      return "SIGHUP";
+    case SIGINT:
+      return "SIGINT";
+    case SIGQUIT:
+      return "SIGQUIT";
+    case SIGTERM:
+      return "SIGTERM";
+    case SIGUSR1:
+      return "SIGUSR1";
+    case SIGUSR2:
+      return "SIGUSR2";
+    default:
+      return std::to_string(signum);
+  }
+}
+
+// Links the test binary to "t<N>.exe" in the execution root and points
+// `test_path` at the link, to work around tools that fail on long paths.
+// Activated with --test_env=TEST_SHORT_EXEC_PATH=1, like in test-setup.sh.
+bool ShortenTestPath(const std::string& exec_root, std::string* test_path) {
+  std::string base;
+  struct stat st;
+  for (int qualifier = 0;; ++qualifier) {
+    base = exec_root + "/t" + std::to_string(qualifier);
+    if (lstat(base.c_str(), &st) != 0 &&
+        lstat((base + ".exe").c_str(), &st) != 0 &&
+        lstat((base + ".zip").c_str(), &st) != 0) {
+      break;
+    }
+  }
+  std::string stem = *test_path;
+  std::string::size_type dot = stem.find_last_of('.');
+  std::string::size_type slash = stem.find_last_of('/');
+  if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+    stem.erase(dot);
+  }
+  // sh_test and py_test need the script and the zip next to the binary; the
+  // links dangle for other tests.
+  (void)symlink(stem.c_str(), base.c_str());
+  (void)symlink((stem + ".zip").c_str(), (base + ".zip").c_str());
+  if (symlink(test_path->c_str(), (base + ".exe").c_str()) != 0) {
+    LogErrno(__LINE__, "Failed to create symlink", base + ".exe");
+    return false;
+  }
+  *test_path = base + ".exe";
+  return true;
+}
+
+// Runs the test and waits for it to finish. Everything the test writes to
+// stdout and stderr is copied to stdout, and also to `outerr` unless it is
+// empty. Returns the exit code of the test, in the same form as a shell would.
+int RunSubprocess(const std::vector<std::string>& args,
+                  const std::string& outerr, time_t* duration) {
+  int log_fd = -1;
+  int pipe_fds[2] = {-1, -1};
+  int sigchld_pipe[2] = {-1, -1};
+  if (!outerr.empty()) {
+    log_fd = open(outerr.c_str(),
+                  O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0666);
+    if (log_fd < 0) {
+      LogErrno(__LINE__, "Failed to open file for writing", outerr);
+      return 1;
+    }
+    if (pipe(pipe_fds) != 0) {
+      LogErrno(__LINE__, "Failed to create pipe", outerr);
+      close(log_fd);
+      return 1;
+    }
+    fcntl(pipe_fds[0], F_SETFD, FD_CLOEXEC);
+    if (!InstallSigchldHandler(sigchld_pipe)) {
+      LogErrno(__LINE__, "Failed to create pipe", outerr);
+      close(pipe_fds[0]);
+      close(pipe_fds[1]);
+      close(log_fd);
+      return 1;
+    }
+  }
+
+  std::vector<char*> argv;
+  for (const auto& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  const time_t start = time(nullptr);
+  InstallSignalHandlers();
+  pid_t pid = fork();
+  if (pid < 0) {
+    LogErrno(__LINE__, "Failed to fork", args[0]);
+    return 1;
+  }
+  if (pid == 0) {
+    RestoreSignalHandlers();
+    if (sigchld_pipe[0] >= 0) {
+      RestoreSigchldHandler(sigchld_pipe);
+    }
+    if (pipe_fds[1] >= 0) {
+      dup2(pipe_fds[1], STDOUT_FILENO);
+      dup2(pipe_fds[1], STDERR_FILENO);
+      close(pipe_fds[1]);
+    }
+    execvp(argv[0], argv.data());
+    int err = errno;
+    fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+    _exit(err == ENOENT ? 127 : 126);
+  }
+  test_pid = pid;
+  // We might have been signaled before the handler knew about the test.
+  if (received_signal != 0) {
+    kill(pid, received_signal);
+  }
+
+  int status;
+  bool exited = false;
+  if (log_fd >= 0) {
+    close(pipe_fds[1]);
+    // Copy the output only until the test exits: a background process that
+    // the test left behind may hold the pipe open for much longer. Once the
+    // test is gone, copy what is buffered in the pipe without blocking.
+    char buf[16384];
+    while (true) {
+      if (!exited) {
+        pid_t r = waitpid(pid, &status, WNOHANG);
+        if (r < 0 && errno != EINTR) {
+          LogErrno(__LINE__, "Failed to wait for test", args[0]);
+          return 1;
+        }
+        if (r == pid) {
+          exited = true;
+          fcntl(pipe_fds[0], F_SETFL,
+                fcntl(pipe_fds[0], F_GETFL) | O_NONBLOCK);
+        } else {
+          struct pollfd fds[2] = {{pipe_fds[0], POLLIN, 0},
+                                  {sigchld_pipe[0], POLLIN, 0}};
+          if (poll(fds, 2, -1) < 0) {
+            continue;
+          }
+          if (fds[1].revents & POLLIN) {
+            while (read(sigchld_pipe[0], buf, sizeof(buf)) > 0) {
+            }
+          }
+          if (fds[0].revents == 0) {
+            continue;
+          }
+        }
+      }
+      ssize_t n = read(pipe_fds[0], buf, sizeof(buf));
+      if (n == 0) {
+        break;
+      }
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          LogErrno(__LINE__, "Failed to read test output", outerr);
+        }
+        break;
+      }
+      (void)WriteAll(STDOUT_FILENO, buf, n);
+      (void)WriteAll(log_fd, buf, n);
+    }
+    close(pipe_fds[0]);
+    close(log_fd);
+    RestoreSigchldHandler(sigchld_pipe);
+  }
+
+  while (!exited && waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      LogErrno(__LINE__, "Failed to wait for test", args[0]);
+      return 1;
+    }
+  }
+  test_pid = 0;
+  *duration = time(nullptr) - start;
+
+  if (WIFSIGNALED(status)) {
+    return 128 + WTERMSIG(status);
+  }
+  return WEXITSTATUS(status);
+}
+
+// Replace invalid XML characters and locate invalid CDATA sequences.
+//
+// The legal Unicode code points and ranges are U+0009, U+000A, U+000D,
+// U+0020..U+D7FF, U+E000..U+FFFD, and U+10000..U+10FFFF.
+//
+// See CdataEscape in tools/test/windows/tw.cc for the octet sequences that
+// this translates to. Every octet-sequence matching one of these will be left
+// alone, all other octet-sequences will be replaced by '?' characters.
+bool CdataEscape(std::istream* in, std::ostream* out, size_t buffer_size) {
+  // Keep up to three octets of lookahead from the previous chunk.
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[buffer_size + 3]);
+  size_t len = 0;
+  bool eof = false;
+  while (!eof || len > 0) {
+    if (!eof) {
+      in->read(reinterpret_cast<char*>(buf.get() + len), buffer_size);
+      len += in->gcount();
+      if (in->bad()) {
+        return false;
+      }
+      eof = in->eof();
+    }
+
+    size_t i = 0;
+    // Unless this is the last chunk, leave enough octets for a lookahead.
+    const size_t end = eof ? len : (len > 3 ? len - 3 : 0);
+    for (; i < end; ++i) {
+      const uint8_t* p = buf.get() + i + 1;
+      const size_t avail = len - i - 1;
+      const uint8_t c0 = buf[i];
+      if (c0 == ']' && avail >= 2 && p[0] == ']' && p[1] == '>') {
+        *out << "]]>]]<![CDATA[>";
+        i += 2;
+      } else if (c0 == 0x9 || c0 == 0xA || c0 == 0xD ||
+                 (c0 >= 0x20 && c0 <= 0x7F)) {
+        // Matched legal single-octet sequence.
+        *out << static_cast<char>(c0);
+      } else if (c0 >= 0xC0 && c0 <= 0xDF && avail >= 1 && p[0] >= 0x80 &&
+                 p[0] <= 0xBF) {
+        // Matched legal double-octet sequence. Skip the next octet.
+        out->write(reinterpret_cast<const char*>(buf.get() + i), 2);
+        i += 1;
+      } else if (avail >= 2 &&
+                 ((c0 >= 0xE0 && c0 <= 0xEC && p[0] >= 0x80 && p[0] <= 0xBF &&
+                   p[1] >= 0x80 && p[1] <= 0xBF) ||
+                  (c0 == 0xED && p[0] >= 0x80 && p[0] <= 0x9F &&
+                   p[1] >= 0x80 && p[1] <= 0xBF) ||
+                  (c0 == 0xEE && p[0] >= 0x80 && p[0] <= 0xBF &&
+                   p[1] >= 0x80 && p[1] <= 0xBF) ||
+                  (c0 == 0xEF && p[0] >= 0x80 && p[0] <= 0xBE &&
+                   p[1] >= 0x80 && p[1] <= 0xBF) ||
+                  (c0 == 0xEF && p[0] == 0xBF && p[1] >= 0x80 &&
+                   p[1] <= 0xBD))) {
+        // Matched legal triple-octet sequence. Skip the next two octets.
+        out->write(reinterpret_cast<const char*>(buf.get() + i), 3);
+        i += 2;
+      } else if (avail >= 3 && c0 >= 0xF0 && c0 <= 0xF7 && p[0] >= 0x80 &&
+                 p[0] <= 0xBF && p[1] >= 0x80 && p[1] <= 0xBF &&
+                 p[2] >= 0x80 && p[2] <= 0xBF) {
+        // Matched legal quadruple-octet sequence. Skip the next three octets.
+        out->write(reinterpret_cast<const char*>(buf.get() + i), 4);
+        i += 3;
+      } else {
+        // Illegal octet; replace.
+        *out << '?';
+      }
+      if (!out->good()) {
+        return false;
+      }
+    }
+    // A multi-octet sequence may have consumed octets past `end`.
+    if (i >= len) {
+      len = 0;
+    } else {
+      memmove(buf.get(), buf.get() + i, len - i);
+      len -= i;
+    }
+  }
+  return true;
+}
+
+std::string GetTestName() {
+  std::string result = GetEnv("TEST_BINARY");
+  if (result.compare(0, 2, "./") == 0) {
+    result.erase(0, 2);
+  }
+
+  // Ensure that test shards have unique names in the xml output, by including
+  // the shard index in the test name.
+  const std::string total_shards = GetEnv("TEST_TOTAL_SHARDS");
+  if (!total_shards.empty() && atoi(total_shards.c_str()) != 0) {
+    std::stringstream stm;
+    stm << result << "_shard_" << (atoi(GetEnv("TEST_SHARD_INDEX").c_str()) + 1)
+        << "/" << total_shards;
+    result = stm.str();
+  }
+  return result;
+}
+
+std::string CreateErrorTag(int exit_code, int signum) {
+  std::stringstream ss;
+  if (signum == SIGTERM) {
+    ss << "<error message=\"Timed out\"></error>";
+  } else if (signum != 0) {
+    ss << "<error message=\"Terminated by signal " << SignalName(signum)
+       << "\"></error>";
+  } else if (exit_code != 0) {
+    ss << "<error message=\"exited with error code " << exit_code
+       << "\"></error>";
+  }
+  return ss.str();
+}
+
+// Writes a default XML file for the test, embedding its output from
+// `test_outerr`.
+bool CreateXmlLog(const std::string& output, const std::string& test_outerr,
+                  const time_t duration, const int exit_code,
+                  const int signum) {
+  const std::string test_name = GetTestName();
+  const int errors = (exit_code != 0 || signum != 0) ? 1 : 0;
+
+  std::ofstream ostm(output.c_str(), std::ios_base::out |
+                                         std::ios_base::binary |
+                                         std::ios_base::trunc);
+  if (!ostm.is_open() || !ostm.good()) {
+    LogErrno(__LINE__, "Failed to open file for writing", output);
+    return false;
+  }
+
+  // Create XML file stub.
+  ostm << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+          "<testsuites>\n"
+          "  <testsuite name=\""
+       << test_name << "\" tests=\"1\" failures=\"0\" errors=\"" << errors
+       << "\">\n"
+          "    <testcase name=\""
+       << test_name << "\" status=\"run\" duration=\"" << duration
+       << "\" time=\"" << duration << "\">" << CreateErrorTag(exit_code, signum)
+       << "</testcase>\n"
+          "      <system-out>\n"
+          "Generated test.log (if the file is not UTF-8, then this may be "
+          "unreadable):\n"
+          "<![CDATA[";
+
+  // Encode test log to make it embeddable in CDATA.
+  std::ifstream istm(test_outerr.c_str(),
+                     std::ios_base::in | std::ios_base::binary);
+  if (istm.is_open() && !CdataEscape(&istm, &ostm, 16384)) {
+    LogError(__LINE__, "Failed to encode test log %s into %s",
+             test_outerr.c_str(), output.c_str());
+    return false;
+  }
+
+  // Append CDATA end and closing tags.
+  ostm << "]]>\n"
+          "      </system-out>\n"
+          "    </testsuite>\n"
+          "</testsuites>\n";
+  if (!ostm.good()) {
+    LogError(__LINE__, "Failed to write %s", output.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool ArchiveUndeclaredOutputs(const UndeclaredOutputs& undecl) {
+  if (undecl.root.empty()) {
+    // TEST_UNDECLARED_OUTPUTS_DIR was undefined, there's nothing to archive.
+    return true;
+  }
+
+  std::vector<FileInfo> files;
+  if (!GetFileListRelativeTo(undecl.root, &files)) {
+    return false;
+  }
+  if (files.empty()) {
+    return true;
+  }
+  if (!undecl.manifest.empty() &&
+      !CreateUndeclaredOutputsManifest(files, undecl.manifest)) {
+    return false;
+  }
+  if (!undecl.zip.empty() && !CreateZip(undecl.root, files, undecl.zip)) {
+    // Like test-setup.sh, don't fail the test because of this.
+    fprintf(stderr, "Could not create \"%s\"\n", undecl.zip.c_str());
+  }
+  return true;
+}
+
+// Creates the Undeclared Outputs Annotations file.
+//
+// This file is a concatenation of every *.part file directly under
+// `undecl_annot_dir`. The file is written to `output`.
+bool CreateUndeclaredOutputsAnnotations(const std::string& undecl_annot_dir,
+                                        const std::string& output) {
+  struct stat st;
+  if (undecl_annot_dir.empty() || output.empty() ||
+      stat(undecl_annot_dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+    // The directory's environment variable
+    // (TEST_UNDECLARED_OUTPUTS_ANNOTATIONS_DIR) was probably undefined, nothing
+    // to do.
+    return true;
+  }
+
+  std::vector<FileInfo> files;
+  if (!GetFileListRelativeTo(undecl_annot_dir, &files, 0)) {
+    return false;
+  }
+  std::vector<std::string> parts;
+  for (const auto& e : files) {
+    // Only consume "*.part" files.
+    if (!e.IsDirectory() && EndsWith(e.RelativePath(), ".part")) {
+      parts.push_back(undecl_annot_dir + "/" + e.RelativePath());
+    }
+  }
+  // There are no *.part files under `undecl_annot_dir`, nothing to do.
+  if (parts.empty()) {
+    return true;
+  }
+
+  int fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0666);
+  if (fd < 0) {
+    LogErrno(__LINE__, "Failed to open file for writing", output);
+    return false;
+  }
+  bool ok = true;
+  for (const auto& part : parts) {
+    ok = ok && AppendFileTo(part, fd);
+  }
+  close(fd);
+  return ok;
+}
+
+bool ToTime(const char* str, time_t* result) {
+  char* end;
+  errno = 0;
+  long value = strtol(str, &end, 10);
+  if (errno != 0 || *str == 0 || *end != 0) {
+    return false;
+  }
+  *result = value;
+  return true;
+}
+
+}  // namespace
+
+int TestWrapperMain(int argc, char** argv) {
+  // Shift stderr to stdout.
+  dup2(STDOUT_FILENO, STDERR_FILENO);
+  argc--;
+  argv++;
+
+  bool no_echo = false;
+  if (argc > 0 && strcmp(argv[0], "--no_echo") == 0) {
+    // Don't print anything to stdout in this special case.
+    // Currently needed for persistent test runner.
+    no_echo = true;
+    argc--;
+    argv++;
+  }
+  if (!no_echo) {
+    WriteStdout("exec ${PAGER:-/usr/bin/less} \"$0\" || exit 1\n"
+                "Executing tests from " + GetEnv("TEST_TARGET") + "\n");
+  }
+
+  const bool coverage = !GetEnv("COVERAGE_DIR").empty();
+  if (argc < (coverage ? 2 : 1)) {
+    LogError(__LINE__, coverage
+                           ? "Usage: $0 <coverage_script> <test_path> [args...]"
+                           : "Usage: $0 <test_path> [test_args...]");
+    return 1;
+  }
+
+  // The original execution root. The test usually runs in the runfiles
+  // directory, so the current directory is not a reliable way to find it.
+  std::string exec_root, xml_log;
+  UndeclaredOutputs undecl;
+  if (!GetCwd(&exec_root) || !ExportEnvvars(exec_root, &xml_log, &undecl) ||
+      !ChdirToRunfiles()) {
+    return 1;
+  }
+
+  // This header marks where --test_output=streamed will start being printed.
+  if (!no_echo) {
+    WriteStdout(
+        "-------------------------------------------------------------------"
+        "----------\n");
+  }
+
+  // The path of this command-line is usually relative to the exec-root, but
+  // when using --run_under it can be a "/bin/bash -c" command-line.
+  std::vector<std::string> args;
+  std::string exe = coverage ? argv[1] : argv[0];
+  if (exe.compare(0, 2, "./") == 0) {
+    exe.erase(0, 2);
+  }
+  if (coverage) {
+    args.push_back(argv[0]);
+  }
+  std::string test_path =
+      IsAbsolute(exe) ? exe
+                      : Rlocation(GetEnv("TEST_WORKSPACE") + "/" + exe);
+  if (!GetEnv("TEST_SHORT_EXEC_PATH").empty() &&
+      !ShortenTestPath(exec_root, &test_path)) {
+    return 1;
+  }
+  args.push_back(test_path);
+  for (int i = coverage ? 2 : 1; i < argc; ++i) {
+    args.push_back(argv[i]);
+  }
+
+  const bool split_xml_generation =
+      GetEnv("EXPERIMENTAL_SPLIT_XML_GENERATION") == "1";
+  const std::string test_outerr =
+      (split_xml_generation || xml_log.empty()) ? std::string()
+                                                : xml_log + ".log";
+  time_t duration;
+  int result = RunSubprocess(args, test_outerr, &duration);
+
+  if (split_xml_generation) {
+    // Bazel generates the test xml as a separate action.
+    if (received_signal == SIGTERM) {
+      char date[64];
+      time_t now = time(nullptr);
+      strftime(date, sizeof(date), "%F %T %Z", localtime(&now));
+      WriteStdout(std::string("-- Test timed out at ") + date + " --\n");
+    }
+  } else {
+    // If the XML file already exists, maybe the test framework wrote it.
+    // Leave the file alone.
+    bool ok = xml_log.empty() || access(xml_log.c_str(), F_OK) == 0 ||
+              CreateXmlLog(xml_log, test_outerr, duration, result,
+                           received_signal);
+    if (!test_outerr.empty()) {
+      unlink(test_outerr.c_str());
+    }
+    if (!ok) {
+      return 1;
+    }
+  }
+
+  if (!ArchiveUndeclaredOutputs(undecl) ||
+      !CreateUndeclaredOutputsAnnotations(undecl.annotations_dir,
+                                          undecl.annotations)) {
+    return 1;
+  }
+  return result;
+}
+
+int XmlWriterMain(int argc, char** argv) {
+  time_t duration;
+  int exit_code;
+  if (argc < 5) {
+    LogError(__LINE__,
+             "Usage: $0 <test_output_path> <xml_log_path>"
+             " <duration_in_seconds> <exit_code>");
+    return 1;
+  }
+  if (!ToTime(argv[3], &duration)) {
+    LogError(__LINE__, "Failed to parse test duration argument: %s", argv[3]);
+    return 1;
+  }
+  time_t exit_code_value;
+  if (!ToTime(argv[4], &exit_code_value)) {
+    LogError(__LINE__, "Failed to parse exit code argument: %s", argv[4]);
+    return 1;
+  }
+  exit_code = static_cast<int>(exit_code_value);
+  return CreateXmlLog(argv[2], argv[1], duration, exit_code, 0) ? 0 : 1;
+}
+
+namespace testing {
+
+bool TestOnly_GetFileListRelativeTo(const std::string& abs_root,
+                                    std::vector<FileInfo>* result,
+                                    int depth_limit) {
+  return GetFileListRelativeTo(abs_root, result, depth_limit);
+}
+
+bool TestOnly_CreateZip(const std::string& abs_root,
+                        const std::vector<FileInfo>& files,
+                        const std::string& abs_zip) {
+  return CreateZip(abs_root, files, abs_zip);
+}
+
+std::string TestOnly_GetMimeType(const std::string& filename) {
+  return GetMimeType(filename);
+}
+
+bool TestOnly_CreateUndeclaredOutputsManifest(
+    const std::vector<FileInfo>& files, std::string* result) {
+  return CreateUndeclaredOutputsManifestContent(files, result);
+}
+
+bool TestOnly_CreateUndeclaredOutputsAnnotations(
+    const std::string& abs_root, const std::string& abs_output) {
+  return CreateUndeclaredOutputsAnnotations(abs_root, abs_output);
+}
+
+bool TestOnly_CdataEncode(std::istream* in_stm, std::ostream* out_stm,
+                          size_t buffer_size) {
+  return CdataEscape(in_stm, out_stm, buffer_size);
+}
+
+int TestOnly_RunSubprocess(const std::vector<std::string>& args,
+                           const std::string& outerr, time_t* duration) {
+  return RunSubprocess(args, outerr, duration);
+}
+
+}  // namespace testing
+
+}  // namespace test_wrapper
+}  // namespace tools
+}  // namespace bazel
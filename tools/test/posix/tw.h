@@ -0,0 +1,102 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_TOOLS_TEST_POSIX_TW_H_
+#define BAZEL_TOOLS_TEST_POSIX_TW_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace bazel {
+namespace tools {
+namespace test_wrapper {
+
+class FileInfo {
+ public:
+  // C'tor for a directory.
+  explicit FileInfo(const std::string& rel_path)
+      : rel_path_(rel_path), size_(0), mode_(0), is_dir_(true) {}
+
+  // C'tor for a file.
+  FileInfo(const std::string& rel_path, uint64_t size, unsigned int mode)
+      : rel_path_(rel_path), size_(size), mode_(mode), is_dir_(false) {}
+
+  inline const std::string& RelativePath() const { return rel_path_; }
+
+  inline uint64_t Size() const { return size_; }
+
+  inline unsigned int Mode() const { return mode_; }
+
+  inline bool IsDirectory() const { return is_dir_; }
+
+ private:
+  // The file's path, relative to the traversal root.
+  std::string rel_path_;
+
+  // The file's size, in bytes.
+  uint64_t size_;
+
+  // The file's permission bits, stored in the zip entry.
+  unsigned int mode_;
+
+  // Whether this is a directory (true) or a regular file (false).
+  bool is_dir_;
+};
+
+// The main function of the test wrapper, a drop-in replacement for
+// tools/test/test-setup.sh.
+int TestWrapperMain(int argc, char** argv);
+
+// The main function of the test XML writer, a drop-in replacement for
+// tools/test/generate-xml.sh.
+int XmlWriterMain(int argc, char** argv);
+
+namespace testing {
+
+// The following functions are only meant to be used by tests.
+
+bool TestOnly_GetFileListRelativeTo(const std::string& abs_root,
+                                    std::vector<FileInfo>* result,
+                                    int depth_limit = -1);
+
+bool TestOnly_CreateZip(const std::string& abs_root,
+                        const std::vector<FileInfo>& files,
+                        const std::string& abs_zip);
+
+std::string TestOnly_GetMimeType(const std::string& filename);
+
+bool TestOnly_CreateUndeclaredOutputsManifest(
+    const std::vector<FileInfo>& files, std::string* result);
+
+bool TestOnly_CreateUndeclaredOutputsAnnotations(
+    const std::string& abs_root, const std::string& abs_output);
+
+bool TestOnly_CdataEncode(std::istream* in_stm, std::ostream* out_stm,
+                          size_t buffer_size);
+
+int TestOnly_RunSubprocess(const std::vector<std::string>& args,
+                           const std::string& outerr, time_t* duration);
+
+}  // namespace testing
+
+}  // namespace test_wrapper
+}  // namespace tools
+}  // namespace bazel
+
+#endif  // BAZEL_TOOLS_TEST_POSIX_TW_H_
@@ -0,0 +1,266 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Tests for the POSIX implementation of the test wrapper.
+
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tools/test/posix/tw.h"
+
+namespace {
+
+using bazel::tools::test_wrapper::FileInfo;
+using bazel::tools::test_wrapper::testing::TestOnly_CdataEncode;
+using bazel::tools::test_wrapper::testing::
+    TestOnly_CreateUndeclaredOutputsAnnotations;
+using bazel::tools::test_wrapper::testing::
+    TestOnly_CreateUndeclaredOutputsManifest;
+using bazel::tools::test_wrapper::testing::TestOnly_CreateZip;
+using bazel::tools::test_wrapper::testing::TestOnly_GetFileListRelativeTo;
+using bazel::tools::test_wrapper::testing::TestOnly_GetMimeType;
+using bazel::tools::test_wrapper::testing::TestOnly_RunSubprocess;
+
+class TestWrapperPosixTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    const char* tmpdir = getenv("TEST_TMPDIR");
+    std::string tmpl =
+        std::string(tmpdir != nullptr ? tmpdir : "/tmp") + "/tw_test.XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(&tmpl[0]));
+    root_ = tmpl;
+  }
+
+  void TearDown() override {
+    ASSERT_EQ(0, system(("rm -rf '" + root_ + "'").c_str()));
+  }
+
+ protected:
+  void CreateFile(const std::string& rel_path, const std::string& content) {
+    std::ofstream stm(root_ + "/" + rel_path);
+    stm << content;
+  }
+
+  void CreateDir(const std::string& rel_path) {
+    ASSERT_EQ(0, mkdir((root_ + "/" + rel_path).c_str(), 0755));
+  }
+
+  std::string root_;
+};
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream stm(path);
+  std::stringstream result;
+  result << stm.rdbuf();
+  return result.str();
+}
+
+TEST_F(TestWrapperPosixTest, TestGetFileListRelativeTo) {
+  CreateDir("foo");
+  CreateDir("foo/sub");
+  CreateFile("foo/sub/file1", "hello");
+  CreateFile("foo/file2", "foo");
+  CreateFile("file3", "");
+  ASSERT_EQ(0, symlink("foo/file2", (root_ + "/link").c_str()));
+  ASSERT_EQ(0, symlink("does-not-exist", (root_ + "/dangling").c_str()));
+
+  std::vector<FileInfo> files;
+  ASSERT_TRUE(TestOnly_GetFileListRelativeTo(root_, &files));
+  ASSERT_EQ(6, files.size());
+  EXPECT_EQ("file3", files[0].RelativePath());
+  EXPECT_EQ(0, files[0].Size());
+  EXPECT_EQ("foo", files[1].RelativePath());
+  EXPECT_TRUE(files[1].IsDirectory());
+  EXPECT_EQ("foo/file2", files[2].RelativePath());
+  EXPECT_EQ(3, files[2].Size());
+  EXPECT_EQ("foo/sub", files[3].RelativePath());
+  EXPECT_TRUE(files[3].IsDirectory());
+  EXPECT_EQ("foo/sub/file1", files[4].RelativePath());
+  EXPECT_EQ(5, files[4].Size());
+  // Symlinks are followed.
+  EXPECT_EQ("link", files[5].RelativePath());
+  EXPECT_FALSE(files[5].IsDirectory());
+  EXPECT_EQ(3, files[5].Size());
+
+  files.clear();
+  ASSERT_TRUE(TestOnly_GetFileListRelativeTo(root_, &files, 0));
+  ASSERT_EQ(3, files.size());
+  EXPECT_EQ("file3", files[0].RelativePath());
+  EXPECT_EQ("foo", files[1].RelativePath());
+  EXPECT_EQ("link", files[2].RelativePath());
+}
+
+TEST_F(TestWrapperPosixTest, TestGetFileListRelativeToSymlinkLoop) {
+  CreateDir("foo");
+  CreateFile("foo/file1", "hello");
+  ASSERT_EQ(0, symlink("..", (root_ + "/foo/up").c_str()));
+  ASSERT_EQ(0, symlink("foo", (root_ + "/bar").c_str()));
+
+  // Links to a directory being listed are skipped, other links to a
+  // directory are followed.
+  std::vector<FileInfo> files;
+  ASSERT_TRUE(TestOnly_GetFileListRelativeTo(root_, &files));
+  ASSERT_EQ(4, files.size());
+  EXPECT_EQ("bar", files[0].RelativePath());
+  EXPECT_TRUE(files[0].IsDirectory());
+  EXPECT_EQ("bar/file1", files[1].RelativePath());
+  EXPECT_EQ("foo", files[2].RelativePath());
+  EXPECT_EQ("foo/file1", files[3].RelativePath());
+}
+
+TEST_F(TestWrapperPosixTest, TestCreateZip) {
+  CreateDir("foo");
+  CreateFile("foo/file1", "hello");
+  CreateFile("file2", "world");
+
+  std::vector<FileInfo> files;
+  ASSERT_TRUE(TestOnly_GetFileListRelativeTo(root_, &files));
+  const std::string zip = root_ + ".zip";
+  ASSERT_TRUE(TestOnly_CreateZip(root_, files, zip));
+
+  const std::string content = ReadFile(zip);
+  unlink(zip.c_str());
+  ASSERT_GT(content.size(), 4);
+  EXPECT_EQ("PK\x03\x04", content.substr(0, 4));
+  EXPECT_NE(std::string::npos, content.find("foo/"));
+  EXPECT_NE(std::string::npos, content.find("foo/file1"));
+  EXPECT_NE(std::string::npos, content.find("file2"));
+}
+
+TEST_F(TestWrapperPosixTest, TestGetMimeType) {
+  EXPECT_EQ("text/plain", TestOnly_GetMimeType("foo.txt"));
+  EXPECT_EQ("text/plain", TestOnly_GetMimeType("foo/bar.TXT"));
+  EXPECT_EQ("image/png", TestOnly_GetMimeType("foo.png"));
+  EXPECT_EQ("application/xml", TestOnly_GetMimeType("foo.xml"));
+  EXPECT_EQ("application/octet-stream", TestOnly_GetMimeType("foo"));
+  EXPECT_EQ("application/octet-stream", TestOnly_GetMimeType("foo.bar/baz"));
+  EXPECT_EQ("application/octet-stream", TestOnly_GetMimeType("foo.unknown"));
+}
+
+TEST_F(TestWrapperPosixTest, TestUndeclaredOutputsManifest) {
+  std::vector<FileInfo> files = {FileInfo("foo"),
+                                 FileInfo("foo/bar.txt", 9, 0644),
+                                 FileInfo("baz", 2944, 0755),
+                                 FileInfo("huge", 5000000000ULL, 0644)};
+  std::string content;
+  ASSERT_TRUE(TestOnly_CreateUndeclaredOutputsManifest(files, &content));
+  EXPECT_EQ(
+      "foo/bar.txt\t9\ttext/plain\n"
+      "baz\t2944\tapplication/octet-stream\n"
+      "huge\t5000000000\tapplication/octet-stream\n",
+      content);
+}
+
+TEST_F(TestWrapperPosixTest, TestCreateUndeclaredOutputsAnnotations) {
+  CreateDir("annot");
+  CreateDir("annot/sub.part");
+  CreateFile("annot/sub.part/c.part", "c");
+  CreateFile("annot/a.part", "a\n");
+  CreateFile("annot/b.part", "b\n");
+  CreateFile("annot/d.txt", "d\n");
+
+  const std::string output = root_ + "/annotations";
+  ASSERT_TRUE(
+      TestOnly_CreateUndeclaredOutputsAnnotations(root_ + "/annot", output));
+  EXPECT_EQ("a\nb\n", ReadFile(output));
+
+  // No *.part files means no annotations file.
+  CreateDir("empty");
+  const std::string no_output = root_ + "/no-annotations";
+  ASSERT_TRUE(
+      TestOnly_CreateUndeclaredOutputsAnnotations(root_ + "/empty", no_output));
+  EXPECT_NE(0, access(no_output.c_str(), F_OK));
+}
+
+TEST_F(TestWrapperPosixTest, TestRunSubprocessExitCode) {
+  const std::string outerr = root_ + "/outerr";
+  time_t duration;
+  EXPECT_EQ(3, TestOnly_RunSubprocess({"/bin/sh", "-c", "echo hello; exit 3"},
+                                      outerr, &duration));
+  EXPECT_EQ("hello\n", ReadFile(outerr));
+}
+
+TEST_F(TestWrapperPosixTest, TestRunSubprocessSignal) {
+  const std::string outerr = root_ + "/outerr";
+  time_t duration;
+  EXPECT_EQ(128 + SIGKILL,
+            TestOnly_RunSubprocess({"/bin/sh", "-c", "echo bye; kill -9 $$"},
+                                   outerr, &duration));
+  EXPECT_EQ("bye\n", ReadFile(outerr));
+}
+
+TEST_F(TestWrapperPosixTest, TestRunSubprocessBackgroundProcess) {
+  // The test is done when it exits, even if a process that it started in the
+  // background still holds its output open.
+  const std::string outerr = root_ + "/outerr";
+  time_t duration;
+  const time_t start = time(nullptr);
+  EXPECT_EQ(0, TestOnly_RunSubprocess(
+                   {"/bin/sh", "-c", "echo started; sleep 30 & exit 0"},
+                   outerr, &duration));
+  EXPECT_LT(time(nullptr) - start, 20);
+  EXPECT_LT(duration, 20);
+  EXPECT_EQ("started\n", ReadFile(outerr));
+}
+
+void AssertCdataEncode(const std::string& input, const std::string& expected) {
+  // Encode with a tiny buffer as well, to exercise sequences that span
+  // several reads.
+  for (size_t buffer_size : {1, 2, 3, 4, 5, 16384}) {
+    std::istringstream in(input);
+    std::stringstream out;
+    ASSERT_TRUE(TestOnly_CdataEncode(&in, &out, buffer_size));
+    ASSERT_EQ(expected, out.str()) << "buffer_size=" << buffer_size;
+  }
+}
+
+TEST_F(TestWrapperPosixTest, TestCdataEscapeNullTerminator) {
+  AssertCdataEncode(std::string("x\0y", 3), "x?y");
+}
+
+TEST_F(TestWrapperPosixTest, TestCdataEscapeCdataEndings) {
+  AssertCdataEncode("]]>", "]]>]]<![CDATA[>");
+  AssertCdataEncode("x]]>y]]>", "x]]>]]<![CDATA[>y]]>]]<![CDATA[>");
+  AssertCdataEncode("]]]>", "]]]>]]<![CDATA[>");
+  AssertCdataEncode("]]", "]]");
+}
+
+TEST_F(TestWrapperPosixTest, TestCdataEscapeSingleOctets) {
+  AssertCdataEncode("AbC\t\r\n\x1f", "AbC\t\r\n?");
+  AssertCdataEncode("\x80\xbf", "??");
+}
+
+TEST_F(TestWrapperPosixTest, TestCdataEscapeMultiOctets) {
+  // Legal two, three and four-octet sequences.
+  AssertCdataEncode("\xc2\xa9", "\xc2\xa9");
+  AssertCdataEncode("\xe2\x82\xac", "\xe2\x82\xac");
+  AssertCdataEncode("\xf0\x9f\x98\x80", "\xf0\x9f\x98\x80");
+  // Surrogates and U+FFFE are illegal.
+  AssertCdataEncode("\xed\xa0\x80", "???");
+  AssertCdataEncode("\xef\xbf\xbe", "???");
+  // Truncated sequences.
+  AssertCdataEncode("\xe2\x82", "??");
+  AssertCdataEncode("a\xf0\x9f\x98", "a???");
+}
+
+}  // namespace
@@ -1,4 +1,4 @@
-// Copyright 2018 The Bazel Authors. All rights reserved.
+// Copyright 2019 The Bazel Authors. All rights reserved.
 //
 // Licensed under the Apache License, Version 2.0 (the "License");
 // you may not use this file except in compliance with the License.
@@ -12,4 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-int main(void) { return 0; }
+
+#include "tools/test/posix/tw.h"
+
+int main(int argc, char** argv) {
+  return bazel::tools::test_wrapper::XmlWriterMain(argc, argv);
+}
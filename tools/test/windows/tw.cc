@@ -666,11 +666,10 @@ bool _GetFileListRelativeTo(const std::wstring& unc_root,
         result->push_back(FileInfo(rel_path));
       } else {
         if (info.nFileSizeHigh > 0 || info.nFileSizeLow > INT_MAX) {
-          // devtools_ijar::Stat::total_size is declared as `int`, so the file
-          // size limit is INT_MAX. Additionally we limit the files to be below
-          // 4 GiB, not only because int is typically 4 bytes long, but also
-          // because such huge files are unreasonably large as an undeclared
-          // output.
+          // FileInfo::size_ is declared as `int`, so the file size limit is
+          // INT_MAX. Additionally we limit the files to be below 4 GiB, not
+          // only because int is typically 4 bytes long, but also because such
+          // huge files are unreasonably large as an undeclared output.
           LogErrorWithArgAndValue(__LINE__, "File is too large to archive",
                                   rel_path, 0);
           return false;
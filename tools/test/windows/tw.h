@@ -56,10 +56,8 @@ class FileInfo {
 
   // The file's size, in bytes.
   //
-  // Unfortunately this field has to be `int`, so it can only describe files up
-  // to 2 GiB in size. The reason is, devtools_ijar::Stat::total_size is
-  // declared as `int`, which is what we ultimately store the file size in,
-  // therefore this field is also `int`.
+  // This field is `int`, so it can only describe files up to 2 GiB in size,
+  // which GetFileListRelativeTo enforces for undeclared outputs.
   int size_;
 
   // Whether this is a directory (true) or a regular file (false).